@@ -43,6 +43,9 @@ int a_sync_device
  * (SVN subdirectory), and check device config in to this group (SVN subdirectory).
  * if initial checkout of head fails without svn error, we assume that the device config is not 
  * under version control yet, and we are trying to add config of this device to svn.
+ * with WorkingCopyCache set, working copy is kept for the next run and only updated then.
+ * downloaded config stays in memory (config buffer) - only the client backend writes it
+ * to the working copy.
  */
 {
 
@@ -51,17 +54,30 @@ int a_sync_device
    int checkout_status;
    char downloaded_config[MAXPATH];
    char working_copy_config[MAXPATH];
+   config_buffer_t config;
    char svn_tmp_dirname[MAXPATH];
+   char old_label[MAXPATH], new_label[MAXPATH];
    char *full_svn_path = NULL;
    char *group_path = NULL;
    struct addrinfo hints;
    struct addrinfo *res = NULL;
-   int apr_pool_initialized = 0;
    int svn_pool_initialized = 0;
+   int wc_touched = 0;
+   int synced = 0;
+   int sync_status;
+   int digest_known = 0;
+   char config_digest[CONFIG_DIGEST_LEN + 1];
+   config_diff_t config_diff;
+   int changed;
+   pthread_mutex_t *wc_mutex = NULL;
+   svn_worker_t *worker;
    apr_pool_t *thread_global_svn_pool;
    apr_pool_t *thread_global_apr_pool;
+   char *repository;
 
 
+   a_config_buffer_init(&config);
+
    /* check if given hostname is resolving (thread-safe version): */
 
    memset((char *) &hints, 0, sizeof(hints));
@@ -83,15 +99,20 @@ int a_sync_device
 
    /* construct filenames and paths needed for SVN checkout/commit: */
 
-   snprintf(svn_tmp_dirname,MAXPATH,"%s.%d.%s",G_svn_tmp_prefix,G_config_info.instance_id,hostname);
+   if(G_config_info.wc_cache == WC_CACHE_GROUP)
+    snprintf(svn_tmp_dirname,MAXPATH,"%s.%d.group.%s",G_svn_wc_prefix,G_config_info.instance_id,device_group);
+   else if(G_config_info.wc_cache == WC_CACHE_DEVICE)
+    snprintf(svn_tmp_dirname,MAXPATH,"%s.%d.device.%s",G_svn_wc_prefix,G_config_info.instance_id,hostname);
+   else
+    snprintf(svn_tmp_dirname,MAXPATH,"%s.%d.%s",G_svn_tmp_prefix,G_config_info.instance_id,hostname);
    snprintf(downloaded_config,MAXPATH,"%s.new",hostname);
    snprintf(working_copy_config,MAXPATH,"%s/%s",svn_tmp_dirname,hostname);
 
    /* try to get current config from the device. 
-    * if this will succeed, <hostname>.new file should appear in the working directory
+    * if this will succeed, config buffer holds it
     */
 
-   if(a_get_from_device(hostname,platform,authset,arch_method)==-1) 
+   if(a_get_from_device(hostname,platform,authset,arch_method,&config)==-1) 
     {
      a_debug_info2(DEBUGLVL3,"a_sync_device: %s: configuration download failed! exiting!",hostname);
      a_logmsg("%s: FATAL: cannot get configuration from a device! not archived!",hostname); 
@@ -99,33 +120,123 @@ int a_sync_device
      goto skip;
     }
 
-   /* try to make a checkout of previous config version into svn_tmp_dirname: */
-   /* first, allocate sub - global (per thread) memory pools for SVN operation */
-   /* svn_pool_create will cause program exit on alloc fail, so there is no error checking here */
+   if(G_config_info.keep_downloaded_configs)     /* debug copy of what we got */
+    if(!a_config_buffer_save(&config, downloaded_config))
+     a_debug_info2(DEBUGLVL3,"a_sync_device: %s: cannot write %s!",hostname,downloaded_config);
 
-   thread_global_svn_pool = svn_pool_create(G_svn_root_pool);
-   svn_pool_initialized = 1;
+   /* same config as the one archived last time - nothing to do in the repository */
+
+   if(G_config_info.skip_unchanged)
+    if( (digest_known = a_config_digest_compute(&config, config_digest)) )
+     if(a_config_digest_unchanged(hostname, config_digest))
+      {
+       a_logmsg("%s: no changes to config.",hostname);
+       goto skip;
+      }
 
-   if(apr_pool_create(&thread_global_apr_pool, G_apr_root_pool) == APR_SUCCESS) 
-    apr_pool_initialized = 1;
+   /* device group missing in the repository manifest is created here, once - not by every */
+   /* job which finds out that checkout fails (old path below is a fallback now) */
+
+   if(a_repo_manifest_group(device_group) == -1)
+    a_logmsg("%s: WARNING: cannot add device group %s to the repository!",hostname,device_group);
+
+   /* onboarding run: device new to the repository goes in with all the others, in one revision */
+
+   if(G_onboarding && (a_repo_manifest_device_known(device_group,hostname) == 0))
+    {
+     if(a_svn_ra_onboard_add(device_group,hostname,config_by,digest_known ? config_digest : NULL,
+                             &config))
+      {
+       a_logmsg("%s: first time seen. queued for onboarding commit.",hostname);
+       goto skip;
+      }
+
+     a_logmsg("%s: WARNING: cannot queue device for onboarding commit - adding it on its own.",hostname);
+    }
    else
+    a_svn_ra_onboard_drop(hostname);   /* config being archived now is newer */
+
+   if(G_config_info.svn_backend != SVN_BACKEND_CLIENT)
+    {
+     /* no working copy - config goes to the repository straight from memory */
+
+     if(G_config_info.svn_backend == SVN_BACKEND_FS)
+      sync_status = a_svn_fs_sync(device_group,hostname,config_by,&config);
+     else
+      sync_status = a_svn_ra_sync(device_group,hostname,config_by,&config,
+                                  digest_known ? config_digest : NULL);
+
+     switch(sync_status)
+      {
+       case 3:
+        a_logmsg("%s: changes queued for group commit.",hostname);
+        break;          /* batch committer reports the result */
+       case 2:
+        a_logmsg("%s: first time seen. adding device to svn repository.",hostname);
+        a_repo_manifest_device(device_group,hostname);
+#ifdef USE_MYSQL
+        a_mysql_update_timestamp(hostname);
+#endif
+        synced = 1;
+        break;
+       case 1:
+        a_logmsg("%s: archiving changes.",hostname);
+#ifdef USE_MYSQL
+        a_mysql_update_timestamp(hostname);
+#endif
+        synced = 1;
+        break;
+       case 0:
+        a_logmsg("%s: no changes to config.",hostname);
+        synced = 1;
+        break;
+       default:
+        a_debug_info2(DEBUGLVL3,"a_sync_device: %s: commit failed",hostname);
+        a_logmsg("%s: SVN commit failed when commiting config changes.",hostname); 
+        fail = 1;
+      }
+
+     goto skip;
+    }
+
+   /* try to make a checkout of previous config version into svn_tmp_dirname: */
+   /* first, get memory pools of this worker for SVN operation (see a_svn_worker_get) - */
+   /* they are private to the thread, and cleared after every run instead of destroyed */
+
+   if( (worker = a_svn_worker_get()) == NULL )
     {
      a_debug_info2(DEBUGLVL3,"a_sync_device: %s: cannot allocate memory for SVN pool!",hostname);
      fail = 1;
      goto skip;
     }
 
+   thread_global_svn_pool = a_svn_worker_job_pool(worker);
+   thread_global_apr_pool = worker->iter_pool;
+   svn_pool_initialized = 1;
+
 
    a_debug_info2(DEBUGLVL3,"a_sync_device: %s: device in group: %s",hostname,device_group);
 
+   repository = a_repo_route(device_group);   /* RepositoryPath, or a RepositoryRoute of the group */
+
+   if(G_config_info.wc_cache == WC_CACHE_GROUP)
+    if( (wc_mutex = a_svn_wc_lock(svn_tmp_dirname)) == NULL )
+     {
+      a_debug_info2(DEBUGLVL3,"a_sync_device: %s: cannot lock working copy %s!",hostname,svn_tmp_dirname);
+      fail = 1;
+      goto skip;
+     }
+
+   wc_touched = 1;
+
    if(strstr(device_group,"none"))  
     {
-     checkout_status = a_svn_checkout(hostname,G_config_info.repository_path,svn_tmp_dirname,
+     checkout_status = a_svn_wc_update(hostname,repository,svn_tmp_dirname,
                                       thread_global_apr_pool, thread_global_svn_pool);
     }
    else
     {
-     if( (full_svn_path = malloc(strlen(G_config_info.repository_path) + strlen(device_group) + 4) ) == NULL )
+     if( (full_svn_path = malloc(strlen(repository) + strlen(device_group) + 4) ) == NULL )
       { 
        a_debug_info2(DEBUGLVL3,"a_sync_device: %s: malloc failed!"); 
        goto skip; 
@@ -137,10 +248,10 @@ int a_sync_device
        goto skip;
       }
 
-     snprintf(full_svn_path,MAXPATH,"%s/%s",G_config_info.repository_path,device_group);
+     snprintf(full_svn_path,MAXPATH,"%s/%s",repository,device_group);
      snprintf(group_path,MAXPATH,"%s/%s",svn_tmp_dirname,device_group);
 
-     checkout_status = a_svn_checkout(hostname,full_svn_path,svn_tmp_dirname,
+     checkout_status = a_svn_wc_update(hostname,full_svn_path,svn_tmp_dirname,
                                       thread_global_apr_pool, thread_global_svn_pool);
 
      if(checkout_status == -3)  /* specified group does not exist - let's create it */
@@ -150,7 +261,7 @@ int a_sync_device
                      hostname,device_group);
        a_logmsg("adding new device group: %s",device_group);
 
-       checkout_status = a_svn_sparse_checkout(G_config_info.repository_path,svn_tmp_dirname,
+       checkout_status = a_svn_sparse_checkout(repository,svn_tmp_dirname,
                                                thread_global_apr_pool, thread_global_svn_pool);
 
        if(checkout_status < 0) 
@@ -212,7 +323,12 @@ int a_sync_device
     {
      a_debug_info2(DEBUGLVL3,"a_sync_device: checkout failed but no svn err. trying to add to repository.");
 
-     rename(downloaded_config,working_copy_config);
+     if(!a_config_buffer_save(&config, working_copy_config))
+      {
+       a_logmsg("%s: FATAL: cannot write config to the working copy! not archived!",hostname);
+       fail = 1;
+       goto skip;
+      }
 
      if(a_svn_add(hostname, svn_tmp_dirname, thread_global_apr_pool, thread_global_svn_pool) != -1) 
        a_debug_info2(DEBUGLVL5,"a_sync_device: %s: add OK",hostname); 
@@ -229,9 +345,11 @@ int a_sync_device
       {
        a_debug_info2(DEBUGLVL5,"a_sync_device: %s: commit OK",hostname); 
        a_logmsg("%s: first time seen. adding device to svn repository.",hostname);
+       a_repo_manifest_device(device_group,hostname);
 #ifdef USE_MYSQL
        a_mysql_update_timestamp(hostname);
 #endif
+       synced = 1;
       }
      else 
       { 
@@ -245,19 +363,55 @@ int a_sync_device
    else if(checkout_status > -1) /* checkout ok - device config is already under version control */
     {
 
-     rename(downloaded_config,working_copy_config); /* prepare SVN diff  */
+     /* working copy holds the head revision now - compare it with the new config in memory */
+
+     if(strstr(device_group,"none"))
+      {
+       snprintf(old_label,MAXPATH,"%s\t(repository)",hostname);
+       snprintf(new_label,MAXPATH,"%s\t(device)",hostname);
+      }
+     else
+      {
+       snprintf(old_label,MAXPATH,"%s/%s\t(repository)",device_group,hostname);
+       snprintf(new_label,MAXPATH,"%s/%s\t(device)",device_group,hostname);
+      }
+
+     changed = a_config_diff_file(working_copy_config, &config, 
+                                  G_config_info.keep_changelog ? old_label : NULL, new_label, &config_diff);
 
-     if(a_svn_diff(device_group,hostname,config_by,G_config_info.repository_path,svn_tmp_dirname,
-                   thread_global_apr_pool, thread_global_svn_pool))
+     if(changed && !a_config_buffer_save(&config, working_copy_config))
+      {
+       a_logmsg("%s: FATAL: cannot write config to the working copy! not archived!",hostname);
+       a_config_diff_free(&config_diff);
+       fail = 1;
+       goto skip;
+      }
+
+     if(changed == -1)
+      a_debug_info2(DEBUGLVL3,"a_sync_device: %s: config diff failed - committing anyway.",hostname);
+     else if(changed)
+      {
+       a_debug_info2(DEBUGLVL5,"a_sync_device: %s: %d lines added, %d removed.",hostname,
+                     config_diff.added,config_diff.removed);
+
+       if(G_config_info.keep_changelog && (config_diff.text != NULL))
+        if(!a_add_changelog_buffer(config_diff.text, config_diff.text_len, hostname, config_by))
+         a_logmsg("a_sync_device: %s: cannot write changelog entry!",hostname);
+
+       a_config_diff_free(&config_diff);
+      }
+
+     if(changed)
       {
        if(a_svn_commit(hostname,svn_tmp_dirname,config_by,
-                       thread_global_apr_pool, thread_global_svn_pool)) 
+                       thread_global_apr_pool, thread_global_svn_pool) != -1) 
         {
          a_debug_info2(DEBUGLVL5,"a_sync_device: %s: commit OK",hostname);
          a_logmsg("%s: archiving changes.",hostname);
 #ifdef USE_MYSQL
          a_mysql_update_timestamp(hostname);
 #endif
+         synced = 1;
         }
        else 
         {
@@ -267,17 +421,37 @@ int a_sync_device
         }
       }
      else 
+      {
        a_logmsg("%s: no changes to config.",hostname);
+       synced = 1;
+      }
     }
 
 
    skip:
 
-   /* move temp files to one directory, and then remove it */
-   
-   rename(downloaded_config,working_copy_config); 
+   if(synced && digest_known)
+    a_config_digest_store(hostname, config_digest);   /* this is what the repository holds now */
+
+   a_config_buffer_free(&config);
 
-   a_remove_directory(svn_tmp_dirname);
+   /* other backends leave nothing on disk */
+
+   if((G_config_info.svn_backend == SVN_BACKEND_CLIENT) && (G_config_info.wc_cache == WC_CACHE_NONE))
+    a_remove_directory(svn_tmp_dirname);
+   else if(G_config_info.svn_backend == SVN_BACKEND_CLIENT)
+    {
+     /* never keep a working copy with changes that didn't make it to the repository - */
+     /* revert only this device file (working copy may belong to the whole group), and */
+     /* remove the working copy only if even that fails                                */
+
+     if(fail && wc_touched)
+      if(a_svn_wc_revert(hostname, svn_tmp_dirname, thread_global_apr_pool, thread_global_svn_pool) == -1)
+       a_remove_directory(svn_tmp_dirname);
+
+     if(wc_mutex != NULL)
+      pthread_mutex_unlock(wc_mutex);
+    }
 
    if(res != NULL) 
     freeaddrinfo(res);
@@ -288,11 +462,11 @@ int a_sync_device
    if(group_path != NULL)
     free(group_path); 
 
-   if(apr_pool_initialized)
-    apr_pool_destroy(thread_global_apr_pool);
-
    if(svn_pool_initialized)
-    svn_pool_destroy(thread_global_svn_pool);
+    {
+     svn_pool_clear(thread_global_apr_pool);
+     svn_pool_clear(thread_global_svn_pool);
+    }
 
    if(fail) 
    {
@@ -306,45 +480,78 @@ int a_sync_device
 }
 
 
-void *a_archive_bulk
-(void *arg)
+int a_archive_bulk_start
+(int onboarding)
 /*
 *
-* bulk archivization routine
+* start bulk archiver thread. with onboarding set, devices new to the repository
+* are added in one commit when the run ends (see a_archive_bulk).
 *
 */
 {
+   pthread_t bulk_thread;
+   pthread_attr_t thread_attr;
 
-  router_db_entry_t *device_entry_pointer; 
-  config_event_info_t *confinfo;
+   /* bulk archiving is different than queueing a job for a single device.
+    * bulk thread queues jobs for all devices, waiting while the archiver 
+    * queue is full, so it has to run in its own thread - we want to go on 
+    * further as quickly as possible.
+    */
 
-  int thread_counter = 0;
-  unsigned int timer = 0;
+   pthread_attr_init(&thread_attr);
+   pthread_attr_setdetachstate(&thread_attr,PTHREAD_CREATE_DETACHED);
+   pthread_attr_setstacksize(&thread_attr, ARCHIVIST_THREAD_STACK_SIZE);
 
-  #define DEADLOCK_TIMEOUT 2000000 /* five minutes in 300 usecond units  */
+   if(pthread_create(&bulk_thread, &thread_attr, a_archive_bulk, (void *)(long)onboarding))
+    {
+     a_logmsg("ERROR: cannot create bulk archiver thread!");
+     a_debug_info2(DEBUGLVL5,"a_archive_bulk_start: cannot create bulk archiver thread!");
+     pthread_attr_destroy(&thread_attr);
+     return 0;
+    }
 
-  while( G_active_bulk_archiver_threads >= MAX_CONCURRENT_BULK_THREADS )
-   {
-    a_debug_info2(DEBUGLVL5,"a_archive_bulk: waiting for another bulk archiving to end.");
+   pthread_attr_destroy(&thread_attr);
+   return 1;
+}
 
-    sleep(60);
 
-    timer += 1; /* one minute here */ 
-    if(timer > 10) 
-     {
-      a_logmsg("a_archive_bulk: timeout while waiting for another archiving thread to end. exit.");
-      pthread_exit(NULL);
-     }
+void *a_archive_bulk
+(void *arg)
+/*
+*
+* bulk archivization routine. queues archiving job for every device
+* and waits for the archiver workers to finish them.
+* onboarding run (arg not 0, or the first bulk run with BulkOnboarding set) 
+* collects configs of devices new to the repository and adds them in one commit.
+*
+*/
+{
 
-    if(G_stop_all_processing)
-     pthread_exit(NULL);
+  router_db_entry_t *device_entry_pointer; 
+  config_event_info_t *confinfo;
+  int queued = 0;
+  int onboarding;
+
+  pthread_mutex_lock (&G_M_thread_count_mutex);
 
+  if( G_active_bulk_archiver_threads >= MAX_CONCURRENT_BULK_THREADS )
+   {
+    pthread_mutex_unlock (&G_M_thread_count_mutex);
+    a_logmsg("bulk archiver thread: previous bulk archiving is still running - skipping this one.");
+    pthread_exit(NULL);
    }
 
-  pthread_mutex_lock (&G_M_thread_count_mutex);
   G_active_bulk_archiver_threads++;
+  onboarding = ((long)arg != 0) || (G_config_info.bulk_onboarding && (G_bulk_runs == 0));
+  G_bulk_runs++;
   pthread_mutex_unlock (&G_M_thread_count_mutex);
 
+  if(onboarding)
+   {
+    a_logmsg("bulk archiver thread: onboarding run - new devices will be added in one commit.");
+    G_onboarding = 1;
+   }
+
   a_debug_info2(DEBUGLVL5,"a_archive_bulk: starting bulk thread. G_active_bulk_archiver_threads now %d\n",
                   G_active_bulk_archiver_threads);
 
@@ -361,36 +568,18 @@ void *a_archive_bulk
  
     device_entry_pointer = G_router_db;  /* begin of the device database linked list  */
 
-    while(device_entry_pointer!=NULL)
+    while( (device_entry_pointer!=NULL) && !G_stop_all_processing )
     {
 
 #endif
-     timer = 0;
-     while( (G_active_archiver_threads >= G_config_info.archiver_threads) && !G_stop_all_processing )
-      {
-       /* throttle number of active archiver threads to G_config_info.archiver_threads */
-       usleep(300);
-
-       timer += 1; /* 300 usecond units here */
-       if(timer > DEADLOCK_TIMEOUT)
-        {
-         a_logmsg("a_archive_bulk: timeout waiting for single threads to end - deadlock? exit.");
-         pthread_exit(NULL);
-        }
-
-       if(G_stop_all_processing)
-        pthread_exit(NULL);
-      }
-
-    /* start archiver thread for a single device  */
 
      if((confinfo = malloc(sizeof(config_event_info_t))) == NULL)
       {
-       a_debug_info2(DEBUGLVL3,"a_archive_bulk: %s: malloc failed!");
-       pthread_exit(NULL);
+       a_debug_info2(DEBUGLVL3,"a_archive_bulk: malloc failed!");
+       break;
       }
 
-     a_debug_info2(DEBUGLVL5,"a_archive_bulk: allocated new data structure at 0x%p",confinfo);
+     bzero(confinfo,sizeof(config_event_info_t));
 
 #ifdef USE_MYSQL
 
@@ -398,7 +587,7 @@ void *a_archive_bulk
      a_logmsg("bulk archiver thread: checking %s ",router_db[1]);
 
      strcpy(confinfo->configured_by,"scheduled_archiving");
-     strncpy(confinfo->device_id,router_db[1],sizeof(confinfo->device_id));
+     strncpy(confinfo->device_id,router_db[1],sizeof(confinfo->device_id) - 1);
 
 #else
 
@@ -406,31 +595,27 @@ void *a_archive_bulk
      a_logmsg("bulk archiver thread: checking %s ",device_entry_pointer->hostname);
 
      strcpy(confinfo->configured_by,"scheduled_archiving");
-     strncpy(confinfo->device_id,device_entry_pointer->hostname,sizeof(confinfo->device_id));
+     strncpy(confinfo->device_id,device_entry_pointer->hostname,sizeof(confinfo->device_id) - 1);
 
-#endif
+     device_entry_pointer = device_entry_pointer->prev;
 
-     pthread_t next_thread;
-     size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
+#endif
 
-     pthread_attr_t thread_attr;
-     pthread_attr_init(&thread_attr);
-     pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
-     pthread_attr_setstacksize(&thread_attr, stacksize);
-     
-     if(pthread_create(&next_thread, &thread_attr, a_archive_single, (void*)confinfo))
-      {
-       a_logmsg("bulk archiver thread:fatal! cannot create archiver thread!");
-       a_debug_info2(DEBUGLVL5,"a_archive_bulk: cannot create archiver thread for %s (%d)!",
-                     confinfo->device_id,errno);
-       free(confinfo);
-      }
+     /* queue is bounded - this blocks while all workers are busy and the queue is full */
 
-     device_entry_pointer = device_entry_pointer->prev;
-     usleep(5000); 
+     if(a_archiver_submit(confinfo, YES, 0))
+      queued++;
+     else
+      free(confinfo);   /* program is shutting down */
     }
 
-   sleep(60); /* give device archiving threads time to finish before exiting from bulk thread  */
+   a_archiver_pool_wait_bulk(); /* let the workers finish what we queued */
+
+   if(onboarding)
+    {
+     G_onboarding = 0;
+     a_svn_ra_onboard_flush();  /* new devices found by this run - one revision */
+    }
 
    pthread_mutex_lock (&G_M_thread_count_mutex);
    G_active_bulk_archiver_threads--;
@@ -438,33 +623,27 @@ void *a_archive_bulk
 
    a_debug_info2(DEBUGLVL5,"a_archive_bulk: thread exiting. G_active_bulk_archiver_threads now %d\n",
                  G_active_bulk_archiver_threads);
-   a_logmsg("bulk archiver thread finished. there can be some logging from unfinished threads yet.");
+   a_logmsg("bulk archiver thread finished (%d devices queued).",queued);
 
    pthread_exit(NULL);
  
 }
 
 
-void *a_archive_single
-(void *arg)
+int a_archive_device
+(config_event_info_t *config_event_info)
 /*
 *
-* always called via pthread_create. archive config from a single device:
+* archive config from a single device. run by archiver pool workers (see archpool.c),
+* which never run two jobs for the same device at once. returns 1 if device was synced, 
+* 0 otherwise, -1 if device is being archived by someone else (job is retried then).
 *
 */
 {
 
-  config_event_info_t config_event_info;
   router_db_entry_t *router_entry;
   pthread_t my_id;
-  char *devtype;
-  int unlocked = 0, unlock_wait = 0;
-
-  #define ARCH_WAIT_TIMEOUT 30
-
-  a_debug_info2(DEBUGLVL5,"a_archive_single: input data at 0x%p",arg);
-
-  config_event_info = *((config_event_info_t*)(arg));
+  int result = 0;
 
   my_id = pthread_self();
 
@@ -472,76 +651,63 @@ void *a_archive_single
   G_active_archiver_threads++;
   pthread_mutex_unlock(&G_thread_count_mutex);
 
-  a_debug_info2(DEBUGLVL5,"a_archive_single(%u): thread starting. G_active_archiver_threads now %d",
+  a_debug_info2(DEBUGLVL5,"a_archive_device(%u): job starting. G_active_archiver_threads now %d",
                 my_id,G_active_archiver_threads);
 
-  if( (router_entry = a_router_db_search(G_router_db, config_event_info.device_id)) != NULL )
+  if( (router_entry = a_router_db_search(G_router_db, config_event_info->device_id)) != NULL )
    {
-    a_debug_info2(DEBUGLVL5,"a_archive_single(%u): found device %s in database!",
-                  my_id,config_event_info.device_id); 
-    a_debug_info2(DEBUGLVL5,"a_archive_single(%u): trying to sync to SVN...",my_id);
+    a_debug_info2(DEBUGLVL5,"a_archive_device(%u): found device %s in database!",
+                  my_id,config_event_info->device_id); 
+    a_debug_info2(DEBUGLVL5,"a_archive_device(%u): trying to sync to SVN...",my_id);
 
-    while( (!unlocked) && (unlock_wait < ARCH_WAIT_TIMEOUT) )
-    {
-     /* check if another archivization is running */
-     if(!a_is_archived_now(G_router_db, config_event_info.device_id)) 
-      {
-       unlocked = 1;
-
-       pthread_mutex_lock(&G_router_db_mutex);
-       a_set_archived(G_router_db, config_event_info.device_id, 1);  /* lock the device for us */
-       pthread_mutex_unlock(&G_router_db_mutex);
+    /* 
+     * the lock can only be held by another archivist instance sharing the
+     * router.db (MySQL) - our own jobs for this device are serialized by the pool
+     */
 
-       a_debug_info2(DEBUGLVL5,"a_archive_single(%u): args to a_sync_device: %s, %s, %s, %s, %s, %s",
-                     my_id,
-                     config_event_info.device_id,config_event_info.configured_by,
-                     router_entry->group,router_entry->hosttype,router_entry->authset,
-                     router_entry->arch_method);
-
-       a_sync_device(router_entry->group,router_entry->hostname,config_event_info.configured_by,
-                     router_entry->hosttype,router_entry->authset,router_entry->arch_method);
+    if(!a_is_archived_now(G_router_db, config_event_info->device_id)) 
+     {
+      pthread_mutex_lock(&G_router_db_mutex);
+      a_set_archived(G_router_db, config_event_info->device_id, 1);  /* lock the device for us */
+      pthread_mutex_unlock(&G_router_db_mutex);
+
+      a_debug_info2(DEBUGLVL5,"a_archive_device(%u): args to a_sync_device: %s, %s, %s, %s, %s, %s",
+                    my_id,
+                    config_event_info->device_id,config_event_info->configured_by,
+                    router_entry->group,router_entry->hosttype,router_entry->authset,
+                    router_entry->arch_method);
+
+      a_sync_device(router_entry->group,router_entry->hostname,config_event_info->configured_by,
+                    router_entry->hosttype,router_entry->authset,router_entry->arch_method);
        
-       pthread_mutex_lock(&G_router_db_mutex);
-       a_set_archived(G_router_db, config_event_info.device_id, 0);  /* unlock the device after archiving */
-       pthread_mutex_unlock(&G_router_db_mutex);
-      }
-     else
-      {
-       a_debug_info2(DEBUGLVL5,"a_archive_single(%u): another archivization of %s is running. waiting...",
-                     my_id,config_event_info.device_id);
-       sleep(1);  /* wait for device to be unlocked by another thread */
-       unlock_wait++;
-      }
-    }
-  
+      pthread_mutex_lock(&G_router_db_mutex);
+      a_set_archived(G_router_db, config_event_info->device_id, 0);  /* unlock the device after archiving */
+      pthread_mutex_unlock(&G_router_db_mutex);
 
-   if(unlock_wait > ARCH_WAIT_TIMEOUT)
-    {
-     a_debug_info2(DEBUGLVL3,
-                   "a_archive_single(%u): timeout waiting for another archivization of %s to end! archivization failed!",
-                   my_id,config_event_info.device_id);
-    }
+      result = 1;
 
-    a_debug_info2(DEBUGLVL5,"a_archive_single(%u): after SVN sync...",my_id);
+      a_debug_info2(DEBUGLVL5,"a_archive_device(%u): after SVN sync...",my_id);
+     }
+    else
+     {
+      a_debug_info2(DEBUGLVL5,"a_archive_device(%u): another archivization of %s is running. will retry.",
+                    my_id,config_event_info->device_id);
+      result = -1;
+     }
 
    }
   else 
    {
-    a_debug_info2(DEBUGLVL3,"a_archive_single(%u): device %s not found in database!",
-                  my_id,config_event_info.device_id);
-    a_logmsg("%s not found in the router.db. not archiving.",config_event_info.device_id);
+    a_debug_info2(DEBUGLVL3,"a_archive_device(%u): device %s not found in database!",
+                  my_id,config_event_info->device_id);
+    a_logmsg("%s not found in the router.db. not archiving.",config_event_info->device_id);
    }
 
   pthread_mutex_lock (&G_thread_count_mutex);
   G_active_archiver_threads--;
   pthread_mutex_unlock (&G_thread_count_mutex);
 
-  
-  free(arg);
- 
-  /* ^^^ i'm still not sure if it's safe to do this in-thread... */
-
-  a_debug_info2(DEBUGLVL5,"a_archive_single(%u): thread exiting. G_active_archiver_threads now %d",
+  a_debug_info2(DEBUGLVL5,"a_archive_device(%u): job done. G_active_archiver_threads now %d",
                 my_id,G_active_archiver_threads);
 
 #ifdef USE_MYSQL
@@ -549,7 +715,7 @@ void *a_archive_single
    free(router_entry);
 #endif
 
-  pthread_exit(NULL);
+  return result;
 
 }
 
@@ -19,6 +19,11 @@
 *   archivist_config.h - configuration data and structures 
 */
 
+#include <netinet/in.h>
+#include <regex.h>
+#include <pthread.h>
+#include <time.h>
+
 #define YES 1
 #define NO 0
 
@@ -30,6 +35,28 @@
 #define DEFAULT_CONF_LISTEN_SYSLOG NO
 #define DEFAULT_CONF_CHANGELOG NO
 #define DEFAULT_CONF_SYSLOG_PORT 514
+#define DEFAULT_CONF_SYSLOG_RCVBUF 0       /* 0 - leave SO_RCVBUF at system default */
+#define DEFAULT_CONF_SYSLOG_BATCH 64       /* datagrams received in one syscall */
+#define DEFAULT_CONF_SYSLOG_RECEIVERS 0    /* 0 - receive syslog in the main loop */
+#define DEFAULT_CONF_ARCHIVER_QUEUE 16384  /* archiving jobs waiting for a free worker */
+#define DEFAULT_CONF_QUIET_PERIOD 10       /* seconds without config events before a device is archived */
+#define DEFAULT_CONF_WC_CACHE 0            /* WC_CACHE_NONE - checkout and remove working copy every run */
+#define DEFAULT_CONF_SVN_BACKEND 0         /* SVN_BACKEND_CLIENT */
+#define DEFAULT_CONF_SKIP_UNCHANGED YES    /* skip repository work when config digest didn't change */
+#define DEFAULT_CONF_GROUP_COMMIT_WINDOW 0 /* seconds changed configs are collected for one commit (0 - off) */
+#define DEFAULT_CONF_GROUP_COMMIT_FILES 100 /* max. configs in one group commit */
+#define DEFAULT_CONF_GROUP_COMMIT_PER_GROUP NO  /* one group commit per device group */
+#define DEFAULT_CONF_KEEP_DOWNLOADED NO     /* debug: write downloaded configs to <hostname>.new */
+#define DEFAULT_CONF_HELPER_TIMEOUT 300    /* seconds an expect script or rancid may run */
+#define DEFAULT_CONF_COLLECTOR_THREADS 2    /* TerminalArchivingMethod native */
+#define DEFAULT_CONF_COLLECTOR_TIMEOUT 15   /* seconds of device silence - "set timeout" of the expect helpers */
+#define DEFAULT_CONF_TELNET_PORT 23        /* native collector ports */
+#define DEFAULT_CONF_SSH_PORT 22
+#define DEFAULT_CONF_BULK_ONBOARDING YES   /* first bulk run adds new devices in one commit */
+#define DEFAULT_CONF_ONBOARDING_FILES 10000 /* max. new device configs in one onboarding commit */
+#define DEFAULT_CONF_RESOLVER_THREADS 8    /* parallel router.db hostname lookups */
+#define DEFAULT_CONF_ADDR_REFRESH 3600     /* seconds between router.db address map rebuilds */
+#define DEFAULT_CONF_PTR_FALLBACK YES      /* reverse-resolve syslog sources not found in the map */
 #define DEFAULT_CONF_SYSLOG_FILENAME "/var/log/messages"
 #define DEFAULT_CONF_HOSTNAME_FIELD_IN_SYSLOG 4
 #define DEFAULT_CONF_RANCID_PATH "/usr/local/rancid/bin/rancid"
@@ -63,9 +90,20 @@
 
 #define MIN_WORKING_COPY_LEN	200  /* suspicious downloaded config length - truncated? */
 
+#define MAX_SYSLOG_DGRAM_LEN 8191         /* longest syslog datagram we accept (rest is truncated) */
+#define MAX_SYSLOG_BATCH 1024              /* upper limit for SyslogBatchSize */
+#define MAX_SYSLOG_RECEIVERS 64            /* upper limit for SyslogReceiverThreads */
+#define MAX_RESOLVER_THREADS 64            /* upper limit for ResolverThreads */
+#define MAX_PREFILTER_LITERAL 128          /* longest literal taken from a ConfigRegexp for the prefilter */
+#define MAX_DFA_STATES 2048                /* lazily built ConfigRegexp DFA states (see dfa.c) */
+#define MAX_NFA_NODES 65536                /* NFA size limit for the ConfigRegexp union */
+#define DFA_HASH_BUCKETS 1024
+#define SYSLOG_EVENT_QUEUE_LEN 4096        /* config events waiting between receiver threads and archivers */
+
 static char G_config_filename[MAXPATH]="/usr/local/etc/archivist.conf";   /* default config filename  */
 
 static char G_svn_tmp_prefix[20]=".svn_tmp";   /* prefix for name of svn tmp directories */
+static char G_svn_wc_prefix[20]=".svn_wc";     /* prefix for name of kept svn working copies */
 
 /* structure holding archivist configuration data */
 
@@ -75,6 +113,20 @@ typedef struct      { int  instance_id;		/* Archivist instance ID  */
                       char logging;             /* should we enable logging? */
                       char log_filename[MAXPATH];   /* name of the daemon log file */
                       char archiving_method;    /* how to archive config from the devices */
+                      char wc_cache;            /* keep svn working copies between runs (WC_CACHE_*) */
+                      char svn_backend;         /* how configs are committed (SVN_BACKEND_*) */
+                      int  skip_unchanged;      /* compare config digests before going to the repository */
+                      int  group_commit_window;  /* collect scheduled changes for this many seconds (SVNBackend ra) */
+                      int  group_commit_files;   /* ...or until there is this many of them */
+                      int  group_commit_per_group; /* separate revision for every device group */
+                      int  keep_downloaded_configs; /* debug copy of every downloaded config */
+                      int  helper_timeout;       /* kill expect/rancid helpers after this many seconds */
+                      int  collector_threads;    /* threads of the built-in telnet/ssh collector */
+                      int  collector_timeout;    /* give up a device silent for this many seconds */
+                      int  telnet_port;          /* ports the collector connects to */
+                      int  ssh_port;
+                      int  bulk_onboarding;      /* first bulk run after startup is an onboarding run */
+                      int  onboarding_files;     /* commit onboarding batch when it holds this many configs */
                       char tftp_dir[MAXPATH];       /* location of TFTP directory (for SNMP-TFTP method) */
                       char tftp_ip[IPSTRLEN];         /* IP address of TFTP server used in SNMP-TFTP method */
                       char script_dir[MAXPATH];       /* location of internal expect scripts directory */
@@ -85,11 +137,19 @@ typedef struct      { int  instance_id;		/* Archivist instance ID  */
                       int  hostname_field_in_syslog; /* set number of the syslog message field which contains hostname/ip of the device */
                       char listen_syslog;        /* wheter to listen to UDP syslog in search of CONFIG msgs */
                       int  syslog_port;          /* syslog port to listen on */
+                      int  syslog_rcvbuf;        /* SO_RCVBUF of the syslog socket (0 - system default) */
+                      int  syslog_batch_size;    /* max. number of datagrams received in one syscall */
+                      int  syslog_receiver_threads; /* dedicated syslog receiver threads (0 - main loop receives) */
+                      int  resolver_threads;     /* threads resolving router.db hostnames */
+                      int  device_addr_refresh;  /* seconds between address map rebuilds (0 - only on load) */
+                      int  syslog_ptr_fallback;  /* reverse-resolve syslog sources missing from the address map */
                       int  keep_changelog;       /* log every diff to a changelog file */
                       char changelog_filename[MAXPATH]; /* changelog filename */
                       char router_db_path[MAXPATH];         /* location of main device database - required */
                       char repository_path[MAXPATH];        /* URL of the SVN repository - required */
                       int  archiver_threads;	    /* number of concurent archiver threads */
+                      int  archiver_queue_len;   /* max. archiving jobs waiting for a worker */
+                      int  archive_quiet_period; /* debounce of syslog-triggered archiving (seconds) */
                       struct cronjob_t *job_table[MAX_JOBS]; /* table of scheduled backup jobs */
                       int open_command_socket;      /* listen to commands on unix domain socket */
 		      char command_socket_path[MAXPATH]; /* domain socket path */
@@ -126,9 +186,18 @@ typedef struct { char *set_name;
 
 typedef struct { char *config_regexp_string;
                 char *username_field_token;
+                regex_t compiled_regexp;  /* compiled once when the entry is added */
                 void *prev;
               } config_regexp_t;
 
+/* repository route: device groups matching the regexp are archived in their own repository */
+
+typedef struct { char *group_regexp_string;
+                char *repository_path;
+                regex_t compiled_regexp;
+                void *prev;
+              } repo_route_t;
+
 /* structure for loading device config into a dynamic list */
 
 typedef struct { char *conf_line;
@@ -143,19 +212,170 @@ typedef struct { char configured_from[255];
                  char device_id[255];
                } config_event_info_t;
 
+/* one received syslog datagram with its source address */
+
+typedef struct { char payload[MAX_SYSLOG_DGRAM_LEN + 1];
+                 int len;
+                 struct sockaddr_in from;
+               } syslog_datagram_t;
+
+/* batch of syslog datagrams filled by a single receive call */
+
+typedef struct { int capacity;
+                 int count;
+                 syslog_datagram_t *dgrams;
+                 void *msgvec;          /* struct mmsghdr[capacity] where recvmmsg() is available */
+                 void *iovec;           /* struct iovec[capacity] */
+               } syslog_batch_t;
+
+/* cell and ring of the lock-free config event queue (see evqueue.c) */
+
+typedef struct { size_t sequence;
+                 void *data;
+               } evqueue_cell_t;
+
+typedef struct { evqueue_cell_t *cells;
+                 size_t mask;
+                 char pad1[64];            /* keep producer and consumer positions on separate cache lines */
+                 size_t enqueue_pos;
+                 char pad2[64];
+                 size_t dequeue_pos;
+                 char pad3[64];
+                 int notify_fd;            /* eventfd signalled by producers (-1 if not available) */
+               } evqueue_t;
+
+/* Aho-Corasick automaton of literals required by ConfigRegexp entries (see prefilter.c) */
+
+typedef struct { int *delta;               /* nstates x 256 transition table */
+                 unsigned char *accept;    /* states in which some literal ends */
+                 unsigned char first_byte[256];
+                 int single_first_byte;    /* -1 unless all literals start with the same byte */
+                 int nstates;
+                 int nliterals;
+               } literal_prefilter_t;
+
+/* NFA of all ConfigRegexp entries and the DFA built from it on demand (see dfa.c) */
+
+typedef struct { int type;                 /* NFA_SET, NFA_SPLIT, NFA_EPS, NFA_BOL, NFA_EOL, NFA_MATCH */
+                 int out1;
+                 int out2;
+                 int pattern;              /* NFA_MATCH: index of matched ConfigRegexp */
+                 unsigned char set[32];    /* NFA_SET: bitmap of accepted bytes */
+               } nfa_node_t;
+
+typedef struct { int next[256];            /* -1 - transition not computed yet */
+                 int *nfa_states;          /* sorted set of NFA nodes this state stands for */
+                 int nfa_count;
+                 int accept;               /* lowest pattern index matched here, -1 if none */
+                 int eol_accept;           /* same, if input ends here */
+                 int id;                   /* index in config_dfa_t.states */
+                 void *hash_next;
+               } dfa_state_t;
+
+typedef struct { nfa_node_t *nodes;
+                 int nnodes;
+                 int nodes_allocated;
+                 int start;
+                 config_regexp_t **patterns;   /* pattern index -> ConfigRegexp entry */
+                 int npatterns;
+                 dfa_state_t *states[MAX_DFA_STATES];
+                 int nstates;
+                 dfa_state_t *hash[DFA_HASH_BUCKETS];
+                 int *scratch_stack;
+                 int *scratch_set;
+                 unsigned int *scratch_mark;
+                 unsigned int mark_gen;
+                 pthread_mutex_t mutex;       /* held while new states are built */
+               } config_dfa_t;
+
+/* archiving state of a single device (see archpool.c) */
+
+#define DEVICE_JOB_IDLE 0
+#define DEVICE_JOB_QUEUED 1      /* waiting for the quiet period to pass or for a free worker */
+#define DEVICE_JOB_RUNNING 2
+#define DEVICE_JOB_RERUN 3       /* running, and more events came in meanwhile */
+
+#define DEVICE_JOB_MAX_DELAY 6   /* debounce never delays a device more than 6 quiet periods */
+#define DEVICE_JOB_LOCK_RETRIES 30  /* seconds to wait for a device locked by someone else */
+#define DEVICE_JOBS_HASH_SIZE 256
+
+typedef struct device_job_t { char device_id[255];
+                 int state;
+                 config_event_info_t *event;   /* events merged for the next run */
+                 int merged_events;
+                 time_t first_event;
+                 time_t due;                   /* not started before this time */
+                 int lock_retries;
+                 int bulk;                     /* bulk archiving submissions waiting for the next run */
+                 struct device_job_t *next;    /* on the delayed list */
+               } device_job_t;
+
+/* archiver worker pool with its job queue (see archpool.c) */
+
+typedef struct { device_job_t **jobs;      /* ring buffer of devices ready to be archived */
+                 int capacity;             /* max. devices queued or delayed */
+                 int ring_size;
+                 int head;
+                 int count;                /* queue depth */
+                 device_job_t *delayed;    /* devices waiting for their quiet period to pass */
+                 int delayed_count;
+                 int max_depth;            /* highest queue depth seen */
+                 int busy;                 /* workers running a job */
+                 int nworkers;
+                 unsigned long completed;
+                 unsigned long merged;     /* events merged into already queued jobs */
+                 int (*archive)(config_event_info_t *);   /* a_archive_device (tests put a stub here) */
+                 int bulk_jobs;            /* bulk archiving submissions not archived yet */
+                 pthread_mutex_t mutex;
+                 pthread_cond_t not_empty;
+                 pthread_cond_t not_full;
+                 pthread_cond_t bulk_done;
+               } archiver_pool_t;
+
 /* declarations of public data structures */
 
 config_info_t G_config_info;
 router_db_entry_t *G_router_db;
 auth_set_t *G_auth_set_list;
 config_regexp_t *G_config_regexp_list;
+repo_route_t *G_repo_routes;
+evqueue_t *G_syslog_event_queue;
+literal_prefilter_t *G_config_prefilter;
+config_dfa_t *G_config_dfa;
+archiver_pool_t *G_archiver_pool;
 
 /* prototypes of routines wchich use above structs */
 
 router_db_entry_t *a_load_router_db(char *filename);
 router_db_entry_t *a_router_db_search(router_db_entry_t *router_db_idx, char *hostname);
+router_db_entry_t *a_router_db_index_lookup(char *hostname);
+int a_is_archived_now(router_db_entry_t *router_db_idx, char *hostname);
+int a_set_archived(router_db_entry_t *router_db_idx, char *hostname, int arch_status);
+void a_router_db_free(router_db_entry_t *start);
 auth_set_t *a_auth_set_add(auth_set_t *prev, char *data);
 config_regexp_t *a_config_regexp_add(config_regexp_t *prev, char *data);
+repo_route_t *a_repo_route_add(repo_route_t *prev, char *group_regexp, char *repository);
 auth_set_t *a_auth_set_search(auth_set_t *auth_set_list_idx, char *setname);
+syslog_batch_t *a_syslog_batch_alloc(int capacity);
+int a_syslog_batch_receive(int sock, syslog_batch_t *batch, int wait);
+int a_syslog_batch_process(syslog_batch_t *batch);
+int a_dispatch_config_event(config_event_info_t *conf_event_info);
+evqueue_t *a_evqueue_create(size_t capacity);
+int a_evqueue_push(evqueue_t *queue, void *data);
+void *a_evqueue_pop(evqueue_t *queue);
+void a_evqueue_notify(evqueue_t *queue);
+void a_evqueue_clear_notify(evqueue_t *queue);
+literal_prefilter_t *a_literal_prefilter_build(config_regexp_t *config_regexp_list);
+int a_literal_prefilter_scan(literal_prefilter_t *prefilter, const char *buffer);
+config_dfa_t *a_config_dfa_build(config_regexp_t *config_regexp_list);
+int a_config_dfa_match(config_dfa_t *dfa, const char *buffer);
+void a_device_name_by_addr(struct sockaddr_in *from, char *name, int namelen);
+int a_archiver_pool_start(int nworkers, int capacity);
+int a_archiver_submit(config_event_info_t *job, int wait, int quiet_period);
+void *a_archiver_worker(void *arg);
+void a_archiver_pool_wait_bulk(void);
+int a_archiver_queue_depth(void);
+void a_archiver_pool_stats_log(void);
+int a_archive_device(config_event_info_t *config_event_info);
 
 /* end of archivist_config.h */
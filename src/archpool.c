@@ -0,0 +1,576 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    archpool.c - archiver worker pool
+*
+*    ArchiverThreads long-lived workers take single-device archiving jobs
+*    (config_event_info_t) from a bounded FIFO queue. syslog events, scheduled
+*    jobs, external commands and bulk archiving all just queue jobs here.
+*
+*    every device has at most one job in the pool (idle -> queued -> running, and
+*    rerun if events arrive while it is running). events for a device that already
+*    has a job are merged into it. syslog-triggered jobs wait on the delayed list
+*    until ArchiveQuietPeriod seconds pass without another event from the device,
+*    so a burst of config changes ends with a single download and commit.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+
+int a_archiver_pool_start
+(int nworkers, int capacity)
+/*
+*
+* create job queue and start archiver workers. returns number of started workers.
+*
+*/
+{
+   archiver_pool_t *pool;
+   pthread_t worker;
+   pthread_attr_t thread_attr;
+   size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
+   int i;
+
+   if( (pool = calloc(1, sizeof(archiver_pool_t))) == NULL )
+    goto malloc_fail;
+
+   /* 
+    * a device that is re-queued after its run (events came in while it was running)
+    * may overshoot the capacity, at most one per worker - leave room for these. 
+    */
+
+   if( (pool->jobs = calloc(capacity + nworkers, sizeof(device_job_t *))) == NULL )
+    {
+     free(pool);
+     goto malloc_fail;
+    }
+
+   if( (G_device_jobs = a_hash_create(DEVICE_JOBS_HASH_SIZE, YES)) == NULL )
+    {
+     free(pool->jobs);
+     free(pool);
+     goto malloc_fail;
+    }
+
+   pool->capacity = capacity;
+   pool->ring_size = capacity + nworkers;
+   pool->archive = a_archive_device;
+
+   pthread_mutex_init(&pool->mutex, NULL);
+   pthread_cond_init(&pool->not_empty, NULL);
+   pthread_cond_init(&pool->not_full, NULL);
+   pthread_cond_init(&pool->bulk_done, NULL);
+
+   G_archiver_pool = pool;
+
+   pthread_attr_init(&thread_attr);
+   pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+   pthread_attr_setstacksize(&thread_attr, stacksize);
+
+   for(i = 0; i < nworkers; i++)
+    if(pthread_create(&worker, &thread_attr, a_archiver_worker, (void *)pool))
+     {
+      a_logmsg("WARNING: cannot create archiver worker thread (%d)! running with %d workers.",errno,i);
+      break;
+     }
+
+   pthread_attr_destroy(&thread_attr);
+
+   pool->nworkers = i;
+
+   if(i == 0)
+    {
+     a_logmsg("FATAL: cannot create any archiver worker thread!");
+     a_cleanup_and_exit();
+    }
+
+   return i;
+
+ malloc_fail:
+   a_logmsg("FATAL: a_archiver_pool_start: malloc failed!");
+   a_cleanup_and_exit();
+   return 0;
+}
+
+
+int a_configured_by_listed
+(char *list, char *user)
+/*
+*
+* check if user is already on the ", " separated configured_by list
+*
+*/
+{
+   char *found;
+   size_t len = strlen(user);
+
+   for(found = list; (found = strstr(found, user)) != NULL; found += len)
+    if( ((found == list) || (*(found - 1) == ' ')) && ((found[len] == 0x0) || (found[len] == ',')) )
+     return 1;
+
+   return 0;
+}
+
+
+void a_config_event_merge
+(config_event_info_t *into, config_event_info_t *from)
+/*
+*
+* merge config event into another event of the same device - add users who
+* made the changes to the configured_by list (as long as the list fits).
+*
+*/
+{
+   size_t len = strlen(into->configured_by);
+
+   if((from->configured_by[0] == 0x0) || a_configured_by_listed(into->configured_by, from->configured_by))
+    return;
+
+   if(len == 0)
+    {
+     strcpy(into->configured_by, from->configured_by);
+     return;
+    }
+
+   if( (len + strlen(from->configured_by) + 2) < sizeof(into->configured_by) )
+    {
+     strcat(into->configured_by, ", ");
+     strcat(into->configured_by, from->configured_by);
+    }
+}
+
+
+void a_device_job_debounce
+(device_job_t *device_job, time_t now, int quiet_period)
+/*
+*
+* push start of the device job quiet_period seconds from now, but not further
+* than DEVICE_JOB_MAX_DELAY quiet periods from the first event of a burst.
+*
+*/
+{
+   time_t latest;
+
+   latest = device_job->first_event + (DEVICE_JOB_MAX_DELAY * quiet_period);
+
+   device_job->due = ((now + quiet_period) < latest) ? (now + quiet_period) : latest;
+}
+
+
+void a_device_job_enqueue
+(archiver_pool_t *pool, device_job_t *device_job)
+/*
+*
+* put device on the ring of devices ready to be archived. pool mutex must be held.
+*
+*/
+{
+   device_job->state = DEVICE_JOB_QUEUED;
+
+   pool->jobs[(pool->head + pool->count) % pool->ring_size] = device_job;
+   pool->count++;
+
+   if(pool->count > pool->max_depth)
+    pool->max_depth = pool->count;
+}
+
+
+void a_device_job_delay
+(archiver_pool_t *pool, device_job_t *device_job)
+/*
+*
+* put device on the delayed list, where it waits until its due time. pool mutex must be held.
+*
+*/
+{
+   device_job->state = DEVICE_JOB_QUEUED;
+   device_job->next = pool->delayed;
+   pool->delayed = device_job;
+   pool->delayed_count++;
+}
+
+
+time_t a_device_jobs_promote
+(archiver_pool_t *pool, time_t now)
+/*
+*
+* move delayed devices which are due to the ring. returns earliest due time
+* of devices still delayed (0 if none). pool mutex must be held.
+*
+*/
+{
+   device_job_t **link = &pool->delayed, *device_job;
+   time_t next_due = 0;
+
+   while( (device_job = *link) != NULL )
+    {
+     if(device_job->due <= now)
+      {
+       *link = device_job->next;
+       device_job->next = NULL;
+       pool->delayed_count--;
+       a_device_job_enqueue(pool, device_job);
+       continue;
+      }
+
+     if((next_due == 0) || (device_job->due < next_due))
+      next_due = device_job->due;
+
+     link = &device_job->next;
+    }
+
+   return next_due;
+}
+
+
+int a_archiver_submit
+(config_event_info_t *job, int wait, int quiet_period)
+/*
+*
+* queue single-device archiving job. if the device is already queued or being 
+* archived, the event is merged into the job waiting for it. otherwise the device 
+* is archived after quiet_period seconds without further events (0 - as soon as possible).
+*
+* with wait set, block while the queue is full (bulk archiving), otherwise give up at once. 
+* bulk archiving then waits for its jobs with a_archiver_pool_wait_bulk.
+* returns 1 if job was queued, 2 if it was merged - job is freed by the pool then - 
+* or 0 (job stays with the caller).
+*
+*/
+{
+   archiver_pool_t *pool = G_archiver_pool;
+   device_job_t *device_job;
+   struct timespec deadline;
+   struct timeval now;
+
+   if(pool == NULL)
+    return 0;
+
+   pthread_mutex_lock(&pool->mutex);
+
+   while( ((device_job = a_hash_get(G_device_jobs, job->device_id)) == NULL) &&
+          ((pool->count + pool->delayed_count) >= pool->capacity) )
+    {
+     if(!wait || G_stop_all_processing)
+      {
+       pthread_mutex_unlock(&pool->mutex);
+       return 0;
+      }
+
+     /* wake up every second to notice program shutdown */
+     gettimeofday(&now, NULL);
+     deadline.tv_sec = now.tv_sec + 1;
+     deadline.tv_nsec = now.tv_usec * 1000;
+     pthread_cond_timedwait(&pool->not_full, &pool->mutex, &deadline);
+    }
+
+   if(G_stop_all_processing)
+    {
+     pthread_mutex_unlock(&pool->mutex);
+     return 0;
+    }
+
+   gettimeofday(&now, NULL);
+
+   /* due times are whole seconds - round up, so that the quiet period is never cut short */
+   if((quiet_period > 0) && (now.tv_usec > 0))
+    now.tv_sec++;
+
+   if(device_job != NULL)
+    {
+     /* device already queued or running - merge */
+
+     if(device_job->event == NULL)
+      device_job->event = job;
+     else
+      {
+       a_config_event_merge(device_job->event, job);
+       free(job);
+      }
+
+     device_job->merged_events++;
+     pool->merged++;
+
+     if(wait)
+      {
+       device_job->bulk++;
+       pool->bulk_jobs++;
+      }
+
+     if(device_job->state == DEVICE_JOB_RUNNING)
+      {
+       /* config changed while we were downloading it - run once more after this run */
+       device_job->state = DEVICE_JOB_RERUN;
+       device_job->first_event = now.tv_sec;
+      }
+
+     a_device_job_debounce(device_job, now.tv_sec, quiet_period);
+
+     pthread_cond_signal(&pool->not_empty);   /* due time could be earlier now */
+     pthread_mutex_unlock(&pool->mutex);
+     return 2;
+    }
+
+   if( (device_job = calloc(1, sizeof(device_job_t))) == NULL )
+    {
+     pthread_mutex_unlock(&pool->mutex);
+     a_debug_info2(DEBUGLVL3,"a_archiver_submit: malloc failed!");
+     return 0;
+    }
+
+   strncpy(device_job->device_id, job->device_id, sizeof(device_job->device_id) - 1);
+   device_job->event = job;
+   device_job->first_event = now.tv_sec;
+   device_job->due = now.tv_sec + quiet_period;
+
+   if(!a_hash_put(G_device_jobs, device_job->device_id, device_job))
+    {
+     pthread_mutex_unlock(&pool->mutex);
+     free(device_job);
+     a_debug_info2(DEBUGLVL3,"a_archiver_submit: malloc failed!");
+     return 0;
+    }
+
+   if(wait)
+    {
+     device_job->bulk = 1;
+     pool->bulk_jobs++;
+    }
+
+   if(quiet_period > 0)
+    a_device_job_delay(pool, device_job);
+   else
+    a_device_job_enqueue(pool, device_job);
+
+   pthread_cond_signal(&pool->not_empty);
+   pthread_mutex_unlock(&pool->mutex);
+
+   return 1;
+}
+
+
+void *a_archiver_worker
+(void *arg)
+/*
+*
+* archiver worker thread: run queued jobs, one at a time, forever.
+*
+*/
+{
+   archiver_pool_t *pool = (archiver_pool_t *)arg;
+   device_job_t *device_job;
+   config_event_info_t *event;
+   struct timespec deadline;
+   time_t next_due;
+   int result, bulk;
+
+   while(TRUE)
+    {
+     pthread_mutex_lock(&pool->mutex);
+
+     while(TRUE)
+      {
+       next_due = (pool->delayed != NULL) ? a_device_jobs_promote(pool, time(NULL)) : 0;
+
+       if(pool->count > 0)
+        break;
+
+       if(next_due)
+        {
+         deadline.tv_sec = next_due;
+         deadline.tv_nsec = 0;
+         pthread_cond_timedwait(&pool->not_empty, &pool->mutex, &deadline);
+        }
+       else
+        pthread_cond_wait(&pool->not_empty, &pool->mutex);
+      }
+
+     device_job = pool->jobs[pool->head];
+     pool->head = (pool->head + 1) % pool->ring_size;
+     pool->count--;
+     pool->busy++;
+
+     device_job->state = DEVICE_JOB_RUNNING;
+     event = device_job->event;          /* events coming from now on are for the next run */
+     device_job->event = NULL;
+     bulk = device_job->bulk;
+     device_job->bulk = 0;
+
+     if(pool->count > 0)
+      pthread_cond_signal(&pool->not_empty);   /* more promoted jobs - pass the wakeup on */
+
+     pthread_cond_signal(&pool->not_full);
+     pthread_mutex_unlock(&pool->mutex);
+
+     if(device_job->merged_events)
+      a_debug_info2(DEBUGLVL5,"a_archiver_worker: %s: %d config events merged into this run (configured by %s).",
+                    device_job->device_id,device_job->merged_events,event->configured_by);
+
+     result = G_stop_all_processing ? 0 : pool->archive(event);
+
+     pthread_mutex_lock(&pool->mutex);
+
+     device_job->merged_events = 0;
+
+     if(result == -1)
+      {
+       /* device locked by someone else - try again in a second, keeping the events */
+
+       if(device_job->lock_retries++ < DEVICE_JOB_LOCK_RETRIES)
+        {
+         if(device_job->event != NULL)
+          {
+           a_config_event_merge(event, device_job->event);
+           free(device_job->event);
+          }
+         device_job->event = event;
+         event = NULL;
+         device_job->bulk += bulk;
+         bulk = 0;
+         device_job->state = DEVICE_JOB_RERUN;
+         if(device_job->due < (time(NULL) + 1))
+          device_job->due = time(NULL) + 1;
+        }
+       else
+        a_debug_info2(DEBUGLVL3,
+                      "a_archiver_worker: timeout waiting for another archivization of %s to end! archivization failed!",
+                      device_job->device_id);
+      }
+     else
+      device_job->lock_retries = 0;
+
+     free(event);
+
+     if(device_job->state == DEVICE_JOB_RERUN)
+      {
+       a_device_job_delay(pool, device_job);
+       pthread_cond_signal(&pool->not_empty);
+      }
+     else
+      {
+       a_hash_remove(G_device_jobs, device_job->device_id);
+       free(device_job);
+      }
+
+     pool->busy--;
+     pool->completed++;
+
+     pool->bulk_jobs -= bulk;
+
+     if(bulk && (pool->bulk_jobs == 0))
+      pthread_cond_broadcast(&pool->bulk_done);
+
+     pthread_mutex_unlock(&pool->mutex);
+    }
+
+   return NULL;
+}
+
+
+void a_archiver_pool_wait_bulk
+(void)
+/*
+*
+* wait until devices submitted by bulk archiving are archived (or shutdown begins).
+* jobs queued by syslog events meanwhile are not waited for - with events coming
+* all the time the pool is never idle.
+*
+*/
+{
+   archiver_pool_t *pool = G_archiver_pool;
+   struct timespec deadline;
+   struct timeval now;
+
+   if(pool == NULL)
+    return;
+
+   pthread_mutex_lock(&pool->mutex);
+
+   while((pool->bulk_jobs > 0) && !G_stop_all_processing)
+    {
+     gettimeofday(&now, NULL);
+     deadline.tv_sec = now.tv_sec + 1;
+     deadline.tv_nsec = now.tv_usec * 1000;
+     pthread_cond_timedwait(&pool->bulk_done, &pool->mutex, &deadline);
+    }
+
+   pthread_mutex_unlock(&pool->mutex);
+}
+
+
+int a_archiver_queue_depth
+(void)
+/*
+*
+* number of devices waiting for a free worker or for their quiet period to pass
+*
+*/
+{
+   int depth;
+
+   if(G_archiver_pool == NULL)
+    return 0;
+
+   pthread_mutex_lock(&G_archiver_pool->mutex);
+   depth = G_archiver_pool->count + G_archiver_pool->delayed_count;
+   pthread_mutex_unlock(&G_archiver_pool->mutex);
+
+   return depth;
+}
+
+
+void a_archiver_pool_stats_log
+(void)
+/*
+*
+* log archiver queue statistics (with every log marker)
+*
+*/
+{
+   archiver_pool_t *pool = G_archiver_pool;
+   int depth, delayed, max_depth, busy;
+   unsigned long completed, merged;
+
+   if(pool == NULL)
+    return;
+
+   pthread_mutex_lock(&pool->mutex);
+   depth = pool->count;
+   delayed = pool->delayed_count;
+   max_depth = pool->max_depth;
+   busy = pool->busy;
+   completed = pool->completed;
+   merged = pool->merged;
+   pthread_mutex_unlock(&pool->mutex);
+
+   a_logmsg("archiver queue: %d jobs waiting (max. %d of %d), %d in quiet period, %d of %d workers busy, %lu jobs done, %lu events merged.",
+            depth, max_depth, pool->capacity, delayed, busy, pool->nworkers, completed, merged);
+}
+
+
+/* end of archpool.c  */
@@ -0,0 +1,1192 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    collector.c - built-in telnet/ssh collector (TerminalArchivingMethod native)
+*
+*    instead of expect + telnet/ssh processes for every device, archiver workers hand
+*    their downloads over to a few collector threads. every collector thread keeps
+*    all its device sessions in one poll() loop - a session is a non-blocking socket
+*    (telnet spoken here, ssh through libssh when we are built with it) and a state
+*    machine doing what the expect helper of the platform does: login, enable, pager
+*    off, config command, read until the prompt comes back. timeout is counted from
+*    the last data received (CollectorTimeout), whole session is limited by
+*    HelperTimeout. platforms and methods without a dialogue here go to expect helpers.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/telnet.h>
+
+#ifdef HAVE_LIBSSH
+#include <libssh/libssh.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+
+/* session states */
+
+#define CS_CONNECT        1
+#define CS_SSH_HANDSHAKE  2
+#define CS_SSH_AUTH       3
+#define CS_SSH_KBDINT     4
+#define CS_SSH_CHANNEL    5
+#define CS_SSH_PTY        6
+#define CS_SSH_SHELL      7
+#define CS_LOGIN          8    /* waiting for login/password prompt or the first prompt */
+#define CS_PROMPT_CHECK   9    /* empty line sent - the line coming back is the prompt */
+#define CS_ENABLE        10
+#define CS_PAGER         11    /* pager commands, one per prompt */
+#define CS_CONFIG        12    /* config command sent - collecting until the prompt */
+#define CS_DONE          13
+
+/* telnet command parser states */
+
+#define TS_DATA    0
+#define TS_IAC     1
+#define TS_OPTION  2
+#define TS_SB      3
+#define TS_SB_IAC  4
+
+#define COLLECTOR_READ_LEN 16384
+#define COLLECTOR_KBDINT_ROUNDS 3
+
+
+/* dialogues - the same steps as in helpers/<platform>.get.* (cat5 and others stay with expect) */
+
+const collector_profile_t G_collector_profiles[] =
+ {
+  { "cisco",   "enable", NULL,  { "terminal length 0", "terminal pager 0", NULL }, "write term" },
+  { "nxos",    "enable", NULL,  { "terminal length 0", NULL, NULL },               "show running-config" },
+  { "mlx",     "enable", NULL,  { "terminal length 0", NULL, NULL },               "write term" },
+  { "juniper", NULL,     "cli", { "set cli screen-length 0", NULL, NULL },         "show configuration" },
+  { NULL,      NULL,     NULL,  { NULL, NULL, NULL },                              NULL }
+ };
+
+
+const collector_profile_t *a_collector_profile
+(char *platform)
+{
+   int i;
+
+   for(i = 0; G_collector_profiles[i].platform != NULL; i++)
+    if(!strcmp(G_collector_profiles[i].platform, platform))
+     return &G_collector_profiles[i];
+
+   return NULL;
+}
+
+
+void a_collector_finish
+(collector_session_t *session, int result, const char *error)
+/*
+*
+* end the session: close the connection, and leave the result for the worker
+*
+*/
+{
+   if(session->state == CS_DONE)
+    return;
+
+   session->state = CS_DONE;
+   session->result = result;
+   session->error = error;
+
+#ifdef HAVE_LIBSSH
+   if(session->channel != NULL)
+    {
+     ssh_channel_close((ssh_channel)session->channel);
+     ssh_channel_free((ssh_channel)session->channel);
+     session->channel = NULL;
+    }
+
+   if(session->ssh != NULL)
+    {
+     ssh_disconnect((ssh_session)session->ssh);
+     ssh_free((ssh_session)session->ssh);
+     session->ssh = NULL;
+     session->fd = -1;          /* socket was handed over to libssh, closed by it */
+    }
+#endif
+
+   if(session->fd != -1)
+    {
+     close(session->fd);
+     session->fd = -1;
+    }
+}
+
+
+int a_collector_write
+(collector_session_t *session, const char *data, size_t len)
+/*
+*
+* send bytes to the device. commands are short - they fit into the socket
+* buffer, so a write that would block is an error. returns 1 on success.
+*
+*/
+{
+   ssize_t written;
+
+#ifdef HAVE_LIBSSH
+   if(session->method == COLLECTOR_SSH)
+    return (ssh_channel_write((ssh_channel)session->channel, data, len) == (int)len);
+#endif
+
+   while(len > 0)
+    {
+     if( (written = send(session->fd, data, len, MSG_NOSIGNAL)) == -1 )
+      {
+       if(errno == EINTR)
+        continue;
+       return 0;
+      }
+
+     data += written;
+     len -= written;
+    }
+
+   return 1;
+}
+
+
+int a_collector_send
+(collector_session_t *session, const char *command)
+/*
+*
+* send a command line, and forget what the device said before it
+*
+*/
+{
+   session->screen.len = 0;
+
+   if(session->screen.data != NULL)
+    session->screen.data[0] = 0x0;
+
+   a_debug_info2(DEBUGLVL5,"a_collector_send: %s: sending command.",session->hostname);
+
+   if(a_collector_write(session, command, strlen(command)))
+    if(a_collector_write(session, (session->method == COLLECTOR_TELNET) ? "\r\n" : "\r",
+                         (session->method == COLLECTOR_TELNET) ? 2 : 1))
+     return 1;
+
+   a_collector_finish(session, -1, "cannot send to the device");
+   return 0;
+}
+
+
+char *a_collector_tail
+(collector_session_t *session, char *tail, size_t tail_size)
+/*
+*
+* last (unfinished) line of the device output, with whitespace trimmed, copied to
+* tail. returns where this line starts in the screen buffer.
+*
+*/
+{
+   char *start, *line, *end;
+   size_t len;
+
+   tail[0] = 0x0;
+
+   if(session->screen.data == NULL)
+    return NULL;
+
+   start = end = session->screen.data + session->screen.len;
+
+   while((start > session->screen.data) && (start[-1] != '\n'))
+    start--;
+
+   line = start;
+
+   while((end > line) && ((end[-1] == ' ') || (end[-1] == '\r') || (end[-1] == '\t')))
+    end--;
+
+   while((line < end) && ((*line == ' ') || (*line == '\r') || (*line == '\t')))
+    line++;
+
+   if( (len = end - line) >= tail_size )
+    {
+     line = end - (tail_size - 1);
+     len = tail_size - 1;
+    }
+
+   memcpy(tail, line, len);
+   tail[len] = 0x0;
+
+   return start;
+}
+
+
+void a_collector_next_command
+(collector_session_t *session)
+/*
+*
+* at the prompt: next pager command, or the config command when there are no more
+*
+*/
+{
+   const collector_profile_t *profile = session->profile;
+
+   if(profile->pager_commands[session->pager_next] != NULL)
+    a_collector_send(session, profile->pager_commands[session->pager_next++]);
+   else if(a_collector_send(session, profile->config_command))
+    session->state = CS_CONFIG;
+}
+
+
+int a_collector_pager_erase
+(collector_session_t *session)
+/*
+*
+* after the space, devices erase their --More-- prompt: backspaces, spaces and
+* backspaces again (IOS), or CR, spaces and CR. drop that from the screen buffer.
+* returns 0 if it didn't come in whole yet - wait for more data then.
+*
+*/
+{
+   char *start = session->screen.data + session->pager_erase - 1;
+   char *end = session->screen.data + session->screen.len;
+   char *p = start;
+   size_t n = 0, i;
+
+   while((p < end) && (*p == '\b'))
+    p++, n++;
+
+   if(n > 0)
+    {
+     for(i = 0; (i < n) && (p < end) && (*p == ' '); i++, p++);
+     if(i == n)
+      for(i = 0; (i < n) && (p < end) && (*p == '\b'); i++, p++);
+     if((p == end) && (i < n))
+      return 0;
+    }
+   else if((p < end) && (*p == '\r'))
+    {
+     for(p++; (p < end) && (*p == ' '); p++);
+
+     if(p == end)
+      return 0;
+
+     if((*p == '\r') && (p > start + 1))
+      p++;
+     else
+      p = start;                  /* just a line of the config */
+    }
+   else if(p == end)
+    return 0;
+
+   memmove(start, p, end - p);
+   session->screen.len -= p - start;
+   session->screen.data[session->screen.len] = 0x0;
+   session->pager_erase = 0;
+
+   return 1;
+}
+
+
+void a_collector_dialogue
+(collector_session_t *session)
+/*
+*
+* react to what the device said (screen buffer) - one step of the platform dialogue
+*
+*/
+{
+   char tail[COLLECTOR_PROMPT_LEN];
+   char *tail_start, *config_start;
+   size_t tail_len;
+   int newline;
+   char last;
+
+   tail_start = a_collector_tail(session, tail, sizeof(tail));
+
+   tail_len = strlen(tail);
+   last = tail_len ? tail[tail_len - 1] : 0x0;
+   newline = (tail_start != NULL) && (tail_start != session->screen.data);  /* a whole line came since the last command */
+
+   switch(session->state)
+    {
+     case CS_LOGIN:
+      if(strstr(tail,"ame:") || strstr(tail,"ogin:"))
+       {
+        if(session->logins > 0)
+         a_collector_finish(session, -1, "login failed");
+        else
+         a_collector_send(session, session->login);
+       }
+      else if(strstr(tail,"ssword:"))
+       {
+        if(session->logins++ > 0)
+         a_collector_finish(session, -1, "login failed");
+        else
+         a_collector_send(session, session->password);
+       }
+      else if((last == '#') || (last == '>') || (last == '%'))
+       {
+        if(a_collector_send(session, ""))     /* see what comes back - banners end with '#' too */
+         session->state = CS_PROMPT_CHECK;
+       }
+      break;
+
+     case CS_PROMPT_CHECK:
+      if(strstr(tail,"ame:") || strstr(tail,"ogin:") || strstr(tail,"ssword:"))
+       {
+        session->state = CS_LOGIN;
+        a_collector_dialogue(session);
+        break;
+       }
+
+      if(!newline)
+       break;
+
+      if(last == '%')
+       {
+        if((session->profile->shell_command != NULL) && (session->shells++ == 0))
+         a_collector_send(session, session->profile->shell_command);
+        else
+         a_collector_finish(session, -1, "unexpected shell prompt");
+       }
+      else if((last == '>') && (session->profile->enable_command != NULL))
+       {
+        if(session->enables++ > 0)
+         a_collector_finish(session, -1, "enable failed");
+        else if(a_collector_send(session, session->profile->enable_command))
+         session->state = CS_ENABLE;
+       }
+      else if((last == '#') || (last == '>'))
+       {
+        strcpy(session->prompt, tail);
+        a_debug_info2(DEBUGLVL5,"a_collector_dialogue: %s: prompt is [%s].",session->hostname,tail);
+        session->state = CS_PAGER;
+        a_collector_next_command(session);
+       }
+      break;
+
+     case CS_ENABLE:
+      if(strstr(tail,"ssword:"))
+       {
+        if(session->enable_passwords++ > 0)
+         a_collector_finish(session, -1, "enable failed");
+        else
+         a_collector_send(session, session->enable_password);
+       }
+      else if(strstr(tail,"ame:"))
+       {
+        if(session->enable_passwords > 0)
+         a_collector_finish(session, -1, "enable failed");
+        else
+         a_collector_send(session, session->login);
+       }
+      else if(newline && (last == '#'))
+       {
+        if(a_collector_send(session, ""))
+         session->state = CS_PROMPT_CHECK;
+       }
+      else if(newline && (last == '>'))
+       a_collector_finish(session, -1, "enable failed");
+      break;
+
+     case CS_PAGER:
+      if(newline && !strcmp(tail, session->prompt))
+       a_collector_next_command(session);
+      break;
+
+     case CS_CONFIG:
+      if(session->pager_erase)
+       {
+        if(!a_collector_pager_erase(session))
+         break;
+        a_collector_dialogue(session);
+        break;
+       }
+
+      if(strstr(tail,"More") && strstr(tail,"--"))
+       {
+        /* pager still on - drop its prompt and ask for the next page */
+
+        session->screen.len = tail_start - session->screen.data;
+        session->screen.data[session->screen.len] = 0x0;
+        session->pager_erase = session->screen.len + 1;
+
+        if(!a_collector_write(session, " ", 1))
+         a_collector_finish(session, -1, "cannot send to the device");
+        break;
+       }
+
+      if(newline && !strcmp(tail, session->prompt))
+       {
+        /* first line is the echo of the command, last one is the prompt */
+
+        config_start = memchr(session->screen.data, '\n', session->screen.len) + 1;
+
+        if(!a_config_buffer_append(session->config, config_start, tail_start - config_start))
+         {
+          a_collector_finish(session, -1, "malloc failed");
+          break;
+         }
+
+        a_collector_send(session, "exit");
+        a_collector_finish(session, 1, NULL);
+       }
+      break;
+    }
+}
+
+
+void a_collector_telnet_answer
+(collector_session_t *session, unsigned char command, unsigned char option)
+/*
+*
+* telnet option negotiation: we let the device echo and suppress go-ahead,
+* everything else is refused. every option is answered once.
+*
+*/
+{
+   unsigned char reply[3];
+   int which = (command == DO) ? 0 : 1;
+
+   if((command != DO) && (command != WILL))
+    return;
+
+   if(session->telnet_answered[which][option / 8] & (1 << (option % 8)))
+    return;
+
+   session->telnet_answered[which][option / 8] |= (1 << (option % 8));
+
+   reply[0] = IAC;
+   reply[1] = (command == DO) ? WONT :
+              (((option == TELOPT_ECHO) || (option == TELOPT_SGA)) ? DO : DONT);
+   reply[2] = option;
+
+   a_collector_write(session, (char *)reply, 3);
+}
+
+
+int a_collector_telnet_read
+(collector_session_t *session)
+/*
+*
+* read from the telnet connection, strip telnet commands, add the rest to the
+* screen buffer. returns 1 if the connection is still open, 0 if the device closed
+* it, -1 on error.
+*
+*/
+{
+   unsigned char buffer[COLLECTOR_READ_LEN];
+   char data[COLLECTOR_READ_LEN];
+   size_t data_len = 0;
+   ssize_t readed, i;
+   unsigned char c;
+
+   if( (readed = read(session->fd, buffer, sizeof(buffer))) == 0 )
+    return 0;
+
+   if(readed == -1)
+    return ((errno == EAGAIN) || (errno == EINTR)) ? 1 : -1;
+
+   for(i = 0; i < readed; i++)
+    {
+     c = buffer[i];
+
+     switch(session->telnet_state)
+      {
+       case TS_DATA:
+        if(c == IAC)
+         session->telnet_state = TS_IAC;
+        else if(c != 0x0)            /* NUL after CR */
+         data[data_len++] = c;
+        break;
+
+       case TS_IAC:
+        if(c == IAC)
+         {
+          data[data_len++] = c;
+          session->telnet_state = TS_DATA;
+         }
+        else if((c == WILL) || (c == WONT) || (c == DO) || (c == DONT))
+         {
+          session->telnet_command = c;
+          session->telnet_state = TS_OPTION;
+         }
+        else if(c == SB)
+         session->telnet_state = TS_SB;
+        else
+         session->telnet_state = TS_DATA;     /* NOP, GA and such */
+        break;
+
+       case TS_OPTION:
+        a_collector_telnet_answer(session, session->telnet_command, c);
+        session->telnet_state = TS_DATA;
+        break;
+
+       case TS_SB:
+        if(c == IAC)
+         session->telnet_state = TS_SB_IAC;
+        break;
+
+       case TS_SB_IAC:
+        session->telnet_state = (c == SE) ? TS_DATA : TS_SB;
+        break;
+      }
+    }
+
+   if(data_len > 0)
+    if(!a_config_buffer_append(&session->screen, data, data_len))
+     return -1;
+
+   return 1;
+}
+
+
+#ifdef HAVE_LIBSSH
+
+int a_collector_ssh_read
+(collector_session_t *session)
+/*
+*
+* read what the ssh channel has for us. returns as a_collector_telnet_read.
+*
+*/
+{
+   char buffer[COLLECTOR_READ_LEN];
+   int readed;
+
+   while( (readed = ssh_channel_read_nonblocking((ssh_channel)session->channel, buffer, sizeof(buffer), 0)) > 0 )
+    if(!a_config_buffer_append(&session->screen, buffer, readed))
+     return -1;
+
+   if(readed == SSH_ERROR)
+    return -1;
+
+   if(ssh_channel_is_eof((ssh_channel)session->channel))
+    return 0;
+
+   return 1;
+}
+
+
+int a_collector_ssh_setup
+(collector_session_t *session)
+/*
+*
+* ssh handshake, authentication (password, then keyboard-interactive), shell
+* channel with a pty - as far as it goes without blocking. returns 1 when the
+* shell is open, 0 if we have to wait for the device (or the session failed).
+*
+*/
+{
+   ssh_session ssh = (ssh_session)session->ssh;
+   int rc, i, prompts;
+
+   for(;;)
+    switch(session->state)
+     {
+      case CS_SSH_HANDSHAKE:
+       if( (rc = ssh_connect(ssh)) == SSH_AGAIN )
+        return 0;
+
+       if(rc != SSH_OK)
+        {
+         a_debug_info2(DEBUGLVL3,"a_collector_ssh_setup: %s: %s",session->hostname,ssh_get_error(ssh));
+         a_collector_finish(session, -1, "ssh handshake failed");
+         return 0;
+        }
+
+       switch(ssh_session_is_known_server(ssh))
+        {
+         case SSH_KNOWN_HOSTS_OK:
+          break;
+         case SSH_KNOWN_HOSTS_UNKNOWN:
+         case SSH_KNOWN_HOSTS_NOT_FOUND:
+          /* first contact - expect helpers answer "yes" here too */
+          a_logmsg("%s: new ssh host key - added to known hosts.",session->hostname);
+          ssh_session_update_known_hosts(ssh);
+          break;
+         default:
+          a_collector_finish(session, -1, "ssh host key changed or cannot be checked");
+          return 0;
+        }
+
+       session->state = CS_SSH_AUTH;
+       break;
+
+      case CS_SSH_AUTH:
+       if( (rc = ssh_userauth_password(ssh, NULL, session->password)) == SSH_AUTH_AGAIN )
+        return 0;
+
+       if(rc == SSH_AUTH_SUCCESS)
+        session->state = CS_SSH_CHANNEL;
+       else if(rc == SSH_AUTH_ERROR)
+        {
+         a_collector_finish(session, -1, "ssh authentication failed");
+         return 0;
+        }
+       else
+        session->state = CS_SSH_KBDINT;     /* many devices take keyboard-interactive only */
+       break;
+
+      case CS_SSH_KBDINT:
+       if( (rc = ssh_userauth_kbdint(ssh, NULL, NULL)) == SSH_AUTH_AGAIN )
+        return 0;
+
+       if(rc == SSH_AUTH_SUCCESS)
+        session->state = CS_SSH_CHANNEL;
+       else if((rc == SSH_AUTH_INFO) && (session->logins++ < COLLECTOR_KBDINT_ROUNDS))
+        {
+         prompts = ssh_userauth_kbdint_getnprompts(ssh);
+
+         for(i = 0; i < prompts; i++)
+          ssh_userauth_kbdint_setanswer(ssh, i, session->password);
+        }
+       else
+        {
+         a_collector_finish(session, -1, "ssh authentication failed");
+         return 0;
+        }
+       break;
+
+      case CS_SSH_CHANNEL:
+       if(session->channel == NULL)
+        if( (session->channel = ssh_channel_new(ssh)) == NULL )
+         {
+          a_collector_finish(session, -1, "cannot open ssh channel");
+          return 0;
+         }
+
+       if( (rc = ssh_channel_open_session((ssh_channel)session->channel)) == SSH_AGAIN )
+        return 0;
+
+       if(rc != SSH_OK)
+        {
+         a_collector_finish(session, -1, "cannot open ssh channel");
+         return 0;
+        }
+
+       session->state = CS_SSH_PTY;
+       break;
+
+      case CS_SSH_PTY:
+       if( (rc = ssh_channel_request_pty_size((ssh_channel)session->channel, "vt100", 200, 24)) == SSH_AGAIN )
+        return 0;
+
+       if(rc != SSH_OK)
+        {
+         a_collector_finish(session, -1, "cannot get a terminal on the device");
+         return 0;
+        }
+
+       session->state = CS_SSH_SHELL;
+       break;
+
+      case CS_SSH_SHELL:
+       if( (rc = ssh_channel_request_shell((ssh_channel)session->channel)) == SSH_AGAIN )
+        return 0;
+
+       if(rc != SSH_OK)
+        {
+         a_collector_finish(session, -1, "cannot get a shell on the device");
+         return 0;
+        }
+
+       session->state = CS_LOGIN;   /* some devices ask for login again */
+       session->logins = 0;
+       return 1;
+
+      default:
+       return 1;
+     }
+}
+
+#endif
+
+
+void a_collector_connected
+(collector_session_t *session)
+/*
+*
+* non-blocking connect finished - check how, and start talking
+*
+*/
+{
+   socklen_t len = sizeof(int);
+   int error = 0;
+
+   if((getsockopt(session->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) || (error != 0))
+    {
+     a_debug_info2(DEBUGLVL5,"a_collector_connected: %s: connect failed (%d).",session->hostname,error);
+     a_collector_finish(session, -1, "cannot connect");
+     return;
+    }
+
+   if(session->method == COLLECTOR_TELNET)
+    {
+     session->state = CS_LOGIN;
+     return;
+    }
+
+#ifdef HAVE_LIBSSH
+   if( (session->ssh = ssh_new()) == NULL )
+    {
+     a_collector_finish(session, -1, "malloc failed");
+     return;
+    }
+
+   ssh_options_set((ssh_session)session->ssh, SSH_OPTIONS_HOST, session->hostname);  /* known hosts key */
+   ssh_options_set((ssh_session)session->ssh, SSH_OPTIONS_USER, session->login);
+   ssh_options_set((ssh_session)session->ssh, SSH_OPTIONS_FD, &session->fd);
+   ssh_set_blocking((ssh_session)session->ssh, 0);
+
+   session->state = CS_SSH_HANDSHAKE;
+   a_collector_ssh_setup(session);
+#endif
+}
+
+
+void a_collector_session_start
+(collector_session_t *session)
+/*
+*
+* start non-blocking connect to the device
+*
+*/
+{
+   session->started = session->last_data = time(NULL);
+   session->state = CS_CONNECT;
+
+   if( (session->fd = socket(session->addr.ss_family, SOCK_STREAM, 0)) == -1 )
+    {
+     a_collector_finish(session, -1, "cannot create socket");
+     return;
+    }
+
+   fcntl(session->fd, F_SETFL, fcntl(session->fd, F_GETFL) | O_NONBLOCK);
+   fcntl(session->fd, F_SETFD, FD_CLOEXEC);     /* helpers started by a_spawn must not get it */
+
+   if(connect(session->fd, (struct sockaddr *)&session->addr, session->addr_len) == 0)
+    a_collector_connected(session);
+   else if(errno != EINPROGRESS)
+    {
+     a_debug_info2(DEBUGLVL5,"a_collector_session_start: %s: connect failed (%d).",session->hostname,errno);
+     a_collector_finish(session, -1, "cannot connect");
+    }
+}
+
+
+void a_collector_step
+(collector_session_t *session)
+/*
+*
+* something happened on the session socket - move the session on
+*
+*/
+{
+   int open;
+
+   if(session->state == CS_CONNECT)
+    {
+     a_collector_connected(session);
+     return;
+    }
+
+#ifdef HAVE_LIBSSH
+   if((session->method == COLLECTOR_SSH) && (session->state < CS_LOGIN))
+    if(!a_collector_ssh_setup(session))
+     return;
+
+   if(session->method == COLLECTOR_SSH)
+    open = a_collector_ssh_read(session);
+   else
+#endif
+    open = a_collector_telnet_read(session);
+
+   if(session->state == CS_DONE)
+    return;
+
+   if(open == -1)
+    {
+     a_collector_finish(session, -1, "connection error");
+     return;
+    }
+
+   a_collector_dialogue(session);
+
+   if(!open)
+    a_collector_finish(session, -1, "connection closed by the device");
+}
+
+
+short a_collector_events
+(collector_session_t *session)
+{
+   if(session->state == CS_CONNECT)
+    return POLLOUT;
+
+#ifdef HAVE_LIBSSH
+   if((session->ssh != NULL) && (ssh_get_poll_flags((ssh_session)session->ssh) & SSH_WRITE_PENDING))
+    return POLLIN | POLLOUT;
+#endif
+
+   return POLLIN;
+}
+
+
+void a_collector_session_done
+(collector_session_t *session)
+/*
+*
+* give the finished session back to the worker waiting for it
+*
+*/
+{
+   pthread_mutex_lock(&session->mutex);
+   session->finished = 1;
+   pthread_cond_signal(&session->done);
+   pthread_mutex_unlock(&session->mutex);
+}
+
+
+void *a_collector_thread
+(void *arg)
+/*
+*
+* collector thread: all its sessions in one poll() loop
+*
+*/
+{
+   collector_t *collector = (collector_t *)arg;
+   collector_session_t *sessions = NULL, *incoming, *session, **link;
+   struct pollfd *pfds = NULL, *new_pfds;
+   int pfds_size = 0, nsessions = 0, i;
+   char drain[64];
+   time_t now;
+
+   for(;;)
+    {
+     pthread_mutex_lock(&collector->mutex);
+     incoming = collector->incoming;
+     collector->incoming = NULL;
+     pthread_mutex_unlock(&collector->mutex);
+
+     while( (session = incoming) != NULL )
+      {
+       incoming = session->next;
+       session->next = sessions;
+       sessions = session;
+       nsessions++;
+       a_collector_session_start(session);
+      }
+
+     if(pfds_size < nsessions + 1)
+      {
+       if( (new_pfds = realloc(pfds, (nsessions + 1) * sizeof(struct pollfd))) == NULL )
+        {
+         a_debug_info2(DEBUGLVL3,"a_collector_thread: malloc failed!");
+         sleep(1);
+         continue;
+        }
+
+       pfds = new_pfds;
+       pfds_size = nsessions + 1;
+      }
+
+     pfds[0].fd = collector->wakeup[0];
+     pfds[0].events = POLLIN;
+     pfds[0].revents = 0;
+
+     for(i = 1, session = sessions; session != NULL; session = session->next, i++)
+      {
+       pfds[i].fd = (session->state == CS_DONE) ? -1 : session->fd;   /* poll skips it */
+       pfds[i].events = a_collector_events(session);
+       pfds[i].revents = 0;
+      }
+
+     if(poll(pfds, nsessions + 1, sessions ? 1000 : -1) == -1)
+      if(errno != EINTR)
+       {
+        a_debug_info2(DEBUGLVL3,"a_collector_thread: poll failed (%d)!",errno);
+        sleep(1);
+       }
+
+     if(pfds[0].revents & POLLIN)
+      while(read(collector->wakeup[0], drain, sizeof(drain)) > 0);
+
+     now = time(NULL);
+
+     for(i = 1, session = sessions; session != NULL; session = session->next, i++)
+      {
+       if(session->state == CS_DONE)
+        continue;
+
+       if(pfds[i].revents)
+        {
+         session->last_data = now;
+         a_collector_step(session);
+        }
+
+       if(session->state == CS_DONE)
+        continue;
+
+       if(now - session->last_data >= G_config_info.collector_timeout)
+        a_collector_finish(session, -1, "timeout - device stopped responding");
+       else if((G_config_info.helper_timeout > 0) && (now - session->started >= G_config_info.helper_timeout))
+        a_collector_finish(session, -1, "timeout - HelperTimeout reached");
+      }
+
+     /* hand finished sessions back to their workers */
+
+     link = &sessions;
+
+     while( (session = *link) != NULL )
+      if(session->state == CS_DONE)
+       {
+        *link = session->next;
+        nsessions--;
+        a_collector_session_done(session);
+       }
+      else
+       link = &session->next;
+    }
+
+   return NULL;
+}
+
+
+int a_collector_start
+(int nthreads)
+/*
+*
+* start collector threads. returns number of started threads.
+*
+*/
+{
+   pthread_t thread;
+   pthread_attr_t thread_attr;
+   size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
+   int i;
+
+#ifdef HAVE_LIBSSH
+   ssh_init();
+#endif
+
+   if( (G_collectors = calloc(nthreads, sizeof(collector_t))) == NULL )
+    {
+     a_logmsg("FATAL: a_collector_start: malloc failed!");
+     return 0;
+    }
+
+   pthread_attr_init(&thread_attr);
+   pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+   pthread_attr_setstacksize(&thread_attr, stacksize);
+
+   for(i = 0; i < nthreads; i++)
+    {
+     pthread_mutex_init(&G_collectors[i].mutex, NULL);
+
+     if(pipe(G_collectors[i].wakeup) == -1)
+      break;
+
+     fcntl(G_collectors[i].wakeup[0], F_SETFL, O_NONBLOCK);
+     fcntl(G_collectors[i].wakeup[1], F_SETFL, O_NONBLOCK);
+     fcntl(G_collectors[i].wakeup[0], F_SETFD, FD_CLOEXEC);
+     fcntl(G_collectors[i].wakeup[1], F_SETFD, FD_CLOEXEC);
+
+     if(pthread_create(&thread, &thread_attr, a_collector_thread, (void *)&G_collectors[i]))
+      {
+       close(G_collectors[i].wakeup[0]);
+       close(G_collectors[i].wakeup[1]);
+       break;
+      }
+    }
+
+   pthread_attr_destroy(&thread_attr);
+
+   G_collector_count = i;     /* workers use the collector from now on */
+
+#ifdef HAVE_LIBSSH
+   a_logmsg("native collector: %d threads.",i);
+#else
+   a_logmsg("native collector: %d threads (telnet only - built without libssh).",i);
+#endif
+
+   if(i < nthreads)
+    a_logmsg("WARNING: cannot start all collector threads (%d)! expect helpers used if none.",errno);
+
+   return i;
+}
+
+
+int a_get_using_native
+(char *device_name, char *device_type, char *auth_set, char *arch_method, config_buffer_t *config)
+/*
+*
+* get device config through the collector threads (into the config buffer).
+* returns 1 on success, -1 on failure, 0 if the collector cannot talk to this
+* device (platform without dialogue, ssh1, ssh without libssh) - use expect then.
+*
+*/
+{
+   collector_session_t *session;
+   const collector_profile_t *profile;
+   auth_set_t *device_auth_set;
+   collector_t *collector;
+   struct addrinfo hints, *res = NULL;
+   struct stat script;
+   char port[16];
+   char script_path[MAXPATH];
+   char result_file[MAXPATH];
+   unsigned int pick = 0;
+   char *c;
+   int method, result;
+
+   if(G_collector_count == 0)
+    return 0;
+
+   if(!strcmp(arch_method,"telnet"))
+    method = COLLECTOR_TELNET;
+#ifdef HAVE_LIBSSH
+   else if(!strcmp(arch_method,"ssh") || !strcmp(arch_method,"ssh2"))
+    method = COLLECTOR_SSH;
+#endif
+   else
+    return 0;
+
+   if( (profile = a_collector_profile(device_type)) == NULL )
+    return 0;
+
+   if((device_auth_set = a_auth_set_search(G_auth_set_list,auth_set)) == NULL)
+    {
+     a_debug_info2(DEBUGLVL3,"a_get_using_native: auth set %s not found for device %s. not archiving!",
+                   auth_set,device_name);
+     return -1;
+    }
+
+   /* name is resolved here, in the worker - collector threads never block */
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = PF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+
+   snprintf(port,sizeof(port),"%d",(method == COLLECTOR_TELNET) ? G_config_info.telnet_port : G_config_info.ssh_port);
+
+   if((getaddrinfo(device_name, port, &hints, &res) != 0) || (res == NULL))
+    {
+     a_logmsg("%s: native collector: name is not resolving!",device_name);
+     return -1;
+    }
+
+   if( (session = calloc(1, sizeof(collector_session_t))) == NULL )
+    {
+     freeaddrinfo(res);
+     a_debug_info2(DEBUGLVL3,"a_get_using_native: malloc failed!");
+     return -1;
+    }
+
+   memcpy(&session->addr, res->ai_addr, res->ai_addrlen);
+   session->addr_len = res->ai_addrlen;
+   freeaddrinfo(res);
+
+   session->hostname = device_name;
+   session->method = method;
+   session->profile = profile;
+   session->login = device_auth_set->login;
+   session->password = device_auth_set->password1;
+   session->enable_password = (device_auth_set->password2 != NULL) ? device_auth_set->password2 :
+                                                                     device_auth_set->password1;
+   session->fd = -1;
+   session->config = config;
+   a_config_buffer_init(&session->screen);
+   pthread_mutex_init(&session->mutex, NULL);
+   pthread_cond_init(&session->done, NULL);
+
+   /* same device - same collector thread */
+
+   for(c = device_name; *c; c++)
+    pick = pick * 31 + (unsigned char)*c;
+
+   collector = &G_collectors[pick % G_collector_count];
+
+   pthread_mutex_lock(&collector->mutex);
+   session->next = collector->incoming;
+   collector->incoming = session;
+   pthread_mutex_unlock(&collector->mutex);
+
+   if(write(collector->wakeup[1], "x", 1) == -1)
+    a_debug_info2(DEBUGLVL5,"a_get_using_native: wakeup pipe full.");   /* collector is awake anyway */
+
+   pthread_mutex_lock(&session->mutex);
+
+   while(!session->finished)
+    pthread_cond_wait(&session->done, &session->mutex);
+
+   pthread_mutex_unlock(&session->mutex);
+
+   result = session->result;
+
+   if(result != 1)
+    a_logmsg("%s: native collector: %s!",device_name,session->error ? session->error : "failed");
+
+   a_config_buffer_free(&session->screen);
+   pthread_mutex_destroy(&session->mutex);
+   pthread_cond_destroy(&session->done);
+   free(session);
+
+   if(result != 1)
+    return -1;
+
+   /* platform post-processing script is optional here - as for expect helpers. it works on a file. */
+
+   snprintf(script_path,MAXPATH,"%s/%s.process.py",G_config_info.script_dir,device_type);
+
+   if((stat(script_path,&script) == 0) && (script.st_size > 0))
+    {
+     snprintf(result_file,MAXPATH,"%s.new",device_name);
+
+     if(!a_config_buffer_save(config,result_file) || (a_cleanup_config_file(result_file,device_type) == -1) ||
+        !a_config_buffer_load(config,result_file))
+      a_logmsg("%s: native collector: post-processing of config failed.",device_name);
+
+     remove(result_file);
+    }
+
+   if(config->len < MIN_WORKING_COPY_LEN)
+    {
+     a_logmsg("%s: native collector: device config is shorter than minimum expected size (%d bytes)!",
+              device_name,MIN_WORKING_COPY_LEN);
+     return -1;
+    }
+
+   return 1;
+}
+
+
+/* end of collector.c  */
@@ -0,0 +1,209 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    confbuf.c - downloaded device config kept in memory
+*
+*    config get method fills a config buffer, and the rest of the archive run
+*    (digest, diff, onboarding, svn backends) works on this buffer. helpers writing
+*    to a file (expect scripts, rancid, TFTP upload) are read once and the file is
+*    removed. with KeepDownloadedConfigs the buffer is also written to <hostname>.new
+*    in the working directory - for debugging only.
+*
+*/
+
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+void a_config_buffer_init
+(config_buffer_t *config)
+/*
+*
+* empty buffer, nothing allocated yet
+*
+*/
+{
+   config->data = NULL;
+   config->len = 0;
+   config->size = 0;
+}
+
+
+int a_config_buffer_reserve
+(config_buffer_t *config, size_t len)
+/*
+*
+* make room for len more bytes (and the terminating zero).
+* returns 1 on success, 0 on malloc failure.
+*
+*/
+{
+   size_t size;
+   char *data;
+
+   if(config->len + len < config->size)
+    return 1;
+
+   size = config->size ? config->size : CONFIG_BUFFER_INITIAL;
+
+   while(size <= config->len + len)
+    size *= 2;
+
+   if( (data = realloc(config->data, size)) == NULL )
+    return 0;
+
+   config->data = data;
+   config->size = size;
+   return 1;
+}
+
+
+int a_config_buffer_append
+(config_buffer_t *config, const char *data, size_t len)
+/*
+*
+* add downloaded bytes at the end of the buffer (data stays zero-terminated).
+* returns 1 on success, 0 on malloc failure.
+*
+*/
+{
+   if(!a_config_buffer_reserve(config, len))
+    return 0;
+
+   memcpy(config->data + config->len, data, len);
+   config->len += len;
+   config->data[config->len] = 0x0;
+   return 1;
+}
+
+
+int a_config_buffer_load
+(config_buffer_t *config, char *filename)
+/*
+*
+* read config written by a helper into the buffer (replacing its content), and
+* remove the file. returns 1 on success, 0 if the file cannot be read.
+*
+*/
+{
+   struct stat config_stat;
+   ssize_t readed = -1;
+   int config_fd;
+
+   if( (config_fd = open(filename, O_RDONLY)) == -1 )
+    return 0;
+
+   config->len = 0;
+
+   if((fstat(config_fd, &config_stat) == -1) || !a_config_buffer_reserve(config, config_stat.st_size))
+    {
+     close(config_fd);
+     return 0;
+    }
+
+   /* file size is only a hint - read until EOF */
+
+   for(;;)
+    {
+     if((config->len + 1 >= config->size) && !a_config_buffer_reserve(config, config->size))
+      break;
+
+     readed = read(config_fd, config->data + config->len, config->size - config->len - 1);
+
+     if(readed > 0)
+      config->len += readed;
+     else if((readed == -1) && (errno == EINTR))
+      continue;
+     else
+      break;
+    }
+
+   close(config_fd);
+
+   if(readed != 0)
+    {
+     a_debug_info2(DEBUGLVL5,"a_config_buffer_load: cannot read %s (%d)!",filename,errno);
+     return 0;
+    }
+
+   config->data[config->len] = 0x0;
+   remove(filename);
+
+   return 1;
+}
+
+
+int a_config_buffer_save
+(config_buffer_t *config, char *filename)
+/*
+*
+* write buffer content to a file (working copy, debug copy).
+* returns 1 on success, 0 on error.
+*
+*/
+{
+   size_t written = 0;
+   ssize_t result;
+   int config_fd;
+
+   if( (config_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1 )
+    {
+     a_debug_info2(DEBUGLVL5,"a_config_buffer_save: cannot open %s (%d)!",filename,errno);
+     return 0;
+    }
+
+   while(written < config->len)
+    {
+     if( (result = write(config_fd, config->data + written, config->len - written)) == -1 )
+      {
+       if(errno == EINTR)
+        continue;
+
+       a_debug_info2(DEBUGLVL5,"a_config_buffer_save: cannot write %s (%d)!",filename,errno);
+       close(config_fd);
+       return 0;
+      }
+
+     written += result;
+    }
+
+   if(close(config_fd) == -1)
+    return 0;
+
+   return 1;
+}
+
+
+void a_config_buffer_free
+(config_buffer_t *config)
+{
+   free(config->data);
+   a_config_buffer_init(config);
+}
+
+
+/* end of confbuf.c  */
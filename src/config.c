@@ -45,6 +45,24 @@ void a_load_config_defaults
 
   conf_struct->archiving_method = ARCHIVE_USING_INTERNAL;
 
+  conf_struct->wc_cache = DEFAULT_CONF_WC_CACHE;
+
+  conf_struct->svn_backend = DEFAULT_CONF_SVN_BACKEND;
+
+  conf_struct->skip_unchanged = DEFAULT_CONF_SKIP_UNCHANGED;
+
+  conf_struct->group_commit_window = DEFAULT_CONF_GROUP_COMMIT_WINDOW;
+  conf_struct->group_commit_files = DEFAULT_CONF_GROUP_COMMIT_FILES;
+  conf_struct->group_commit_per_group = DEFAULT_CONF_GROUP_COMMIT_PER_GROUP;
+  conf_struct->keep_downloaded_configs = DEFAULT_CONF_KEEP_DOWNLOADED;
+  conf_struct->helper_timeout = DEFAULT_CONF_HELPER_TIMEOUT;
+  conf_struct->collector_threads = DEFAULT_CONF_COLLECTOR_THREADS;
+  conf_struct->collector_timeout = DEFAULT_CONF_COLLECTOR_TIMEOUT;
+  conf_struct->telnet_port = DEFAULT_CONF_TELNET_PORT;
+  conf_struct->ssh_port = DEFAULT_CONF_SSH_PORT;
+  conf_struct->bulk_onboarding = DEFAULT_CONF_BULK_ONBOARDING;
+  conf_struct->onboarding_files = DEFAULT_CONF_ONBOARDING_FILES;
+
   strcpy(conf_struct->log_filename,DEFAULT_CONF_LOGFILENAME);
 
   conf_struct->tail_syslog = DEFAULT_CONF_TAIL_SYSLOG;
@@ -55,10 +73,25 @@ void a_load_config_defaults
 
   conf_struct->syslog_port = DEFAULT_CONF_SYSLOG_PORT;
 
+  conf_struct->syslog_rcvbuf = DEFAULT_CONF_SYSLOG_RCVBUF;
+
+  conf_struct->syslog_batch_size = DEFAULT_CONF_SYSLOG_BATCH;
+
+  conf_struct->syslog_receiver_threads = DEFAULT_CONF_SYSLOG_RECEIVERS;
+
+  conf_struct->resolver_threads = DEFAULT_CONF_RESOLVER_THREADS;
+
+  conf_struct->device_addr_refresh = DEFAULT_CONF_ADDR_REFRESH;
+
+  conf_struct->syslog_ptr_fallback = DEFAULT_CONF_PTR_FALLBACK;
+
   conf_struct->keep_changelog = DEFAULT_CONF_CHANGELOG;
 
   conf_struct->archiver_threads = NUM_ARCH_THREADS;
 
+  conf_struct->archiver_queue_len = DEFAULT_CONF_ARCHIVER_QUEUE;
+  conf_struct->archive_quiet_period = DEFAULT_CONF_QUIET_PERIOD;
+
   strcpy(conf_struct->changelog_filename,DEFAULT_CONF_CHANGELOG_FILENAME);
 
   strcpy(conf_struct->syslog_filename,DEFAULT_CONF_SYSLOG_FILENAME);
@@ -171,6 +204,14 @@ config_regexp_t *a_config_regexp_add
     return prev;
    }
 
+  if(regcomp(&workptr->compiled_regexp, regexp_string, REG_EXTENDED|REG_NOSUB) != 0)
+   {
+    a_debug_info2(DEBUGLVL3,"a_config_regexp_add: cannot compile regexp: \'%s\'!",regexp_string);
+    fprintf(stderr,"WARNING:ConfigRegexp \'%s\' is not a valid regular expression - ignored!\n",regexp_string);
+    free(workptr);
+    return prev;
+   }
+
   if( (workptr->config_regexp_string = malloc(strlen(regexp_string)+1)) == NULL)
    goto malloc_fail;
   if( (workptr->username_field_token = malloc(strlen(username_token)+1)) == NULL)
@@ -195,6 +236,50 @@ config_regexp_t *a_config_regexp_add
 
 }
 
+
+repo_route_t *a_repo_route_add
+(repo_route_t *prev, char *group_regexp, char *repository)
+/*
+* add an entry to global repository route list
+*/
+{
+  repo_route_t *workptr;
+
+  if((group_regexp == NULL) || (repository == NULL) || (strlen(repository) >= MAXPATH))
+   {
+    fprintf(stderr,"WARNING:incomplete RepositoryRoute entry found in config file!\n");
+    return prev;
+   }
+
+  if( (workptr = malloc(sizeof(repo_route_t))) == NULL)
+   goto malloc_fail;
+
+  if(regcomp(&workptr->compiled_regexp, group_regexp, REG_EXTENDED|REG_NOSUB) != 0)
+   {
+    fprintf(stderr,"WARNING:RepositoryRoute \'%s\' is not a valid regular expression - ignored!\n",group_regexp);
+    free(workptr);
+    return prev;
+   }
+
+  if( (workptr->group_regexp_string = strdup(group_regexp)) == NULL)
+   goto malloc_fail;
+  if( (workptr->repository_path = strdup(repository)) == NULL)
+   goto malloc_fail;
+
+  workptr->prev = prev;
+
+  a_debug_info2(DEBUGLVL3,"a_repo_route_add: device groups \'%s\' go to %s",
+                workptr->group_regexp_string,workptr->repository_path);
+
+  return workptr;
+
+  malloc_fail:
+   a_debug_info2(DEBUGLVL3,"a_repo_route_add: malloc failed!");
+   fprintf(stderr,"a_repo_route_add: malloc failed!\n");
+   return prev;
+
+}
+
 router_db_entry_t *a_router_db_list_add
 (router_db_entry_t *prev, char *data)
 /*
@@ -434,7 +519,8 @@ void a_load_and_parse_config_info
   if(strlen(archivist_config[4]) > 0)
    {
     if(strstr(archivist_config[4],"rancid")) conf_struct->archiving_method = ARCHIVE_USING_RANCID;
-    if(strstr(archivist_config[4],"internal")) conf_struct->archiving_method = ARCHIVE_USING_INTERNAL;
+    else if(strstr(archivist_config[4],"internal")) conf_struct->archiving_method = ARCHIVE_USING_INTERNAL;
+    else if(strstr(archivist_config[4],"native")) conf_struct->archiving_method = ARCHIVE_USING_NATIVE;
     else a_config_error("ArchivingMethod");
    }
   else a_config_error("ArchivingMethod");
@@ -503,7 +589,7 @@ void a_load_and_parse_config_info
 
   /* archiver thread count */
   tmp1 = atoi(archivist_config[18]);
-   if(( tmp1 > 0 || tmp1 < 256 )) conf_struct->archiver_threads = tmp1;
+   if(( tmp1 > 0 && tmp1 <= 256 )) conf_struct->archiver_threads = tmp1;
   else a_config_error("ArchiverThreads");
 
   /* command socket option */
@@ -715,17 +801,97 @@ void a_load_and_parse_config_info
            a_config_error("SyslogPort");
          }
 
+    if(a_regexp_match(conf_field,"^syslogrecvbuffer",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if(tmp1 >= 0)
+           conf_struct->syslog_rcvbuf = tmp1;
+          else
+           a_config_error("SyslogRecvBuffer");
+         }
+
+    if(a_regexp_match(conf_field,"^syslogbatchsize",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 <= MAX_SYSLOG_BATCH))
+           conf_struct->syslog_batch_size = tmp1;
+          else
+           a_config_error("SyslogBatchSize");
+         }
+
+    if(a_regexp_match(conf_field,"^syslogreceiverthreads",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 >= 0) && (tmp1 <= MAX_SYSLOG_RECEIVERS))
+           conf_struct->syslog_receiver_threads = tmp1;
+          else
+           a_config_error("SyslogReceiverThreads");
+         }
+
+    if(a_regexp_match(conf_field,"^resolverthreads",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 <= MAX_RESOLVER_THREADS))
+           conf_struct->resolver_threads = tmp1;
+          else
+           a_config_error("ResolverThreads");
+         }
+
+    if(a_regexp_match(conf_field,"^deviceaddressrefresh",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if(tmp1 >= 0)
+           conf_struct->device_addr_refresh = tmp1;
+          else
+           a_config_error("DeviceAddressRefresh");
+         }
+
+    if(a_regexp_match(conf_field,"^syslogptrfallback",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 == 0 || tmp1 == 1))
+           conf_struct->syslog_ptr_fallback = tmp1;
+          else
+           a_config_error("SyslogPTRFallback");
+         }
+
      if(a_regexp_match(conf_field,"^archiverthreads",REGCOMP_NOCASE))
          {
           conf_field = (char *)strtok(NULL, " ");
           tmp1 = atoi(conf_field);
           /* 256 concurrent single-device threads max. */
-          if((tmp1 > 0 || tmp1 < 256)) 
+          if((tmp1 > 0) && (tmp1 <= 256)) 
            conf_struct->archiver_threads = tmp1; 
           else
            a_config_error("ArchiverThreads");
          }
 
+    if(a_regexp_match(conf_field,"^archiverqueuelength",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if(tmp1 > 0)
+           conf_struct->archiver_queue_len = tmp1;
+          else
+           a_config_error("ArchiverQueueLength");
+         }
+
+    if(a_regexp_match(conf_field,"^archivequietperiod",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 >= 0) && (tmp1 <= 3600))
+           conf_struct->archive_quiet_period = tmp1;
+          else
+           a_config_error("ArchiveQuietPeriod");
+         }
+
     if(a_regexp_match(conf_field,"^rancidexecpath",REGCOMP_NOCASE))
          {
           conf_field = (char *)strtok(NULL, " ");
@@ -769,11 +935,158 @@ void a_load_and_parse_config_info
            {
             if(strstr(conf_field,"rancid")) conf_struct->archiving_method = ARCHIVE_USING_RANCID;
             else if(strstr(conf_field,"internal")) conf_struct->archiving_method = ARCHIVE_USING_INTERNAL;
+            else if(strstr(conf_field,"native")) conf_struct->archiving_method = ARCHIVE_USING_NATIVE;
             else a_config_error("TerminalArchivingMethod");
            }
           else a_config_error("TerminalArchivingMethod");
          }
 
+    if(a_regexp_match(conf_field,"^workingcopycache",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          if( (strlen(conf_field) > 0) && (strlen(conf_field) < MAXPATH) )
+           {
+            if(strstr(conf_field,"none")) conf_struct->wc_cache = WC_CACHE_NONE;
+            else if(strstr(conf_field,"group")) conf_struct->wc_cache = WC_CACHE_GROUP;
+            else if(strstr(conf_field,"device")) conf_struct->wc_cache = WC_CACHE_DEVICE;
+            else a_config_error("WorkingCopyCache");
+           }
+          else a_config_error("WorkingCopyCache");
+         }
+
+    if(a_regexp_match(conf_field,"^svnbackend",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          if( (strlen(conf_field) > 0) && (strlen(conf_field) < MAXPATH) )
+           {
+            if(strstr(conf_field,"client")) conf_struct->svn_backend = SVN_BACKEND_CLIENT;
+            else if(strstr(conf_field,"ra")) conf_struct->svn_backend = SVN_BACKEND_RA;
+            else if(strstr(conf_field,"fs")) conf_struct->svn_backend = SVN_BACKEND_FS;
+            else a_config_error("SVNBackend");
+           }
+          else a_config_error("SVNBackend");
+         }
+
+    if(a_regexp_match(conf_field,"^skipunchangedconfigs",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 == 0 || tmp1 == 1))
+           conf_struct->skip_unchanged = tmp1;
+          else
+           a_config_error("SkipUnchangedConfigs");
+         }
+
+    if(a_regexp_match(conf_field,"^groupcommitwindow",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 >= 0) && (tmp1 <= 3600))
+           conf_struct->group_commit_window = tmp1;
+          else
+           a_config_error("GroupCommitWindow");
+         }
+
+    if(a_regexp_match(conf_field,"^groupcommitmaxfiles",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 <= 10000))
+           conf_struct->group_commit_files = tmp1;
+          else
+           a_config_error("GroupCommitMaxFiles");
+         }
+
+    if(a_regexp_match(conf_field,"^groupcommitpergroup",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 == 0 || tmp1 == 1))
+           conf_struct->group_commit_per_group = tmp1;
+          else
+           a_config_error("GroupCommitPerGroup");
+         }
+
+    if(a_regexp_match(conf_field,"^collectorthreads",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 <= 64))
+           conf_struct->collector_threads = tmp1;
+          else
+           a_config_error("CollectorThreads");
+         }
+
+    if(a_regexp_match(conf_field,"^collectortimeout",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 <= 3600))
+           conf_struct->collector_timeout = tmp1;
+          else
+           a_config_error("CollectorTimeout");
+         }
+
+    if(a_regexp_match(conf_field,"^collectortelnetport",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 < 65536))
+           conf_struct->telnet_port = tmp1;
+          else
+           a_config_error("CollectorTelnetPort");
+         }
+
+    if(a_regexp_match(conf_field,"^collectorsshport",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 < 65536))
+           conf_struct->ssh_port = tmp1;
+          else
+           a_config_error("CollectorSSHPort");
+         }
+
+    if(a_regexp_match(conf_field,"^keepdownloadedconfigs",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 == 0 || tmp1 == 1)) 
+           conf_struct->keep_downloaded_configs = tmp1;
+          else 
+           a_config_error("KeepDownloadedConfigs");
+         }
+
+    if(a_regexp_match(conf_field,"^helpertimeout",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 >= 0) && (tmp1 <= 86400))
+           conf_struct->helper_timeout = tmp1;
+          else
+           a_config_error("HelperTimeout");
+         }
+
+    if(a_regexp_match(conf_field,"^bulkonboarding",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 == 0 || tmp1 == 1))
+           conf_struct->bulk_onboarding = tmp1;
+          else
+           a_config_error("BulkOnboarding");
+         }
+
+    if(a_regexp_match(conf_field,"^onboardingmaxfiles",REGCOMP_NOCASE))
+         {
+          conf_field = (char *)strtok(NULL, " ");
+          tmp1 = atoi(conf_field);
+          if((tmp1 > 0) && (tmp1 <= 100000))
+           conf_struct->onboarding_files = tmp1;
+          else
+           a_config_error("OnboardingMaxFiles");
+         }
+
     if(a_regexp_match(conf_field,"^internalscripts",REGCOMP_NOCASE))
         {
          conf_field = (char *)strtok(NULL, " ");
@@ -820,6 +1133,13 @@ void a_load_and_parse_config_info
          G_config_regexp_list = a_config_regexp_add(G_config_regexp_list,config_regexp_data);
         }
 
+    if(a_regexp_match(conf_field,"^repositoryroute",REGCOMP_NOCASE))
+        {
+         tmp = (char *)strtok(NULL, " ");
+         conf_field = (char *)strtok(NULL, " ");
+         G_repo_routes = a_repo_route_add(G_repo_routes,tmp,conf_field);
+        }
+
     if(a_regexp_match(conf_field,"^encryptedauthset",REGCOMP_NOCASE))
         {
          bzero(auth_set_data,255);
@@ -879,6 +1199,56 @@ void a_load_and_parse_config_info
 } 
 
 
+char *a_repo_route
+(char *device_group)
+/*
+*
+* repository of a device group - the first RepositoryRoute (in config file order)
+* with regexp matching the group, RepositoryPath if there is none. 
+*
+*/
+{
+  repo_route_t *route;
+  char *repository = G_config_info.repository_path;
+
+  if(strstr(device_group,"none"))
+   return repository;
+
+  for(route = G_repo_routes; route != NULL; route = route->prev)   /* list is in reverse order */
+   if(regexec(&route->compiled_regexp, device_group, 0, NULL, 0) == 0)
+    repository = route->repository_path;
+
+  return repository;
+}
+
+
+int a_repositories
+(char **repositories, int max)
+/*
+*
+* all configured repositories, each once - RepositoryPath first. returns their number.
+*
+*/
+{
+  repo_route_t *route;
+  int count = 0, i;
+
+  repositories[count++] = G_config_info.repository_path;
+
+  for(route = G_repo_routes; route != NULL; route = route->prev)
+   {
+    for(i = 0; i < count; i++)
+     if(!strcmp(repositories[i], route->repository_path))
+      break;
+
+    if((i == count) && (count < max))
+     repositories[count++] = route->repository_path;
+   }
+
+  return count;
+}
+
+
 auth_set_t *a_auth_set_search
 (auth_set_t *auth_set_list_idx, char *setname)
 /*
@@ -921,11 +1291,15 @@ router_db_entry_t *a_router_db_search
 
    char *strstr_out;
 
-   tmp_pointer = router_db_idx;
-
    a_debug_info2(DEBUGLVL5,"a_router_db_search: linked list at 0x%p",router_db_idx);
 
-   if(strlen(hostname) > 0)  /* don't try to search for empty string */
+   if(strlen(hostname) == 0)  /* don't try to search for empty string */
+    return NULL;
+
+   if(G_router_db_index != NULL)
+    return a_router_db_index_lookup(hostname);
+
+   tmp_pointer = router_db_idx;
 
     while(tmp_pointer != NULL)
      {
@@ -994,6 +1368,17 @@ int a_is_archived_now
    router_db_entry_t *tmp_pointer;
    char *strstr_out;
 
+   if(G_router_db_index != NULL)
+    {
+     if( (tmp_pointer = a_router_db_index_lookup(hostname)) != NULL )
+      {
+       a_debug_info2(DEBUGLVL5,"a_is_archived_now: device %s, value: %d !",hostname,tmp_pointer->archived_now);
+       return tmp_pointer->archived_now;
+      }
+     a_debug_info2(DEBUGLVL5,"a_is_archived_now: device %s not found in router.db index!\n",hostname);
+     return 0;
+    }
+
    tmp_pointer = router_db_idx;
 
    while(tmp_pointer != NULL)
@@ -1054,6 +1439,14 @@ int a_set_archived
 #ifndef USE_MYSQL
    router_db_entry_t *tmp_pointer;
    char *strstr_out;
+
+   if(G_router_db_index != NULL)
+    {
+     if( (tmp_pointer = a_router_db_index_lookup(hostname)) == NULL )
+      return 0;
+     tmp_pointer->archived_now = arch_status;
+     return 1;
+    }
   
    tmp_pointer = router_db_idx;
 
@@ -1098,6 +1491,59 @@ int a_set_archived
 
 #ifndef USE_MYSQL
 
+hash_table_t *a_router_db_index_build
+(router_db_entry_t *router_db_idx)
+/*
+* build case-insensitive hostname index of router.db list. when a hostname is listed
+* more than once, the entry found first on the list wins - same as with the list walk.
+*/
+{
+   hash_table_t *index;
+   router_db_entry_t *tmp_pointer;
+   char *key;
+
+   if( (index = a_hash_create(G_router_db_entries * 2, YES)) == NULL )
+    {
+     a_debug_info2(DEBUGLVL3,"a_router_db_index_build: malloc failed - router.db will be searched sequentially!");
+     return NULL;
+    }
+
+   for(tmp_pointer = router_db_idx; tmp_pointer != NULL; tmp_pointer = tmp_pointer->prev)
+    {
+     key = a_trimwhitespace(tmp_pointer->hostname);
+
+     if(a_hash_get(index, key) != NULL)
+      {
+       a_debug_info2(DEBUGLVL5,"a_router_db_index_build: duplicate router.db entry for %s ignored.",key);
+       continue;
+      }
+
+     if(!a_hash_put(index, key, tmp_pointer))
+      {
+       a_debug_info2(DEBUGLVL3,"a_router_db_index_build: malloc failed - router.db will be searched sequentially!");
+       a_hash_free(index, NULL);
+       return NULL;
+      }
+    }
+
+   return index;
+}
+
+
+router_db_entry_t *a_router_db_index_lookup
+(char *hostname)
+/*
+* find router.db entry by hostname (case-insensitive, surrounding whitespace ignored)
+*/
+{
+   char key[MAXPATH];
+
+   snprintf(key, MAXPATH, "%s", hostname);   /* strncpy would zero-fill all of MAXPATH */
+
+   return (router_db_entry_t *)a_hash_get(G_router_db_index, a_trimwhitespace(key));
+}
+
+
 void a_router_db_free
 (router_db_entry_t *start)
 /*
@@ -1105,6 +1551,9 @@ void a_router_db_free
 */
 {
    router_db_entry_t *tmp_pointer,*freethis; 
+
+   a_hash_free(G_router_db_index, NULL);
+   G_router_db_index = NULL;
    
    tmp_pointer = start;
 
@@ -1158,6 +1607,8 @@ router_db_entry_t *a_load_router_db
    else
      a_debug_info2(DEBUGLVL5,"a_load_router_db: %d entries loaded from router.db",counter);
 
+   G_router_db_index = a_router_db_index_build(router_db_idx);
+
    return (router_db_entry_t *)router_db_idx;
 
 #else
@@ -23,6 +23,7 @@
 #include "Python.h"
 
 #include <pthread.h>
+#include <regex.h>
 
 #ifdef USE_MYSQL
 
@@ -32,8 +33,11 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <svn_pools.h>
 
 #define DEBUGLVL1 1
@@ -42,11 +46,11 @@
 #define DEBUGLVL4 4
 #define DEBUGLVL5 5
 
-#define FAST_DLY 200       /* main program loop delay in microseconds - fast mode */
-#define SLOW_DLY 1000000   /* main program loop delay in microseconds - slow mode */
+#define FAST_DLY 200       /* main program loop delay in microseconds - fast mode (polling loop only) */
+#define SLOW_DLY 1000000   /* main program loop delay in microseconds - slow mode (polling loop only) */
 #define MAX_CONF_LINES 256 /* max line count in the config file */
 
-#define NUM_ARCH_THREADS 20     /* concurrent single-device archiver threads */
+#define NUM_ARCH_THREADS 20     /* default number of archiver workers */
 #define MAX_CONCURRENT_BULK_THREADS 1
 
 #if defined(sun) || defined(__sun)
@@ -76,10 +80,198 @@
 
 #define ARCHIVE_USING_RANCID 1
 #define ARCHIVE_USING_INTERNAL 2
+#define ARCHIVE_USING_NATIVE 3     /* built-in telnet/ssh collector, expect helpers for the rest */
+
+/* working copies kept between archive runs: */
+
+#define WC_CACHE_NONE 0      /* fresh checkout for every run, removed afterwards */
+#define WC_CACHE_GROUP 1     /* one working copy per device group */
+#define WC_CACHE_DEVICE 2    /* one working copy per device */
+
+/* how device configs get to the repository: */
+
+#define SVN_BACKEND_CLIENT 0   /* svn client library and a working copy */
+#define SVN_BACKEND_RA 1       /* svn_ra commit editor, straight from memory (see svnra.c) */
+#define SVN_BACKEND_FS 2       /* svn_repos/svn_fs transactions on a local repository (see svnfs.c) */
+
+#define SPAWN_TIMEOUT -2       /* a_spawn: helper killed after HelperTimeout */
+#define SPAWN_OUTPUT_LEN 1024  /* last bytes of helper output kept for the log */
+
+#define REPO_PACK 1            /* repository maintenance jobs (see svnfs.c) */
+#define REPO_VERIFY 2
+#define REPO_MAINTENANCE_RETRY 60  /* postponed maintenance job is retried after that many seconds */
 
 #define REGCOMP_CASE 1
 #define REGCOMP_NOCASE 0
 
+#define REGEXP_CACHE_BUCKETS 64   /* compiled regexp cache used by a_regexp_match */
+#define REGEXP_CACHE_MAX 512      /* when the cache is full, patterns are compiled per call */
+
+/* compiled regexp cache entry */
+
+typedef struct { char *pattern;
+                 int case_sensitive;
+                 regex_t compiled;
+                 void *next;
+               } regexp_cache_entry_t;
+
+#define HASH_MIN_SIZE 64          /* initial bucket count of hash tables (see hash.c) */
+
+/* string keyed hash table */
+
+typedef struct { char *key;
+                 void *data;
+                 void *next;
+               } hash_entry_t;
+
+typedef struct { hash_entry_t **buckets;
+                 int size;
+                 int count;
+                 int nocase;               /* keys compared case-insensitive */
+               } hash_table_t;
+
+#define MAX_DEVICE_ADDRS 8        /* addresses of one device kept in the address map */
+#define PTR_CACHE_TTL 600         /* seconds a reverse lookup result for unknown syslog source is kept */
+#define PTR_CACHE_MAX 4096        /* reverse lookup cache is flushed when it grows beyond this */
+
+/* device hostname with its resolved addresses (see devmap.c) */
+
+typedef struct { char *hostname;
+                 struct in_addr addrs[MAX_DEVICE_ADDRS];
+                 int naddrs;
+               } device_addr_t;
+
+/* devices shared by resolver threads */
+
+typedef struct { device_addr_t *devices;
+                 int count;
+                 int next;                 /* next device to resolve (atomic) */
+               } device_resolve_job_t;
+
+/* cached reverse lookup result */
+
+typedef struct { char name[255];
+                 time_t expires;
+               } ptr_cache_entry_t;
+
+#define CONFIG_DIGEST_FILE ".config_digests"   /* + .<instance id>, in the working directory (see digest.c) */
+#define CONFIG_DIGEST_LEN 40                   /* SHA-1, hex */
+
+#define RA_SESSIONS_PER_WORKER 16   /* open svn_ra sessions kept by one archiver worker */
+#define MAX_REPOSITORIES 64         /* RepositoryPath and RepositoryRoute repositories */
+#define AUTH_BATONS_PER_WORKER 16   /* svn client auth batons (one per commit author) kept by one worker */
+
+#define RA_BATCH_AUTHOR "scheduled_archiving"   /* only runs of this author are group-committed */
+#define RA_BATCH_AUTHORS_PROP "archivist:authors" /* revision property: "<path> <author>" per line */
+#define RA_BATCH_SELECTED(item, repo, group) (!strcmp((item)->repository, (repo)) && \
+                                              (((group) == NULL) || !strcmp((item)->device_group, (group))))
+#define MANIFEST_AUTHOR "new_device_group"      /* author of device group commits */
+
+#define DIFF_CONTEXT_LINES 3   /* unified diffs written to the changelog */
+
+/* result of a config diff (see diff.c) */
+
+typedef struct { char *text;          /* unified diff, NULL if not asked for */
+                 size_t text_len;
+                 int added;           /* lines */
+                 int removed;
+               } config_diff_t;
+
+/* downloaded device config (see confbuf.c) */
+
+#define CONFIG_BUFFER_INITIAL 16384   /* bytes - grows by doubling */
+
+typedef struct { char *data;          /* zero-terminated, NULL until something is put in */
+                 size_t len;
+                 size_t size;         /* allocated */
+               } config_buffer_t;
+
+/* built-in telnet/ssh collector (see collector.c) */
+
+#define COLLECTOR_TELNET 1
+#define COLLECTOR_SSH 2
+
+#define COLLECTOR_PROMPT_LEN 128
+
+/* dialogue with a device platform - what the expect helper of the platform does */
+
+typedef struct { char *platform;             /* router.db device type */
+                 char *enable_command;       /* NULL - login lands in privileged mode */
+                 char *shell_command;        /* sent when login lands in a unix shell ('%' prompt) */
+                 char *pager_commands[3];    /* NULL terminated */
+                 char *config_command;
+               } collector_profile_t;
+
+/* one device download, driven by a collector thread */
+
+typedef struct collector_session_t { char *hostname;
+                 int method;                          /* COLLECTOR_TELNET or COLLECTOR_SSH */
+                 const collector_profile_t *profile;
+                 char *login;                         /* from the AuthSet of the device */
+                 char *password;
+                 char *enable_password;
+                 struct sockaddr_storage addr;
+                 socklen_t addr_len;
+                 int fd;
+                 void *ssh;                           /* ssh_session, ssh_channel (libssh) */
+                 void *channel;
+                 int state;
+                 int telnet_state;                    /* telnet command parser */
+                 unsigned char telnet_command;
+                 unsigned char telnet_answered[2][32]; /* options answered: DO, WILL (bitmaps) */
+                 int logins;                          /* passwords sent at login */
+                 int enables;                         /* enable commands sent */
+                 int enable_passwords;
+                 int shells;                          /* shell_command sent */
+                 int pager_next;
+                 size_t pager_erase;                  /* screen offset + 1 where the device erases its --More-- */
+                 config_buffer_t screen;              /* device output since the last command sent */
+                 char prompt[COLLECTOR_PROMPT_LEN];
+                 config_buffer_t *config;             /* downloaded config goes here */
+                 time_t started;
+                 time_t last_data;
+                 int result;                          /* 1 - config downloaded, -1 - failed */
+                 const char *error;
+                 int finished;
+                 pthread_mutex_t mutex;               /* worker waits for the session on done */
+                 pthread_cond_t done;
+                 struct collector_session_t *next;
+               } collector_session_t;
+
+typedef struct { pthread_mutex_t mutex;
+                 collector_session_t *incoming;       /* handed over by archiver workers */
+                 int wakeup[2];                       /* pipe - incoming is not empty */
+               } collector_t;
+
+/* changed device config waiting for a group commit (see svnra.c) */
+
+typedef struct ra_batch_item_t { char *device_group;
+                 char *repository;                    /* a_repo_route of the group - not freed */
+                 char *device_name;
+                 char *author;
+                 char digest[CONFIG_DIGEST_LEN + 1];  /* empty if not known */
+                 char *config;
+                 size_t config_len;
+                 int added;                           /* device was new to the repository */
+                 struct ra_batch_item_t *next;
+               } ra_batch_item_t;
+
+/* svn state kept by an archiver worker between archive runs (see svnra.c) */
+
+#define WORKER_POOL_MAX_FREE 4194304   /* bytes of freed memory kept by the allocator of a worker */
+
+typedef struct { apr_pool_t *pool;            /* lives as long as the worker (or APR reinit), own allocator */
+                 apr_pool_t *job_pool;        /* cleared for every archive run */
+                 apr_pool_t *iter_pool;       /* per-file work within a run */
+                 apr_pool_t *session_pool;    /* ra sessions, cleared when there are too many */
+                 unsigned int apr_generation; /* G_apr_generation the pool was created in */
+                 hash_table_t *ra_sessions;   /* repository + commit author -> svn_ra_session_t */
+                 hash_table_t *repos;         /* SVNBackend fs: repository path -> svn_repos_t opened by the worker */
+                 struct svn_client_ctx_t *client_ctx;  /* SVNBackend client: context for every run */
+                 apr_pool_t *auth_pool;       /* auth batons of client_ctx, cleared when too many */
+                 hash_table_t *auth_batons;   /* commit author -> svn_auth_baton_t */
+               } svn_worker_t;
+
 #ifndef nil
 
 #define nil ((void*)0)
@@ -94,6 +286,39 @@ pthread_mutex_t G_router_db_mutex;
 pthread_mutex_t G_embedded_running_mutex;
 pthread_mutex_t G_changelog_write_mutex;
 pthread_mutex_t G_SQL_query_mutex;
+pthread_mutex_t G_regexp_cache_mutex;
+pthread_mutex_t G_device_addr_mutex;
+pthread_mutex_t G_wc_locks_mutex;
+pthread_mutex_t G_config_digest_mutex;
+pthread_mutex_t G_repo_manifest_mutex;
+pthread_mutex_t G_onboard_mutex;
+pthread_mutex_t G_ra_batch_mutex;       /* held while a batch is being committed */
+pthread_cond_t G_ra_batch_cond;
+
+regexp_cache_entry_t *G_regexp_cache[REGEXP_CACHE_BUCKETS];
+int G_regexp_cache_entries;
+
+hash_table_t *G_router_db_index;       /* router.db hostname (case-insensitive) -> router_db_entry_t */
+hash_table_t *G_device_addr_map;       /* IP address -> router.db hostname */
+hash_table_t *G_ptr_cache;             /* IP address -> ptr_cache_entry_t */
+hash_table_t *G_config_digests;        /* router.db hostname -> digest of the config in the repository */
+hash_table_t *G_repo_manifest;          /* repository path of every device group and device config -> kind */
+hash_table_t *G_wc_locks;              /* working copy dirname -> pthread_mutex_t (WorkingCopyCache group) */
+hash_table_t *G_device_jobs;           /* device id -> device_job_t, guarded by archiver pool mutex */
+volatile int G_device_addr_refresh_now;
+FILE *G_config_digest_file;
+ra_batch_item_t *G_ra_batch;            /* changed configs waiting for a group commit */
+int G_ra_batch_count;
+time_t G_ra_batch_started;              /* when the first of them came */
+ra_batch_item_t *G_onboard_batch;       /* configs of new devices waiting for the onboarding commit */
+int G_onboard_count;
+volatile int G_onboarding;              /* onboarding bulk run in progress */
+volatile int G_repo_maintenance;        /* repo-pack or repo-verify job running */
+collector_t *G_collectors;              /* built-in collector threads (TerminalArchivingMethod native) */
+int G_collector_count;
+hash_table_t *G_verified_revs;          /* repository path -> last revision checked by repo-verify */
+int G_bulk_runs;                        /* bulk runs started since startup */
+unsigned long G_unchanged_configs;      /* syncs skipped because config digest didn't change */
 
 int G_stop_all_processing;
 int G_active_archiver_threads;
@@ -116,6 +341,8 @@ int G_mainloop_dly;
 
 apr_pool_t *G_svn_root_pool;
 apr_pool_t *G_apr_root_pool;
+volatile unsigned int G_apr_generation;   /* bumped on every APR reinit */
+pthread_key_t G_svn_worker_key;
 
 PyThreadState *G_py_main_thread_state;
 
@@ -128,8 +355,8 @@ MYSQL *G_db_connection;
 /* prototypes of pthread and signal callable routines: */
 
 extern void a_signal_cleanup(void);
-extern void *a_archive_single(void *arg);
 extern void *a_archive_bulk(void *arg);
+int a_archive_bulk_start(int onboarding);
 extern void a_apr_reinit(void);
 
 /* other prototypes */
@@ -142,6 +369,69 @@ char *a_config_regexp_match(char *syslog_buffer);
 void a_dump_memstats_solaris(void);
 void a_dump_memstats_freebsd(void);
 void a_dump_memstats_linux(void);
+void a_mainloop_run(void);
+hash_table_t *a_hash_create(int size, int nocase);
+void *a_hash_get(hash_table_t *table, const char *key);
+int a_hash_put(hash_table_t *table, const char *key, void *data);
+void *a_hash_remove(hash_table_t *table, const char *key);
+void a_hash_free(hash_table_t *table, void (*free_data)(void *));
+int a_device_addr_map_build(void);
+int a_device_addr_refresher_start(void);
+void a_device_addr_refresh_request(void);
+int a_svn_wc_update(char *device_name, char *repository_path, char *wc_dir, 
+                    apr_pool_t *apr_pool, apr_pool_t *svn_pool);
+int a_svn_wc_revert(char *device_name, char *wc_dir, apr_pool_t *apr_pool, apr_pool_t *svn_pool);
+pthread_mutex_t *a_svn_wc_lock(char *wc_dir);
+int a_svn_ra_init(void);
+svn_worker_t *a_svn_worker_get(void);
+apr_pool_t *a_svn_worker_job_pool(svn_worker_t *worker);
+struct svn_client_ctx_t *a_svn_client_ctx(char *author);
+struct svn_ra_session_t *a_svn_ra_session(svn_worker_t *worker, char *repository, char *author);
+void a_svn_ra_session_drop(svn_worker_t *worker, char *repository, char *author);
+char *a_repo_route(char *device_group);
+int a_repositories(char **repositories, int max);
+struct svn_error_t *a_svn_ra_commit_done(const struct svn_commit_info_t *commit_info, void *baton, apr_pool_t *pool);
+int a_svn_ra_sync(char *device_group, char *device_name, char *configured_by, config_buffer_t *config,
+                  char *config_digest);
+int a_svn_ra_batch_committer_start(void);
+int a_svn_fs_init(int open_repositories);
+int a_repo_maintenance_start(int job);
+int a_spawn(char *const argv[], int timeout, char *output, size_t output_len);
+int a_svn_fs_sync(char *device_group, char *device_name, char *configured_by, config_buffer_t *config);
+int a_repo_manifest_load(void);
+int a_repo_manifest_group(char *device_group);
+void a_repo_manifest_device(char *device_group, char *device_name);
+int a_repo_manifest_device_known(char *device_group, char *device_name);
+int a_svn_ra_onboard_add(char *device_group, char *device_name, char *author, char *config_digest,
+                         config_buffer_t *config);
+void a_svn_ra_onboard_drop(char *device_name);
+void a_svn_ra_onboard_flush(void);
+int a_config_digest_load(void);
+int a_config_digest_compute(config_buffer_t *config, char *digest);
+int a_config_digest_unchanged(char *hostname, char *digest);
+void a_config_digest_store(char *hostname, char *digest);
+void a_config_digest_stats_log(void);
+int a_config_diff(const char *old_config, size_t old_len, const char *new_config, size_t new_len,
+                  const char *old_label, const char *new_label, config_diff_t *diff);
+int a_config_diff_file(char *old_filename, config_buffer_t *config, const char *old_label, const char *new_label,
+                       config_diff_t *diff);
+void a_config_diff_free(config_diff_t *diff);
+void a_config_buffer_init(config_buffer_t *config);
+int a_config_buffer_append(config_buffer_t *config, const char *data, size_t len);
+int a_config_buffer_load(config_buffer_t *config, char *filename);
+int a_config_buffer_save(config_buffer_t *config, char *filename);
+void a_config_buffer_free(config_buffer_t *config);
+int a_get_from_device(char *device_name, char *device_type, char *device_auth_set_name, char *device_arch_method,
+                      config_buffer_t *config);
+int a_get_using_rancid(char *device_name, char *device_type, config_buffer_t *config);
+int a_get_using_expect(char *device_name, char *device_type, char *auth_set, char *arch_method,
+                       config_buffer_t *config);
+int a_get_using_snmp(char *device_name, char *device_type, char *device_auth_set_name, config_buffer_t *config);
+int a_cleanup_config_file(char *filename, char *platform_type);
+int a_collector_start(int nthreads);
+int a_get_using_native(char *device_name, char *device_type, char *auth_set, char *arch_method,
+                       config_buffer_t *config);
+int a_add_changelog_buffer(const char *diff_buffer, int diff_size, char *device_name, char *configured_by);
 
 /* define SUN_LEN for the systems which don't have it */
 
@@ -0,0 +1,403 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    devmap.c - IP address -> device map for syslog sources
+*
+*    all router.db hostnames are resolved (in parallel) when router.db is loaded and
+*    then every DeviceAddressRefresh seconds, into a map from IP address to router.db
+*    hostname. syslog source addresses are looked up in this map, so there is no DNS
+*    traffic on the syslog path. addresses not found in the map can optionally be
+*    reverse-resolved - results of these lookups are cached for PTR_CACHE_TTL seconds.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+
+int a_device_hostnames_snapshot
+(device_addr_t **devices)
+/*
+*
+* copy hostnames of all devices from router.db, so they can be resolved
+* without holding router.db lock. returns number of devices, -1 on error.
+*
+*/
+{
+   device_addr_t *list;
+   char *trimmed;
+   int count = 0, i;
+
+#ifndef USE_MYSQL
+
+   router_db_entry_t *tmp_pointer;
+
+   pthread_mutex_lock(&G_router_db_mutex);
+
+   for(tmp_pointer = G_router_db; tmp_pointer != NULL; tmp_pointer = tmp_pointer->prev)
+    count++;
+
+   if( (list = calloc(count ? count : 1, sizeof(device_addr_t))) == NULL )
+    {
+     pthread_mutex_unlock(&G_router_db_mutex);
+     return -1;
+    }
+
+   for(i = 0, tmp_pointer = G_router_db; tmp_pointer != NULL; tmp_pointer = tmp_pointer->prev, i++)
+    if( (list[i].hostname = strdup(tmp_pointer->hostname)) == NULL )
+     break;
+
+   pthread_mutex_unlock(&G_router_db_mutex);
+
+#else
+
+   MYSQL_RES *raw_sql_res;
+   MYSQL_ROW sql_res;
+
+   if( (raw_sql_res = a_mysql_select("select hostname from router_db")) == NULL )
+    return -1;
+
+   count = mysql_num_rows(raw_sql_res);
+
+   if( (list = calloc(count ? count : 1, sizeof(device_addr_t))) == NULL )
+    {
+     mysql_free_result(raw_sql_res);
+     return -1;
+    }
+
+   for(i = 0; (i < count) && ((sql_res = mysql_fetch_row(raw_sql_res)) != NULL); i++)
+    if( (list[i].hostname = strdup(sql_res[0])) == NULL )
+     break;
+
+   mysql_free_result(raw_sql_res);
+
+#endif
+
+   if(i < count)      /* strdup failed */
+    {
+     while(i > 0)
+      free(list[--i].hostname);
+     free(list);
+     return -1;
+    }
+
+   for(i = 0; i < count; i++)
+    {
+     trimmed = a_trimwhitespace(list[i].hostname);
+     memmove(list[i].hostname, trimmed, strlen(trimmed) + 1);
+    }
+
+   *devices = list;
+   return count;
+}
+
+
+void *a_device_resolver
+(void *arg)
+/*
+*
+* resolver thread: take next unresolved device from the job and resolve its
+* hostname to IPv4 addresses, until all devices are done.
+*
+*/
+{
+   device_resolve_job_t *job = (device_resolve_job_t *)arg;
+   device_addr_t *device;
+   struct addrinfo hints, *result, *ai;
+   int idx;
+
+   bzero(&hints, sizeof(hints));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_DGRAM;
+
+   while( (idx = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count )
+    {
+     device = &job->devices[idx];
+
+     if(getaddrinfo(device->hostname, NULL, &hints, &result) != 0)
+      continue;
+
+     for(ai = result; (ai != NULL) && (device->naddrs < MAX_DEVICE_ADDRS); ai = ai->ai_next)
+      device->addrs[device->naddrs++] = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+
+     freeaddrinfo(result);
+    }
+
+   return NULL;
+}
+
+
+int a_device_addr_map_build
+(void)
+/*
+*
+* resolve all router.db hostnames using ResolverThreads threads and replace
+* the address map with the result. returns number of addresses in the new map,
+* -1 on error (old map is kept then).
+*
+*/
+{
+   device_resolve_job_t job;
+   pthread_t *threads;
+   hash_table_t *map, *old_map;
+   char addr_str[INET_ADDRSTRLEN], *name;
+   int nthreads, started, unresolved = 0, i, j;
+
+   if( (job.count = a_device_hostnames_snapshot(&job.devices)) == -1 )
+    {
+     a_debug_info2(DEBUGLVL3,"a_device_addr_map_build: cannot read device list!");
+     return -1;
+    }
+
+   job.next = 0;
+
+   nthreads = G_config_info.resolver_threads;
+   if(nthreads > job.count)
+    nthreads = job.count;
+
+   if( (threads = malloc((nthreads ? nthreads : 1) * sizeof(pthread_t))) == NULL )
+    goto build_fail;
+
+   for(started = 0; started < nthreads; started++)
+    if(pthread_create(&threads[started], NULL, a_device_resolver, &job) != 0)
+     break;
+
+   if((started == 0) && (job.count > 0))
+    a_device_resolver(&job);       /* no threads - do it ourselves */
+
+   for(i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+   free(threads);
+
+   if( (map = a_hash_create(job.count * 2, NO)) == NULL )
+    goto build_fail;
+
+   for(i = 0; i < job.count; i++)
+    {
+     if(job.devices[i].naddrs == 0)
+      {
+       unresolved++;
+       a_debug_info2(DEBUGLVL5,"a_device_addr_map_build: cannot resolve %s!",job.devices[i].hostname);
+       continue;
+      }
+
+     for(j = 0; j < job.devices[i].naddrs; j++)
+      {
+       inet_ntop(AF_INET, &job.devices[i].addrs[j], addr_str, sizeof(addr_str));
+
+       if(a_hash_get(map, addr_str) != NULL)   /* first device listed for the address wins */
+        continue;
+
+       if( ((name = strdup(job.devices[i].hostname)) == NULL) || !a_hash_put(map, addr_str, name) )
+        {
+         free(name);
+         a_hash_free(map, free);
+         goto build_fail;
+        }
+      }
+    }
+
+   pthread_mutex_lock(&G_device_addr_mutex);
+   old_map = G_device_addr_map;
+   G_device_addr_map = map;
+   pthread_mutex_unlock(&G_device_addr_mutex);
+
+   a_hash_free(old_map, free);
+
+   if(unresolved)
+    a_logmsg("WARNING: %d of %d router.db hostnames could not be resolved.",unresolved,job.count);
+
+   a_debug_info2(DEBUGLVL3,"a_device_addr_map_build: %d devices, %d addresses mapped.",job.count,map->count);
+
+   for(i = 0; i < job.count; i++)
+    free(job.devices[i].hostname);
+   free(job.devices);
+
+   return map->count;
+
+ build_fail:
+   a_debug_info2(DEBUGLVL3,"a_device_addr_map_build: malloc failed!");
+   for(i = 0; i < job.count; i++)
+    free(job.devices[i].hostname);
+   free(job.devices);
+   return -1;
+}
+
+
+void a_device_addr_refresh_request
+(void)
+/*
+*
+* ask refresher thread to rebuild the address map as soon as possible
+* (router.db was re-read). safe to call from a signal handler.
+*
+*/
+{
+   G_device_addr_refresh_now = 1;
+}
+
+
+void *a_device_addr_refresher
+(void *arg)
+/*
+*
+* thread rebuilding the address map every DeviceAddressRefresh seconds,
+* or when asked by a_device_addr_refresh_request.
+*
+*/
+{
+   time_t next_refresh;
+
+   next_refresh = time(NULL) + G_config_info.device_addr_refresh;
+
+   while(!G_stop_all_processing)
+    {
+     sleep(1);
+
+     if(G_device_addr_refresh_now ||
+        ((G_config_info.device_addr_refresh > 0) && (time(NULL) >= next_refresh)))
+      {
+       G_device_addr_refresh_now = 0;
+       a_device_addr_map_build();
+       next_refresh = time(NULL) + G_config_info.device_addr_refresh;
+      }
+    }
+
+   return NULL;
+}
+
+
+int a_device_addr_refresher_start
+(void)
+{
+   pthread_t thread;
+   pthread_attr_t attr;
+
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+   if(pthread_create(&thread, &attr, a_device_addr_refresher, NULL) != 0)
+    {
+     a_logmsg("WARNING: cannot start device address refresher thread - addresses resolved at startup will be used.");
+     pthread_attr_destroy(&attr);
+     return 0;
+    }
+
+   pthread_attr_destroy(&attr);
+   return 1;
+}
+
+
+void a_device_name_by_addr
+(struct sockaddr_in *from, char *name, int namelen)
+/*
+*
+* translate syslog source address into router.db hostname using the address map.
+* unknown addresses are reverse-resolved (cached) if SyslogPTRFallback is on,
+* otherwise the address itself is returned.
+*
+*/
+{
+   ptr_cache_entry_t *cached;
+   char addr_str[INET_ADDRSTRLEN], *hostname;
+   time_t now;
+
+   inet_ntop(AF_INET, &from->sin_addr, addr_str, sizeof(addr_str));
+
+   pthread_mutex_lock(&G_device_addr_mutex);
+
+   if( (hostname = a_hash_get(G_device_addr_map, addr_str)) != NULL )
+    {
+     strncpy(name, hostname, namelen - 1);
+     name[namelen - 1] = 0x0;
+     pthread_mutex_unlock(&G_device_addr_mutex);
+     return;
+    }
+
+   if(!G_config_info.syslog_ptr_fallback)
+    {
+     pthread_mutex_unlock(&G_device_addr_mutex);
+     strncpy(name, addr_str, namelen - 1);
+     name[namelen - 1] = 0x0;
+     return;
+    }
+
+   now = time(NULL);
+
+   if( ((cached = a_hash_get(G_ptr_cache, addr_str)) != NULL) && (cached->expires > now) )
+    {
+     strncpy(name, cached->name, namelen - 1);
+     name[namelen - 1] = 0x0;
+     pthread_mutex_unlock(&G_device_addr_mutex);
+     return;
+    }
+
+   pthread_mutex_unlock(&G_device_addr_mutex);
+
+   /* not in the map - ask DNS (unlocked, this may take a while) */
+
+   if(getnameinfo((struct sockaddr *)from, sizeof(struct sockaddr_in), name, namelen, NULL, 0, 0) != 0)
+    {
+     strncpy(name, addr_str, namelen - 1);   /* no PTR record - cache the address itself */
+     name[namelen - 1] = 0x0;
+    }
+
+   pthread_mutex_lock(&G_device_addr_mutex);
+
+   if((G_ptr_cache == NULL) || (G_ptr_cache->count >= PTR_CACHE_MAX))
+    {
+     a_hash_free(G_ptr_cache, free);
+     G_ptr_cache = a_hash_create(PTR_CACHE_MAX, NO);
+    }
+
+   if(G_ptr_cache != NULL)
+    {
+     if( (cached = a_hash_get(G_ptr_cache, addr_str)) == NULL )
+      if( (cached = malloc(sizeof(ptr_cache_entry_t))) != NULL )
+       if(!a_hash_put(G_ptr_cache, addr_str, cached))
+        {
+         free(cached);
+         cached = NULL;
+        }
+
+     if(cached != NULL)
+      {
+       strncpy(cached->name, name, sizeof(cached->name) - 1);
+       cached->name[sizeof(cached->name) - 1] = 0x0;
+       cached->expires = now + PTR_CACHE_TTL;
+      }
+    }
+
+   pthread_mutex_unlock(&G_device_addr_mutex);
+}
+
+
+/* end of devmap.c  */
@@ -0,0 +1,969 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    dfa.c - union DFA matcher for ConfigRegexp entries
+*
+*    all ConfigRegexp patterns are parsed and compiled into one Thompson NFA, with
+*    a MATCH node per pattern. DFA states (sets of NFA nodes) are built lazily,
+*    on first use of a transition, and cached - so a syslog line is scanned once,
+*    one table lookup per byte, no matter how many patterns are configured.
+*
+*    only the POSIX extended regexp subset we can match exactly is supported
+*    (no back-references, GNU word boundaries etc.). if any pattern uses something
+*    else, the DFA is not built and matching falls back to regexec.
+*    DFA states are never freed - when MAX_DFA_STATES is reached, lines needing a new
+*    state are handed over to regexec as well.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#define NFA_SET 1
+#define NFA_SPLIT 2
+#define NFA_EPS 3
+#define NFA_BOL 4
+#define NFA_EOL 5
+#define NFA_MATCH 6
+
+#define AST_SET 1
+#define AST_CAT 2
+#define AST_ALT 3
+#define AST_REPEAT 4
+#define AST_BOL 5
+#define AST_EOL 6
+#define AST_EMPTY 7
+
+#define MAX_REGEXP_REPEAT 255
+
+/* parsed regexp */
+
+typedef struct { int type;
+                 int min, max;             /* AST_REPEAT, max == -1 - unbounded */
+                 unsigned char set[32];    /* AST_SET */
+                 void *left;
+                 void *right;
+               } regexp_ast_t;
+
+/* regexp parser state */
+
+typedef struct { const char *p;
+                 int depth;
+                 int error;
+               } regexp_parser_t;
+
+
+#define SET_ADD(set,c) ((set)[(unsigned char)(c) >> 3] |= (1 << ((unsigned char)(c) & 7)))
+#define SET_HAS(set,c) ((set)[(unsigned char)(c) >> 3] & (1 << ((unsigned char)(c) & 7)))
+
+
+regexp_ast_t *a_regexp_ast_new
+(regexp_parser_t *parser, int type, void *left, void *right)
+/*
+*
+* allocate parse tree node
+*
+*/
+{
+   regexp_ast_t *node;
+
+   if( (node = calloc(1, sizeof(regexp_ast_t))) == NULL )
+    {
+     parser->error = 1;
+     return NULL;
+    }
+
+   node->type = type;
+   node->left = left;
+   node->right = right;
+
+   return node;
+}
+
+
+void a_regexp_ast_free
+(regexp_ast_t *node)
+{
+   if(node == NULL)
+    return;
+
+   a_regexp_ast_free(node->left);
+   a_regexp_ast_free(node->right);
+   free(node);
+}
+
+
+int a_regexp_class_set
+(const char *name, int len, unsigned char *set)
+/*
+*
+* add members of POSIX character class [:name:] to set. returns 0 for unknown class.
+*
+*/
+{
+   int c, (*classfn)(int) = NULL;
+
+   if((len == 5) && !strncmp(name,"alpha",5)) classfn = isalpha;
+   else if((len == 5) && !strncmp(name,"digit",5)) classfn = isdigit;
+   else if((len == 5) && !strncmp(name,"alnum",5)) classfn = isalnum;
+   else if((len == 5) && !strncmp(name,"upper",5)) classfn = isupper;
+   else if((len == 5) && !strncmp(name,"lower",5)) classfn = islower;
+   else if((len == 5) && !strncmp(name,"space",5)) classfn = isspace;
+   else if((len == 5) && !strncmp(name,"punct",5)) classfn = ispunct;
+   else if((len == 5) && !strncmp(name,"print",5)) classfn = isprint;
+   else if((len == 5) && !strncmp(name,"graph",5)) classfn = isgraph;
+   else if((len == 5) && !strncmp(name,"cntrl",5)) classfn = iscntrl;
+   else if((len == 5) && !strncmp(name,"blank",5)) classfn = isblank;
+   else if((len == 6) && !strncmp(name,"xdigit",6)) classfn = isxdigit;
+
+   if(classfn == NULL)
+    return 0;
+
+   for(c = 1; c < 256; c++)
+    if(classfn(c))
+     SET_ADD(set,c);
+
+   return 1;
+}
+
+
+regexp_ast_t *a_regexp_parse_bracket
+(regexp_parser_t *parser)
+/*
+*
+* parse bracket expression. parser->p points just past '['.
+*
+*/
+{
+   regexp_ast_t *node;
+   const char *name;
+   int negate = 0, first = 1, c, lo, hi, i;
+
+   if( (node = a_regexp_ast_new(parser, AST_SET, NULL, NULL)) == NULL )
+    return NULL;
+
+   if(*parser->p == '^')
+    {
+     negate = 1;
+     parser->p++;
+    }
+
+   while(first || (*parser->p != ']'))
+    {
+     first = 0;
+
+     if(*parser->p == 0)
+      {
+       parser->error = 1;              /* unterminated bracket */
+       return node;
+      }
+
+     if((parser->p[0] == '[') && (parser->p[1] == ':'))
+      {
+       name = parser->p + 2;
+       if( (parser->p = strstr(name, ":]")) == NULL )
+        {
+         parser->error = 1;
+         return node;
+        }
+       if(!a_regexp_class_set(name, parser->p - name, node->set))
+        parser->error = 1;
+       parser->p += 2;
+       continue;
+      }
+
+     if((parser->p[0] == '[') && ((parser->p[1] == '.') || (parser->p[1] == '=')))
+      {
+       /* single character collating element / equivalence class only */
+       if(parser->p[2] && (parser->p[3] == parser->p[1]) && (parser->p[4] == ']'))
+        {
+         SET_ADD(node->set, parser->p[2]);
+         parser->p += 5;
+         continue;
+        }
+       parser->error = 1;
+       return node;
+      }
+
+     c = (unsigned char)*parser->p++;
+
+     if((parser->p[0] == '-') && parser->p[1] && (parser->p[1] != ']'))
+      {
+       if(parser->p[1] == '[')
+        {
+         parser->error = 1;            /* ranges ending with collating elements */
+         return node;
+        }
+       lo = c;
+       hi = (unsigned char)parser->p[1];
+       parser->p += 2;
+       if(lo > hi)
+        {
+         parser->error = 1;
+         return node;
+        }
+       for(i = lo; i <= hi; i++)
+        SET_ADD(node->set, i);
+       continue;
+      }
+
+     SET_ADD(node->set, c);
+    }
+
+   parser->p++;   /* ']' */
+
+   if(negate)
+    for(i = 0; i < 32; i++)
+     node->set[i] = ~node->set[i];
+
+   node->set[0] &= ~1;       /* NUL never appears in a C string */
+
+   return node;
+}
+
+
+regexp_ast_t *a_regexp_parse_alt(regexp_parser_t *parser);
+
+
+regexp_ast_t *a_regexp_parse_atom
+(regexp_parser_t *parser)
+/*
+*
+* parse single atom: literal, '.', bracket expression, group or anchor
+*
+*/
+{
+   regexp_ast_t *node;
+   int c;
+
+   switch(*parser->p)
+    {
+     case '(':
+      parser->p++;
+      parser->depth++;
+      node = a_regexp_parse_alt(parser);
+      if(*parser->p != ')')
+       parser->error = 1;
+      else
+       parser->p++;
+      parser->depth--;
+      return node;
+
+     case '[':
+      parser->p++;
+      return a_regexp_parse_bracket(parser);
+
+     case '^':
+      parser->p++;
+      return a_regexp_ast_new(parser, AST_BOL, NULL, NULL);
+
+     case '$':
+      parser->p++;
+      return a_regexp_ast_new(parser, AST_EOL, NULL, NULL);
+
+     case '.':
+      parser->p++;
+      if( (node = a_regexp_ast_new(parser, AST_SET, NULL, NULL)) != NULL )
+       {
+        memset(node->set, 0xff, sizeof(node->set));
+        node->set[0] &= ~1;
+       }
+      return node;
+
+     case '*':
+     case '+':
+     case '?':
+     case '{':
+      parser->error = 1;               /* quantifier without an atom - left to regexec */
+      return NULL;
+
+     case '\\':
+      parser->p++;
+      c = (unsigned char)*parser->p;
+      if(c == 0)
+       {
+        parser->error = 1;
+        return NULL;
+       }
+      parser->p++;
+      if( (node = a_regexp_ast_new(parser, AST_SET, NULL, NULL)) == NULL )
+       return NULL;
+      if(isalnum(c))
+       {
+        switch(c)
+         {
+          case 'w':
+          case 'W':
+           a_regexp_class_set("alnum", 5, node->set);
+           SET_ADD(node->set,'_');
+           break;
+          case 's':
+          case 'S':
+           a_regexp_class_set("space", 5, node->set);
+           break;
+          default:
+           parser->error = 1;          /* back-references, word boundaries... */
+           return node;
+         }
+        if(isupper(c))
+         {
+          for(c = 0; c < 32; c++)
+           node->set[c] = ~node->set[c];
+          node->set[0] &= ~1;
+         }
+       }
+      else
+       SET_ADD(node->set, c);
+      return node;
+
+     default:
+      if( (node = a_regexp_ast_new(parser, AST_SET, NULL, NULL)) != NULL )
+       SET_ADD(node->set, *parser->p);
+      parser->p++;
+      return node;
+    }
+}
+
+
+int a_regexp_ast_anchored
+(regexp_ast_t *node)
+/*
+*
+* 1 if there is '^' or '$' anywhere in the subtree
+*
+*/
+{
+   if(node == NULL)
+    return 0;
+
+   if((node->type == AST_BOL) || (node->type == AST_EOL))
+    return 1;
+
+   return a_regexp_ast_anchored(node->left) || a_regexp_ast_anchored(node->right);
+}
+
+
+regexp_ast_t *a_regexp_parse_repeat
+(regexp_parser_t *parser)
+/*
+*
+* parse atom with optional quantifiers: *, +, ?, {m}, {m,}, {m,n}
+*
+*/
+{
+   regexp_ast_t *node, *repeat;
+   int min, max;
+   char *endptr;
+
+   node = a_regexp_parse_atom(parser);
+
+   while(!parser->error && *parser->p && strchr("*+?{", *parser->p))
+    {
+     if(a_regexp_ast_anchored(node))
+      {
+       parser->error = 1;              /* regcomp reads "^*" as a literal '*', and regexec matches */
+       return node;                    /* anchors in repeated groups in its own way ("(^b)+c" matches "bbc") */
+      }
+     switch(*parser->p++)
+      {
+       case '*': min = 0; max = -1; break;
+       case '+': min = 1; max = -1; break;
+       case '?': min = 0; max = 1; break;
+       default:
+        if(!isdigit((unsigned char)*parser->p))
+         {
+          parser->error = 1;
+          return node;
+         }
+        min = max = strtol(parser->p, &endptr, 10);
+        parser->p = endptr;
+        if(*parser->p == ',')
+         {
+          parser->p++;
+          if(isdigit((unsigned char)*parser->p))
+           {
+            max = strtol(parser->p, &endptr, 10);
+            parser->p = endptr;
+           }
+          else
+           max = -1;
+         }
+        if((*parser->p != '}') || (min > MAX_REGEXP_REPEAT) || (max > MAX_REGEXP_REPEAT) ||
+           ((max != -1) && (max < min)))
+         {
+          parser->error = 1;
+          return node;
+         }
+        parser->p++;
+      }
+
+     if( (repeat = a_regexp_ast_new(parser, AST_REPEAT, node, NULL)) == NULL )
+      return node;
+     repeat->min = min;
+     repeat->max = max;
+     node = repeat;
+    }
+
+   return node;
+}
+
+
+regexp_ast_t *a_regexp_parse_cat
+(regexp_parser_t *parser)
+{
+   regexp_ast_t *node = NULL, *atom;
+
+   while(!parser->error && *parser->p && (*parser->p != '|') && ((*parser->p != ')') || (parser->depth == 0)))
+    {
+     if(*parser->p == ')')
+      {
+       parser->error = 1;              /* unmatched ')' */
+       break;
+      }
+     atom = a_regexp_parse_repeat(parser);
+     node = (node == NULL) ? atom : a_regexp_ast_new(parser, AST_CAT, node, atom);
+    }
+
+   if(node == NULL)
+    node = a_regexp_ast_new(parser, AST_EMPTY, NULL, NULL);
+
+   return node;
+}
+
+
+regexp_ast_t *a_regexp_parse_alt
+(regexp_parser_t *parser)
+{
+   regexp_ast_t *node;
+
+   node = a_regexp_parse_cat(parser);
+
+   while(!parser->error && (*parser->p == '|'))
+    {
+     parser->p++;
+     node = a_regexp_ast_new(parser, AST_ALT, node, a_regexp_parse_cat(parser));
+    }
+
+   return node;
+}
+
+
+int a_nfa_node_add
+(config_dfa_t *dfa, int type)
+/*
+*
+* append node to the NFA, return its index or -1
+*
+*/
+{
+   nfa_node_t *nodes;
+   int allocated;
+
+   if(dfa->nnodes >= MAX_NFA_NODES)
+    return -1;
+
+   if(dfa->nnodes == dfa->nodes_allocated)
+    {
+     allocated = dfa->nodes_allocated ? dfa->nodes_allocated * 2 : 256;
+     if( (nodes = realloc(dfa->nodes, allocated * sizeof(nfa_node_t))) == NULL )
+      return -1;
+     dfa->nodes = nodes;
+     dfa->nodes_allocated = allocated;
+    }
+
+   bzero(&dfa->nodes[dfa->nnodes], sizeof(nfa_node_t));
+   dfa->nodes[dfa->nnodes].type = type;
+   dfa->nodes[dfa->nnodes].out1 = -1;
+   dfa->nodes[dfa->nnodes].out2 = -1;
+
+   return dfa->nnodes++;
+}
+
+
+int a_nfa_compile
+(config_dfa_t *dfa, regexp_ast_t *node, int *end)
+/*
+*
+* compile parse tree into NFA fragment. returns fragment start node, *end is set to its
+* final NFA_EPS node (out1 still unconnected). returns -1 when NFA gets too big.
+* node indices are used everywhere, since dfa->nodes moves while we add nodes.
+*
+*/
+{
+   int start, left_end, right, right_end, split, tail, i, copy, copy_end;
+
+   switch(node->type)
+    {
+     case AST_SET:
+     case AST_BOL:
+     case AST_EOL:
+      if( (start = a_nfa_node_add(dfa, (node->type == AST_SET) ? NFA_SET :
+                                       (node->type == AST_BOL) ? NFA_BOL : NFA_EOL)) == -1 )
+       return -1;
+      if( (*end = a_nfa_node_add(dfa, NFA_EPS)) == -1 )
+       return -1;
+      memcpy(dfa->nodes[start].set, node->set, sizeof(node->set));
+      dfa->nodes[start].out1 = *end;
+      return start;
+
+     case AST_EMPTY:
+      if( (start = a_nfa_node_add(dfa, NFA_EPS)) == -1 )
+       return -1;
+      *end = start;
+      return start;
+
+     case AST_CAT:
+      if( (start = a_nfa_compile(dfa, node->left, &left_end)) == -1 )
+       return -1;
+      if( (right = a_nfa_compile(dfa, node->right, end)) == -1 )
+       return -1;
+      dfa->nodes[left_end].out1 = right;
+      return start;
+
+     case AST_ALT:
+      if( (split = a_nfa_node_add(dfa, NFA_SPLIT)) == -1 )
+       return -1;
+      if( (start = a_nfa_compile(dfa, node->left, &left_end)) == -1 )
+       return -1;
+      if( (right = a_nfa_compile(dfa, node->right, &right_end)) == -1 )
+       return -1;
+      if( (*end = a_nfa_node_add(dfa, NFA_EPS)) == -1 )
+       return -1;
+      dfa->nodes[split].out1 = start;
+      dfa->nodes[split].out2 = right;
+      dfa->nodes[left_end].out1 = *end;
+      dfa->nodes[right_end].out1 = *end;
+      return split;
+
+     case AST_REPEAT:
+      if( (start = a_nfa_node_add(dfa, NFA_EPS)) == -1 )
+       return -1;
+      tail = start;
+
+      for(i = 0; i < node->min; i++)                   /* mandatory copies */
+       {
+        if( (copy = a_nfa_compile(dfa, node->left, &copy_end)) == -1 )
+         return -1;
+        dfa->nodes[tail].out1 = copy;
+        tail = copy_end;
+       }
+
+      if(node->max == -1)                              /* loop */
+       {
+        if( (split = a_nfa_node_add(dfa, NFA_SPLIT)) == -1 )
+         return -1;
+        if( (copy = a_nfa_compile(dfa, node->left, &copy_end)) == -1 )
+         return -1;
+        if( (*end = a_nfa_node_add(dfa, NFA_EPS)) == -1 )
+         return -1;
+        dfa->nodes[tail].out1 = split;
+        dfa->nodes[split].out1 = copy;
+        dfa->nodes[split].out2 = *end;
+        dfa->nodes[copy_end].out1 = split;
+        return start;
+       }
+
+      for(; i < node->max; i++)                        /* optional copies */
+       {
+        if( (split = a_nfa_node_add(dfa, NFA_SPLIT)) == -1 )
+         return -1;
+        if( (copy = a_nfa_compile(dfa, node->left, &copy_end)) == -1 )
+         return -1;
+        if( (right_end = a_nfa_node_add(dfa, NFA_EPS)) == -1 )
+         return -1;
+        dfa->nodes[tail].out1 = split;
+        dfa->nodes[split].out1 = copy;
+        dfa->nodes[split].out2 = right_end;
+        dfa->nodes[copy_end].out1 = right_end;
+        tail = right_end;
+       }
+
+      *end = tail;
+      return start;
+    }
+
+   return -1;
+}
+
+
+int a_nfa_closure
+(config_dfa_t *dfa, int *seeds, int nseeds, int bol, int eol)
+/*
+*
+* epsilon closure of seed nodes. result (sorted set of NFA_SET, NFA_EOL and NFA_MATCH
+* nodes - the ones that matter for further matching) is left in dfa->scratch_set,
+* its size is returned. anchors are passed only when bol/eol is set.
+*
+*/
+{
+   int sp = 0, count = 0, i, j, node, tmp;
+
+   if(++dfa->mark_gen == 0)
+    {
+     bzero(dfa->scratch_mark, dfa->nnodes * sizeof(unsigned int));
+     dfa->mark_gen = 1;
+    }
+
+   for(i = 0; i < nseeds; i++)
+    if(dfa->scratch_mark[seeds[i]] != dfa->mark_gen)
+     {
+      dfa->scratch_mark[seeds[i]] = dfa->mark_gen;
+      dfa->scratch_stack[sp++] = seeds[i];
+     }
+
+   while(sp > 0)
+    {
+     node = dfa->scratch_stack[--sp];
+
+     switch(dfa->nodes[node].type)
+      {
+       case NFA_SET:
+       case NFA_MATCH:
+        dfa->scratch_set[count++] = node;
+        continue;
+
+       case NFA_BOL:
+        if(!bol)
+         continue;
+        break;
+
+       case NFA_EOL:
+        if(!eol)
+         {
+          dfa->scratch_set[count++] = node;
+          continue;
+         }
+        break;
+      }
+
+     for(i = 0; i < 2; i++)
+      {
+       tmp = i ? dfa->nodes[node].out2 : dfa->nodes[node].out1;
+       if((tmp != -1) && (dfa->scratch_mark[tmp] != dfa->mark_gen))
+        {
+         dfa->scratch_mark[tmp] = dfa->mark_gen;
+         dfa->scratch_stack[sp++] = tmp;
+        }
+      }
+    }
+
+   for(i = 1; i < count; i++)      /* insertion sort - sets are small */
+    {
+     tmp = dfa->scratch_set[i];
+     for(j = i - 1; (j >= 0) && (dfa->scratch_set[j] > tmp); j--)
+      dfa->scratch_set[j + 1] = dfa->scratch_set[j];
+     dfa->scratch_set[j + 1] = tmp;
+    }
+
+   return count;
+}
+
+
+int a_nfa_set_accept
+(config_dfa_t *dfa, int *set, int count)
+/*
+*
+* lowest pattern index among NFA_MATCH nodes of the set, -1 if none
+*
+*/
+{
+   int i, accept = -1;
+
+   for(i = 0; i < count; i++)
+    if(dfa->nodes[set[i]].type == NFA_MATCH)
+     if((accept == -1) || (dfa->nodes[set[i]].pattern < accept))
+      accept = dfa->nodes[set[i]].pattern;
+
+   return accept;
+}
+
+
+int a_dfa_state_add
+(config_dfa_t *dfa, int count, int initial)
+/*
+*
+* find or create DFA state for NFA node set in dfa->scratch_set.
+* returns state index or -1 if the state cache is full. called with dfa->mutex held
+* (or before the DFA is published).
+*
+*/
+{
+   dfa_state_t *state;
+   unsigned int hash = 5381;
+   int i, eol_seeds, *seeds;
+
+   for(i = 0; i < count; i++)
+    hash = ((hash << 5) + hash) + dfa->scratch_set[i];
+   hash %= DFA_HASH_BUCKETS;
+
+   if(!initial)
+    for(state = dfa->hash[hash]; state != NULL; state = state->hash_next)
+     if((state->nfa_count == count) && !memcmp(state->nfa_states, dfa->scratch_set, count * sizeof(int)))
+      return state->id;
+
+   if(dfa->nstates >= MAX_DFA_STATES)
+    return -1;
+
+   if( (state = malloc(sizeof(dfa_state_t))) == NULL )
+    return -1;
+
+   if( (state->nfa_states = malloc((count ? count : 1) * sizeof(int))) == NULL )
+    {
+     free(state);
+     return -1;
+    }
+
+   for(i = 0; i < 256; i++)
+    state->next[i] = -1;
+
+   memcpy(state->nfa_states, dfa->scratch_set, count * sizeof(int));
+   state->nfa_count = count;
+   state->accept = a_nfa_set_accept(dfa, state->nfa_states, count);
+
+   /* what would match if the input ended here - pass the pending '$' anchors */
+
+   if( (seeds = malloc((count ? count : 1) * sizeof(int))) == NULL )
+    {
+     free(state->nfa_states);
+     free(state);
+     return -1;
+    }
+
+   for(i = 0, eol_seeds = 0; i < count; i++)
+    if(dfa->nodes[state->nfa_states[i]].type == NFA_EOL)
+     seeds[eol_seeds++] = state->nfa_states[i];
+
+   state->eol_accept = -1;
+   if(eol_seeds)
+    state->eol_accept = a_nfa_set_accept(dfa, dfa->scratch_set,
+                                         a_nfa_closure(dfa, seeds, eol_seeds, initial, 1));
+   free(seeds);
+
+   if(!initial)       /* initial state is never looked up - its closure passed '^' */
+    {
+     state->hash_next = dfa->hash[hash];
+     dfa->hash[hash] = state;
+    }
+   else
+    state->hash_next = NULL;
+
+   state->id = dfa->nstates;
+   dfa->states[dfa->nstates] = state;
+
+   return dfa->nstates++;
+}
+
+
+int a_dfa_step
+(config_dfa_t *dfa, int from, unsigned char c)
+/*
+*
+* compute transition of DFA state 'from' on byte c. every position is also a possible
+* start of a match (regexec searches, it doesn't anchor), so the NFA start node
+* is always added to the seeds. returns state index or -1 if the cache is full.
+*
+*/
+{
+   dfa_state_t *state = dfa->states[from];
+   int i, nseeds = 0, next, *seeds;
+
+   /* closure uses the first nnodes entries of scratch_stack as its stack */
+
+   seeds = dfa->scratch_stack + dfa->nnodes;
+
+   for(i = 0; i < state->nfa_count; i++)
+    if((dfa->nodes[state->nfa_states[i]].type == NFA_SET) && SET_HAS(dfa->nodes[state->nfa_states[i]].set, c))
+     seeds[nseeds++] = dfa->nodes[state->nfa_states[i]].out1;
+
+   seeds[nseeds++] = dfa->start;
+
+   if( (next = a_dfa_state_add(dfa, a_nfa_closure(dfa, seeds, nseeds, 0, 0), 0)) == -1 )
+    return -1;
+
+   __atomic_store_n(&state->next[c], next, __ATOMIC_RELEASE);
+
+   return next;
+}
+
+
+config_dfa_t *a_config_dfa_build
+(config_regexp_t *config_regexp_list)
+/*
+*
+* build the NFA of all ConfigRegexp entries and the initial DFA state.
+* pattern index follows list order, so on multiple matches we report the
+* same entry the regexec loop in a_config_regexp_match would.
+* returns NULL if some pattern cannot be handled here.
+*
+*/
+{
+   config_dfa_t *dfa;
+   config_regexp_t *workptr;
+   regexp_parser_t parser;
+   regexp_ast_t *ast;
+   int i, start, end, match, split, prev_start = -1;
+
+   if(config_regexp_list == NULL)
+    return NULL;
+
+   if( (dfa = calloc(1, sizeof(config_dfa_t))) == NULL )
+    goto malloc_fail;
+
+   for(workptr = config_regexp_list; workptr != NULL; workptr = workptr->prev)
+    dfa->npatterns++;
+
+   if( (dfa->patterns = malloc(dfa->npatterns * sizeof(config_regexp_t *))) == NULL )
+    goto malloc_fail;
+
+   for(i = 0, workptr = config_regexp_list; workptr != NULL; workptr = workptr->prev, i++)
+    {
+     dfa->patterns[i] = workptr;
+
+     bzero(&parser, sizeof(parser));
+     parser.p = workptr->config_regexp_string;
+
+     ast = a_regexp_parse_alt(&parser);
+
+     if(parser.error || (*parser.p != 0) || (ast == NULL))
+      {
+       a_debug_info2(DEBUGLVL3,"a_config_dfa_build: ConfigRegexp \'%s\' not supported by DFA matcher - using regexec.",
+                     workptr->config_regexp_string);
+       a_regexp_ast_free(ast);
+       goto build_fail;
+      }
+
+     start = a_nfa_compile(dfa, ast, &end);
+     a_regexp_ast_free(ast);
+
+     if((start == -1) || ((match = a_nfa_node_add(dfa, NFA_MATCH)) == -1))
+      {
+       a_debug_info2(DEBUGLVL3,"a_config_dfa_build: ConfigRegexp NFA too big - using regexec.");
+       goto build_fail;
+      }
+
+     dfa->nodes[match].pattern = i;
+     dfa->nodes[end].out1 = match;
+
+     /* join with previous patterns */
+
+     if(prev_start == -1)
+      prev_start = start;
+     else
+      {
+       if( (split = a_nfa_node_add(dfa, NFA_SPLIT)) == -1 )
+        goto build_fail;
+       dfa->nodes[split].out1 = start;
+       dfa->nodes[split].out2 = prev_start;
+       prev_start = split;
+      }
+    }
+
+   dfa->start = prev_start;
+
+   /* scratch_stack holds closure stack plus step seeds, hence twice the node count */
+
+   dfa->scratch_stack = malloc(2 * dfa->nnodes * sizeof(int) + sizeof(int));
+   dfa->scratch_set = malloc(dfa->nnodes * sizeof(int) + sizeof(int));
+   dfa->scratch_mark = calloc(dfa->nnodes, sizeof(unsigned int));
+
+   if((dfa->scratch_stack == NULL) || (dfa->scratch_set == NULL) || (dfa->scratch_mark == NULL))
+    goto malloc_fail;
+
+   pthread_mutex_init(&dfa->mutex, NULL);
+
+   /* state 0 - start of the line */
+
+   if(a_dfa_state_add(dfa, a_nfa_closure(dfa, &dfa->start, 1, 1, 0), 1) != 0)
+    goto malloc_fail;
+
+   a_debug_info2(DEBUGLVL3,"a_config_dfa_build: %d patterns, %d NFA nodes.",dfa->npatterns,dfa->nnodes);
+
+   return dfa;
+
+ malloc_fail:
+   a_debug_info2(DEBUGLVL3,"a_config_dfa_build: malloc failed!");
+
+ build_fail:
+   if(dfa != NULL)
+    {
+     free(dfa->nodes);
+     free(dfa->patterns);
+     free(dfa->scratch_stack);
+     free(dfa->scratch_set);
+     free(dfa->scratch_mark);
+     free(dfa);
+    }
+   return NULL;
+}
+
+
+int a_config_dfa_match
+(config_dfa_t *dfa, const char *buffer)
+/*
+*
+* scan buffer once. returns index (in dfa->patterns) of the matching ConfigRegexp,
+* -1 if nothing matches, -2 if the DFA state cache is full and the line has
+* to be matched with regexec. safe to call from many threads: known transitions
+* are read without locking, new states are built under dfa->mutex.
+*
+*/
+{
+   const unsigned char *p = (const unsigned char *)buffer;
+   dfa_state_t *state;
+   int current = 0, next, best = INT_MAX;
+
+   state = dfa->states[0];
+   if(state->accept != -1)
+    best = state->accept;
+
+   while(*p && (best != 0))
+    {
+     if( (next = __atomic_load_n(&state->next[*p], __ATOMIC_ACQUIRE)) == -1 )
+      {
+       pthread_mutex_lock(&dfa->mutex);
+       if( (next = state->next[*p]) == -1 )
+        next = a_dfa_step(dfa, current, *p);
+       pthread_mutex_unlock(&dfa->mutex);
+
+       if(next == -1)
+        return -2;
+      }
+
+     current = next;
+     state = dfa->states[current];
+     p++;
+
+     if((state->accept != -1) && (state->accept < best))
+      best = state->accept;
+    }
+
+   if((*p == 0) && (state->eol_accept != -1) && (state->eol_accept < best))
+    best = state->eol_accept;
+
+   return (best == INT_MAX) ? -1 : best;
+}
+
+
+/* end of dfa.c  */
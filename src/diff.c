@@ -0,0 +1,571 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    diff.c - line diff of two configs held in memory
+*
+*    every line gets a number identifying its text (same text - same number), and
+*    lines which exist only in one of the configs are marked changed right away.
+*    remaining lines are compared with Myers' O(ND) algorithm (linear space version,
+*    searching for the middle snake), like GNU diff does. the result - decision,
+*    counts of added and removed lines, and unified diff text - comes in one pass.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+
+typedef struct { const char *text;
+                 size_t len;
+                 unsigned int hash;
+                 int id;                 /* same text - same id */
+               } diff_line_t;
+
+#define DIFF_NO_NEWLINE "\n\\ No newline at end of file\n"
+
+typedef struct { diff_line_t *lines;
+                 int count;
+                 char *changed;          /* line is removed (old) / added (new) */
+                 int *matchable;         /* indexes of lines existing in both configs */
+                 int *ids;               /* ids of matchable lines */
+                 int nmatchable;
+               } diff_file_t;
+
+typedef struct { char *data;
+                 size_t len;
+                 size_t size;
+                 int failed;
+               } diff_buffer_t;
+
+
+int a_diff_split_lines
+(const char *config, size_t len, diff_file_t *file)
+/*
+*
+* split config into lines (with their newlines). returns 1, 0 on malloc failure.
+*
+*/
+{
+   const char *p, *end = config + len, *eol;
+   unsigned int hash;
+   int count = 0;
+
+   for(p = config; p < end; p = eol + 1)
+    {
+     if( (eol = memchr(p, '\n', end - p)) == NULL )
+      eol = end - 1;
+     count++;
+    }
+
+   file->count = count;
+
+   if( (file->lines = malloc((count ? count : 1) * sizeof(diff_line_t))) == NULL )
+    return 0;
+
+   if( (file->changed = calloc(count + 1, 1)) == NULL )
+    return 0;
+
+   for(count = 0, p = config; p < end; p = eol + 1, count++)
+    {
+     if( (eol = memchr(p, '\n', end - p)) == NULL )
+      eol = end - 1;
+
+     for(hash = 2166136261U, file->lines[count].text = p; p <= eol; p++)   /* FNV-1a */
+      hash = (hash ^ (unsigned char)*p) * 16777619U;
+
+     file->lines[count].len = eol + 1 - file->lines[count].text;
+     file->lines[count].hash = hash;
+    }
+
+   return 1;
+}
+
+
+int a_diff_number_lines
+(diff_file_t *old_file, diff_file_t *new_file)
+/*
+*
+* give every distinct line text an id, and pick lines which can be matched at all
+* (their text exists in both configs). returns 1, 0 on malloc failure.
+*
+*/
+{
+   int *table, *in_old, *in_new;
+   unsigned int size, slot;
+   int ids = 0, i, f;
+   diff_file_t *files[2] = { old_file, new_file };
+   diff_line_t *line, *known = NULL;
+   diff_line_t **by_id;
+
+   for(size = 64; size < (unsigned int)(old_file->count + new_file->count) * 2; size <<= 1);
+
+   table = malloc(size * sizeof(int));
+   by_id = malloc((old_file->count + new_file->count + 1) * sizeof(diff_line_t *));
+   in_old = calloc(old_file->count + new_file->count + 1, sizeof(int));
+   in_new = calloc(old_file->count + new_file->count + 1, sizeof(int));
+
+   if((table == NULL) || (by_id == NULL) || (in_old == NULL) || (in_new == NULL))
+    {
+     free(table); free(by_id); free(in_old); free(in_new);
+     return 0;
+    }
+
+   memset(table, 0xff, size * sizeof(int));       /* -1: free slot */
+
+   for(f = 0; f < 2; f++)
+    for(i = 0; i < files[f]->count; i++)
+     {
+      line = &files[f]->lines[i];
+
+      for(slot = line->hash & (size - 1); table[slot] != -1; slot = (slot + 1) & (size - 1))
+       {
+        known = by_id[table[slot]];
+        if((known->hash == line->hash) && (known->len == line->len) && !memcmp(known->text, line->text, line->len))
+         break;
+       }
+
+      if(table[slot] == -1)
+       {
+        table[slot] = ids;
+        by_id[ids++] = line;
+       }
+
+      line->id = table[slot];
+
+      if(f == 0)
+       in_old[line->id]++;
+      else
+       in_new[line->id]++;
+     }
+
+   for(f = 0; f < 2; f++)
+    {
+     files[f]->matchable = malloc((files[f]->count ? files[f]->count : 1) * sizeof(int));
+     files[f]->ids = malloc((files[f]->count ? files[f]->count : 1) * sizeof(int));
+
+     if((files[f]->matchable == NULL) || (files[f]->ids == NULL))
+      {
+       free(table); free(by_id); free(in_old); free(in_new);
+       return 0;
+      }
+
+     for(files[f]->nmatchable = 0, i = 0; i < files[f]->count; i++)
+      if(in_old[files[f]->lines[i].id] && in_new[files[f]->lines[i].id])
+       {
+        files[f]->matchable[files[f]->nmatchable] = i;
+        files[f]->ids[files[f]->nmatchable++] = files[f]->lines[i].id;
+       }
+      else
+       files[f]->changed[i] = 1;       /* nothing to match it with */
+    }
+
+   free(table);
+   free(by_id);
+   free(in_old);
+   free(in_new);
+
+   return 1;
+}
+
+
+void a_diff_middle_snake
+(int *xv, int *yv, int xoff, int xlim, int yoff, int ylim, int *fd, int *bd, int *xmid, int *ymid)
+/*
+*
+* find the middle snake of the shortest edit script of xv[xoff..xlim) -> yv[yoff..ylim).
+* fd and bd are forward and backward furthest reaching x on diagonal k = x - y.
+*
+*/
+{
+   int dmin = xoff - ylim, dmax = xlim - yoff;
+   int fmid = xoff - yoff, bmid = xlim - ylim;
+   int fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+   int odd = (fmid - bmid) & 1;
+   int d, x, y, tlo, thi;
+
+   fd[fmid] = xoff;
+   bd[bmid] = xlim;
+
+   for(;;)
+    {
+     /* one more edit forward */
+
+     if(fmin > dmin)
+      fd[--fmin - 1] = -1;
+     else
+      ++fmin;
+
+     if(fmax < dmax)
+      fd[++fmax + 1] = -1;
+     else
+      --fmax;
+
+     for(d = fmax; d >= fmin; d -= 2)
+      {
+       tlo = fd[d - 1];
+       thi = fd[d + 1];
+       x = (tlo >= thi) ? tlo + 1 : thi;
+       y = x - d;
+
+       while((x < xlim) && (y < ylim) && (xv[x] == yv[y]))
+        x++, y++;
+
+       fd[d] = x;
+
+       if(odd && (bmin <= d) && (d <= bmax) && (bd[d] <= x))
+        {
+         *xmid = x;
+         *ymid = y;
+         return;
+        }
+      }
+
+     /* one more edit backward */
+
+     if(bmin > dmin)
+      bd[--bmin - 1] = INT_MAX;
+     else
+      ++bmin;
+
+     if(bmax < dmax)
+      bd[++bmax + 1] = INT_MAX;
+     else
+      --bmax;
+
+     for(d = bmax; d >= bmin; d -= 2)
+      {
+       tlo = bd[d - 1];
+       thi = bd[d + 1];
+       x = (tlo < thi) ? tlo : thi - 1;
+       y = x - d;
+
+       while((x > xoff) && (y > yoff) && (xv[x - 1] == yv[y - 1]))
+        x--, y--;
+
+       bd[d] = x;
+
+       if(!odd && (fmin <= d) && (d <= fmax) && (x <= fd[d]))
+        {
+         *xmid = x;
+         *ymid = y;
+         return;
+        }
+      }
+    }
+}
+
+
+void a_diff_compare
+(diff_file_t *old_file, diff_file_t *new_file, int xoff, int xlim, int yoff, int ylim, int *fd, int *bd)
+/*
+*
+* mark changed lines of matchable parts xoff..xlim (old) and yoff..ylim (new)
+*
+*/
+{
+   int *xv = old_file->ids, *yv = new_file->ids;
+   int xmid, ymid;
+
+   while((xoff < xlim) && (yoff < ylim) && (xv[xoff] == yv[yoff]))
+    xoff++, yoff++;
+
+   while((xlim > xoff) && (ylim > yoff) && (xv[xlim - 1] == yv[ylim - 1]))
+    xlim--, ylim--;
+
+   if(xoff == xlim)
+    while(yoff < ylim)
+     new_file->changed[new_file->matchable[yoff++]] = 1;
+   else if(yoff == ylim)
+    while(xoff < xlim)
+     old_file->changed[old_file->matchable[xoff++]] = 1;
+   else
+    {
+     a_diff_middle_snake(xv, yv, xoff, xlim, yoff, ylim, fd, bd, &xmid, &ymid);
+     a_diff_compare(old_file, new_file, xoff, xmid, yoff, ymid, fd, bd);
+     a_diff_compare(old_file, new_file, xmid, xlim, ymid, ylim, fd, bd);
+    }
+}
+
+
+void a_diff_append
+(diff_buffer_t *buffer, const char *data, size_t len)
+{
+   char *bigger;
+   size_t size;
+
+   if(buffer->failed)
+    return;
+
+   if(buffer->len + len + 1 > buffer->size)
+    {
+     for(size = buffer->size ? buffer->size : 4096; size < buffer->len + len + 1; size <<= 1);
+
+     if( (bigger = realloc(buffer->data, size)) == NULL )
+      {
+       buffer->failed = 1;
+       return;
+      }
+
+     buffer->data = bigger;
+     buffer->size = size;
+    }
+
+   memcpy(buffer->data + buffer->len, data, len);
+   buffer->len += len;
+   buffer->data[buffer->len] = 0x0;
+}
+
+
+void a_diff_append_line
+(diff_buffer_t *buffer, char prefix, diff_line_t *line)
+{
+   a_diff_append(buffer, &prefix, 1);
+   a_diff_append(buffer, line->text, line->len);
+
+   if(line->text[line->len - 1] != '\n')
+    a_diff_append(buffer, DIFF_NO_NEWLINE, strlen(DIFF_NO_NEWLINE));
+}
+
+
+void a_diff_unified
+(diff_file_t *old_file, diff_file_t *new_file, const char *old_label, const char *new_label,
+ diff_buffer_t *buffer)
+/*
+*
+* unified diff (DIFF_CONTEXT_LINES lines of context) of the marked configs
+*
+*/
+{
+   char header[64];
+   int i, j, hunk_i, hunk_j, end_i, end_j, next_i, next_j, equal;
+
+   a_diff_append(buffer, "--- ", 4);
+   a_diff_append(buffer, old_label, strlen(old_label));
+   a_diff_append(buffer, "\n+++ ", 5);
+   a_diff_append(buffer, new_label, strlen(new_label));
+   a_diff_append(buffer, "\n", 1);
+
+   i = j = 0;
+
+   for(;;)
+    {
+     /* skip to the next change */
+
+     while((i < old_file->count) && (j < new_file->count) && !old_file->changed[i] && !new_file->changed[j])
+      i++, j++;
+
+     if((i >= old_file->count) && (j >= new_file->count))
+      break;
+
+     hunk_i = (i > DIFF_CONTEXT_LINES) ? i - DIFF_CONTEXT_LINES : 0;
+     hunk_j = j - (i - hunk_i);
+
+     /* find the end of the hunk - changes closer than 2 * context lines are joined */
+
+     end_i = i;
+     end_j = j;
+
+     for(;;)
+      {
+       while((end_i < old_file->count) && old_file->changed[end_i])
+        end_i++;
+       while((end_j < new_file->count) && new_file->changed[end_j])
+        end_j++;
+
+       for(next_i = end_i, next_j = end_j, equal = 0;
+           (next_i < old_file->count) && (next_j < new_file->count) &&
+           !old_file->changed[next_i] && !new_file->changed[next_j]; next_i++, next_j++)
+        equal++;
+
+       if((equal > 2 * DIFF_CONTEXT_LINES) || ((next_i >= old_file->count) && (next_j >= new_file->count)))
+        break;
+
+       end_i = next_i;
+       end_j = next_j;
+      }
+
+     end_i += (equal < DIFF_CONTEXT_LINES) ? equal : DIFF_CONTEXT_LINES;
+     end_j += (equal < DIFF_CONTEXT_LINES) ? equal : DIFF_CONTEXT_LINES;
+
+     snprintf(header, sizeof(header), "@@ -%d,%d +%d,%d @@\n",
+              (end_i > hunk_i) ? hunk_i + 1 : hunk_i, end_i - hunk_i,
+              (end_j > hunk_j) ? hunk_j + 1 : hunk_j, end_j - hunk_j);
+     a_diff_append(buffer, header, strlen(header));
+
+     /* removed lines of a change go before the added ones */
+
+     for(i = hunk_i, j = hunk_j; (i < end_i) || (j < end_j); )
+      {
+       if((i < end_i) && old_file->changed[i])
+        a_diff_append_line(buffer, '-', &old_file->lines[i++]);
+       else if((j < end_j) && new_file->changed[j])
+        a_diff_append_line(buffer, '+', &new_file->lines[j++]);
+       else
+        {
+         a_diff_append_line(buffer, ' ', &old_file->lines[i++]);
+         j++;
+        }
+      }
+    }
+}
+
+
+void a_diff_file_free
+(diff_file_t *file)
+{
+   free(file->lines);
+   free(file->changed);
+   free(file->matchable);
+   free(file->ids);
+}
+
+
+int a_config_diff
+(const char *old_config, size_t old_len, const char *new_config, size_t new_len,
+ const char *old_label, const char *new_label, config_diff_t *diff)
+/*
+*
+* diff two configs. counts of added and removed lines go to diff, and unified diff
+* text too - if labels are given (free it with a_config_diff_free).
+* returns 1 if configs differ, 0 if they are the same, -1 on malloc failure.
+*
+*/
+{
+   diff_file_t old_file, new_file;
+   diff_buffer_t buffer;
+   int *diagonals = NULL;
+   int i, result = -1;
+
+   bzero(diff, sizeof(config_diff_t));
+
+   if((old_len == new_len) && !memcmp(old_config, new_config, new_len))
+    return 0;
+
+   bzero(&old_file, sizeof(old_file));
+   bzero(&new_file, sizeof(new_file));
+   bzero(&buffer, sizeof(buffer));
+
+   if(!a_diff_split_lines(old_config, old_len, &old_file) || !a_diff_split_lines(new_config, new_len, &new_file))
+    goto diff_done;
+
+   if(!a_diff_number_lines(&old_file, &new_file))
+    goto diff_done;
+
+   /* diagonals -(new lines + 1) .. (old lines + 1), forward and backward */
+
+   if( (diagonals = malloc(2 * (old_file.nmatchable + new_file.nmatchable + 3) * sizeof(int))) == NULL )
+    goto diff_done;
+
+   a_diff_compare(&old_file, &new_file, 0, old_file.nmatchable, 0, new_file.nmatchable,
+                  diagonals + new_file.nmatchable + 1,
+                  diagonals + new_file.nmatchable + 1 + old_file.nmatchable + new_file.nmatchable + 3);
+
+   for(i = 0; i < old_file.count; i++)
+    diff->removed += old_file.changed[i];
+   for(i = 0; i < new_file.count; i++)
+    diff->added += new_file.changed[i];
+
+   if((old_label != NULL) && (new_label != NULL))
+    {
+     a_diff_unified(&old_file, &new_file, old_label, new_label, &buffer);
+
+     if(buffer.failed)
+      {
+       free(buffer.data);
+       goto diff_done;
+      }
+
+     diff->text = buffer.data;
+     diff->text_len = buffer.len;
+    }
+
+   result = 1;
+
+ diff_done:
+   if(result == -1)
+    a_debug_info2(DEBUGLVL3,"a_config_diff: malloc failed!");
+
+   free(diagonals);
+   a_diff_file_free(&old_file);
+   a_diff_file_free(&new_file);
+
+   return result;
+}
+
+
+int a_config_diff_file
+(char *old_filename, config_buffer_t *config, const char *old_label, const char *new_label,
+ config_diff_t *diff)
+/*
+*
+* a_config_diff of a config file (working copy) and a downloaded config.
+* returns as a_config_diff, -1 if the file cannot be read.
+*
+*/
+{
+   char *old_config = NULL;
+   FILE *config_file;
+   long size;
+   int result = -1;
+
+   bzero(diff, sizeof(config_diff_t));
+
+   if( (config_file = fopen(old_filename, "rb")) == NULL )
+    {
+     a_debug_info2(DEBUGLVL5,"a_config_diff_file: cannot open %s!",old_filename);
+     return -1;
+    }
+
+   fseek(config_file, 0, SEEK_END);
+   size = ftell(config_file);
+   rewind(config_file);
+
+   if((size < 0) || ((old_config = malloc(size ? size : 1)) == NULL) ||
+      (fread(old_config, 1, size, config_file) != (size_t)size))
+    {
+     a_debug_info2(DEBUGLVL5,"a_config_diff_file: cannot read %s!",old_filename);
+     goto file_done;
+    }
+
+   result = a_config_diff(old_config, size, config->data, config->len, old_label, new_label, diff);
+
+ file_done:
+   fclose(config_file);
+   free(old_config);
+
+   return result;
+}
+
+
+void a_config_diff_free
+(config_diff_t *diff)
+{
+   free(diff->text);
+   diff->text = NULL;
+   diff->text_len = 0;
+}
+
+
+/* end of diff.c  */
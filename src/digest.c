@@ -0,0 +1,249 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    digest.c - digests of archived device configs
+*
+*    SHA-1 of the config last committed (or found unchanged) for every device is kept
+*    in memory and in the .config_digests.<instance id> file in the working directory.
+*    a downloaded config with the same digest needs no repository work at all.
+*    digest file is append-only while running (later lines win), and compacted on load.
+*    its first line holds repository path (and routes) - digests of other repositories 
+*    are dropped.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include "apr_sha1.h"
+
+
+int a_config_digest_compute
+(config_buffer_t *config, char *digest)
+/*
+*
+* SHA-1 of a downloaded config, as hex string (digest must hold CONFIG_DIGEST_LEN + 1 chars).
+* returns 1 on success, 0 if there is no config.
+*
+*/
+{
+   apr_sha1_ctx_t ctx;
+   unsigned char sha1[APR_SHA1_DIGESTSIZE];
+   int i;
+
+   if(config->data == NULL)
+    return 0;
+
+   apr_sha1_init(&ctx);
+   apr_sha1_update(&ctx, config->data, config->len);
+   apr_sha1_final(sha1, &ctx);
+
+   for(i = 0; i < APR_SHA1_DIGESTSIZE; i++)
+    sprintf(digest + (i * 2), "%02x", sha1[i]);
+
+   return 1;
+}
+
+
+int a_config_digest_load
+(void)
+/*
+*
+* load device digests from the digest file, write it back compacted and keep it
+* open for appending. returns number of devices with known digest, -1 on error.
+*
+*/
+{
+   char filename[MAXPATH], tmp_filename[MAXPATH];
+   char line[MAXPATH * 4], repository[MAXPATH * 4];
+   char *hostname, *digest, *old_digest;
+   repo_route_t *route;
+   hash_entry_t *entry;
+   FILE *digest_file;
+   size_t len;
+   int i;
+
+   snprintf(filename, MAXPATH, "%s.%d", CONFIG_DIGEST_FILE, G_config_info.instance_id);
+   snprintf(tmp_filename, MAXPATH, "%s.%d.tmp", CONFIG_DIGEST_FILE, G_config_info.instance_id);
+
+   len = snprintf(repository, sizeof(repository), "# %s", G_config_info.repository_path);
+
+   for(route = G_repo_routes; (route != NULL) && (len < sizeof(repository)); route = route->prev)
+    len += snprintf(repository + len, sizeof(repository) - len, " %s %s", 
+                    route->group_regexp_string, route->repository_path);
+
+   if(len >= sizeof(repository) - 1)
+    len = sizeof(repository) - 2;
+
+   strcpy(repository + len, "\n");
+
+   if( (G_config_digests = a_hash_create(G_router_db_entries * 2, YES)) == NULL )
+    return -1;
+
+   if( (digest_file = fopen(filename, "r")) != NULL )
+    {
+     if( (fgets(line, sizeof(line), digest_file) != NULL) && !strcmp(line, repository) )
+      while(fgets(line, sizeof(line), digest_file) != NULL)
+       {
+        digest = strtok(line, " \n");
+        hostname = strtok(NULL, " \n");
+
+        if((digest == NULL) || (hostname == NULL) || (strlen(digest) != CONFIG_DIGEST_LEN))
+         continue;
+
+        if( (old_digest = a_hash_get(G_config_digests, hostname)) != NULL )
+         strcpy(old_digest, digest);
+        else if( (digest = strdup(digest)) != NULL )
+         if(!a_hash_put(G_config_digests, hostname, digest))
+          free(digest);
+       }
+     else
+      a_logmsg("config digests in %s belong to another repository - dropped.",filename);
+
+     fclose(digest_file);
+    }
+
+   /* write the digests back - one line per device */
+
+   if( (digest_file = fopen(tmp_filename, "w")) == NULL )
+    {
+     a_logmsg("WARNING: cannot write config digest file %s (%d)! digests won't be kept.",tmp_filename,errno);
+     return -1;
+    }
+
+   fputs(repository, digest_file);
+
+   for(i = 0; i < G_config_digests->size; i++)
+    for(entry = G_config_digests->buckets[i]; entry != NULL; entry = entry->next)
+     fprintf(digest_file, "%s %s\n", (char *)entry->data, entry->key);
+
+   if((fclose(digest_file) != 0) || (rename(tmp_filename, filename) != 0))
+    {
+     a_logmsg("WARNING: cannot write config digest file %s (%d)! digests won't be kept.",filename,errno);
+     remove(tmp_filename);
+     return -1;
+    }
+
+   if( (G_config_digest_file = fopen(filename, "a")) == NULL )
+    {
+     a_logmsg("WARNING: cannot open config digest file %s (%d)! digests won't be kept.",filename,errno);
+     return -1;
+    }
+
+   return G_config_digests->count;
+}
+
+
+int a_config_digest_unchanged
+(char *hostname, char *digest)
+/*
+*
+* check if config with this digest is what we have archived for the device last time.
+* counts the hits - these are syncs which didn't need the repository.
+*
+*/
+{
+   char *known_digest;
+   int unchanged;
+
+   pthread_mutex_lock(&G_config_digest_mutex);
+
+   unchanged = ( ((known_digest = a_hash_get(G_config_digests, hostname)) != NULL) &&
+                 !strcmp(known_digest, digest) );
+
+   if(unchanged)
+    G_unchanged_configs++;
+
+   pthread_mutex_unlock(&G_config_digest_mutex);
+
+   return unchanged;
+}
+
+
+void a_config_digest_store
+(char *hostname, char *digest)
+/*
+*
+* remember digest of config which is now in the repository for the device
+*
+*/
+{
+   char *known_digest;
+
+   if((G_config_digests == NULL) || (G_config_digest_file == NULL))
+    return;
+
+   pthread_mutex_lock(&G_config_digest_mutex);
+
+   if( (known_digest = a_hash_get(G_config_digests, hostname)) != NULL )
+    {
+     if(!strcmp(known_digest, digest))
+      {
+       pthread_mutex_unlock(&G_config_digest_mutex);
+       return;
+      }
+     strcpy(known_digest, digest);
+    }
+   else if( (known_digest = strdup(digest)) != NULL )
+    {
+     if(!a_hash_put(G_config_digests, hostname, known_digest))
+      {
+       free(known_digest);
+       pthread_mutex_unlock(&G_config_digest_mutex);
+       return;
+      }
+    }
+
+   fprintf(G_config_digest_file, "%s %s\n", digest, hostname);
+   fflush(G_config_digest_file);
+
+   pthread_mutex_unlock(&G_config_digest_mutex);
+}
+
+
+void a_config_digest_stats_log
+(void)
+/*
+*
+* log how many syncs were skipped thanks to config digests (with every log marker)
+*
+*/
+{
+   unsigned long unchanged;
+   int known;
+
+   if(G_config_digests == NULL)
+    return;
+
+   pthread_mutex_lock(&G_config_digest_mutex);
+   unchanged = G_unchanged_configs;
+   known = G_config_digests->count;
+   pthread_mutex_unlock(&G_config_digest_mutex);
+
+   a_logmsg("config digests: %lu unchanged configs not sent to SVN, digests of %d devices known.",
+            unchanged, known);
+}
+
+
+/* end of digest.c  */
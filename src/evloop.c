@@ -0,0 +1,433 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    evloop.c - main loop: event-driven (epoll) version and portable polling version
+*
+*    on systems with epoll and timerfd the daemon sleeps in epoll_wait() until the
+*    syslog socket, the command socket or the tailed file has something for us,
+*    or until the job timer (armed to the next cronjob run time) expires.
+*    everywhere else we fall back to the old poll-and-usleep loop.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "scheduler.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+
+#define USE_EPOLL_MAINLOOP 1
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#endif
+
+
+#define EV_SYSLOG_SOCKET   1   /* tags carried in epoll_event.data.u32 */
+#define EV_COMMAND_SOCKET  2
+#define EV_TAILLOG         3
+#define EV_JOB_TIMER       4
+#define EV_TAILLOG_TIMER   5
+#define EV_EVENT_QUEUE     6
+
+#define MAX_EPOLL_EVENTS 16
+
+#define TAILLOG_POLL_INTERVAL 1  /* seconds - used only when inotify is not available */
+
+
+void a_mainloop_poll
+(void)
+/*
+*
+* portable main loop: poll every data source, then sleep G_mainloop_dly microseconds.
+*
+*/
+{
+   char syslog_msgbuffer[BUFLEN];
+
+   /* choose main loop delay value */
+
+   if(!G_config_info.listen_syslog && !G_config_info.tail_syslog)
+    G_mainloop_dly = SLOW_DLY;  /* no need to waste system resources when we dont track any datastreams */
+   else
+    G_mainloop_dly = FAST_DLY;  /* when tracking some datastreams, we need to poll descriptors frequently */
+
+   a_debug_info2(DEBUGLVL1,"a_mainloop_poll: entering polling main loop...");
+
+   while(TRUE)
+    {
+     if(G_config_info.listen_syslog && (G_syslog_event_queue == NULL))
+      a_check_syslog_stream(G_syslog_socket);
+
+     a_syslog_events_consume();      /* events queued by syslog receiver threads */
+
+     if(G_config_info.tail_syslog)
+      if(a_check_taillog_stream(G_syslog_file_handle,syslog_msgbuffer,NULL))
+        a_parse_syslog_buffer(syslog_msgbuffer,NULL);
+
+     a_check_and_run_jobs();         /* execute cron-like job manager */
+
+     if(G_config_info.open_command_socket)
+      a_check_and_parse_cmds(G_command_socket);
+
+     usleep(G_mainloop_dly);
+    }
+}
+
+
+#ifdef USE_EPOLL_MAINLOOP
+
+int a_evloop_add
+(int epoll_fd, int fd, unsigned int tag)
+/*
+*
+* register descriptor for read readiness in the main loop epoll set
+*
+*/
+{
+   struct epoll_event ev;
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.u32 = tag;
+
+   if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+     a_debug_info2(DEBUGLVL3,"a_evloop_add: cannot add descriptor %d (tag %d) to epoll set (%d)!",
+                   fd,tag,errno);
+     return -1;
+    }
+
+   return 1;
+}
+
+
+void a_job_timer_arm
+(int timer_fd)
+/*
+*
+* arm job timer to the run time of the earliest scheduled job (absolute, wall clock).
+* if there are no jobs - disarm it. run time already in the past is armed one second
+* from now - a job that stays due can't make the loop spin.
+*
+*/
+{
+   struct itimerspec its;
+   time_t next, earliest;
+
+   memset(&its, 0, sizeof(its));
+
+   next = a_jobs_next_runtime();
+
+   if(next != NEVER)
+    {
+     earliest = time(NULL) + 1;
+     its.it_value.tv_sec = (next < earliest) ? earliest : next;
+    }
+
+   if(timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+     a_debug_info2(DEBUGLVL3,"a_job_timer_arm: timerfd_settime failed (%d)!",errno);
+}
+
+
+void a_fd_drain
+(int fd)
+/*
+*
+* consume pending data from timerfd/inotify descriptor so it won't stay readable
+*
+*/
+{
+   char buf[4096];
+
+   while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+}
+
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+int a_taillog_watch_setup
+(void)
+/*
+*
+* watch directory containing tailed syslog file - this way we will see
+* both appends to the file and its re-creation after logfile rotation.
+*
+*/
+{
+   int fd;
+   char dirname[MAXPATH];
+   char *slash;
+
+   strncpy(dirname,G_config_info.syslog_filename,MAXPATH-1);
+   dirname[MAXPATH-1] = 0x0;
+
+   if((slash = strrchr(dirname,'/')) == NULL)
+    strcpy(dirname,".");
+   else if(slash == dirname)
+    dirname[1] = 0x0;
+   else
+    *slash = 0x0;
+
+   if((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    {
+     a_debug_info2(DEBUGLVL3,"a_taillog_watch_setup: inotify_init1 failed (%d)!",errno);
+     return -1;
+    }
+
+   if(inotify_add_watch(fd, dirname, IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE) == -1)
+    {
+     a_debug_info2(DEBUGLVL3,"a_taillog_watch_setup: cannot watch %s (%d)!",dirname,errno);
+     close(fd);
+     return -1;
+    }
+
+   a_debug_info2(DEBUGLVL5,"a_taillog_watch_setup: watching %s for syslog file changes.",dirname);
+
+   return fd;
+}
+
+
+int a_taillog_watch_check
+(int fd)
+/*
+*
+* read pending inotify events - return 1 if any of them concerns the tailed syslog file
+* (other files in the same directory are ignored).
+*
+*/
+{
+   char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+   const struct inotify_event *event;
+   char *basename, *p;
+   ssize_t len;
+   int hit = 0;
+
+   if((basename = strrchr(G_config_info.syslog_filename,'/')) == NULL)
+    basename = G_config_info.syslog_filename;
+   else
+    basename++;
+
+   while((len = read(fd, buf, sizeof(buf))) > 0)
+    for(p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len)
+     {
+      event = (const struct inotify_event *)p;
+      if( (event->len > 0) && (strcmp(event->name,basename) == 0) )
+       hit = 1;
+     }
+
+   return hit;
+}
+
+#endif
+
+
+int a_interval_timer_setup
+(int seconds)
+/*
+*
+* create periodic timerfd
+*
+*/
+{
+   int fd;
+   struct itimerspec its;
+
+   if((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    return -1;
+
+   memset(&its, 0, sizeof(its));
+   its.it_value.tv_sec = seconds;
+   its.it_interval.tv_sec = seconds;
+
+   if(timerfd_settime(fd, 0, &its, NULL) == -1)
+    {
+     close(fd);
+     return -1;
+    }
+
+   return fd;
+}
+
+
+int a_mainloop_epoll
+(void)
+/*
+*
+* event-driven main loop. returns only if the reactor cannot be set up -
+* caller should then fall back to a_mainloop_poll().
+*
+*/
+{
+   struct epoll_event events[MAX_EPOLL_EVENTS];
+   char syslog_msgbuffer[BUFLEN];
+   int epoll_fd, job_timer_fd, taillog_fd = -1;
+   int i, n;
+
+   if((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    {
+     a_debug_info2(DEBUGLVL3,"a_mainloop_epoll: epoll_create1 failed (%d)!",errno);
+     return -1;
+    }
+
+   if((job_timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    {
+     a_debug_info2(DEBUGLVL3,"a_mainloop_epoll: timerfd_create failed (%d)!",errno);
+     close(epoll_fd);
+     return -1;
+    }
+
+   if(a_evloop_add(epoll_fd, job_timer_fd, EV_JOB_TIMER) == -1)
+    goto setup_fail;
+
+   if(G_config_info.listen_syslog)
+    {
+     if(G_syslog_event_queue == NULL)
+      {
+       if(a_evloop_add(epoll_fd, G_syslog_socket, EV_SYSLOG_SOCKET) == -1)
+        goto setup_fail;
+      }
+     else   /* receiver threads own the sockets - we only consume their events */
+      {
+       if(G_syslog_event_queue->notify_fd == -1)
+        goto setup_fail;
+       if(a_evloop_add(epoll_fd, G_syslog_event_queue->notify_fd, EV_EVENT_QUEUE) == -1)
+        goto setup_fail;
+      }
+    }
+
+   if(G_config_info.open_command_socket)
+    if(a_evloop_add(epoll_fd, G_command_socket, EV_COMMAND_SOCKET) == -1)
+     goto setup_fail;
+
+   if(G_config_info.tail_syslog)
+    {
+#ifdef HAVE_SYS_INOTIFY_H
+     if((taillog_fd = a_taillog_watch_setup()) != -1)
+      {
+       if(a_evloop_add(epoll_fd, taillog_fd, EV_TAILLOG) == -1)
+        goto setup_fail;
+      }
+     else
+#endif
+      {
+       /* no inotify - check the tailed file on a periodic timer */
+       if((taillog_fd = a_interval_timer_setup(TAILLOG_POLL_INTERVAL)) == -1)
+        goto setup_fail;
+       if(a_evloop_add(epoll_fd, taillog_fd, EV_TAILLOG_TIMER) == -1)
+        goto setup_fail;
+      }
+    }
+
+   a_job_timer_arm(job_timer_fd);
+
+   a_debug_info2(DEBUGLVL1,"a_mainloop_epoll: entering event-driven main loop...");
+
+   while(TRUE)
+    {
+     n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+
+     if(n == -1)
+      {
+       if(errno != EINTR)   /* signals (SIGHUP, SIGUSR1) will wake us up here - that's fine */
+        a_debug_info2(DEBUGLVL3,"a_mainloop_epoll: epoll_wait failed (%d)!",errno);
+       continue;
+      }
+
+     for(i = 0; i < n; i++)
+      switch(events[i].data.u32)
+       {
+        case EV_SYSLOG_SOCKET:
+         a_check_syslog_stream(G_syslog_socket);
+         break;
+
+#ifdef HAVE_SYS_INOTIFY_H
+        case EV_TAILLOG:
+         if(!a_taillog_watch_check(taillog_fd))
+          break;   /* something else changed in the syslog directory */
+         if(a_check_taillog_stream(G_syslog_file_handle,syslog_msgbuffer,NULL))
+          a_parse_syslog_buffer(syslog_msgbuffer,NULL);
+         break;
+#endif
+
+        case EV_TAILLOG_TIMER:
+         a_fd_drain(taillog_fd);
+         if(a_check_taillog_stream(G_syslog_file_handle,syslog_msgbuffer,NULL))
+          a_parse_syslog_buffer(syslog_msgbuffer,NULL);
+         break;
+
+        case EV_EVENT_QUEUE:
+         a_syslog_events_consume();
+         break;
+
+        case EV_COMMAND_SOCKET:
+         a_check_and_parse_cmds(G_command_socket);
+         break;
+
+        case EV_JOB_TIMER:
+         a_fd_drain(job_timer_fd);
+         a_check_and_run_jobs();     /* execute cron-like job manager */
+         a_job_timer_arm(job_timer_fd);
+         break;
+       }
+    }
+
+   setup_fail:
+
+   a_logmsg("WARNING: cannot set up event-driven main loop - falling back to polling.");
+
+   if(taillog_fd != -1)
+    close(taillog_fd);
+   close(job_timer_fd);
+   close(epoll_fd);
+
+   return -1;
+}
+
+#endif
+
+
+void a_mainloop_run
+(void)
+/*
+*
+* run main program loop - never returns
+*
+*/
+{
+#ifdef USE_EPOLL_MAINLOOP
+   a_mainloop_epoll();
+#endif
+   a_mainloop_poll();
+}
+
+
+/* end of evloop.c  */
@@ -0,0 +1,203 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    evqueue.c - bounded lock-free multi-producer/multi-consumer event queue
+*
+*    used to pass config events from syslog receiver threads to the archiving side.
+*    this is the well known bounded MPMC ring by Dmitry Vyukov: every cell carries
+*    a sequence number telling producers and consumers whose turn it is, so the
+*    only shared writes are one CAS on enqueue/dequeue position per operation.
+*    producers never block - push fails when the ring is full.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+
+evqueue_t *a_evqueue_create
+(size_t capacity)
+/*
+*
+* create event queue. capacity is rounded up to the power of two.
+*
+*/
+{
+   evqueue_t *queue;
+   size_t i, size = 2;
+
+   while(size < capacity)
+    size <<= 1;
+
+   if( (queue = malloc(sizeof(evqueue_t))) == NULL )
+    return NULL;
+
+   if( (queue->cells = malloc(size * sizeof(evqueue_cell_t))) == NULL )
+    {
+     free(queue);
+     return NULL;
+    }
+
+   for(i = 0; i < size; i++)
+    {
+     queue->cells[i].sequence = i;
+     queue->cells[i].data = NULL;
+    }
+
+   queue->mask = size - 1;
+   queue->enqueue_pos = 0;
+   queue->dequeue_pos = 0;
+
+#ifdef HAVE_SYS_EVENTFD_H
+   queue->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+   queue->notify_fd = -1;  /* consumer has to poll */
+#endif
+
+   return queue;
+}
+
+
+int a_evqueue_push
+(evqueue_t *queue, void *data)
+/*
+*
+* add an element to the queue. return 1 on success, 0 if the queue is full.
+*
+*/
+{
+   evqueue_cell_t *cell;
+   size_t pos, seq;
+   intptr_t diff;
+
+   pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+
+   for(;;)
+    {
+     cell = &queue->cells[pos & queue->mask];
+     seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+     diff = (intptr_t)seq - (intptr_t)pos;
+
+     if(diff == 0)
+      {
+       if(__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;          /* cell is ours. on failure pos holds the current value - retry */
+      }
+     else if(diff < 0)
+      return 0;         /* queue full */
+     else
+      pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    }
+
+   cell->data = data;
+   __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+   return 1;
+}
+
+
+void *a_evqueue_pop
+(evqueue_t *queue)
+/*
+*
+* take an element from the queue. return NULL if the queue is empty.
+*
+*/
+{
+   evqueue_cell_t *cell;
+   size_t pos, seq;
+   intptr_t diff;
+   void *data;
+
+   pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+
+   for(;;)
+    {
+     cell = &queue->cells[pos & queue->mask];
+     seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+     diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+     if(diff == 0)
+      {
+       if(__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+      }
+     else if(diff < 0)
+      return NULL;      /* queue empty */
+     else
+      pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    }
+
+   data = cell->data;
+   __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+
+   return data;
+}
+
+
+void a_evqueue_notify
+(evqueue_t *queue)
+/*
+*
+* wake up consumer waiting on queue->notify_fd
+*
+*/
+{
+#ifdef HAVE_SYS_EVENTFD_H
+   uint64_t one = 1;
+
+   if(queue->notify_fd != -1)
+    if(write(queue->notify_fd, &one, sizeof(one)) == -1)
+     if(errno != EAGAIN)
+      a_debug_info2(DEBUGLVL3,"a_evqueue_notify: eventfd write failed (%d)!",errno);
+#endif
+}
+
+
+void a_evqueue_clear_notify
+(evqueue_t *queue)
+/*
+*
+* reset wakeup descriptor - called by consumer before draining the queue
+*
+*/
+{
+#ifdef HAVE_SYS_EVENTFD_H
+   uint64_t count;
+
+   if(queue->notify_fd != -1)
+    if(read(queue->notify_fd, &count, sizeof(count)) == -1)
+     ;   /* EAGAIN - nothing was signalled */
+#endif
+}
+
+
+/* end of evqueue.c  */
@@ -30,10 +30,12 @@
 
 
 int a_get_from_device
-(char *device_name, char *device_type, char *device_auth_set_name, char *device_arch_method)
+(char *device_name, char *device_type, char *device_auth_set_name, char *device_arch_method,
+ config_buffer_t *config)
 /*
 *
-* dispatch config get request according to the configured config get method
+* dispatch config get request according to the configured config get method.
+* downloaded config ends up in the config buffer.
 *
 */
 {
@@ -41,11 +43,17 @@ int a_get_from_device
   int op_status = -1;
 
   if(strstr(device_arch_method,"snmp"))
-    op_status = a_get_using_snmp(device_name,device_type,device_auth_set_name);
+    op_status = a_get_using_snmp(device_name,device_type,device_auth_set_name,config);
   else if(G_config_info.archiving_method == ARCHIVE_USING_RANCID)
-    op_status = a_get_using_rancid(device_name,device_type);
+    op_status = a_get_using_rancid(device_name,device_type,config);
   else if(G_config_info.archiving_method == ARCHIVE_USING_INTERNAL)
-    op_status = a_get_using_expect(device_name,device_type,device_auth_set_name,device_arch_method);
+    op_status = a_get_using_expect(device_name,device_type,device_auth_set_name,device_arch_method,config);
+  else if(G_config_info.archiving_method == ARCHIVE_USING_NATIVE)
+   {
+    /* platforms/methods the collector doesn't know go through expect scripts */
+    if( (op_status = a_get_using_native(device_name,device_type,device_auth_set_name,device_arch_method,config)) == 0 )
+     op_status = a_get_using_expect(device_name,device_type,device_auth_set_name,device_arch_method,config);
+   }
   else return -1;
 
   return op_status;
@@ -54,35 +62,48 @@ int a_get_from_device
 
 
 int a_get_using_rancid
-(char *device_name, char *device_type)
+(char *device_name, char *device_type, config_buffer_t *config)
 /*
 * get device config using Really Awesome Cisco confIg Differ frontend (rancid-fe)
 * rancid uses .cloginrc as a device credentials storage, so our AuthSets defined in config file 
 * have no efect here - user must have valid .cloginrc for this method to work.
+* rancid output file is read into the config buffer and removed.
 */
 {
  
-   struct stat outfile;
-   char rancid_command[MAXPATH];
+   char rancid_target[MAXPATH];
    char rancid_filename[MAXPATH];
+   char rancid_output[SPAWN_OUTPUT_LEN];
+   char *rancid_argv[3];
+   int spawn_result;
 
-   /* build filenames and command strings */
+   /* build filenames and helper argv */
    snprintf(rancid_filename,MAXPATH,"%s.new",device_name);
-   snprintf(rancid_command,MAXPATH,"%s %s:%s",G_config_info.rancid_exec_path,device_name,device_type);
+   snprintf(rancid_target,MAXPATH,"%s:%s",device_name,device_type);
+
+   rancid_argv[0] = G_config_info.rancid_exec_path;
+   rancid_argv[1] = rancid_target;
+   rancid_argv[2] = NULL;
 
    remove(rancid_filename); /* try to remove the file */
 
    a_debug_info2(DEBUGLVL5,"a_get_using_rancid: executing rancid %s %s:%s...",
                  G_config_info.rancid_exec_path, device_name, device_type);
-   a_our_system(rancid_command);
-   a_debug_info2(DEBUGLVL5,"a_get_using_rancid: rancid finished...");
+   spawn_result = a_spawn(rancid_argv,G_config_info.helper_timeout,rancid_output,sizeof(rancid_output));
+   a_debug_info2(DEBUGLVL5,"a_get_using_rancid: rancid finished (%d)...",spawn_result);
+
+   if(spawn_result == SPAWN_TIMEOUT)
+    {
+     a_logmsg("%s: rancid killed after %d seconds!",device_name,G_config_info.helper_timeout);
+     return -1;
+    }
 
-   if(stat(rancid_filename,&outfile) == -1)
+   if(!a_config_buffer_load(config,rancid_filename))
     {
      a_logmsg("FATAL: %s: rancid failed!",device_name); 
      return -1;
     } /* no rancid file after rancid run - fail */
-   else if(outfile.st_size < MIN_WORKING_COPY_LEN) 
+   else if(config->len < MIN_WORKING_COPY_LEN) 
     {
      a_logmsg("FATAL: %s: rancid outfile is less that predefined minimum length (%d bytes) - looks like rancid failed!",
               device_name,MIN_WORKING_COPY_LEN); 
@@ -191,11 +212,13 @@ int a_cleanup_config_file
 }
 
 int a_get_using_expect
-(char *device_name, char *device_type, char *auth_set, char *arch_method)
+(char *device_name, char *device_type, char *auth_set, char *arch_method, config_buffer_t *config)
 /*
 *
-* get device config using expect script
-* libexpect is not thread-safe - only way to use expect in a thread is system()
+* get device config using expect script (into the config buffer)
+* libexpect is not thread-safe - only way to use expect in a thread is to run
+* expect binary as a separate process (a_spawn). passwords are passed in argv,
+* never through a shell.
 *
 */
 {
@@ -203,9 +226,10 @@ int a_get_using_expect
   auth_set_t *device_auth_set;
   struct stat outfile,helper_script;
   char script_path[MAXPATH];
-  char exp_command[MAXPATH];
+  char exp_output[SPAWN_OUTPUT_LEN];
   char result_file[MAXPATH];
-  int system_result = 0;
+  char *exp_argv[7];
+  int spawn_result = 0;
 
 
   /* build a command string for expect get script */
@@ -218,14 +242,18 @@ int a_get_using_expect
     return -1;
    }
 
-  snprintf(exp_command,MAXPATH,"%s %s %s %s %s ",
-           G_config_info.expect_exec_path,script_path,device_name,
-           device_auth_set->login,device_auth_set->password1);
+  exp_argv[0] = G_config_info.expect_exec_path;
+  exp_argv[1] = script_path;
+  exp_argv[2] = device_name;
+  exp_argv[3] = device_auth_set->login;
+  exp_argv[4] = device_auth_set->password1;
 
   if(device_auth_set->password2 != NULL)
-   strcat(exp_command,device_auth_set->password2);
+   exp_argv[5] = device_auth_set->password2;
   else 
-   strcat(exp_command,device_auth_set->password1);
+   exp_argv[5] = device_auth_set->password1;
+
+  exp_argv[6] = NULL;
 
   snprintf(result_file,MAXPATH,"%s.new",device_name);
 
@@ -241,11 +269,18 @@ int a_get_using_expect
     return -1;
    }
 
-  system_result = a_our_system(exp_command); 
+  spawn_result = a_spawn(exp_argv,G_config_info.helper_timeout,exp_output,sizeof(exp_output)); 
 
-  if((system_result >> 8) > 0)
+  if(spawn_result == SPAWN_TIMEOUT)
+   {
+    a_logmsg("%s: expect script killed after %d seconds!",device_name,G_config_info.helper_timeout);
+    a_debug_info2(DEBUGLVL5,"a_get_using_expect: %s: last output: %s",device_name,exp_output);
+    return -1;
+   }
+  else if(spawn_result != 0)
    { 
-    a_debug_info2(DEBUGLVL5,"a_get_using_expect: %s: expect script failed!",device_name);
+    a_debug_info2(DEBUGLVL5,"a_get_using_expect: %s: expect script failed (%d), last output: %s",
+                  device_name,spawn_result,exp_output);
     a_logmsg("%s: expect script failed!",device_name);
     return -1;
    }
@@ -272,6 +307,15 @@ int a_get_using_expect
      }
    }
 
+  /* python post-processing works on the file - config goes to memory after it */
+
+  if(!a_config_buffer_load(config,result_file))
+   {
+    a_logmsg("%s: expect method: cannot read downloaded config file.",device_name);
+    remove(result_file);
+    return -1;
+   }
+
   return 1;
 
 }
@@ -0,0 +1,248 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    hash.c - string keyed hash table (separate chaining, grows as needed)
+*
+*    tables are not locked here - callers protect them with their own mutexes.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+
+unsigned int a_hash_string
+(const char *key, int nocase)
+/*
+*
+* djb2 string hash, optionally case-insensitive
+*
+*/
+{
+   unsigned int hash = 5381;
+   const unsigned char *c;
+
+   for(c = (const unsigned char *)key; *c; c++)
+    hash = ((hash << 5) + hash) + (nocase ? tolower(*c) : *c);
+
+   return hash;
+}
+
+
+hash_table_t *a_hash_create
+(int size, int nocase)
+/*
+*
+* create empty hash table. nocase - keys are compared case-insensitive.
+*
+*/
+{
+   hash_table_t *table;
+
+   if(size < HASH_MIN_SIZE)
+    size = HASH_MIN_SIZE;
+
+   if( (table = malloc(sizeof(hash_table_t))) == NULL )
+    return NULL;
+
+   if( (table->buckets = calloc(size, sizeof(hash_entry_t *))) == NULL )
+    {
+     free(table);
+     return NULL;
+    }
+
+   table->size = size;
+   table->count = 0;
+   table->nocase = nocase;
+
+   return table;
+}
+
+
+hash_entry_t *a_hash_find
+(hash_table_t *table, const char *key)
+{
+   hash_entry_t *entry;
+
+   entry = table->buckets[a_hash_string(key, table->nocase) % table->size];
+
+   for(; entry != NULL; entry = entry->next)
+    if(table->nocase ? !strcasecmp(entry->key, key) : !strcmp(entry->key, key))
+     return entry;
+
+   return NULL;
+}
+
+
+void *a_hash_get
+(hash_table_t *table, const char *key)
+/*
+*
+* return data stored under key, NULL if not found
+*
+*/
+{
+   hash_entry_t *entry;
+
+   if((table == NULL) || (key == NULL))
+    return NULL;
+
+   if( (entry = a_hash_find(table, key)) == NULL )
+    return NULL;
+
+   return entry->data;
+}
+
+
+void a_hash_grow
+(hash_table_t *table)
+/*
+*
+* double the bucket count. if memory is short, table just stays as it is.
+*
+*/
+{
+   hash_entry_t **buckets, *entry, *next;
+   int size, i;
+   unsigned int idx;
+
+   size = table->size * 2;
+
+   if( (buckets = calloc(size, sizeof(hash_entry_t *))) == NULL )
+    return;
+
+   for(i = 0; i < table->size; i++)
+    for(entry = table->buckets[i]; entry != NULL; entry = next)
+     {
+      next = entry->next;
+      idx = a_hash_string(entry->key, table->nocase) % size;
+      entry->next = buckets[idx];
+      buckets[idx] = entry;
+     }
+
+   free(table->buckets);
+   table->buckets = buckets;
+   table->size = size;
+}
+
+
+int a_hash_put
+(hash_table_t *table, const char *key, void *data)
+/*
+*
+* store data under key (key is copied). data already stored under the same key
+* is replaced - freeing it is up to the caller. return 1 on success, 0 on malloc failure.
+*
+*/
+{
+   hash_entry_t *entry;
+   unsigned int idx;
+
+   if( (entry = a_hash_find(table, key)) != NULL )
+    {
+     entry->data = data;
+     return 1;
+    }
+
+   if(table->count >= table->size)
+    a_hash_grow(table);
+
+   if( (entry = malloc(sizeof(hash_entry_t))) == NULL )
+    return 0;
+
+   if( (entry->key = strdup(key)) == NULL )
+    {
+     free(entry);
+     return 0;
+    }
+
+   idx = a_hash_string(key, table->nocase) % table->size;
+
+   entry->data = data;
+   entry->next = table->buckets[idx];
+   table->buckets[idx] = entry;
+   table->count++;
+
+   return 1;
+}
+
+
+void *a_hash_remove
+(hash_table_t *table, const char *key)
+/*
+*
+* remove key from the table, return data that was stored under it
+*
+*/
+{
+   hash_entry_t *entry, **link;
+   void *data;
+
+   link = &table->buckets[a_hash_string(key, table->nocase) % table->size];
+
+   for(entry = *link; entry != NULL; link = (hash_entry_t **)&entry->next, entry = entry->next)
+    if(table->nocase ? !strcasecmp(entry->key, key) : !strcmp(entry->key, key))
+     {
+      *link = entry->next;
+      data = entry->data;
+      free(entry->key);
+      free(entry);
+      table->count--;
+      return data;
+     }
+
+   return NULL;
+}
+
+
+void a_hash_free
+(hash_table_t *table, void (*free_data)(void *))
+/*
+*
+* free hash table. free_data (if not NULL) is called for every stored data pointer.
+*
+*/
+{
+   hash_entry_t *entry, *next;
+   int i;
+
+   if(table == NULL)
+    return;
+
+   for(i = 0; i < table->size; i++)
+    for(entry = table->buckets[i]; entry != NULL; entry = next)
+     {
+      next = entry->next;
+      if(free_data != NULL)
+       free_data(entry->data);
+      free(entry->key);
+      free(entry);
+     }
+
+   free(table->buckets);
+   free(table);
+}
+
+
+/* end of hash.c  */
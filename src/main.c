@@ -35,9 +35,9 @@ main
 (int argc, char **argv)
 {
 
-   char syslog_msgbuffer[BUFLEN];
-   char ip_from[IPSTRLEN];
    int pid,c;
+   int manifest_entries;
+   repo_route_t *route;
 
    a_init_globals(); /* init global variables, mutexes, and other one-time stuff  */
 
@@ -106,6 +106,9 @@ main
 
    a_load_and_parse_config_info(G_config_filename,&G_config_info);     
 
+   G_config_prefilter = a_literal_prefilter_build(G_config_regexp_list);
+   G_config_dfa = a_config_dfa_build(G_config_regexp_list);
+
    if(a_check_for_lockfile())                         
     { 
      fprintf(stderr,"\nERROR: archivist lockfile for instance %d exists!",G_config_info.instance_id); 
@@ -125,9 +128,16 @@ main
      a_cleanup_and_exit();
     }
 
-   if(a_svn_configured_repo_stat() != 1)
+   if(a_svn_ra_init() != 1)   /* repository manifest is read through svn_ra - whatever the backend */
+    {
+     fprintf(stderr,"FATAL: cannot initialize SVN repository access library!\n");
+     a_cleanup_and_exit();
+    }
+
+   if(a_svn_fs_init(G_config_info.svn_backend == SVN_BACKEND_FS) != 1)   /* repo-pack/verify need svn_fs too */
     {
-     fprintf(stderr,"FATAL: configured SVN repository (%s) is not accessible!\n",G_config_info.repository_path);
+     fprintf(stderr,"FATAL: cannot open SVN repository %s directly (is it a local file:// repository?)\n",
+             G_config_info.repository_path);
      a_cleanup_and_exit();
     }
 
@@ -140,6 +150,21 @@ main
 
    G_router_db = a_load_router_db(G_config_info.router_db_path); /* load device list from router.db file */
 
+   /* list the repository (this is also the check that it is accessible) and add missing device groups: */
+
+   if( (manifest_entries = a_repo_manifest_load()) == -1 )
+    {
+     fprintf(stderr,"FATAL: configured SVN repository (%s or a RepositoryRoute) is not accessible!\n",
+             G_config_info.repository_path);
+     a_cleanup_and_exit();
+    }
+
+   if(G_config_info.listen_syslog)
+    a_device_addr_map_build();    /* syslog source address -> device, no DNS on the syslog path */
+
+   if(G_config_info.skip_unchanged)
+    a_config_digest_load();       /* digests of configs archived by previous runs */
+
    /* on startup, log config information to the logfile: */
 
 #ifndef USE_MYSQL
@@ -148,9 +173,14 @@ main
  
    a_logmsg("--> version: %s",ARCHIVIST_VERSION);
    a_logmsg("--> router.db file: %s (%d entries)",G_config_info.router_db_path,G_router_db_entries);
+   a_logmsg("--> %d archiver threads, archiver queue length %d",G_config_info.archiver_threads,
+            G_config_info.archiver_queue_len);
 
    /*if above SVN test passed - we assume that SVN is accessible - OK:*/
    a_logmsg("--> SVN repository path: %s (OK)",G_config_info.repository_path); 
+   for(route = G_repo_routes; route != NULL; route = route->prev)
+    a_logmsg("--> device groups matching '%s' go to %s (OK)",route->group_regexp_string,route->repository_path);
+   a_logmsg("--> %d device groups and configs in the repository",manifest_entries);
 
    if(G_config_info.open_command_socket)
     a_logmsg("--> listening to commands on %s",G_config_info.command_socket_path);
@@ -160,6 +190,10 @@ main
     a_logmsg("--> tailing syslog file %s",G_config_info.syslog_filename);
    if(G_config_info.listen_syslog)
     a_logmsg("--> listening to syslog messages on port %d",G_config_info.syslog_port);
+   if(G_config_info.listen_syslog && (G_config_info.syslog_receiver_threads > 0))
+    a_logmsg("--> using %d syslog receiver threads",G_config_info.syslog_receiver_threads);
+   if(G_config_info.listen_syslog && (G_device_addr_map != NULL))
+    a_logmsg("--> %d router.db addresses mapped for syslog sources",G_device_addr_map->count);
    if(G_config_info.keep_changelog)
     a_logmsg("--> logging config diffs to %s",G_config_info.changelog_filename);
    if(G_config_dump_memstats)
@@ -171,7 +205,12 @@ main
    /* setup sockets and file descriptors to listen on (if configured to do so): */
 
    if(G_config_info.listen_syslog)
-    G_syslog_socket = a_syslog_socket_setup();
+    {
+     if(G_config_info.syslog_receiver_threads > 0)
+      a_syslog_receivers_setup();   /* sockets only - threads are started after fork */
+     else
+      G_syslog_socket = a_syslog_socket_setup();
+    }
 
    if(G_config_info.tail_syslog)
     G_syslog_file_handle = a_syslog_fstream_setup();
@@ -195,34 +234,31 @@ main
         }
     }
 
-   /* choose main loop delay value */
+   if(G_config_info.archiving_method == ARCHIVE_USING_NATIVE)
+    a_collector_start(G_config_info.collector_threads);
 
-   if(!G_config_info.listen_syslog && !G_config_info.tail_syslog)
-    G_mainloop_dly = SLOW_DLY;  /* no need to waste system resources when we dont track any datastreams */
-   else
-    G_mainloop_dly = FAST_DLY;  /* when tracking some datastreams, we need to poll descriptors frequently */
+   a_archiver_pool_start(G_config_info.archiver_threads, G_config_info.archiver_queue_len);
 
-   a_debug_info2(DEBUGLVL1,"main: entering main loop...");
+   if(G_config_info.listen_syslog && (G_config_info.syslog_receiver_threads > 0))
+    a_syslog_receivers_start();
 
-   /* main program: */
+   if(G_config_info.listen_syslog)
+    a_device_addr_refresher_start();
 
-   while(TRUE)
+   if(G_config_info.group_commit_window > 0)
     {
-     if(G_config_info.listen_syslog)
-      if(a_check_syslog_stream(G_syslog_socket,syslog_msgbuffer,ip_from))
-        a_parse_syslog_buffer(syslog_msgbuffer,ip_from);
-
-     if(G_config_info.tail_syslog)
-      if(a_check_taillog_stream(G_syslog_file_handle,syslog_msgbuffer,NULL)) 
-        a_parse_syslog_buffer(syslog_msgbuffer,NULL); 
-
-     a_check_and_run_jobs();         /* execute cron-like job manager */
+     if(G_config_info.svn_backend == SVN_BACKEND_RA)
+      a_svn_ra_batch_committer_start();
+     else
+      {
+       a_logmsg("WARNING: GroupCommitWindow works only with SVNBackend ra - ignored.");
+       G_config_info.group_commit_window = 0;
+      }
+    }
 
-     if(G_config_info.open_command_socket)
-      a_check_and_parse_cmds(G_command_socket);
+   /* main program: */
 
-     usleep(G_mainloop_dly);
-    }
+   a_mainloop_run();  /* event-driven where available, polling elsewhere - never returns */
 
 }
 
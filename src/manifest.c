@@ -0,0 +1,461 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    manifest.c - map of device groups and device configs in the repository
+*
+*    repository head is listed once at startup (this is also the check that the
+*    repository is accessible), and every router.db group missing in it is created -
+*    all of them in a single commit. with RepositoryRoute, every repository is listed
+*    (only groups routed to it count) and gets its own commit of missing groups.
+*    archiver workers look groups up in the map, so a device job never finds out
+*    about a missing group by a failed checkout, and two workers never race to
+*    create the same group: group created later (router.db re-read) is created by
+*    the first job that needs it, under G_repo_manifest_mutex.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "svn_pools.h"
+#include "svn_ra.h"
+#include "svn_delta.h"
+#include "svn_props.h"
+#include "apr_hash.h"
+
+#define MANIFEST_GROUP "group"
+#define MANIFEST_DEVICE "device"
+
+
+int a_repo_manifest_scan
+(svn_ra_session_t *session, char *repository, svn_revnum_t head, hash_table_t *manifest, apr_pool_t *pool)
+/*
+*
+* list repository root and every directory in it into the manifest:
+* directories are device groups, files are device configs. groups routed to
+* another repository (and root files of other than the default one) are skipped.
+* returns number of entries in the manifest, -1 on error.
+*
+*/
+{
+   apr_hash_t *root_entries, *group_entries;
+   apr_hash_index_t *root_idx, *group_idx;
+   apr_pool_t *group_pool;
+   svn_dirent_t *dirent;
+   svn_error_t *svn_err;
+   const void *name, *file_name;
+   void *value;
+   char path[MAXPATH];
+
+   if( (svn_err = svn_ra_get_dir2(session, &root_entries, NULL, NULL, "", head, SVN_DIRENT_KIND, pool)) )
+    goto scan_fail;
+
+   group_pool = svn_pool_create(pool);
+
+   for(root_idx = apr_hash_first(pool, root_entries); root_idx != NULL; root_idx = apr_hash_next(root_idx))
+    {
+     apr_hash_this(root_idx, &name, NULL, &value);
+     dirent = value;
+
+     if(dirent->kind == svn_node_file)
+      {
+       if(strcmp(repository, G_config_info.repository_path))   /* "none" group lives in RepositoryPath */
+        continue;
+
+       if(!a_hash_put(manifest, name, MANIFEST_DEVICE))
+        return -1;
+       continue;
+      }
+
+     if((dirent->kind != svn_node_dir) || strcmp(a_repo_route((char *)name), repository))
+      continue;
+
+     if(!a_hash_put(manifest, name, MANIFEST_GROUP))
+      return -1;
+
+     svn_pool_clear(group_pool);
+
+     if( (svn_err = svn_ra_get_dir2(session, &group_entries, NULL, NULL, name, head, SVN_DIRENT_KIND, group_pool)) )
+      goto scan_fail;
+
+     for(group_idx = apr_hash_first(group_pool, group_entries); group_idx != NULL; group_idx = apr_hash_next(group_idx))
+      {
+       apr_hash_this(group_idx, &file_name, NULL, &value);
+       dirent = value;
+
+       if(dirent->kind != svn_node_file)
+        continue;
+
+       snprintf(path, MAXPATH, "%s/%s", (const char *)name, (const char *)file_name);
+
+       if(!a_hash_put(manifest, path, MANIFEST_DEVICE))
+        return -1;
+      }
+    }
+
+   svn_pool_destroy(group_pool);
+
+   return manifest->count;
+
+ scan_fail:
+   a_logmsg("svn error: cannot list repository %s: %s",repository,svn_err->message);
+   a_debug_info2(DEBUGLVL3,"a_repo_manifest_scan: svn error: %s",svn_err->message);
+   svn_error_clear(svn_err);
+   return -1;
+}
+
+
+int a_repo_manifest_add_groups
+(svn_ra_session_t *session, char **groups, int count, apr_pool_t *pool)
+/*
+*
+* create device groups (repository root directories) - all in one commit.
+* returns 1 on success, -1 on error.
+*
+*/
+{
+   const svn_delta_editor_t *editor;
+   void *edit_baton, *root_baton, *dir_baton;
+   svn_revnum_t head, committed = SVN_INVALID_REVNUM;
+   svn_error_t *svn_err;
+   apr_hash_t *revprops;
+   int editing = 0, i;
+
+   revprops = apr_hash_make(pool);
+   apr_hash_set(revprops, SVN_PROP_REVISION_LOG, APR_HASH_KEY_STRING, svn_string_create("", pool));
+
+   if( (svn_err = svn_ra_get_latest_revnum(session, &head, pool)) )
+    goto add_fail;
+
+   if( (svn_err = svn_ra_get_commit_editor3(session, &editor, &edit_baton, revprops,
+                                            a_svn_ra_commit_done, &committed, NULL, FALSE, pool)) )
+    goto add_fail;
+
+   editing = 1;
+
+   if( (svn_err = editor->open_root(edit_baton, head, pool, &root_baton)) )
+    goto add_fail;
+
+   for(i = 0; i < count; i++)
+    {
+     if( (svn_err = editor->add_directory(groups[i], root_baton, NULL, SVN_INVALID_REVNUM, pool, &dir_baton)) )
+      goto add_fail;
+
+     if( (svn_err = editor->close_directory(dir_baton, pool)) )
+      goto add_fail;
+    }
+
+   if( (svn_err = editor->close_directory(root_baton, pool)) )
+    goto add_fail;
+
+   if( (svn_err = editor->close_edit(edit_baton, pool)) )
+    goto add_fail;
+
+   a_debug_info2(DEBUGLVL5,"a_repo_manifest_add_groups: %d groups added in revision %ld",count,committed);
+
+   return 1;
+
+ add_fail:
+   a_logmsg("svn error: cannot add device groups: %s",svn_err->message);
+   a_debug_info2(DEBUGLVL3,"a_repo_manifest_add_groups: svn error: %s",svn_err->message);
+   svn_error_clear(svn_err);
+
+   if(editing)
+    svn_error_clear(editor->abort_edit(edit_baton, pool));
+
+   return -1;
+}
+
+
+int a_repo_manifest_missing_groups
+(hash_table_t *manifest, char ***groups)
+/*
+*
+* router.db device groups which are not in the manifest (each listed once).
+* returns their number, -1 on malloc failure. free the list and its strings.
+*
+*/
+{
+   hash_table_t *seen;
+   char **list = NULL, **bigger, *group;
+   int count = 0, size = 0;
+
+   if( (seen = a_hash_create(64, NO)) == NULL )
+    return -1;
+
+#ifndef USE_MYSQL
+
+   router_db_entry_t *tmp_pointer;
+
+   pthread_mutex_lock(&G_router_db_mutex);
+
+   for(tmp_pointer = G_router_db; tmp_pointer != NULL; tmp_pointer = tmp_pointer->prev)
+    {
+     group = tmp_pointer->group;
+
+#else
+
+   MYSQL_RES *raw_sql_res;
+   MYSQL_ROW sql_res;
+
+   if( (raw_sql_res = a_mysql_select("select * from router_db")) == NULL )
+    {
+     a_hash_free(seen, NULL);
+     return -1;
+    }
+
+   while( (sql_res = mysql_fetch_row(raw_sql_res)) != NULL )
+    {
+     group = sql_res[0];
+
+#endif
+
+     if(strstr(group,"none") || (a_hash_get(manifest, group) != NULL) || (a_hash_get(seen, group) != NULL))
+      continue;
+
+     if(count == size)
+      {
+       size = size ? size * 2 : 16;
+       if( (bigger = realloc(list, size * sizeof(char *))) == NULL )
+        break;
+       list = bigger;
+      }
+
+     if( (list[count] = strdup(group)) == NULL )
+      break;
+
+     if(!a_hash_put(seen, group, list[count]))
+      {
+       free(list[count]);
+       break;
+      }
+
+     count++;
+    }
+
+#ifndef USE_MYSQL
+   pthread_mutex_unlock(&G_router_db_mutex);
+#else
+   mysql_free_result(raw_sql_res);
+#endif
+
+   a_hash_free(seen, NULL);
+   *groups = list;
+
+   return count;
+}
+
+
+int a_repo_manifest_load
+(void)
+/*
+*
+* build the manifest from head of every repository and create missing device groups.
+* returns number of groups and device configs in the repositories, -1 if one of
+* them cannot be listed.
+*
+*/
+{
+   svn_worker_t *worker;
+   svn_ra_session_t *session;
+   svn_revnum_t head;
+   svn_error_t *svn_err;
+   hash_table_t *manifest;
+   apr_pool_t *pool;
+   char **groups = NULL, **routed = NULL;
+   char *repositories[MAX_REPOSITORIES];
+   int count = 0, missing, repository_count, routed_count, r, i;
+
+   if( (manifest = a_hash_create(G_router_db_entries * 2, NO)) == NULL )
+    return -1;
+
+   if( (worker = a_svn_worker_get()) == NULL )
+    {
+     a_hash_free(manifest, NULL);
+     return -1;
+    }
+
+   pool = a_svn_worker_job_pool(worker);
+
+   repository_count = a_repositories(repositories, MAX_REPOSITORIES);
+
+   for(r = 0; r < repository_count; r++)
+    {
+     if( (session = a_svn_ra_session(worker, repositories[r], MANIFEST_AUTHOR)) == NULL )
+      goto load_fail;
+
+     if( (svn_err = svn_ra_get_latest_revnum(session, &head, pool)) )
+      {
+       a_debug_info2(DEBUGLVL3,"a_repo_manifest_load: svn error: %s",svn_err->message);
+       svn_error_clear(svn_err);
+       goto load_fail;
+      }
+
+     if( (count = a_repo_manifest_scan(session, repositories[r], head, manifest, pool)) == -1 )
+      goto load_fail;
+
+     svn_pool_clear(pool);
+    }
+
+   if( (missing = a_repo_manifest_missing_groups(manifest, &groups)) > 0 )
+    {
+     a_logmsg("adding %d new device groups.",missing);
+
+     if( (routed = malloc(missing * sizeof(char *))) != NULL )
+      for(r = 0; r < repository_count; r++)
+       {
+        for(routed_count = 0, i = 0; i < missing; i++)
+         if(!strcmp(a_repo_route(groups[i]), repositories[r]))
+          routed[routed_count++] = groups[i];
+
+        if(routed_count == 0)
+         continue;
+
+        if( (session = a_svn_ra_session(worker, repositories[r], MANIFEST_AUTHOR)) != NULL )
+         if(a_repo_manifest_add_groups(session, routed, routed_count, worker->iter_pool) == 1)
+          for(i = 0; i < routed_count; i++)
+           a_hash_put(manifest, routed[i], MANIFEST_GROUP);
+
+        svn_pool_clear(worker->iter_pool);
+       }
+
+     free(routed);
+    }
+
+   for(i = 0; i < missing; i++)
+    free(groups[i]);
+   free(groups);
+
+   svn_pool_clear(worker->iter_pool);
+   svn_pool_clear(pool);
+
+   pthread_mutex_lock(&G_repo_manifest_mutex);
+   a_hash_free(G_repo_manifest, NULL);
+   G_repo_manifest = manifest;
+   pthread_mutex_unlock(&G_repo_manifest_mutex);
+
+   return manifest->count;
+
+ load_fail:
+   a_hash_free(manifest, NULL);
+   svn_pool_clear(pool);
+   return -1;
+}
+
+
+int a_repo_manifest_group
+(char *device_group)
+/*
+*
+* make sure the device group exists in the repository, creating it if it isn't in
+* the manifest. returns 1 if it exists (or there is no manifest), -1 on error.
+*
+*/
+{
+   svn_worker_t *worker;
+   svn_ra_session_t *session;
+   int result = -1;
+
+   if(strstr(device_group,"none"))
+    return 1;
+
+   pthread_mutex_lock(&G_repo_manifest_mutex);   /* one group is created once */
+
+   if((G_repo_manifest == NULL) || (a_hash_get(G_repo_manifest, device_group) != NULL))
+    {
+     pthread_mutex_unlock(&G_repo_manifest_mutex);
+     return 1;
+    }
+
+   a_logmsg("adding new device group: %s",device_group);
+
+   if( ((worker = a_svn_worker_get()) != NULL) &&
+       ((session = a_svn_ra_session(worker, a_repo_route(device_group), MANIFEST_AUTHOR)) != NULL) )
+    {
+     if( (result = a_repo_manifest_add_groups(session, &device_group, 1, worker->iter_pool)) == 1 )
+      a_hash_put(G_repo_manifest, device_group, MANIFEST_GROUP);
+     else
+      a_svn_ra_session_drop(worker, a_repo_route(device_group), MANIFEST_AUTHOR);
+
+     svn_pool_clear(worker->iter_pool);
+    }
+
+   pthread_mutex_unlock(&G_repo_manifest_mutex);
+
+   return result;
+}
+
+
+void a_repo_manifest_device
+(char *device_group, char *device_name)
+/*
+*
+* remember that a device config was added to the repository
+*
+*/
+{
+   char path[MAXPATH];
+
+   if(strstr(device_group,"none"))
+    snprintf(path, MAXPATH, "%s", device_name);
+   else
+    snprintf(path, MAXPATH, "%s/%s", device_group, device_name);
+
+   pthread_mutex_lock(&G_repo_manifest_mutex);
+
+   if((G_repo_manifest != NULL) && (a_hash_get(G_repo_manifest, path) == NULL))
+    a_hash_put(G_repo_manifest, path, MANIFEST_DEVICE);
+
+   pthread_mutex_unlock(&G_repo_manifest_mutex);
+}
+
+
+int a_repo_manifest_device_known
+(char *device_group, char *device_name)
+/*
+*
+* is the device config in the repository? 1 - yes, 0 - no, -1 - don't know (no manifest)
+*
+*/
+{
+   char path[MAXPATH];
+   int known;
+
+   if(strstr(device_group,"none"))
+    snprintf(path, MAXPATH, "%s", device_name);
+   else
+    snprintf(path, MAXPATH, "%s/%s", device_group, device_name);
+
+   pthread_mutex_lock(&G_repo_manifest_mutex);
+
+   if(G_repo_manifest == NULL)
+    known = -1;
+   else
+    known = (a_hash_get(G_repo_manifest, path) != NULL);
+
+   pthread_mutex_unlock(&G_repo_manifest_mutex);
+
+   return known;
+}
+
+
+/* end of manifest.c  */
@@ -345,6 +345,8 @@ void a_sighup_handler
    G_router_db = a_load_router_db(G_config_info.router_db_path);
    pthread_mutex_unlock(&G_router_db_mutex); 
 
+   a_device_addr_refresh_request();   /* re-resolve device addresses */
+
    a_logmsg("SIGHUP: Re-readed device database file (%d entries now).", G_router_db_entries);
 
 }
@@ -421,23 +423,6 @@ void a_tolower_str
    *p = (char)tolower(*p);
 }
 
-int a_rename
-(char *src, char *dst)
-/* 
-* rename a file (even across the filesystems). Ugly version using system() call.
-*/
-{
- char command[MAXPATH];
-
- bzero(command,MAXPATH);
- snprintf(command,MAXPATH,"/bin/mv %s %s",src,dst); 
- if((a_our_system(command)) == -1)
-   return -1;
- else
-   return 1; 
-}
-
-
 int a_ftouch
 (const char *path)
 /*
@@ -497,65 +482,6 @@ void a_refresh_signals
 
 
 
-int a_our_system
-(const char *cmd)
-/*
-* taken from opengroup.org, and modified for MT-safety.
-* http://pubs.opengroup.org/onlinepubs/009695399/functions/system.html
-*
-* notes about system(), exec(), fork() and thread-safety:
-*
-* it is said, that fork() - when used in threads - produces unpredictable results. 
-* normally, when forking, entire program that calls fork() is cloned in the memory, and this copy 
-* is executed from the point where fork() was called. in case of a multithreaded program, usually 
-* only thread calling fork() is cloned, which is probably not what one would want when using 
-* fork() to do some further processing in the forked code. 
-* according to various sources, only reasonable use of fork() in threads, is to immediately call exec() 
-* after fork() - that is to replace forked, "orphaned" single thread, with a new program - which 
-* is exactly what we are doing here, so essentially - regarding thread safety - this function 
-* _should_ be MT-safe...
-* 
-*/
-{
-    int stat;
-    pid_t pid;
-    struct sigaction sa, savintr, savequit;
-    sigset_t saveblock;
-    if (cmd == NULL)
-        return(1);
-    sa.sa_handler = SIG_IGN;
-    sigemptyset(&sa.sa_mask);       
-    sa.sa_flags = 0;
-    sigemptyset(&savintr.sa_mask);
-    sigemptyset(&savequit.sa_mask);
-    sigaction(SIGINT, &sa, &savintr);      /* save SIGINT action, and temporarily set it to IGNORE */
-    sigaction(SIGQUIT, &sa, &savequit);    /* savve SIGQUIT action, and temporarily set it to IGNORE */
-    sigaddset(&sa.sa_mask, SIGCHLD);
-    pthread_sigmask(SIG_BLOCK, &sa.sa_mask, &saveblock);
-    if ((pid = fork()) == 0) {                                  /* child will execute this  - restore signal handlers and execl */
-        sigaction(SIGINT, &savintr, (struct sigaction *)0);     
-        sigaction(SIGQUIT, &savequit, (struct sigaction *)0);
-        sigprocmask(SIG_SETMASK, &saveblock, (sigset_t *)0);
-        execl("/bin/sh", "sh", "-c", cmd, (char *)0);           
-        _exit(127);
-    }
-    if (pid == -1) {
-        stat = -1; /* errno comes from fork() */
-    } else {                                                   /* parent will execute this - wait for a child to terminate */
-        while (waitpid(pid, &stat, 0) == -1) {
-            if (errno != EINTR){
-                stat = -1;
-                break;
-            }
-        }
-    }
-    sigaction(SIGINT, &savintr, (struct sigaction *)0);             /* restore SIGINT/SIGQUIT signal handlers in parent thread */
-    sigaction(SIGQUIT, &savequit, (struct sigaction *)0);
-    pthread_sigmask(SIG_SETMASK, &saveblock, (sigset_t *)0);
-    return(stat);
-}
-
-
 void a_init_globals
 (void)
 /*
@@ -573,12 +499,50 @@ void a_init_globals
    G_config_dump_memstats = 0;
    G_auth_set_list = NULL;
    G_config_regexp_list = NULL;
+   G_repo_routes = NULL;
+   G_verified_revs = a_hash_create(MAX_REPOSITORIES, NO);
+   G_syslog_event_queue = NULL;
+   G_config_prefilter = NULL;
+   G_config_dfa = NULL;
 
    pthread_mutex_init(&G_thread_count_mutex, NULL);
    pthread_mutex_init(&G_M_thread_count_mutex, NULL);
    pthread_mutex_init(&G_embedded_running_mutex, NULL);
    pthread_mutex_init(&G_changelog_write_mutex, NULL);
    pthread_mutex_init(&G_SQL_query_mutex, NULL);
+   pthread_mutex_init(&G_regexp_cache_mutex, NULL);
+   pthread_mutex_init(&G_device_addr_mutex, NULL);
+   pthread_mutex_init(&G_wc_locks_mutex, NULL);
+   pthread_mutex_init(&G_config_digest_mutex, NULL);
+   pthread_mutex_init(&G_repo_manifest_mutex, NULL);
+   pthread_mutex_init(&G_onboard_mutex, NULL);
+   pthread_mutex_init(&G_ra_batch_mutex, NULL);
+   pthread_cond_init(&G_ra_batch_cond, NULL);
+
+   G_router_db_index = NULL;
+   G_archiver_pool = NULL;
+   G_device_addr_map = NULL;
+   G_device_jobs = NULL;
+   G_ptr_cache = NULL;
+   G_wc_locks = NULL;
+   G_config_digests = NULL;
+   G_repo_manifest = NULL;
+   G_config_digest_file = NULL;
+   G_unchanged_configs = 0;
+   G_ra_batch = NULL;
+   G_collectors = NULL;
+   G_collector_count = 0;
+   G_ra_batch_count = 0;
+   G_onboard_batch = NULL;
+   G_onboard_count = 0;
+   G_onboarding = 0;
+   G_repo_maintenance = 0;
+   G_bulk_runs = 0;
+   G_apr_generation = 0;
+   G_device_addr_refresh_now = 0;
+
+   bzero(G_regexp_cache,sizeof(G_regexp_cache));
+   G_regexp_cache_entries = 0;
  
    apr_initialize(); /* initialize APR data structures - once */
 
@@ -645,19 +609,104 @@ char *a_config_regexp_match
 (char *syslog_buffer)
 /*
 * search syslog buffer for a patterns specified in ConfigRegex entries
+* (union DFA from dfa.c if available, otherwise regexps compiled in a_config_regexp_add)
 */
 {
   config_regexp_t *workptr;
+  int status, pattern;
 
   if(syslog_buffer == NULL) return NULL;
 
+  if(G_config_prefilter != NULL)        /* no required literal in the line - no regexp can match */
+   if(!a_literal_prefilter_scan(G_config_prefilter, syslog_buffer))
+    return NULL;
+
+  if(G_config_dfa != NULL)              /* all patterns in one pass - regexec only if DFA gave up */
+   {
+    pattern = a_config_dfa_match(G_config_dfa, syslog_buffer);
+    if(pattern >= 0)
+     return G_config_dfa->patterns[pattern]->username_field_token;
+    if(pattern == -1)
+     return NULL;
+   }
+
   for(workptr = G_config_regexp_list;workptr!=NULL;workptr=workptr->prev)
    {
-    if(a_regexp_match(syslog_buffer,workptr->config_regexp_string,REGCOMP_CASE))
-     {
-      return workptr->username_field_token;
-     }
+    status = regexec(&workptr->compiled_regexp, syslog_buffer, (size_t) 0, NULL, 0);
+
+    if(status == 0)
+     return workptr->username_field_token;
+
+    if(status != REG_NOMATCH)
+     a_debug_info2(DEBUGLVL3,"a_config_regexp_match: regexec failed! [%d,%s]!",status,
+                   workptr->config_regexp_string);
+   }
+  return NULL;
+}
+
+
+regex_t *a_regexp_cache_get
+(const char *pattern, int case_sensitive)
+/*
+* return compiled form of pattern from the regexp cache, compiling and
+* caching it on first use. returns NULL if pattern doesn't compile or
+* cache is full - caller has to compile the pattern on its own then.
+* cache entries live until program exit, so returned pointer stays valid.
+*/
+{
+  regexp_cache_entry_t *workptr;
+  unsigned int hash = 5381;
+  const char *c;
+  int regcomp_flags;
+
+  for(c = pattern; *c; c++)
+   hash = ((hash << 5) + hash) + (unsigned char)*c;
+
+  hash %= REGEXP_CACHE_BUCKETS;
+
+  pthread_mutex_lock(&G_regexp_cache_mutex);
+
+  for(workptr = G_regexp_cache[hash]; workptr != NULL; workptr = workptr->next)
+   if((workptr->case_sensitive == case_sensitive) && !strcmp(workptr->pattern,pattern))
+    {
+     pthread_mutex_unlock(&G_regexp_cache_mutex);
+     return &workptr->compiled;
+    }
+
+  if(G_regexp_cache_entries >= REGEXP_CACHE_MAX)
+   goto cache_fail;
+
+  if( (workptr = malloc(sizeof(regexp_cache_entry_t))) == NULL )
+   goto cache_fail;
+
+  if( (workptr->pattern = strdup(pattern)) == NULL )
+   {
+    free(workptr);
+    goto cache_fail;
    }
+
+  if(case_sensitive)
+   regcomp_flags = REG_EXTENDED|REG_NOSUB;
+  else
+   regcomp_flags = REG_EXTENDED|REG_NOSUB|REG_ICASE;
+
+  if((regcomp(&workptr->compiled, pattern, regcomp_flags)) != 0)
+   {
+    free(workptr->pattern);
+    free(workptr);
+    goto cache_fail;
+   }
+
+  workptr->case_sensitive = case_sensitive;
+  workptr->next = G_regexp_cache[hash];
+  G_regexp_cache[hash] = workptr;
+  G_regexp_cache_entries++;
+
+  pthread_mutex_unlock(&G_regexp_cache_mutex);
+  return &workptr->compiled;
+
+ cache_fail:
+  pthread_mutex_unlock(&G_regexp_cache_mutex);
   return NULL;
 }
 
@@ -667,29 +716,35 @@ int a_regexp_match
 /*
 * regexp matching routine
 * from: http://pubs.opengroup.org/onlinepubs/009695399/functions/regcomp.html
+* compiled patterns are taken from the regexp cache (see a_regexp_cache_get)
 */
 {
     int status,regcomp_flags = 0;
-    regex_t re;
+    regex_t re, *cached_re;
     
-    if(case_sensitive) 
-     regcomp_flags = REG_EXTENDED|REG_NOSUB;
+    if( (cached_re = a_regexp_cache_get(pattern, case_sensitive)) != NULL )
+     status = regexec(cached_re, string, (size_t) 0, NULL, 0);
     else
-     regcomp_flags = REG_EXTENDED|REG_NOSUB|REG_ICASE;
-
-    if((regcomp(&re, pattern, regcomp_flags)) != 0) 
      {
-      a_debug_info2(DEBUGLVL3,"a_regexp_match: Regular expression compilation error: [%s]!",pattern);
-      return(0);      
-     }
+      if(case_sensitive) 
+       regcomp_flags = REG_EXTENDED|REG_NOSUB;
+      else
+       regcomp_flags = REG_EXTENDED|REG_NOSUB|REG_ICASE;
+
+      if((regcomp(&re, pattern, regcomp_flags)) != 0) 
+       {
+        a_debug_info2(DEBUGLVL3,"a_regexp_match: Regular expression compilation error: [%s]!",pattern);
+        return(0);      
+       }
 
-    status = regexec(&re, string, (size_t) 0, NULL, 0);
-    regfree(&re);
+      status = regexec(&re, string, (size_t) 0, NULL, 0);
+      regfree(&re);
+     }
     
-    if (status == 1) 
+    if (status == REG_NOMATCH) 
      return 0;
 
-    if (status > 1) 
+    if (status != 0) 
      {
       a_debug_info2(DEBUGLVL3,"a_regexp_match: regexec failed! [%d,%s,%s]!",status,pattern,string);
       return 0;      
@@ -810,63 +865,38 @@ void a_apr_reinit
 
    G_svn_root_pool = svn_pool_create(NULL);
    apr_pool_create(&G_apr_root_pool,NULL);
+
+   G_apr_generation++;     /* pools kept by archiver workers are gone */
    
   }
 }
 
-int a_add_changelog_entry
-(char *diff_filename, int diff_filesize, char *device_name, char *configured_by)
+int a_add_changelog_buffer
+(const char *diff_buffer, int diff_size, char *device_name, char *configured_by)
 /*
 *
-* add an entry to a device config changelog file
+* add a diff held in memory to the device config changelog file
 *
 */
 {
-   char *diff_buffer;
    char asctime_str[26]; /* 26 bytes according to the opengroup docs */
    char header[512], footer[512];
    int wrote = 0;
-   size_t readed = 0;
    time_t t;
    struct tm tstruct;
-   FILE *svn_diff_file;
    FILE *diff_logfile;
-   int fail = 0;
 
    header[0] = 0;
    footer[0] = 0;
 
-   a_debug_info2(DEBUGLVL5,"a_add_changelog_entry: %s: size of the changelog entry to write: %d",device_name, diff_filesize);
-
-   diff_buffer = malloc(diff_filesize);
-
-   if( (svn_diff_file = fopen(diff_filename, "rb")) == NULL)
-     {
-      a_debug_info2(DEBUGLVL5,"a_add_changelog_entry: %s: cannot open SVN diff file %s (%d)!",device_name, diff_filename, errno);
-      free(diff_buffer);
-      return 0;
-     }
-
-   if( (readed = fread(diff_buffer, diff_filesize, 1, svn_diff_file)) == 0 )
-     {
-      a_debug_info2(DEBUGLVL5,"a_add_changelog_entry: %s: cannot read in SVN diff file %s (%d)!",device_name, diff_filename, errno);
-      free(diff_buffer);
-      return 0;
-     }
-
-   fclose(svn_diff_file);
-
-   remove(diff_filename);
-
-   a_debug_info2(DEBUGLVL5,"a_add_changelog_entry: %s: writing %d bytes diff to a changelog file.",
-                 device_name, diff_filesize);
+   a_debug_info2(DEBUGLVL5,"a_add_changelog_buffer: %s: writing %d bytes diff to a changelog file.",
+                 device_name, diff_size);
 
    pthread_mutex_lock(&G_changelog_write_mutex);
 
    if((diff_logfile = fopen(G_config_info.changelog_filename,"a+")) == NULL)
      {
-      a_debug_info2(DEBUGLVL5,"a_svn_diff: ERROR: cannot open diff log file (%d)!",errno);
-      free(diff_buffer);
+      a_debug_info2(DEBUGLVL5,"a_add_changelog_buffer: ERROR: cannot open diff log file (%d)!",errno);
       pthread_mutex_unlock(&G_changelog_write_mutex);
       return 0;
      }
@@ -881,13 +911,13 @@ int a_add_changelog_entry
             "\n====== change end ======\n");
 
    fwrite(header,strlen(header),1,diff_logfile);
-   wrote = fwrite(diff_buffer,diff_filesize,1,diff_logfile);
+   wrote = fwrite(diff_buffer,diff_size,1,diff_logfile);
    fwrite(footer,strlen(footer),1,diff_logfile);   
 
    if(wrote < 1)
       {
        a_logmsg("ERROR: cannot write to diff file (%d)!",errno);  
-       free(diff_buffer);
+       fclose(diff_logfile);
        pthread_mutex_unlock(&G_changelog_write_mutex);
        return 0;
       }
@@ -896,8 +926,6 @@ int a_add_changelog_entry
 
    pthread_mutex_unlock(&G_changelog_write_mutex);
 
-   free(diff_buffer);
-
    return 1;
 
 
@@ -1122,9 +1150,6 @@ int a_check_and_parse_cmds(int socket)
 
     int n,s2,t;
     char str[MAX_CMDSIZ];
-    pthread_attr_t thread_attr;
-    pthread_t scheduled_thread;
-    size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
     config_event_info_t *confinfo;
     struct sockaddr_un remote;
 
@@ -1144,31 +1169,41 @@ int a_check_and_parse_cmds(int socket)
          a_logmsg("received external command: %s",str);
          a_debug_info2(DEBUGLVL3,"a_check_and_parse_cmds: received a command: %s",str);
 
-        /* command parsing goes here - for now command string is treated as a name of device to check */
+        /* "onboard" starts an onboarding bulk run, anything else is treated as a name of device to check */
 
-        confinfo = malloc(sizeof(config_event_info_t));
- 
-        pthread_attr_init(&thread_attr);
-        pthread_attr_setdetachstate(&thread_attr,PTHREAD_CREATE_DETACHED);
-        pthread_attr_setstacksize(&thread_attr, stacksize);
+        if(!strcmp(a_trimwhitespace(str),"onboard"))
+         {
+          a_logmsg("starting onboarding bulk archiver thread");
+          a_archive_bulk_start(YES);
+          close(s2);
+          return 1;
+         }
+
+        if( (confinfo = malloc(sizeof(config_event_info_t))) == NULL )
+         {
+          a_debug_info2(DEBUGLVL3,"a_check_and_parse_cmds: malloc failed!");
+          close(s2);
+          return -1;
+         }
+
+        bzero(confinfo,sizeof(config_event_info_t));
 
         strcpy(confinfo->configured_by,"triggered_archiving");
-        strncpy(confinfo->device_id,str,sizeof(confinfo->device_id));
+        strncpy(confinfo->device_id,str,sizeof(confinfo->device_id) - 1);
         a_trimwhitespace(confinfo->device_id);
 
         a_debug_info2(DEBUGLVL5,
-                      "a_check_and_run_jobs: starting externally-triggered device archiving for: [%s]."
+                      "a_check_and_parse_cmds: queueing externally-triggered device archiving for: [%s]."
                       ,confinfo->device_id);
-        a_logmsg("%s: starting externally-triggered archiver thread.",confinfo->device_id);
+        a_logmsg("%s: queueing externally-triggered archiving.",confinfo->device_id);
 
-        if(pthread_create(&scheduled_thread, &thread_attr, a_archive_single, (void *)confinfo))
+        if(!a_archiver_submit(confinfo, NO, 0))
          {
-          a_logmsg("fatal! cannot create externally-triggered archiver thread!");
-          a_debug_info2(DEBUGLVL5,"a_check_and_parse_cmds: cannot create externally-triggered archiver thread!");
+          a_logmsg("%s: WARNING: archiver queue is full! externally-triggered archiving skipped!",
+                   confinfo->device_id);
+          free(confinfo);
          }
 
-        usleep(500);
-
        }
 
       close(s2);
@@ -0,0 +1,364 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    prefilter.c - literal substring prefilter for ConfigRegexp matching
+*
+*    almost no syslog line is a config event, so before running regexec for every
+*    ConfigRegexp we check if the line contains at least one literal fragment that
+*    every match of some ConfigRegexp must contain (SYS-5-CONFIG_I and the like).
+*    all such literals are compiled into one Aho-Corasick automaton, so a line is
+*    scanned once, no matter how many patterns are configured.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+
+static void a_literal_flush
+(char *run, int *run_len, char *best, int *best_len)
+/*
+*
+* helper for a_regexp_required_literal: keep the longest literal run seen so far
+*
+*/
+{
+   if(*run_len > *best_len)
+    {
+     memcpy(best, run, *run_len);
+     *best_len = *run_len;
+    }
+   *run_len = 0;
+}
+
+
+int a_regexp_required_literal
+(const char *regexp, char *literal, int maxlen)
+/*
+*
+* find the longest literal fragment which must appear in every string matching
+* POSIX extended regexp. only top level of the expression is examined - groups,
+* bracket expressions and optional atoms end literal runs. returns literal length
+* (literal is NUL terminated), or 0 if regexp doesn't require any literal
+* (top level alternation, or no plain characters at all).
+*
+*/
+{
+   char run[MAX_PREFILTER_LITERAL], best[MAX_PREFILTER_LITERAL];
+   int run_len = 0, best_len = 0, depth = 0;
+   const char *p = regexp;
+   char c;
+
+   if(maxlen > MAX_PREFILTER_LITERAL)
+    maxlen = MAX_PREFILTER_LITERAL;
+
+   while(*p)
+    {
+     if(*p == '[')                      /* bracket expression - skip it */
+      {
+       a_literal_flush(run, &run_len, best, &best_len);
+       p++;
+       if(*p == '^') p++;
+       if(*p == ']') p++;
+       while(*p && (*p != ']'))
+        {
+         if((*p == '[') && ((p[1] == ':') || (p[1] == '.') || (p[1] == '=')))
+          {
+           c = p[1];
+           p += 2;
+           while(*p && !((*p == c) && (p[1] == ']')))
+            p++;
+           if(*p) p++;
+          }
+         if(*p) p++;
+        }
+       if(*p) p++;
+       continue;
+      }
+
+     if(*p == '(')
+      {
+       a_literal_flush(run, &run_len, best, &best_len);
+       depth++; p++;
+       continue;
+      }
+
+     if(*p == ')')
+      {
+       a_literal_flush(run, &run_len, best, &best_len);
+       if(depth > 0) depth--;
+       p++;
+       continue;
+      }
+
+     if(*p == '|')
+      {
+       if(depth == 0)
+        {
+         literal[0] = 0;
+         return 0;                      /* top level alternation - nothing is mandatory */
+        }
+       p++;
+       continue;
+      }
+
+     if(*p == '{')                      /* interval - skip it */
+      {
+       a_literal_flush(run, &run_len, best, &best_len);
+       while(*p && (*p != '}'))
+        p++;
+       if(*p) p++;
+       continue;
+      }
+
+     if(strchr(".^$*+?", *p))
+      {
+       a_literal_flush(run, &run_len, best, &best_len);
+       p++;
+       continue;
+      }
+
+     if(*p == '\\')
+      {
+       if(!p[1])
+        break;
+       if(isalnum((unsigned char)p[1]))   /* \w, \s, \b and friends are not literals */
+        {
+         a_literal_flush(run, &run_len, best, &best_len);
+         p += 2;
+         continue;
+        }
+       c = p[1];
+       p += 2;
+      }
+     else
+      c = *p++;
+
+     if(depth > 0)                      /* anything inside a group may be optional */
+      continue;
+
+     if((*p == '*') || (*p == '?') || (*p == '{'))
+      {
+       a_literal_flush(run, &run_len, best, &best_len);   /* optional atom */
+       continue;
+      }
+
+     if(run_len < maxlen - 1)
+      run[run_len++] = c;
+
+     if(*p == '+')                      /* atom is mandatory, but the run ends after it */
+      a_literal_flush(run, &run_len, best, &best_len);
+    }
+
+   a_literal_flush(run, &run_len, best, &best_len);
+
+   memcpy(literal, best, best_len);
+   literal[best_len] = 0;
+
+   return best_len;
+}
+
+
+literal_prefilter_t *a_literal_prefilter_build
+(config_regexp_t *config_regexp_list)
+/*
+*
+* build Aho-Corasick automaton from required literals of all configured ConfigRegexp
+* entries. returns NULL if any entry has no required literal (so every line has to go
+* to regexec anyway), or if there are no entries at all.
+*
+*/
+{
+   literal_prefilter_t *prefilter = NULL;
+   config_regexp_t *workptr;
+   char literal[MAX_PREFILTER_LITERAL];
+   int max_states = 1, len, i, state, next, qhead, qtail;
+   int *fail = NULL, *queue = NULL;
+
+   if(config_regexp_list == NULL)
+    return NULL;
+
+   for(workptr = config_regexp_list; workptr != NULL; workptr = workptr->prev)
+    {
+     if( (len = a_regexp_required_literal(workptr->config_regexp_string, literal, MAX_PREFILTER_LITERAL)) == 0 )
+      {
+       a_debug_info2(DEBUGLVL3,"a_literal_prefilter_build: ConfigRegexp \'%s\' has no required literal - prefilter disabled.",
+                     workptr->config_regexp_string);
+       return NULL;
+      }
+     max_states += len;
+    }
+
+   if( (prefilter = malloc(sizeof(literal_prefilter_t))) == NULL )
+    goto malloc_fail;
+
+   prefilter->delta = malloc(max_states * 256 * sizeof(int));
+   prefilter->accept = calloc(max_states, 1);
+   fail = malloc(max_states * sizeof(int));
+   queue = malloc(max_states * sizeof(int));
+
+   if((prefilter->delta == NULL) || (prefilter->accept == NULL) || (fail == NULL) || (queue == NULL))
+    goto malloc_fail;
+
+   for(i = 0; i < max_states * 256; i++)
+    prefilter->delta[i] = -1;
+
+   bzero(prefilter->first_byte, sizeof(prefilter->first_byte));
+   prefilter->nstates = 1;
+   prefilter->nliterals = 0;
+
+   /* build the trie */
+
+   for(workptr = config_regexp_list; workptr != NULL; workptr = workptr->prev)
+    {
+     len = a_regexp_required_literal(workptr->config_regexp_string, literal, MAX_PREFILTER_LITERAL);
+
+     a_debug_info2(DEBUGLVL5,"a_literal_prefilter_build: ConfigRegexp \'%s\' requires literal \'%s\'",
+                   workptr->config_regexp_string, literal);
+
+     prefilter->first_byte[(unsigned char)literal[0]] = 1;
+
+     for(state = 0, i = 0; i < len; i++)
+      {
+       next = prefilter->delta[state * 256 + (unsigned char)literal[i]];
+       if(next == -1)
+        {
+         next = prefilter->nstates++;
+         prefilter->delta[state * 256 + (unsigned char)literal[i]] = next;
+        }
+       state = next;
+      }
+
+     prefilter->accept[state] = 1;
+     prefilter->nliterals++;
+    }
+
+   /* turn the trie into a full DFA (breadth-first over failure links) */
+
+   qhead = qtail = 0;
+
+   for(i = 0; i < 256; i++)
+    {
+     next = prefilter->delta[i];
+     if(next == -1)
+      prefilter->delta[i] = 0;
+     else
+      {
+       fail[next] = 0;
+       queue[qtail++] = next;
+      }
+    }
+
+   while(qhead < qtail)
+    {
+     state = queue[qhead++];
+
+     if(prefilter->accept[fail[state]])
+      prefilter->accept[state] = 1;
+
+     for(i = 0; i < 256; i++)
+      {
+       next = prefilter->delta[state * 256 + i];
+       if(next == -1)
+        prefilter->delta[state * 256 + i] = prefilter->delta[fail[state] * 256 + i];
+       else
+        {
+         fail[next] = prefilter->delta[fail[state] * 256 + i];
+         queue[qtail++] = next;
+        }
+      }
+    }
+
+   /* with only one distinct first byte, libc strchr can do the skipping for us */
+
+   prefilter->single_first_byte = -1;
+   for(i = 0, len = 0; i < 256; i++)
+    if(prefilter->first_byte[i])
+     {
+      prefilter->single_first_byte = i;
+      len++;
+     }
+   if(len != 1)
+    prefilter->single_first_byte = -1;
+
+   free(fail);
+   free(queue);
+
+   a_debug_info2(DEBUGLVL3,"a_literal_prefilter_build: %d literals, %d automaton states.",
+                 prefilter->nliterals, prefilter->nstates);
+
+   return prefilter;
+
+ malloc_fail:
+   a_debug_info2(DEBUGLVL3,"a_literal_prefilter_build: malloc failed!");
+   if(prefilter != NULL)
+    {
+     free(prefilter->delta);
+     free(prefilter->accept);
+     free(prefilter);
+    }
+   free(fail);
+   free(queue);
+   return NULL;
+}
+
+
+int a_literal_prefilter_scan
+(literal_prefilter_t *prefilter, const char *buffer)
+/*
+*
+* return 1 if buffer contains any of the prefilter literals, 0 otherwise.
+* while in the start state, bytes that cannot begin a literal are skipped
+* without touching the transition table.
+*
+*/
+{
+   const unsigned char *p = (const unsigned char *)buffer;
+   int state = 0;
+
+   while(TRUE)
+    {
+     if(state == 0)
+      {
+       if(prefilter->single_first_byte != -1)
+        p = (const unsigned char *)strchr((const char *)p, prefilter->single_first_byte);
+       else
+        while(*p && !prefilter->first_byte[*p])
+         p++;
+
+       if((p == NULL) || (*p == 0))
+        return 0;
+      }
+     else if(*p == 0)
+      return 0;
+
+     state = prefilter->delta[state * 256 + *p++];
+
+     if(prefilter->accept[state])
+      return 1;
+    }
+}
+
+
+/* end of prefilter.c  */
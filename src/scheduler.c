@@ -602,11 +602,11 @@ void a_check_and_run_jobs
 * device hostname - to schedule backup of a single device 
 * "all" - to schedule backup of all devices
 * "log-marker" - to schedule insert of log marking in a daemon log file
+* "repo-pack", "repo-verify" - to pack or verify local repositories (run when archiving is idle)
 */
 {
 
    int i;
-   pthread_t scheduled_thread;
 
    if(G_stop_all_processing)
      return;           /* program is in the state of cleanup&exit - just return. */
@@ -622,72 +622,64 @@ void a_check_and_run_jobs
       a_debug_info2(DEBUGLVL5,"a_check_and_run_jobs: time has come for job %d: %s",i,G_cronjobs[i]->cmd);
 
       if(strstr(G_cronjobs[i]->cmd,"log-marker")) 
+       {
         a_logmsg("-- MARK --");
+        a_archiver_pool_stats_log();
+        a_config_digest_stats_log();
+       }
       else if(strstr(G_cronjobs[i]->cmd,"dump-memstats"))
         a_dump_memstats();
+      else if(strstr(G_cronjobs[i]->cmd,"repo-pack") || strstr(G_cronjobs[i]->cmd,"repo-verify"))
+       {
+        /* repository maintenance waits until nothing is archived - retried every */
+        /* REPO_MAINTENANCE_RETRY seconds, rescheduled only after it has started  */
+
+        if(a_repo_maintenance_start(strstr(G_cronjobs[i]->cmd,"repo-pack") ? REPO_PACK : REPO_VERIFY) == 0)
+         {
+          a_debug_info2(DEBUGLVL5,"a_check_and_run_jobs: %s postponed - archiving in progress.",
+                        G_cronjobs[i]->cmd);
+          G_cronjobs[i]->rtime = G_now + REPO_MAINTENANCE_RETRY;
+          continue;
+         }
+       }
 #ifdef USE_MYSQL
       else if(strstr(G_cronjobs[i]->cmd,"update-timestamp")) 
         a_mysql_update_archivist_timestamp();
 #endif
       else if(strstr(G_cronjobs[i]->cmd,"all"))
        {
-
-        /* starting a bulk archiving thread is different that starting one 
-         * for a single device.
-         * in bulk thread started from scheduler, we want to start, and go on
-         * further as quickly as possible, so checking active thread count
-         * and waiting for thread_count to decrease is done in-thread, 
-         * instead of doing this before starting a thread.
-         */
-
-        pthread_attr_t thread_attr;
-
-        size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
-
-        pthread_attr_init(&thread_attr);
-        pthread_attr_setdetachstate(&thread_attr,PTHREAD_CREATE_DETACHED);
-        pthread_attr_setstacksize(&thread_attr, stacksize);
-
         a_logmsg("starting scheduled bulk archiver thread");
-
-        if(pthread_create(&scheduled_thread, &thread_attr, a_archive_bulk,NULL))
-         {
-          a_logmsg("ERROR: cannot create bulk archiver thread!");
-          a_debug_info2(DEBUGLVL5,"a_check_and_run_jobs: cannot create bulk archiver thread!");
-         }
-
+        a_archive_bulk_start(NO);
        }
       else 
        { 
         /* scheduled archiving for a single device */
         
         config_event_info_t *confinfo;
-        pthread_attr_t thread_attr;
-
-        confinfo = malloc(sizeof(config_event_info_t));
 
-        size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
+        if( (confinfo = malloc(sizeof(config_event_info_t))) == NULL )
+         {
+          a_debug_info2(DEBUGLVL3,"a_check_and_run_jobs: malloc failed!");
+          a_job_reschedule(G_cronjobs[i]);
+          continue;
+         }
 
-        pthread_attr_init(&thread_attr);
-        pthread_attr_setdetachstate(&thread_attr,PTHREAD_CREATE_DETACHED);
-        pthread_attr_setstacksize(&thread_attr, stacksize);
+        bzero(confinfo,sizeof(config_event_info_t));
 
         strcpy(confinfo->configured_by,"scheduled_archiving");
-        strncpy(confinfo->device_id,G_cronjobs[i]->cmd,sizeof(confinfo->device_id));
+        strncpy(confinfo->device_id,G_cronjobs[i]->cmd,sizeof(confinfo->device_id) - 1);
         a_trimwhitespace(confinfo->device_id); 
         
-        a_debug_info2(DEBUGLVL5,"a_check_and_run_jobs: starting scheduled device archiving for: [%s]."
+        a_debug_info2(DEBUGLVL5,"a_check_and_run_jobs: queueing scheduled device archiving for: [%s]."
                       ,confinfo->device_id); 
-        a_logmsg("%s: starting scheduled archiver thread.",confinfo->device_id);
+        a_logmsg("%s: queueing scheduled archiving.",confinfo->device_id);
 
-        if(pthread_create(&scheduled_thread, &thread_attr, a_archive_single, (void *)confinfo))
+        if(!a_archiver_submit(confinfo, NO, 0))
          {
-          a_logmsg("fatal! cannot create scheduled archiver thread!");
-          a_debug_info2(DEBUGLVL5,"a_check_and_run_jobs: cannot create scheduled archiver thread!");
+          a_logmsg("%s: WARNING: archiver queue is full! scheduled archiving skipped!",confinfo->device_id);
+          free(confinfo);
          }
 
-        usleep(500);
-
        }
 
       a_job_reschedule(G_cronjobs[i]);
@@ -697,5 +689,24 @@ void a_check_and_run_jobs
 }
 
 
+time_t a_jobs_next_runtime
+(void)
+/*
+* return the earliest time at which some scheduled job should run.
+* NEVER is returned when there is nothing scheduled at all.
+* (used by the main loop to arm its job timer)
+*/
+{
+   int i;
+   time_t next = NEVER;
+
+   for(i=1;i<=G_jobcount;i++)
+    if(G_cronjobs[i]->rtime < next)
+     next = G_cronjobs[i]->rtime;
+
+   return next;
+}
+
+
 /* end of scheduler.c  */
 
@@ -44,5 +44,6 @@ time_t G_next;     /* current time. */
 #define bit_isset(map, n)       (!!((map)[(n) >> 3] & (1 << ((n) & 7))))
 
 cronjob_t *a_job_parse(char *job_data);
+time_t a_jobs_next_runtime(void);
 
 
@@ -32,10 +32,11 @@
 
 int a_get_using_snmp
 /*
-* SNMP method for getting config
+* SNMP method for getting config. device uploads it to our TFTP directory, where
+* it is post-processed and read into the config buffer.
 *
 */
-(char *device_name, char *device_type, char *device_auth_set_name)
+(char *device_name, char *device_type, char *device_auth_set_name, config_buffer_t *config)
 {
 
   int result;
@@ -53,7 +54,7 @@ int a_get_using_snmp
 
   community_string = device_auth_set->login;
 
-  snprintf(result_file,2048,"%s.new",device_name);
+  snprintf(result_file,MAXPATH,"%s/%s.new",G_config_info.tftp_dir,device_name);
 
   /* dispatch SNMP request according to the device type (add your own SNMP methods here): */
 
@@ -67,7 +68,7 @@ int a_get_using_snmp
      return -1;
     }
 
-  /* dispatch end. now we should have <hostname>.new file in CWD */
+  /* dispatch end. now we should have <hostname>.new file in TFTP directory */
 
   if(stat(result_file,&outfile) == -1)
    {
@@ -92,6 +93,13 @@ int a_get_using_snmp
      }
    }
 
+  if(!a_config_buffer_load(config,result_file))
+   {
+    a_logmsg("%s: SNMP config get method: cannot read downloaded config file.",device_name);
+    remove(result_file);
+    return -1;
+   }
+
   return result;
 
 }
@@ -443,14 +451,9 @@ int a_SNMP_IOS_get_config
      }
     if(timeout >= 20) return 0;
 
-    a_debug_info2(DEBUGLVL5,"SNMP_IOS_get_config: about to move %s to %s",tftp_path,dst_filename);
+    a_debug_info2(DEBUGLVL5,"SNMP_IOS_get_config: config uploaded to %s",tftp_path);
 
-    if((a_rename(tftp_path,dst_filename)) == -1)
-     {
-      a_debug_info2(DEBUGLVL3,"SNMP_IOS_get_config: cannot rename working config file (%d)!",errno);
-      return 0;
-     }
-    return 1;
+    return 1;   /* a_get_using_snmp reads it from there */
    }
 
   a_logmsg("%s: SNMP config get failed!",hostname);
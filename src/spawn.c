@@ -0,0 +1,257 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    spawn.c - running helper programs (expect scripts, rancid, mv)
+*
+*    helpers are started with posix_spawn - no copy of the daemon address space is
+*    made (libc uses vfork/CLONE_VM), so the cost doesn't grow with the daemon, and
+*    no process-wide signal dispositions are touched. argv goes to the helper as it
+*    is - there is no shell in between. every helper runs in its own process group,
+*    which is killed when HelperTimeout passes. helper stdout and stderr are read
+*    through a pipe; the last part of it is kept for the log.
+*
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      /* pipe2() */
+#endif
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+
+long long a_spawn_now_ms
+(void)
+/*
+*
+* monotonic clock in milliseconds - helper timeout must not follow clock steps
+*
+*/
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+int a_spawn_pipe
+(int fds[2])
+/*
+*
+* pipe with both ends closed on exec - helpers started by other workers at the
+* same time must not inherit it (we would never see EOF then)
+*
+*/
+{
+#ifdef HAVE_PIPE2
+   return pipe2(fds, O_CLOEXEC);
+#else
+   if(pipe(fds) == -1)
+    return -1;
+
+   fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+   return 0;
+#endif
+}
+
+
+void a_spawn_output_add
+(char *output, size_t output_len, size_t *used, const char *data, size_t len)
+/*
+*
+* append helper output to the buffer, dropping the oldest part when it is full
+*
+*/
+{
+   size_t room = output_len - 1;
+
+   if(room == 0)
+    return;
+
+   if(len >= room)
+    {
+     data += len - room;
+     len = room;
+    }
+
+   if(*used + len > room)
+    {
+     memmove(output, output + (*used + len - room), room - len);
+     *used = room - len;
+    }
+
+   memcpy(output + *used, data, len);
+   *used += len;
+   output[*used] = 0x0;
+}
+
+
+int a_spawn
+(char *const argv[], int timeout, char *output, size_t output_len)
+/*
+*
+* run helper program argv[0] (searched in PATH) with arguments argv[1..], and wait
+* for it - at most timeout seconds (0 - no limit). output (if not NULL) gets the
+* last output_len - 1 bytes of helper stdout+stderr.
+* returns exit code of the helper, 128 + signal number if it was killed by a
+* signal, SPAWN_TIMEOUT if it was killed after timeout, -1 if it cannot be started.
+*
+*/
+{
+   posix_spawn_file_actions_t actions;
+   posix_spawnattr_t attr;
+   sigset_t sigdefault, sigmask;
+   struct pollfd pfd;
+   char buffer[4096];
+   size_t used = 0;
+   ssize_t readed;
+   long long deadline, remaining;
+   pid_t pid;
+   int fds[2], status, wait_ms, timed_out = 0, result;
+
+   if(output != NULL && output_len > 0)
+    output[0] = 0x0;
+
+   if(a_spawn_pipe(fds) == -1)
+    {
+     a_debug_info2(DEBUGLVL3,"a_spawn: cannot create pipe (%d)!",errno);
+     return -1;
+    }
+
+   posix_spawn_file_actions_init(&actions);
+   posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+   posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+   posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+   /* own process group (killed as a whole on timeout), default signal handling, nothing blocked */
+
+   sigemptyset(&sigmask);
+   sigemptyset(&sigdefault);
+   sigaddset(&sigdefault, SIGINT);
+   sigaddset(&sigdefault, SIGQUIT);
+   sigaddset(&sigdefault, SIGTERM);
+   sigaddset(&sigdefault, SIGHUP);
+   sigaddset(&sigdefault, SIGPIPE);
+   sigaddset(&sigdefault, SIGCHLD);
+   sigaddset(&sigdefault, SIGUSR1);
+
+   posix_spawnattr_init(&attr);
+   posix_spawnattr_setpgroup(&attr, 0);
+   posix_spawnattr_setsigmask(&attr, &sigmask);
+   posix_spawnattr_setsigdefault(&attr, &sigdefault);
+   posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+   result = posix_spawnp(&pid, argv[0], &actions, &attr, argv, environ);
+
+   posix_spawnattr_destroy(&attr);
+   posix_spawn_file_actions_destroy(&actions);
+   close(fds[1]);
+
+   if(result != 0)
+    {
+     a_debug_info2(DEBUGLVL3,"a_spawn: cannot start %s (%d)!",argv[0],result);
+     close(fds[0]);
+     return -1;
+    }
+
+   a_debug_info2(DEBUGLVL5,"a_spawn: started %s (pid %d).",argv[0],pid);
+
+   /* read helper output until EOF (all its processes are gone or closed it) or timeout */
+
+   deadline = a_spawn_now_ms() + (long long)timeout * 1000;
+   pfd.fd = fds[0];
+   pfd.events = POLLIN;
+
+   for(;;)
+    {
+     if(timeout > 0)
+      {
+       if( (remaining = deadline - a_spawn_now_ms()) <= 0 )
+        {
+         timed_out = 1;
+         break;
+        }
+       wait_ms = (int)remaining;
+      }
+     else
+      wait_ms = -1;
+
+     if(poll(&pfd, 1, wait_ms) == -1)
+      {
+       if(errno == EINTR)
+        continue;
+       break;
+      }
+
+     if(pfd.revents == 0)
+      continue;
+
+     if( (readed = read(fds[0], buffer, sizeof(buffer))) > 0 )
+      {
+       if(output != NULL && output_len > 0)
+        a_spawn_output_add(output, output_len, &used, buffer, readed);
+       continue;
+      }
+
+     if((readed == -1) && (errno == EINTR))
+      continue;
+
+     break;   /* EOF */
+    }
+
+   close(fds[0]);
+
+   if(timed_out)
+    {
+     a_debug_info2(DEBUGLVL3,"a_spawn: %s (pid %d) runs longer than %d s - killed.",argv[0],pid,timeout);
+     kill(-pid, SIGKILL);    /* whole process group - expect and its spawned telnet/ssh too */
+    }
+
+   while(waitpid(pid, &status, 0) == -1)
+    if(errno != EINTR)
+     return -1;
+
+   if(timed_out)
+    return SPAWN_TIMEOUT;
+
+   if(WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+
+   return WEXITSTATUS(status);
+}
+
+
+/* end of spawn.c  */
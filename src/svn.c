@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include "svn_client.h"
 #include "svn_cmdline.h"
 #include "svn_pools.h"
@@ -36,6 +37,83 @@
 #define APR_LOCALE_CHARSET   (const char *)1 
 
 
+svn_client_ctx_t *a_svn_client_ctx
+(char *author)
+/*
+*
+* svn client context of the calling thread, created on first use and kept by its
+* svn_worker_t (again after APR reinit). auth baton of the author (NULL - none)
+* is swapped in - batons are kept per author, as they cache the username.
+*
+*/
+{
+   svn_worker_t *worker;
+   svn_auth_baton_t *auth_baton;
+   svn_auth_provider_object_t *provider;
+   apr_array_header_t *providers;
+   svn_error_t *svn_err;
+
+   if( (worker = a_svn_worker_get()) == NULL )
+    {
+     a_debug_info2(DEBUGLVL3,"a_svn_client_ctx: malloc failed!");
+     return NULL;
+    }
+
+   if(worker->client_ctx == NULL)
+    {
+     if( (svn_err = svn_client_create_context(&worker->client_ctx, worker->pool)) )
+      {
+       a_logmsg("svn error: %s",svn_err->message);
+       a_debug_info2(DEBUGLVL5,"a_svn_client_ctx: svn error: %s",svn_err->message);
+       svn_error_clear(svn_err);
+       worker->client_ctx = NULL;
+       return NULL;
+      }
+
+     worker->auth_pool = svn_pool_create(worker->pool);
+     a_hash_free(worker->auth_batons, NULL);
+     worker->auth_batons = NULL;
+    }
+
+   if(author == NULL)
+    {
+     worker->client_ctx->auth_baton = NULL;
+     return worker->client_ctx;
+    }
+
+   if( (auth_baton = a_hash_get(worker->auth_batons, author)) == NULL )
+    {
+     if((worker->auth_batons == NULL) || (worker->auth_batons->count >= AUTH_BATONS_PER_WORKER))
+      {
+       /* too many authors - drop all batons and start over */
+
+       a_hash_free(worker->auth_batons, NULL);
+       svn_pool_clear(worker->auth_pool);
+
+       if( (worker->auth_batons = a_hash_create(AUTH_BATONS_PER_WORKER, NO)) == NULL )
+        {
+         a_debug_info2(DEBUGLVL3,"a_svn_client_ctx: malloc failed!");
+         return NULL;
+        }
+      }
+
+     providers = apr_array_make(worker->auth_pool, 1, sizeof(svn_auth_provider_object_t *));
+
+     svn_auth_get_username_provider(&provider, worker->auth_pool);
+     APR_ARRAY_PUSH(providers, svn_auth_provider_object_t *) = provider;
+     svn_auth_open(&auth_baton, providers, worker->auth_pool);
+     svn_auth_set_parameter(auth_baton, SVN_AUTH_PARAM_DEFAULT_USERNAME, apr_pstrdup(worker->auth_pool, author));
+
+     if(!a_hash_put(worker->auth_batons, author, auth_baton))
+      a_debug_info2(DEBUGLVL3,"a_svn_client_ctx: malloc failed! auth baton will not be kept.");
+    }
+
+   worker->client_ctx->auth_baton = auth_baton;
+
+   return worker->client_ctx;
+}
+
+
 int a_svn_sparse_checkout
 (char *repository_path, char *temp_working_dir, apr_pool_t *apr_pool, apr_pool_t *svn_pool)
 /*
@@ -64,11 +142,8 @@ int a_svn_sparse_checkout
     
     strncpy(temp_svn_path,temp_working_dir,MAXPATH);
 
-    svn_err = svn_client_create_context( &context, svn_pool );
-
-    if(svn_err){a_logmsg("a_svn_sparse_checkout: svn error: %s",svn_err->message);
-                a_debug_info2(DEBUGLVL5,"a_svn_sparse_checkout: svn error: %s",svn_err->message);
-                return -2;}
+    if( (context = a_svn_client_ctx(NULL)) == NULL )
+     return -2;
 
     svn_opt_revision_t pegrevision;
     pegrevision.kind = svn_opt_revision_unspecified;
@@ -116,8 +191,7 @@ int a_svn_checkout
 
     char temp_svn_path[MAXPATH];
 
-    svn_client_ctx_t* context1;
-    svn_client_ctx_t* context2;
+    svn_client_ctx_t* context;
 
     a_debug_info2(DEBUGLVL5,"a_svn_checkout: args: [%s], [%s], [%s]",
                   device_name,repository_path,temp_working_dir);
@@ -129,19 +203,8 @@ int a_svn_checkout
                                           
     strcpy(temp_svn_path,temp_working_dir);
 
-    svn_err = svn_client_create_context(&context1, svn_pool);
-
-    if(svn_err){a_logmsg("%s: svn error: %s",device_name,svn_err->message);
-                a_debug_info2(DEBUGLVL5,"a_svn_checkout: svn error: %s",svn_err->message); 
-                return -2;}
-
-    svn_err = svn_client_create_context(&context2, svn_pool);
-
-    if(svn_err){
-                a_logmsg("%s: svn error: %s",device_name,svn_err->message);
-                a_debug_info2(DEBUGLVL5,"a_svn_checkout: svn error: %s",svn_err->message); 
-                return -2;
-               }
+    if( (context = a_svn_client_ctx(NULL)) == NULL )
+     return -2;
 
     svn_opt_revision_t pegrevision;
     pegrevision.kind = svn_opt_revision_unspecified;
@@ -157,7 +220,7 @@ int a_svn_checkout
                             svn_depth_empty,
                             FALSE,
                             FALSE,
-                            context1,
+                            context,
                             svn_pool
                             );
 
@@ -186,7 +249,7 @@ int a_svn_checkout
                             FALSE,
                             FALSE,
                             FALSE,
-                            context2,
+                            context,
                             svn_pool
                             );
 
@@ -199,131 +262,6 @@ int a_svn_checkout
 
 
 
-int a_svn_diff
-(char *device_group, char *device_name, char *configured_by, char *repository_path, 
- char *temp_working_dir, apr_pool_t *apr_pool, apr_pool_t *svn_pool)
-/*
-*
-* diff of a working copy and svn head (for a single file)
-*
-*/
-{
-
-    svn_error_t* err;
-    int int_err;
-    apr_array_header_t *device_arr;
-    apr_file_t *diff_outfile;
-    apr_file_t *diff_errfile;
-    apr_array_header_t *array;
-    struct stat svn_diff_file_info;
-    int svn_diff_file_size = 0;
-
-    char temp_svn_path[MAXPATH];
-    char full_device_svn_path[MAXPATH];
-    char svn_diff_outfname[50]=".";
-    char svn_diff_errfname[50]=".";
-
-    svn_client_ctx_t* context;
-
-    svn_error_t *svn_err;
-
-    temp_svn_path[0] = 0x0;
-    full_device_svn_path[0] = 0x0;
-
-    strcat(temp_svn_path,temp_working_dir);
-
-    strcat(svn_diff_outfname,device_name);
-    strcat(svn_diff_outfname,".diff.tmp");
-
-    strcat(svn_diff_errfname,device_name);
-    strcat(svn_diff_errfname,".diff.err.tmp");
-
-    /* if device is in the device group - add group name to the SVN diff path: */
-
-    if(strstr(device_group,"none"))
-     snprintf(full_device_svn_path,MAXPATH,"%s/%s",repository_path,device_name);
-    else
-     snprintf(full_device_svn_path,MAXPATH,"%s/%s/%s",repository_path,device_group,device_name);
-
-    apr_file_open(&diff_outfile, svn_diff_outfname, (APR_READ | APR_WRITE | APR_CREATE ),
-                            ( APR_FPROT_UREAD | APR_FPROT_UWRITE |
-                              APR_FPROT_GREAD | APR_FPROT_WREAD ),
-                                        apr_pool);
-
-    apr_file_open(&diff_errfile, svn_diff_errfname, (APR_READ | APR_WRITE | APR_CREATE ),
-                            ( APR_FPROT_UREAD | APR_FPROT_UWRITE |
-                              APR_FPROT_GREAD | APR_FPROT_WREAD ),
-                                        apr_pool);
-
-    svn_err = svn_client_create_context( &context, svn_pool );
-    if(svn_err){a_logmsg("%s: svn error: %s",device_name,svn_err->message);
-                a_debug_info2(DEBUGLVL5,"a_svn_diff: svn error: %s",svn_err->message); 
-                return -1;}
-
-
-    svn_opt_revision_t pegrevision;
-    pegrevision.kind = svn_opt_revision_unspecified;
-
-    svn_opt_revision_t revision1;
-    revision1.kind = svn_opt_revision_working;
-
-    svn_opt_revision_t revision2;
-    revision2.kind = svn_opt_revision_head;
-
-    strcat(temp_svn_path,"/");
-    strcat(temp_svn_path,device_name);
-
-    array = apr_array_make (apr_pool, 0, sizeof (const char *));
-
-    svn_err = svn_client_diff4(array,
-                             svn_path_canonicalize(temp_svn_path,apr_pool),
-                             &revision1,
-                             svn_path_canonicalize(full_device_svn_path,apr_pool),
-                             &revision2,
-                             NULL,
-                             svn_depth_empty,
-                             FALSE,
-                             TRUE,
-                             FALSE,
-                             APR_LOCALE_CHARSET,
-                             diff_outfile,
-                             diff_errfile,
-                             NULL,
-                             context,
-                             svn_pool);
-    if(svn_err){
-                a_logmsg("%s: svn error: %s",device_name,svn_err->message);
-                a_debug_info2(DEBUGLVL5,"a_svn_diff: svn error: %s",svn_err->message); 
-                return -1;
-               }
-
-
-    apr_file_close(diff_errfile);
-    remove(svn_diff_errfname);
-    apr_file_close(diff_outfile);
-
-    if( (stat(svn_diff_outfname,&svn_diff_file_info)) == -1)
-     a_debug_info2(DEBUGLVL5,"a_svn_diff: cannot stat %s!",svn_diff_outfname);
-
-    svn_diff_file_size = (int)svn_diff_file_info.st_size; 
-
-    if((G_config_info.keep_changelog) && (svn_diff_file_size > 0)) 
-      if(!a_add_changelog_entry(svn_diff_outfname, svn_diff_file_size, device_name, configured_by))
-       {
-        a_logmsg("a_svn_diff: %s: cannot write changelog entry!",device_name);
-        a_debug_info2(DEBUGLVL5,"a_svn_diff: cannot write changelog entry!",device_name);
-       }
-
-    /* what we are returning here, is the length of a diff file */
-    /* if it is nonzero - revisions differ: */
-
-    remove(svn_diff_outfname);
-    return svn_diff_file_size;  
-
-}
-
-
-
 int a_svn_commit
 (char *device_name, char *temp_working_dir, char *commit_as, 
  apr_pool_t *apr_pool, apr_pool_t *svn_pool)
@@ -336,20 +274,14 @@ int a_svn_commit
     int int_err;
     apr_array_header_t *device_arr;
     svn_commit_info_t *commit_info = NULL;
-    svn_auth_baton_t *auth_baton;
-    svn_auth_provider_object_t *provider;
     svn_error_t *svn_err;
     char temp_svn_path[MAXPATH];
     svn_client_ctx_t* context;
 
     temp_svn_path[0] = 0x0;
 
-    svn_err = svn_client_create_context( &context, svn_pool );
-
-    if(svn_err){
-                a_logmsg("%s: svn error: %s",device_name,svn_err->message);
-                a_debug_info2(DEBUGLVL5,"a_svn_commit: svn error: %s",svn_err->message); return -1;
-               }
+    if( (context = a_svn_client_ctx(commit_as)) == NULL )
+     return -1;
 
 
     device_arr = apr_array_make(apr_pool, 1, sizeof(const char*));
@@ -358,16 +290,6 @@ int a_svn_commit
 
     *(const char**)apr_array_push(device_arr) = temp_svn_path;
 
-
-    apr_array_header_t *providers = apr_array_make (apr_pool, 1, sizeof (svn_auth_provider_object_t *));
-
-    svn_auth_get_username_provider(&provider, svn_pool);
-    APR_ARRAY_PUSH(providers, svn_auth_provider_object_t *) = provider;
-    svn_auth_open(&auth_baton, providers, svn_pool);
-    svn_auth_set_parameter(auth_baton, SVN_AUTH_PARAM_DEFAULT_USERNAME, commit_as);
-
-    (*context).auth_baton = auth_baton;
-
     svn_err = svn_client_commit4(&commit_info,
                            device_arr,
                            svn_depth_empty,
@@ -403,12 +325,8 @@ int a_svn_add
 
   temp_svn_path[0] = 0x0;
 
-  svn_err = svn_client_create_context( &context, svn_pool );
-  if(svn_err)
-   {
-    a_debug_info2(DEBUGLVL3,"a_svn_add: svn error: %s",svn_err->message);
-    return -1;
-   }
+  if( (context = a_svn_client_ctx(NULL)) == NULL )
+   return -1;
 
   snprintf(temp_svn_path,MAXPATH,"%s/%s",temp_working_dir,device_name);
 
@@ -430,40 +348,199 @@ int a_svn_add
 }
 
 
-int a_svn_configured_repo_stat
-(void)
+int a_svn_wc_update
+(char *device_name, char *repository_path, char *wc_dir, apr_pool_t *apr_pool, apr_pool_t *svn_pool)
+/*
+*
+* bring config file of a single device in a kept working copy up to date with HEAD.
+* working copy is checked out again if it is missing, broken or if it belongs to some
+* other repository path. an update error of the device file itself only reverts that
+* file. without WorkingCopyCache this is just a_svn_checkout.
+* return values are the same as of a_svn_checkout.
+*
+*/
+{
+
+    apr_array_header_t *device_arr;
+    svn_error_t *svn_err;
+    struct stat checked_file_info;
+    const char *wc_url = NULL;
+
+    char admin_dir[MAXPATH];
+    char temp_svn_path[MAXPATH];
+
+    svn_client_ctx_t* context;
+
+    a_debug_info2(DEBUGLVL5,"a_svn_wc_update: args: [%s], [%s], [%s]",
+                  device_name,repository_path,wc_dir);
+
+    if(G_config_info.wc_cache == WC_CACHE_NONE)
+     return a_svn_checkout(device_name,repository_path,wc_dir,apr_pool,svn_pool);
+
+    snprintf(admin_dir,MAXPATH,"%s/.svn",wc_dir);
+
+    if(stat(admin_dir,&checked_file_info) == -1)   /* first run - no working copy yet */
+     return a_svn_checkout(device_name,repository_path,wc_dir,apr_pool,svn_pool);
+
+    svn_err = svn_client_url_from_path(&wc_url, wc_dir, svn_pool);
+
+    if(svn_err || (wc_url == NULL) || strcmp(wc_url, svn_path_canonicalize(repository_path, svn_pool)))
+     {
+      a_debug_info2(DEBUGLVL5,"a_svn_wc_update: %s is not a working copy of %s. checking out again.",
+                    wc_dir,repository_path);
+      if(svn_err)
+       svn_error_clear(svn_err);
+      return a_svn_checkout(device_name,repository_path,wc_dir,apr_pool,svn_pool);
+     }
+
+    if( (context = a_svn_client_ctx(NULL)) == NULL )
+     return -2;
+
+    svn_opt_revision_t revision;
+    revision.kind = svn_opt_revision_head;
+
+    snprintf(temp_svn_path,MAXPATH,"%s/%s",wc_dir,device_name);
+
+    device_arr = apr_array_make(apr_pool, 1, sizeof(const char*));
+
+    *(const char**)apr_array_push(device_arr) = temp_svn_path;
+
+    svn_err = svn_client_update3(NULL,
+                            device_arr,
+                            &revision,
+                            svn_depth_empty,
+                            FALSE,
+                            FALSE,
+                            FALSE,
+                            context,
+                            svn_pool
+                            );
+
+    if(svn_err)
+     {
+      /* working copy may be shared by a whole group - don't throw it away because of one */
+      /* device file. clean up locks left by an interrupted run, drop local state of this   */
+      /* device file and try once more. only a working copy that can't be cleaned up (broken */
+      /* .svn) is checked out again.                                                        */
+
+      a_debug_info2(DEBUGLVL5,"a_svn_wc_update: %s: svn error: %s. reverting device file.",
+                    device_name,svn_err->message);
+      svn_error_clear(svn_err);
+
+      if( (svn_err = svn_client_cleanup(wc_dir, context, svn_pool)) )
+       {
+        a_debug_info2(DEBUGLVL5,"a_svn_wc_update: cannot clean up %s: %s. checking out again.",
+                      wc_dir,svn_err->message);
+        svn_error_clear(svn_err);
+        return a_svn_checkout(device_name,repository_path,wc_dir,apr_pool,svn_pool);
+       }
+
+      if(a_svn_wc_revert(device_name,wc_dir,apr_pool,svn_pool) == -1)
+       return -2;
+
+      svn_err = svn_client_update3(NULL,
+                              device_arr,
+                              &revision,
+                              svn_depth_empty,
+                              FALSE,
+                              FALSE,
+                              FALSE,
+                              context,
+                              svn_pool
+                              );
+
+      if(svn_err)
+       {
+        a_logmsg("%s: svn error: %s",device_name,svn_err->message);
+        a_debug_info2(DEBUGLVL5,"a_svn_wc_update: svn error: %s",svn_err->message);
+        svn_error_clear(svn_err);
+        return -2;
+       }
+     }
+
+    if(stat(temp_svn_path,&checked_file_info) != -1) return (int)checked_file_info.st_size; else return -1;
+
+}
+
+
+int a_svn_wc_revert
+(char *device_name, char *wc_dir, apr_pool_t *apr_pool, apr_pool_t *svn_pool)
 /*
 *
-* Initial check if configured SVN repository is accessible
+* drop whatever this device left in a kept working copy (local changes, scheduled add)
+* and remove the file - next a_svn_wc_update brings it back from HEAD.
+* returns 1 on success, -1 if the working copy can't be reverted.
 *
 */
- {
+{
+    apr_array_header_t *device_arr;
+    svn_error_t *svn_err;
+    svn_client_ctx_t* context;
+    char temp_svn_path[MAXPATH];
 
-   int checkout_status;
-   char svn_tmp_dirname[MAXPATH];
-   apr_pool_t *svn_pool;
-   apr_pool_t *apr_pool;
+    if( (context = a_svn_client_ctx(NULL)) == NULL )
+     return -1;
 
-   svn_pool = svn_pool_create(NULL);
-   apr_pool_create(&apr_pool,NULL);
+    snprintf(temp_svn_path,MAXPATH,"%s/%s",wc_dir,device_name);
 
-   snprintf(svn_tmp_dirname,MAXPATH,"%s.%d.test",G_svn_tmp_prefix,G_config_info.instance_id);
+    device_arr = apr_array_make(apr_pool, 1, sizeof(const char*));
 
-   checkout_status = a_svn_sparse_checkout(G_config_info.repository_path,svn_tmp_dirname,
-                                           apr_pool, svn_pool);
+    *(const char**)apr_array_push(device_arr) = temp_svn_path;
 
-   if(checkout_status < 0)
-    {
-     a_debug_info2(DEBUGLVL3,"a_svn_configured_repo_stat: initial repository check failed!");
-    }
+    svn_err = svn_client_revert2(device_arr,
+                                 svn_depth_empty,
+                                 NULL,
+                                 context,
+                                 svn_pool);
 
-   a_remove_directory(svn_tmp_dirname);
+    if(svn_err)
+     {
+      a_debug_info2(DEBUGLVL5,"a_svn_wc_revert: %s: svn error: %s",device_name,svn_err->message);
+      svn_error_clear(svn_err);
+      return -1;
+     }
+
+    if((remove(temp_svn_path) == -1) && (errno != ENOENT))
+     return -1;
 
-   svn_pool_destroy(svn_pool);
-   apr_pool_destroy(apr_pool);
+    return 1;
+}
 
-   return checkout_status;
 
- }
+pthread_mutex_t *a_svn_wc_lock
+(char *wc_dir)
+/*
+*
+* lock working copy shared by devices of one group (svn operations on one working copy
+* can't run concurrently). returns locked mutex, NULL if it cannot be allocated.
+*
+*/
+{
+   pthread_mutex_t *wc_mutex;
+
+   pthread_mutex_lock(&G_wc_locks_mutex);
+
+   if(G_wc_locks == NULL)
+    G_wc_locks = a_hash_create(HASH_MIN_SIZE, NO);
+
+   if( (wc_mutex = a_hash_get(G_wc_locks, wc_dir)) == NULL )
+    if( (wc_mutex = malloc(sizeof(pthread_mutex_t))) != NULL )
+     {
+      pthread_mutex_init(wc_mutex, NULL);
+      if((G_wc_locks == NULL) || !a_hash_put(G_wc_locks, wc_dir, wc_mutex))
+       {
+        free(wc_mutex);
+        wc_mutex = NULL;
+       }
+     }
+
+   pthread_mutex_unlock(&G_wc_locks_mutex);
+
+   if(wc_mutex != NULL)
+    pthread_mutex_lock(wc_mutex);
+
+   return wc_mutex;
+}
+
 
 /* end of svn.c  */
@@ -0,0 +1,565 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    svnfs.c - committing device configs straight to a local repository (SVNBackend fs)
+*
+*    repository at the file:// RepositoryPath (or RepositoryRoute) is opened with
+*    svn_repos, bypassing the client and ra layers. every archiver worker opens it
+*    once and keeps the handle (svn_fs objects can't be shared by threads). config
+*    in the head revision is read from the revision root, and a changed config is
+*    written to a commit transaction - repository hooks are run as with any other
+*    commit.
+*
+*    repo-pack and repo-verify scheduled jobs maintain local repositories the same
+*    way, whatever the SVNBackend - when the daemon isn't archiving anything.
+*
+*/
+
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "svn_pools.h"
+#include "svn_repos.h"
+#include "svn_fs.h"
+#include "svn_io.h"
+#include "svn_path.h"
+
+
+const char *a_svn_fs_repos_path
+(const char *repository, apr_pool_t *pool)
+/*
+*
+* local path of the repository from its file:// URL
+*
+*/
+{
+   const char *path = repository;
+
+   if(!strncasecmp(path, "file://", 7))
+    {
+     path += 7;
+     if(!strncasecmp(path, "localhost/", 10))
+      path += 9;
+    }
+
+   return svn_path_canonicalize(svn_path_uri_decode(path, pool), pool);
+}
+
+
+int a_svn_fs_init
+(int open_repositories)
+/*
+*
+* initialize svn_fs library (and check that the repositories can be opened,
+* if asked to) - once, before archiver workers start
+*
+*/
+{
+   svn_error_t *svn_err;
+   svn_repos_t *repos;
+   apr_pool_t *pool;
+   char *repositories[MAX_REPOSITORIES];
+   int count, i;
+
+   if( (svn_err = svn_fs_initialize(G_svn_root_pool)) )
+    {
+     a_debug_info2(DEBUGLVL3,"a_svn_fs_init: svn error: %s",svn_err->message);
+     svn_error_clear(svn_err);
+     return -1;
+    }
+
+   if(!open_repositories)
+    return 1;
+
+   pool = svn_pool_create(G_svn_root_pool);
+
+   count = a_repositories(repositories, MAX_REPOSITORIES);
+
+   for(i = 0; i < count; i++)
+    {
+     if( (svn_err = svn_repos_open(&repos, a_svn_fs_repos_path(repositories[i], pool), pool)) )
+      {
+       fprintf(stderr,"svn error: %s: %s\n",repositories[i],svn_err->message);
+       a_debug_info2(DEBUGLVL3,"a_svn_fs_init: svn error: %s",svn_err->message);
+       svn_error_clear(svn_err);
+       svn_pool_destroy(pool);
+       return -1;
+      }
+
+     svn_pool_clear(pool);
+    }
+
+   svn_pool_destroy(pool);
+   return 1;
+}
+
+
+svn_repos_t *a_svn_fs_repos
+(svn_worker_t *worker, char *repository)
+/*
+*
+* repository handle of the worker - opened on first use and kept. NULL on error.
+*
+*/
+{
+   svn_error_t *svn_err;
+   svn_repos_t *repos;
+
+   if( (repos = a_hash_get(worker->repos, repository)) != NULL )
+    return repos;
+
+   if(worker->repos == NULL)
+    if( (worker->repos = a_hash_create(MAX_REPOSITORIES, NO)) == NULL )
+     return NULL;
+
+   if( (svn_err = svn_repos_open(&repos, a_svn_fs_repos_path(repository, worker->pool), worker->pool)) )
+    {
+     a_logmsg("svn error: cannot open repository %s: %s",repository,svn_err->message);
+     a_debug_info2(DEBUGLVL5,"a_svn_fs_repos: svn error: %s",svn_err->message);
+     svn_error_clear(svn_err);
+     return NULL;
+    }
+
+   if(!a_hash_put(worker->repos, repository, repos))
+    a_debug_info2(DEBUGLVL3,"a_svn_fs_repos: malloc failed! repository handle will not be kept.");
+
+   a_debug_info2(DEBUGLVL5,"a_svn_fs_repos: opened repository %s",repository);
+
+   return repos;
+}
+
+
+svn_error_t *a_svn_fs_read_file
+(svn_fs_root_t *root, const char *path, svn_stringbuf_t **contents, apr_pool_t *pool)
+/*
+*
+* whole file from the repository into memory
+*
+*/
+{
+   svn_error_t *svn_err;
+   svn_filesize_t length;
+   svn_stream_t *stream;
+   svn_stringbuf_t *buffer;
+   apr_size_t len;
+
+   if( (svn_err = svn_fs_file_length(&length, root, path, pool)) )
+    return svn_err;
+
+   if( (svn_err = svn_fs_file_contents(&stream, root, path, pool)) )
+    return svn_err;
+
+   buffer = svn_stringbuf_create_ensure(length + 1, pool);
+
+   do
+    {
+     len = length - buffer->len;
+
+     if( (svn_err = svn_stream_read(stream, buffer->data + buffer->len, &len)) )
+      return svn_err;
+
+     buffer->len += len;
+    }
+   while((len > 0) && (buffer->len < length));
+
+   buffer->data[buffer->len] = 0x0;
+   *contents = buffer;
+
+   return svn_stream_close(stream);
+}
+
+
+int a_svn_fs_sync
+(char *device_group, char *device_name, char *configured_by, config_buffer_t *config)
+/*
+*
+* commit downloaded config of a device (config buffer) through a repository
+* transaction. device group directory is created in the same commit if needed.
+* returns 1 if changes were committed, 2 if the device was added, 0 if config
+* didn't change, -1 on error (as a_svn_ra_sync).
+*
+*/
+{
+   svn_worker_t *worker;
+   svn_repos_t *repos;
+   svn_fs_t *fs;
+   svn_fs_root_t *head_root, *txn_root;
+   svn_fs_txn_t *txn = NULL;
+   svn_stream_t *stream;
+   apr_pool_t *pool;
+   svn_error_t *svn_err;
+   svn_revnum_t head, committed = SVN_INVALID_REVNUM;
+   svn_node_kind_t kind = svn_node_none, group_kind = svn_node_dir;
+   svn_stringbuf_t *old_config;
+   config_diff_t config_diff;
+   const char *device_path, *group_path, *conflict;
+   apr_size_t len;
+   int in_group, changed, result;
+
+   if( (worker = a_svn_worker_get()) == NULL )
+    {
+     a_debug_info2(DEBUGLVL3,"a_svn_fs_sync: malloc failed!");
+     return -1;
+    }
+
+   if( (repos = a_svn_fs_repos(worker, a_repo_route(device_group))) == NULL )
+    return -1;
+
+   fs = svn_repos_fs(repos);
+
+   pool = a_svn_worker_job_pool(worker);       /* everything for this run */
+
+   in_group = (strstr(device_group,"none") == NULL);
+
+   group_path = apr_psprintf(pool, "/%s", device_group);
+   device_path = in_group ? apr_psprintf(pool, "/%s/%s", device_group, device_name) : 
+                            apr_psprintf(pool, "/%s", device_name);
+
+   if( (svn_err = svn_fs_youngest_rev(&head, fs, pool)) )
+    goto fs_fail;
+
+   if( (svn_err = svn_fs_revision_root(&head_root, fs, head, pool)) )
+    goto fs_fail;
+
+   if(in_group)
+    if( (svn_err = svn_fs_check_path(&group_kind, head_root, group_path, pool)) )
+     goto fs_fail;
+
+   if(group_kind == svn_node_dir)
+    if( (svn_err = svn_fs_check_path(&kind, head_root, device_path, pool)) )
+     goto fs_fail;
+
+   if((group_kind == svn_node_file) || (kind == svn_node_dir))
+    {
+     a_logmsg("%s: %s is not a file in the repository! not archived.",device_name,device_path);
+     result = -1;
+     goto done;
+    }
+
+   if(kind == svn_node_file)
+    {
+     if( (svn_err = a_svn_fs_read_file(head_root, device_path, &old_config, pool)) )
+      goto fs_fail;
+
+     changed = a_config_diff(old_config->data, old_config->len, config->data, config->len,
+                             G_config_info.keep_changelog ? apr_psprintf(pool, "%s\t(revision %ld)", device_path + 1, head) : NULL,
+                             apr_psprintf(pool, "%s\t(device)", device_path + 1), &config_diff);
+
+     if(changed == 0)
+      {
+       result = 0;
+       goto done;
+      }
+
+     if(changed == 1)
+      {
+       a_debug_info2(DEBUGLVL5,"a_svn_fs_sync: %s: %d lines added, %d removed.",device_name,
+                     config_diff.added,config_diff.removed);
+
+       if(G_config_info.keep_changelog && (config_diff.text != NULL))
+        if(!a_add_changelog_buffer(config_diff.text, config_diff.text_len, device_name, configured_by))
+         a_logmsg("a_svn_fs_sync: %s: cannot write changelog entry!",device_name);
+
+       a_config_diff_free(&config_diff);
+      }
+    }
+
+   /* transaction on top of head: (group) -> device file */
+
+   if( (svn_err = svn_repos_fs_begin_txn_for_commit(&txn, repos, head, configured_by, "", pool)) )
+    goto fs_fail;
+
+   if( (svn_err = svn_fs_txn_root(&txn_root, txn, pool)) )
+    goto fs_fail;
+
+   if(in_group && (group_kind == svn_node_none))
+    {
+     a_logmsg("adding new device group: %s",device_group);
+     if( (svn_err = svn_fs_make_dir(txn_root, group_path, pool)) )
+      goto fs_fail;
+    }
+
+   if(kind != svn_node_file)
+    if( (svn_err = svn_fs_make_file(txn_root, device_path, pool)) )
+     goto fs_fail;
+
+   if( (svn_err = svn_fs_apply_text(&stream, txn_root, device_path, NULL, pool)) )
+    goto fs_fail;
+
+   len = config->len;
+
+   if( (svn_err = svn_stream_write(stream, config->data, &len)) )
+    goto fs_fail;
+
+   if( (svn_err = svn_stream_close(stream)) )
+    goto fs_fail;
+
+   if( (svn_err = svn_repos_fs_commit_txn(&conflict, repos, &committed, txn, pool)) )
+    {
+     if(SVN_IS_VALID_REVNUM(committed))     /* committed, but post-commit hook failed */
+      {
+       a_logmsg("%s: svn warning: %s",device_name,svn_err->message);
+       svn_error_clear(svn_err);
+      }
+     else
+      goto fs_fail;
+    }
+
+   a_debug_info2(DEBUGLVL5,"a_svn_fs_sync: %s: committed revision %ld",device_name,committed);
+
+   result = (kind == svn_node_file) ? 1 : 2;
+   goto done;
+
+ fs_fail:
+   a_logmsg("%s: svn error: %s",device_name,svn_err->message);
+   a_debug_info2(DEBUGLVL5,"a_svn_fs_sync: svn error: %s",svn_err->message);
+   svn_error_clear(svn_err);
+
+   if(txn != NULL)
+    svn_error_clear(svn_fs_abort_txn(txn, pool));
+
+   result = -1;
+
+ done:
+   svn_pool_clear(pool);
+   return result;
+}
+
+
+
+svn_error_t *a_repo_maintenance_cancel
+(void *cancel_baton)
+/*
+*
+* stop long repository maintenance when the program is shutting down
+*
+*/
+{
+   if(G_stop_all_processing)
+    return svn_error_create(SVN_ERR_CANCELLED, NULL, "archivist is shutting down");
+
+   return SVN_NO_ERROR;
+}
+
+
+svn_error_t *a_repo_pack_notify
+(void *baton, apr_int64_t shard, svn_fs_pack_notify_action_t action, apr_pool_t *pool)
+{
+   if(action == svn_fs_pack_notify_end)
+    (*(int *)baton)++;
+
+   return SVN_NO_ERROR;
+}
+
+
+int a_repo_maintenance_idle
+(void)
+/*
+*
+* can repository maintenance start now? - no archiving job running or waiting,
+* no bulk run, no group commit pending, and no other maintenance job running.
+*
+*/
+{
+   int idle;
+
+   if(G_repo_maintenance)
+    return 0;
+
+   pthread_mutex_lock(&G_thread_count_mutex);
+   idle = (G_active_archiver_threads == 0);
+   pthread_mutex_unlock(&G_thread_count_mutex);
+
+   pthread_mutex_lock(&G_M_thread_count_mutex);
+   idle = idle && (G_active_bulk_archiver_threads == 0);
+   pthread_mutex_unlock(&G_M_thread_count_mutex);
+
+   return idle && (a_archiver_queue_depth() == 0) && (G_ra_batch == NULL) && (G_onboard_batch == NULL);
+}
+
+
+int a_repo_maintenance_run
+(svn_repos_t *repos, char *repository, int job, apr_pool_t *pool)
+/*
+*
+* pack or verify one repository. repo-verify checks revisions committed since
+* the previous verify of the repository (all of them the first time).
+* returns 1 on success, -1 on error.
+*
+*/
+{
+   svn_error_t *svn_err;
+   svn_revnum_t head, *verified;
+   struct timeval started, finished;
+   int shards = 0;
+
+   gettimeofday(&started, NULL);
+
+   if(job == REPO_PACK)
+    svn_err = svn_repos_fs_pack(repos, a_repo_pack_notify, &shards, a_repo_maintenance_cancel, NULL, pool);
+   else
+    {
+     if( (svn_err = svn_fs_youngest_rev(&head, svn_repos_fs(repos), pool)) )
+      goto maintenance_fail;
+
+     if( (verified = a_hash_get(G_verified_revs, repository)) == NULL )
+      {
+       if( (verified = malloc(sizeof(svn_revnum_t))) == NULL )
+        return -1;
+
+       *verified = -1;
+
+       if(!a_hash_put(G_verified_revs, repository, verified))
+        {
+         free(verified);
+         return -1;
+        }
+      }
+
+     if(*verified >= head)
+      {
+       a_logmsg("repo-verify: %s: no new revisions since the last verify (r%ld).",repository,head);
+       return 1;
+      }
+
+     if( !(svn_err = svn_repos_verify_fs(repos, svn_stream_empty(pool), *verified + 1, head,
+                                         a_repo_maintenance_cancel, NULL, pool)) )
+      {
+       a_logmsg("repo-verify: %s: revisions %ld - %ld verified.",repository,*verified + 1,head);
+       *verified = head;
+      }
+    }
+
+   if(svn_err)
+    goto maintenance_fail;
+
+   gettimeofday(&finished, NULL);
+
+   if(job == REPO_PACK)
+    a_logmsg("repo-pack: %s: %d shards packed in %.1f s.",repository,shards,
+             (finished.tv_sec - started.tv_sec) + (finished.tv_usec - started.tv_usec) / 1000000.0);
+   else
+    a_logmsg("repo-verify: %s: done in %.1f s.",repository,
+             (finished.tv_sec - started.tv_sec) + (finished.tv_usec - started.tv_usec) / 1000000.0);
+
+   return 1;
+
+ maintenance_fail:
+   gettimeofday(&finished, NULL);
+   a_logmsg("%s: %s: FAILED after %.1f s: %s",(job == REPO_PACK) ? "repo-pack" : "repo-verify",repository,
+            (finished.tv_sec - started.tv_sec) + (finished.tv_usec - started.tv_usec) / 1000000.0,
+            svn_err->message);
+   svn_error_clear(svn_err);
+   return -1;
+}
+
+
+void *a_repo_maintenance
+(void *arg)
+/*
+*
+* repository maintenance thread: pack or verify every local repository
+*
+*/
+{
+   svn_worker_t *worker;
+   svn_repos_t *repos;
+   svn_error_t *svn_err;
+   apr_pool_t *pool;
+   char *repositories[MAX_REPOSITORIES];
+   int job = (long)arg;
+   int count, i;
+
+   if( (worker = a_svn_worker_get()) == NULL )
+    {
+     a_debug_info2(DEBUGLVL3,"a_repo_maintenance: malloc failed!");
+     G_repo_maintenance = 0;
+     return NULL;
+    }
+
+   pool = a_svn_worker_job_pool(worker);
+
+   count = a_repositories(repositories, MAX_REPOSITORIES);
+
+   for(i = 0; (i < count) && !G_stop_all_processing; i++)
+    {
+     if(strncasecmp(repositories[i], "file://", 7))
+      {
+       a_logmsg("%s: %s is not a local repository - skipped.",(job == REPO_PACK) ? "repo-pack" : "repo-verify",
+                repositories[i]);
+       continue;
+      }
+
+     if( (svn_err = svn_repos_open(&repos, a_svn_fs_repos_path(repositories[i], pool), pool)) )
+      {
+       a_logmsg("svn error: cannot open repository %s: %s",repositories[i],svn_err->message);
+       svn_error_clear(svn_err);
+       continue;
+      }
+
+     a_repo_maintenance_run(repos, repositories[i], job, pool);
+
+     svn_pool_clear(pool);
+    }
+
+   G_repo_maintenance = 0;
+
+   return NULL;
+}
+
+
+int a_repo_maintenance_start
+(int job)
+/*
+*
+* start repository maintenance job (REPO_PACK, REPO_VERIFY) in its own thread.
+* returns 1 if started, 0 if it has to wait - archiving is in progress (the
+* scheduler asks again), -1 on error.
+*
+*/
+{
+   pthread_t thread;
+   pthread_attr_t attr;
+
+   if(!a_repo_maintenance_idle())
+    return 0;
+
+   G_repo_maintenance = 1;
+
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+   pthread_attr_setstacksize(&attr, ARCHIVIST_THREAD_STACK_SIZE);
+
+   if(pthread_create(&thread, &attr, a_repo_maintenance, (void *)(long)job) != 0)
+    {
+     a_logmsg("ERROR: cannot create repository maintenance thread!");
+     G_repo_maintenance = 0;
+     pthread_attr_destroy(&attr);
+     return -1;
+    }
+
+   pthread_attr_destroy(&attr);
+   return 1;
+}
+
+
+/* end of svnfs.c  */
@@ -0,0 +1,1068 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    svnra.c - committing device configs without a working copy (SVNBackend ra)
+*
+*    every archiver worker keeps its svn_ra sessions to the repository root open
+*    between archive runs - one session per commit author, as the author is bound
+*    to the session. config in the repository is fetched with svn_ra_get_file and
+*    compared with the downloaded one in memory. if it changed, it is sent through
+*    the commit editor as a text delta (or as a new file).
+*
+*    with GroupCommitWindow set, changed configs found by scheduled archiving are not
+*    committed by the worker - they wait in G_ra_batch, and the batch committer thread
+*    commits them together, as one revision.
+*
+*    during an onboarding bulk run (see a_archive_bulk) configs of devices new to the
+*    repository wait in G_onboard_batch the same way, and are added in one revision
+*    when the run ends - whatever the SVNBackend is.
+*/
+
+#include "defs.h"
+#include "archivist_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "svn_pools.h"
+#include "apr_allocator.h"
+#include "svn_auth.h"
+#include "svn_ra.h"
+#include "svn_delta.h"
+#include "svn_io.h"
+#include "svn_path.h"
+#include "svn_props.h"
+
+
+static pthread_once_t G_svn_worker_key_once = PTHREAD_ONCE_INIT;
+
+
+int a_svn_ra_init
+(void)
+/*
+*
+* initialize svn_ra library - once, before archiver workers start
+*
+*/
+{
+   svn_error_t *svn_err;
+
+   if( (svn_err = svn_ra_initialize(G_svn_root_pool)) )
+    {
+     a_debug_info2(DEBUGLVL3,"a_svn_ra_init: svn error: %s",svn_err->message);
+     svn_error_clear(svn_err);
+     return -1;
+    }
+
+   return 1;
+}
+
+
+void a_svn_worker_key_create
+(void)
+{
+   pthread_key_create(&G_svn_worker_key, NULL);
+}
+
+
+svn_worker_t *a_svn_worker_get
+(void)
+/*
+*
+* svn state of the calling archiver worker. created on first use, and again
+* after APR reinit (the old pool was destroyed by apr_terminate then).
+*
+*/
+{
+   svn_worker_t *worker;
+   apr_allocator_t *allocator;
+
+   pthread_once(&G_svn_worker_key_once, a_svn_worker_key_create);
+
+   if( (worker = pthread_getspecific(G_svn_worker_key)) == NULL )
+    {
+     if( (worker = calloc(1, sizeof(svn_worker_t))) == NULL )
+      return NULL;
+     pthread_setspecific(G_svn_worker_key, worker);
+    }
+
+   if((worker->pool != NULL) && (worker->apr_generation == G_apr_generation))
+    return worker;
+
+   /* own root pool and allocator - no locking between workers, and memory freed */
+   /* by clearing the job pools goes back to the system above WORKER_POOL_MAX_FREE */
+
+   if(apr_allocator_create(&allocator) != APR_SUCCESS)
+    return NULL;
+
+   apr_allocator_max_free_set(allocator, WORKER_POOL_MAX_FREE);
+
+   a_hash_free(worker->ra_sessions, NULL);
+   a_hash_free(worker->auth_batons, NULL);
+   worker->ra_sessions = NULL;
+   worker->auth_batons = NULL;
+   worker->client_ctx = NULL;
+   a_hash_free(worker->repos, NULL);
+   worker->repos = NULL;
+   worker->pool = svn_pool_create_ex(NULL, allocator);
+   apr_allocator_owner_set(allocator, worker->pool);
+   worker->job_pool = svn_pool_create(worker->pool);
+   worker->iter_pool = svn_pool_create(worker->pool);
+   worker->session_pool = svn_pool_create(worker->pool);
+   worker->apr_generation = G_apr_generation;
+
+   return worker;
+}
+
+
+apr_pool_t *a_svn_worker_job_pool
+(svn_worker_t *worker)
+/*
+*
+* start of an archive run: clear what the previous run left in the job pools
+*
+*/
+{
+   svn_pool_clear(worker->iter_pool);
+   svn_pool_clear(worker->job_pool);
+
+   return worker->job_pool;
+}
+
+
+svn_ra_session_t *a_svn_ra_session
+(svn_worker_t *worker, char *repository, char *author)
+/*
+*
+* svn_ra session of the worker to the repository, for commits made by author. 
+* opened on first use and kept open. returns NULL on error.
+*
+*/
+{
+   svn_ra_session_t *session;
+   svn_ra_callbacks2_t *callbacks;
+   svn_auth_baton_t *auth_baton;
+   svn_auth_provider_object_t *provider;
+   apr_array_header_t *providers;
+   svn_error_t *svn_err;
+   char key[MAXPATH + 256];
+
+   snprintf(key, sizeof(key), "%s %s", author, repository);
+
+   if( (session = a_hash_get(worker->ra_sessions, key)) != NULL )
+    return session;
+
+   if((worker->ra_sessions == NULL) || (worker->ra_sessions->count >= RA_SESSIONS_PER_WORKER))
+    {
+     /* too many authors - close all sessions by clearing their pool, and start over */
+
+     a_hash_free(worker->ra_sessions, NULL);
+     svn_pool_clear(worker->session_pool);
+
+     if( (worker->ra_sessions = a_hash_create(RA_SESSIONS_PER_WORKER, NO)) == NULL )
+      {
+       a_debug_info2(DEBUGLVL3,"a_svn_ra_session: malloc failed!");
+       return NULL;
+      }
+    }
+
+   providers = apr_array_make(worker->session_pool, 1, sizeof(svn_auth_provider_object_t *));
+
+   svn_auth_get_username_provider(&provider, worker->session_pool);
+   APR_ARRAY_PUSH(providers, svn_auth_provider_object_t *) = provider;
+   svn_auth_open(&auth_baton, providers, worker->session_pool);
+   svn_auth_set_parameter(auth_baton, SVN_AUTH_PARAM_DEFAULT_USERNAME, apr_pstrdup(worker->session_pool, author));
+
+   if( (svn_err = svn_ra_create_callbacks(&callbacks, worker->session_pool)) )
+    goto ra_fail;
+
+   callbacks->auth_baton = auth_baton;
+
+   if( (svn_err = svn_ra_open3(&session, svn_path_canonicalize(repository, worker->session_pool),
+                               NULL, callbacks, NULL, NULL, worker->session_pool)) )
+    goto ra_fail;
+
+   if(!a_hash_put(worker->ra_sessions, key, session))
+    a_debug_info2(DEBUGLVL3,"a_svn_ra_session: malloc failed! session will not be kept.");
+
+   a_debug_info2(DEBUGLVL5,"a_svn_ra_session: opened session to %s for %s",repository,author);
+
+   return session;
+
+ ra_fail:
+   a_logmsg("svn error: cannot open session to %s: %s",repository,svn_err->message);
+   a_debug_info2(DEBUGLVL5,"a_svn_ra_session: svn error: %s",svn_err->message);
+   svn_error_clear(svn_err);
+   return NULL;
+}
+
+
+void a_svn_ra_session_drop
+(svn_worker_t *worker, char *repository, char *author)
+/*
+*
+* forget the session - it may be broken, a new one is opened next time
+*
+*/
+{
+   char key[MAXPATH + 256];
+
+   snprintf(key, sizeof(key), "%s %s", author, repository);
+   a_hash_remove(worker->ra_sessions, key);
+}
+
+
+svn_error_t *a_svn_ra_commit_done
+(const svn_commit_info_t *commit_info, void *baton, apr_pool_t *pool)
+{
+   *(svn_revnum_t *)baton = commit_info->revision;
+   return SVN_NO_ERROR;
+}
+
+
+ra_batch_item_t *a_svn_ra_batch_unlink
+(ra_batch_item_t **batch, int *count, char *device_name)
+/*
+*
+* take device out of the batch, if it is there. mutex of the batch must be held.
+*
+*/
+{
+   ra_batch_item_t **link, *item;
+
+   for(link = batch; (item = *link) != NULL; link = &item->next)
+    if(!strcasecmp(item->device_name, device_name))
+     {
+      *link = item->next;
+      item->next = NULL;
+      (*count)--;
+      return item;
+     }
+
+   return NULL;
+}
+
+
+void a_svn_ra_batch_item_free
+(ra_batch_item_t *item)
+{
+   free(item->device_group);
+   free(item->device_name);
+   free(item->author);
+   free(item->config);
+   free(item);
+}
+
+
+void a_svn_ra_batch_drop
+(char *device_name)
+/*
+*
+* forget config of the device waiting for group commit - a newer one is being
+* committed on its own. waits for the batch being committed right now, if any,
+* so the newer config always ends up on top.
+*
+*/
+{
+   ra_batch_item_t *item;
+
+   pthread_mutex_lock(&G_ra_batch_mutex);
+
+   if( (item = a_svn_ra_batch_unlink(&G_ra_batch, &G_ra_batch_count, device_name)) != NULL )
+    {
+     a_debug_info2(DEBUGLVL5,"a_svn_ra_batch_drop: %s: dropped from group commit.",device_name);
+     a_svn_ra_batch_item_free(item);
+    }
+
+   pthread_mutex_unlock(&G_ra_batch_mutex);
+}
+
+
+ra_batch_item_t *a_svn_ra_batch_item_new
+(char *device_group, char *device_name, char *author, char *config_digest, size_t config_len)
+/*
+*
+* batch item with room for config_len bytes of config. NULL on malloc failure.
+*
+*/
+{
+   ra_batch_item_t *item;
+
+   if( (item = calloc(1, sizeof(ra_batch_item_t))) == NULL )
+    return NULL;
+
+   item->device_group = strdup(device_group);
+   item->repository = a_repo_route(device_group);
+   item->device_name = strdup(device_name);
+   item->author = strdup(author);
+   item->config = malloc(config_len ? config_len : 1);
+   item->config_len = config_len;
+
+   if((item->device_group == NULL) || (item->device_name == NULL) || (item->author == NULL) || (item->config == NULL))
+    {
+     a_svn_ra_batch_item_free(item);
+     return NULL;
+    }
+
+   if(config_digest != NULL)
+    strncpy(item->digest, config_digest, CONFIG_DIGEST_LEN);
+
+   return item;
+}
+
+
+int a_svn_ra_batch_add
+(char *device_group, char *device_name, char *author, char *config_digest,
+ config_buffer_t *config, int added)
+/*
+*
+* put changed config into the batch waiting for group commit (replacing the 
+* one of the same device, if it is there). returns 1 on success, 0 on malloc failure.
+*
+*/
+{
+   ra_batch_item_t *item, *old_item;
+
+   if( (item = a_svn_ra_batch_item_new(device_group, device_name, author, config_digest, config->len)) == NULL )
+    return 0;
+
+   memcpy(item->config, config->data, config->len);
+   item->added = added;
+
+   pthread_mutex_lock(&G_ra_batch_mutex);
+
+   if( (old_item = a_svn_ra_batch_unlink(&G_ra_batch, &G_ra_batch_count, device_name)) != NULL )
+    a_svn_ra_batch_item_free(old_item);       /* newer config of the same device */
+
+   if(G_ra_batch == NULL)
+    G_ra_batch_started = time(NULL);
+
+   item->next = G_ra_batch;
+   G_ra_batch = item;
+   G_ra_batch_count++;
+
+   if(G_ra_batch_count >= G_config_info.group_commit_files)
+    pthread_cond_signal(&G_ra_batch_cond);
+
+   pthread_mutex_unlock(&G_ra_batch_mutex);
+
+   return 1;
+}
+
+
+int a_svn_ra_sync
+(char *device_group, char *device_name, char *configured_by, config_buffer_t *config,
+ char *config_digest)
+/*
+*
+* commit downloaded config of a device (config buffer) without a working copy.
+* device group directory is created in the same commit if it doesn't exist yet.
+* returns 1 if changes were committed, 2 if the device was added, 3 if changes
+* were put into the group commit batch, 0 if config didn't change, -1 on error.
+*
+*/
+{
+   svn_worker_t *worker;
+   svn_ra_session_t *session;
+   apr_pool_t *pool;
+   svn_error_t *svn_err;
+   svn_revnum_t head, committed = SVN_INVALID_REVNUM;
+   svn_node_kind_t kind = svn_node_none, group_kind = svn_node_dir;
+   svn_string_t new_config;
+   svn_stringbuf_t *old_config = NULL;
+   const svn_delta_editor_t *editor;
+   void *edit_baton, *root_baton, *dir_baton, *file_baton;
+   svn_txdelta_window_handler_t handler;
+   void *handler_baton;
+   svn_txdelta_stream_t *delta_stream;
+   apr_hash_t *revprops;
+   const char *device_path;
+   char *repository;
+   int in_group, editing = 0, result, batch, changed;
+   config_diff_t config_diff;
+
+   if(G_config_info.group_commit_window > 0)
+    {
+     /* a config of this device waiting for group commit is older than this one */
+
+     a_svn_ra_batch_drop(device_name);
+     batch = !strcmp(configured_by, RA_BATCH_AUTHOR);
+    }
+   else
+    batch = 0;
+
+   if( (worker = a_svn_worker_get()) == NULL )
+    {
+     a_debug_info2(DEBUGLVL3,"a_svn_ra_sync: malloc failed!");
+     return -1;
+    }
+
+   repository = a_repo_route(device_group);
+
+   if( (session = a_svn_ra_session(worker, repository, configured_by)) == NULL )
+    return -1;
+
+   pool = a_svn_worker_job_pool(worker);       /* everything for this run */
+
+   in_group = (strstr(device_group,"none") == NULL);
+
+   device_path = in_group ? apr_psprintf(pool, "%s/%s", device_group, device_name) : device_name;
+
+   new_config.data = config->data;     /* sent from the buffer - no copy */
+   new_config.len = config->len;
+
+   if( (svn_err = svn_ra_get_latest_revnum(session, &head, pool)) )
+    goto ra_fail;
+
+   if(in_group)
+    if( (svn_err = svn_ra_check_path(session, device_group, head, &group_kind, pool)) )
+     goto ra_fail;
+
+   if(group_kind == svn_node_dir)
+    if( (svn_err = svn_ra_check_path(session, device_path, head, &kind, pool)) )
+     goto ra_fail;
+
+   if((group_kind == svn_node_file) || (kind == svn_node_dir))
+    {
+     a_logmsg("%s: %s is not a file in the repository! not archived.",device_name,device_path);
+     result = -1;
+     goto done;
+    }
+
+   if(kind == svn_node_file)
+    {
+     old_config = svn_stringbuf_create_ensure(new_config.len + 1, pool);
+
+     if( (svn_err = svn_ra_get_file(session, device_path, head, svn_stream_from_stringbuf(old_config, pool),
+                                    NULL, NULL, pool)) )
+      goto ra_fail;
+
+     changed = a_config_diff(old_config->data, old_config->len, new_config.data, new_config.len,
+                             G_config_info.keep_changelog ? apr_psprintf(pool, "%s\t(revision %ld)", device_path, head) : NULL,
+                             apr_psprintf(pool, "%s\t(device)", device_path), &config_diff);
+
+     if(changed == 0)
+      {
+       result = 0;
+       goto done;
+      }
+
+     if(changed == 1)
+      {
+       a_debug_info2(DEBUGLVL5,"a_svn_ra_sync: %s: %d lines added, %d removed.",device_name,
+                     config_diff.added,config_diff.removed);
+
+       if(G_config_info.keep_changelog && (config_diff.text != NULL))
+        if(!a_add_changelog_buffer(config_diff.text, config_diff.text_len, device_name, configured_by))
+         a_logmsg("a_svn_ra_sync: %s: cannot write changelog entry!",device_name);
+
+       a_config_diff_free(&config_diff);
+      }
+    }
+
+   if(batch)
+    {
+     result = a_svn_ra_batch_add(device_group, device_name, configured_by, config_digest,
+                                 config, (kind != svn_node_file)) ? 3 : -1;
+     goto done;
+    }
+
+   /* drive the commit editor: root -> (group) -> device file */
+
+   revprops = apr_hash_make(pool);
+   apr_hash_set(revprops, SVN_PROP_REVISION_LOG, APR_HASH_KEY_STRING, svn_string_create("", pool));
+
+   if( (svn_err = svn_ra_get_commit_editor3(session, &editor, &edit_baton, revprops,
+                                            a_svn_ra_commit_done, &committed, NULL, FALSE, pool)) )
+    goto ra_fail;
+
+   editing = 1;
+
+   if( (svn_err = editor->open_root(edit_baton, head, pool, &root_baton)) )
+    goto ra_fail;
+
+   dir_baton = root_baton;
+
+   if(in_group)
+    {
+     if(group_kind == svn_node_none)
+      {
+       a_logmsg("adding new device group: %s",device_group);
+       svn_err = editor->add_directory(device_group, root_baton, NULL, SVN_INVALID_REVNUM, pool, &dir_baton);
+      }
+     else
+      svn_err = editor->open_directory(device_group, root_baton, head, pool, &dir_baton);
+
+     if(svn_err)
+      goto ra_fail;
+    }
+
+   if(kind == svn_node_file)
+    svn_err = editor->open_file(device_path, dir_baton, head, pool, &file_baton);
+   else
+    svn_err = editor->add_file(device_path, dir_baton, NULL, SVN_INVALID_REVNUM, pool, &file_baton);
+
+   if(svn_err)
+    goto ra_fail;
+
+   if( (svn_err = editor->apply_textdelta(file_baton, NULL, pool, &handler, &handler_baton)) )
+    goto ra_fail;
+
+   if(old_config != NULL)
+    {
+     svn_txdelta(&delta_stream, svn_stream_from_stringbuf(old_config, pool),
+                 svn_stream_from_string(&new_config, pool), pool);
+     svn_err = svn_txdelta_send_txstream(delta_stream, handler, handler_baton, pool);
+    }
+   else
+    svn_err = svn_txdelta_send_string(&new_config, handler, handler_baton, pool);
+
+   if(svn_err)
+    goto ra_fail;
+
+   if( (svn_err = editor->close_file(file_baton, NULL, pool)) )
+    goto ra_fail;
+
+   if(in_group)
+    if( (svn_err = editor->close_directory(dir_baton, pool)) )
+     goto ra_fail;
+
+   if( (svn_err = editor->close_directory(root_baton, pool)) )
+    goto ra_fail;
+
+   if( (svn_err = editor->close_edit(edit_baton, pool)) )
+    goto ra_fail;
+
+   a_debug_info2(DEBUGLVL5,"a_svn_ra_sync: %s: committed revision %ld",device_name,committed);
+
+   result = (kind == svn_node_file) ? 1 : 2;
+   goto done;
+
+ ra_fail:
+   a_logmsg("%s: svn error: %s",device_name,svn_err->message);
+   a_debug_info2(DEBUGLVL5,"a_svn_ra_sync: svn error: %s",svn_err->message);
+   svn_error_clear(svn_err);
+
+   if(editing)
+    svn_error_clear(editor->abort_edit(edit_baton, pool));
+
+   a_svn_ra_session_drop(worker, repository, configured_by);   /* session may be broken */
+
+   result = -1;
+
+ done:
+   svn_pool_clear(pool);
+   return result;
+}
+
+
+int a_svn_ra_batch_send
+(const svn_delta_editor_t *editor, void *dir_baton, ra_batch_item_t *item,
+ svn_ra_session_t *session, svn_revnum_t head, apr_pool_t *pool)
+/*
+*
+* send batched config of one device through the commit editor (full text)
+*
+*/
+{
+   svn_error_t *svn_err;
+   svn_node_kind_t kind;
+   svn_txdelta_window_handler_t handler;
+   void *handler_baton, *file_baton;
+   svn_string_t config;
+   const char *device_path;
+
+   if(strstr(item->device_group,"none"))
+    device_path = item->device_name;
+   else
+    device_path = apr_psprintf(pool, "%s/%s", item->device_group, item->device_name);
+
+   if( (svn_err = svn_ra_check_path(session, device_path, head, &kind, pool)) )
+    goto send_fail;
+
+   if(kind == svn_node_file)
+    svn_err = editor->open_file(device_path, dir_baton, head, pool, &file_baton);
+   else
+    svn_err = editor->add_file(device_path, dir_baton, NULL, SVN_INVALID_REVNUM, pool, &file_baton);
+
+   if(svn_err)
+    goto send_fail;
+
+   item->added = (kind != svn_node_file);
+
+   if( (svn_err = editor->apply_textdelta(file_baton, NULL, pool, &handler, &handler_baton)) )
+    goto send_fail;
+
+   config.data = item->config;       /* sent right away - no copy in the pool */
+   config.len = item->config_len;
+
+   if( (svn_err = svn_txdelta_send_string(&config, handler, handler_baton, pool)) )
+    goto send_fail;
+
+   if( (svn_err = editor->close_file(file_baton, NULL, pool)) )
+    goto send_fail;
+
+   return 1;
+
+ send_fail:
+   a_logmsg("%s: svn error: %s",item->device_name,svn_err->message);
+   svn_error_clear(svn_err);
+   return -1;
+}
+
+
+svn_revnum_t a_svn_ra_batch_commit
+(svn_ra_session_t *session, ra_batch_item_t *batch, char *repository, char *only_group, char *what,
+ apr_pool_t *pool)
+/*
+*
+* commit batched configs of devices archived in the repository (only of devices in
+* only_group, if not NULL) as one revision, logged as "<what> of <n> device configs". 
+* returns the new revision, SVN_INVALID_REVNUM on error.
+*
+*/
+{
+   svn_error_t *svn_err;
+   svn_revnum_t head, committed = SVN_INVALID_REVNUM;
+   svn_node_kind_t group_kind;
+   const svn_delta_editor_t *editor;
+   void *edit_baton, *root_baton, *dir_baton;
+   svn_stringbuf_t *authors;
+   apr_hash_t *revprops, *groups_sent;
+   apr_pool_t *file_pool;
+   ra_batch_item_t *item, *other;
+   int count = 0, editing = 0;
+
+   authors = svn_stringbuf_create("", pool);
+
+   for(item = batch; item != NULL; item = item->next)
+    if(RA_BATCH_SELECTED(item, repository, only_group))
+     {
+      svn_stringbuf_appendcstr(authors, apr_psprintf(pool, "%s%s%s %s\n",
+                               strstr(item->device_group,"none") ? "" : item->device_group,
+                               strstr(item->device_group,"none") ? "" : "/",
+                               item->device_name, item->author));
+      count++;
+     }
+
+   revprops = apr_hash_make(pool);
+   apr_hash_set(revprops, SVN_PROP_REVISION_LOG, APR_HASH_KEY_STRING, 
+                svn_string_create(apr_psprintf(pool, "%s of %d device configs", what, count), pool));
+   apr_hash_set(revprops, RA_BATCH_AUTHORS_PROP, APR_HASH_KEY_STRING, 
+                svn_string_ncreate(authors->data, authors->len, pool));
+
+   if( (svn_err = svn_ra_get_latest_revnum(session, &head, pool)) )
+    goto batch_fail;
+
+   if( (svn_err = svn_ra_get_commit_editor3(session, &editor, &edit_baton, revprops,
+                                            a_svn_ra_commit_done, &committed, NULL, FALSE, pool)) )
+    goto batch_fail;
+
+   editing = 1;
+
+   if( (svn_err = editor->open_root(edit_baton, head, pool, &root_baton)) )
+    goto batch_fail;
+
+   /* the editor wants a depth-first drive - devices are sent group by group */
+
+   groups_sent = apr_hash_make(pool);
+   file_pool = svn_pool_create(pool);   /* batch may be a whole onboarding run - don't keep per-file data */
+
+   for(item = batch; item != NULL; item = item->next)
+    {
+     if(!RA_BATCH_SELECTED(item, repository, only_group))
+      continue;
+
+     if(apr_hash_get(groups_sent, item->device_group, APR_HASH_KEY_STRING) != NULL)
+      continue;
+
+     apr_hash_set(groups_sent, item->device_group, APR_HASH_KEY_STRING, item);
+
+     dir_baton = root_baton;
+
+     if(!strstr(item->device_group,"none"))
+      {
+       if( (svn_err = svn_ra_check_path(session, item->device_group, head, &group_kind, pool)) )
+        goto batch_fail;
+
+       if(group_kind == svn_node_none)
+        {
+         a_logmsg("adding new device group: %s",item->device_group);
+         svn_err = editor->add_directory(item->device_group, root_baton, NULL, SVN_INVALID_REVNUM, pool, &dir_baton);
+        }
+       else
+        svn_err = editor->open_directory(item->device_group, root_baton, head, pool, &dir_baton);
+
+       if(svn_err)
+        goto batch_fail;
+      }
+
+     for(other = item; other != NULL; other = other->next)
+      if(!strcmp(other->device_group, item->device_group))
+       {
+        if(a_svn_ra_batch_send(editor, dir_baton, other, session, head, file_pool) == -1)
+         {
+          svn_error_clear(editor->abort_edit(edit_baton, pool));
+          return SVN_INVALID_REVNUM;
+         }
+        svn_pool_clear(file_pool);
+       }
+
+     if(dir_baton != root_baton)
+      if( (svn_err = editor->close_directory(dir_baton, pool)) )
+       goto batch_fail;
+    }
+
+   if( (svn_err = editor->close_directory(root_baton, pool)) )
+    goto batch_fail;
+
+   if( (svn_err = editor->close_edit(edit_baton, pool)) )
+    goto batch_fail;
+
+   return committed;
+
+ batch_fail:
+   a_logmsg("%s: svn error: %s",what,svn_err->message);
+   a_debug_info2(DEBUGLVL5,"a_svn_ra_batch_commit: svn error: %s",svn_err->message);
+   svn_error_clear(svn_err);
+
+   if(editing)
+    svn_error_clear(editor->abort_edit(edit_baton, pool));
+
+   return SVN_INVALID_REVNUM;
+}
+
+
+void a_svn_ra_batch_report
+(ra_batch_item_t *item, svn_revnum_t committed)
+/*
+*
+* what a worker would do after committing the device config itself
+*
+*/
+{
+   if(committed == SVN_INVALID_REVNUM)
+    {
+     a_logmsg("%s: SVN commit failed when commiting config changes.",item->device_name);
+#ifdef USE_MYSQL
+     a_mysql_update_failed_archivizations(item->device_name);
+#endif
+     return;
+    }
+
+   if(item->added)
+    {
+     a_logmsg("%s: first time seen. adding device to svn repository (revision %ld).",item->device_name,committed);
+     a_repo_manifest_device(item->device_group, item->device_name);
+    }
+   else
+    a_logmsg("%s: archiving changes (revision %ld).",item->device_name,committed);
+
+#ifdef USE_MYSQL
+   a_mysql_update_timestamp(item->device_name);
+#endif
+
+   if(item->digest[0] != 0x0)
+    a_config_digest_store(item->device_name, item->digest);
+}
+
+
+svn_revnum_t a_svn_ra_batch_commit_retry
+(svn_worker_t *worker, ra_batch_item_t *batch, char *repository, char *only_group, char *what,
+ apr_pool_t *pool)
+/*
+*
+* commit the batch, once more with a new session if the first try failed
+* (transaction out of date or broken session)
+*
+*/
+{
+   svn_ra_session_t *session;
+   svn_revnum_t committed = SVN_INVALID_REVNUM;
+   int try;
+
+   for(try = 0; (try < 2) && (committed == SVN_INVALID_REVNUM); try++)
+    {
+     if( (session = a_svn_ra_session(worker, repository, RA_BATCH_AUTHOR)) == NULL )
+      break;
+
+     svn_pool_clear(pool);
+
+     if( (committed = a_svn_ra_batch_commit(session, batch, repository, only_group, what, pool)) == SVN_INVALID_REVNUM )
+      a_svn_ra_session_drop(worker, repository, RA_BATCH_AUTHOR);
+    }
+
+   return committed;
+}
+
+
+void a_svn_ra_batch_commit_all
+(svn_worker_t *worker, ra_batch_item_t *batch, char *what)
+/*
+*
+* commit the batch as one revision in every repository it has configs for, and
+* report the result for every device. repositories are independent - one failing
+* doesn't stop the others.
+*
+*/
+{
+   char *repositories[MAX_REPOSITORIES];
+   ra_batch_item_t *item;
+   svn_revnum_t committed;
+   int count, i;
+
+   count = a_repositories(repositories, MAX_REPOSITORIES);
+
+   for(i = 0; i < count; i++)
+    {
+     for(item = batch; item != NULL; item = item->next)
+      if(!strcmp(item->repository, repositories[i]))
+       break;
+
+     if(item == NULL)        /* nothing for this repository */
+      continue;
+
+     committed = a_svn_ra_batch_commit_retry(worker, batch, repositories[i], NULL, what, worker->iter_pool);
+
+     for(; item != NULL; item = item->next)
+      if(!strcmp(item->repository, repositories[i]))
+       a_svn_ra_batch_report(item, committed);
+    }
+}
+
+
+void a_svn_ra_batch_flush
+(void)
+/*
+*
+* commit all batched configs - as one revision, or one revision per device group.
+* G_ra_batch_mutex must be held (it is held for the whole commit, so a device
+* synced meanwhile by a worker waits in a_svn_ra_batch_drop and goes in later).
+*
+*/
+{
+   svn_worker_t *worker;
+   ra_batch_item_t *batch, *item, *other, *next;
+   svn_revnum_t committed = SVN_INVALID_REVNUM;
+   int seen;
+
+   batch = G_ra_batch;
+   G_ra_batch = NULL;
+
+   a_debug_info2(DEBUGLVL5,"a_svn_ra_batch_flush: committing %d device configs.",G_ra_batch_count);
+
+   G_ra_batch_count = 0;
+
+   if( (worker = a_svn_worker_get()) == NULL )
+    {
+     for(item = batch; item != NULL; item = item->next)
+      a_svn_ra_batch_report(item, SVN_INVALID_REVNUM);
+     goto free_batch;
+    }
+
+   a_svn_worker_job_pool(worker);
+
+   if(!G_config_info.group_commit_per_group)
+    a_svn_ra_batch_commit_all(worker, batch, "group commit");
+   else
+    for(item = batch; item != NULL; item = item->next)
+     {
+      for(seen = 0, other = batch; other != item; other = other->next)
+       if(!strcmp(other->device_group, item->device_group))
+        seen = 1;
+
+      if(seen)             /* group already committed */
+       continue;
+
+      committed = a_svn_ra_batch_commit_retry(worker, batch, item->repository, item->device_group,
+                                              "group commit", worker->iter_pool);
+
+      for(other = item; other != NULL; other = other->next)
+       if(!strcmp(other->device_group, item->device_group))
+        a_svn_ra_batch_report(other, committed);
+     }
+
+   svn_pool_clear(worker->iter_pool);
+
+ free_batch:
+   for(item = batch; item != NULL; item = next)
+    {
+     next = item->next;
+     a_svn_ra_batch_item_free(item);
+    }
+}
+
+
+void *a_svn_ra_batch_committer
+(void *arg)
+/*
+*
+* batch committer thread: commit the batch when GroupCommitWindow seconds passed
+* since its first config came, or when it holds GroupCommitMaxFiles configs.
+*
+*/
+{
+   struct timespec deadline;
+
+   pthread_mutex_lock(&G_ra_batch_mutex);
+
+   while(!G_stop_all_processing)
+    {
+     deadline.tv_sec = time(NULL) + 1;
+     deadline.tv_nsec = 0;
+     pthread_cond_timedwait(&G_ra_batch_cond, &G_ra_batch_mutex, &deadline);
+
+     if( (G_ra_batch != NULL) &&
+         ((G_ra_batch_count >= G_config_info.group_commit_files) ||
+          (time(NULL) >= (G_ra_batch_started + G_config_info.group_commit_window))) )
+      a_svn_ra_batch_flush();
+    }
+
+   pthread_mutex_unlock(&G_ra_batch_mutex);
+
+   return NULL;
+}
+
+
+int a_svn_ra_batch_committer_start
+(void)
+{
+   pthread_t thread;
+   pthread_attr_t attr;
+
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+   pthread_attr_setstacksize(&attr, ARCHIVIST_THREAD_STACK_SIZE);
+
+   if(pthread_create(&thread, &attr, a_svn_ra_batch_committer, NULL) != 0)
+    {
+     a_logmsg("WARNING: cannot start group commit thread - every device will be committed on its own.");
+     G_config_info.group_commit_window = 0;
+     pthread_attr_destroy(&attr);
+     return 0;
+    }
+
+   pthread_attr_destroy(&attr);
+   return 1;
+}
+
+
+int a_svn_ra_onboard_add
+(char *device_group, char *device_name, char *author, char *config_digest, config_buffer_t *config)
+/*
+*
+* put config of a device new to the repository into the onboarding batch. the batch
+* is committed when the onboarding run ends, or right here when it holds
+* OnboardingMaxFiles configs. returns 1 on success, 0 if the config cannot be queued.
+*
+*/
+{
+   ra_batch_item_t *item, *old_item;
+   int full;
+
+   if( (item = a_svn_ra_batch_item_new(device_group, device_name, author, config_digest, config->len)) == NULL )
+    return 0;
+
+   memcpy(item->config, config->data, config->len);
+   item->added = 1;
+
+   pthread_mutex_lock(&G_onboard_mutex);
+
+   if( (old_item = a_svn_ra_batch_unlink(&G_onboard_batch, &G_onboard_count, device_name)) != NULL )
+    a_svn_ra_batch_item_free(old_item);
+
+   item->next = G_onboard_batch;
+   G_onboard_batch = item;
+   G_onboard_count++;
+
+   full = (G_onboard_count >= G_config_info.onboarding_files);
+
+   pthread_mutex_unlock(&G_onboard_mutex);
+
+   if(full)
+    a_svn_ra_onboard_flush();
+
+   return 1;
+}
+
+
+void a_svn_ra_onboard_drop
+(char *device_name)
+/*
+*
+* forget onboarding config of the device - a newer one is being archived on its own
+*
+*/
+{
+   ra_batch_item_t *item;
+
+   pthread_mutex_lock(&G_onboard_mutex);
+
+   if(G_onboard_count > 0)
+    if( (item = a_svn_ra_batch_unlink(&G_onboard_batch, &G_onboard_count, device_name)) != NULL )
+     {
+      a_debug_info2(DEBUGLVL5,"a_svn_ra_onboard_drop: %s: dropped from onboarding commit.",device_name);
+      a_svn_ra_batch_item_free(item);
+     }
+
+   pthread_mutex_unlock(&G_onboard_mutex);
+}
+
+
+void a_svn_ra_onboard_flush
+(void)
+/*
+*
+* add all devices waiting in the onboarding batch to the repository, as one revision
+*
+*/
+{
+   svn_worker_t *worker;
+   ra_batch_item_t *batch, *item, *next;
+   int count;
+
+   pthread_mutex_lock(&G_onboard_mutex);
+   batch = G_onboard_batch;
+   count = G_onboard_count;
+   G_onboard_batch = NULL;
+   G_onboard_count = 0;
+   pthread_mutex_unlock(&G_onboard_mutex);
+
+   if(batch == NULL)
+    return;
+
+   a_logmsg("onboarding: adding %d new devices to the repository.",count);
+
+   if( (worker = a_svn_worker_get()) != NULL )
+    {
+     a_svn_worker_job_pool(worker);
+     a_svn_ra_batch_commit_all(worker, batch, "onboarding");
+     svn_pool_clear(worker->iter_pool);
+    }
+   else
+    for(item = batch; item != NULL; item = item->next)
+     a_svn_ra_batch_report(item, SVN_INVALID_REVNUM);
+
+   for(item = batch; item != NULL; item = next)
+    {
+     next = item->next;
+     a_svn_ra_batch_item_free(item);
+    }
+}
+
+
+/* end of svnra.c  */
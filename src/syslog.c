@@ -19,6 +19,11 @@
 *    syslog.c - UDP syslog listener + syslog buffer parsing procedures
 */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE      /* recvmmsg() */
+#endif
+
+#include "../config.h"
 #include "defs.h"
 #include "archivist_config.h"
 
@@ -27,10 +32,16 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <string.h>
+#include <errno.h>
+
+
+syslog_batch_t *G_syslog_batch;  /* receive batch used by the main loop */
+int *G_syslog_receiver_sockets;  /* sockets of syslog receiver threads */
 
 
 int a_syslog_socket_setup
@@ -42,8 +53,9 @@ int a_syslog_socket_setup
 */
 {
 
-       struct sockaddr_in si_me, si_other;
-       int syslog_socket, i, slen=sizeof(si_other),flags=0;
+       struct sockaddr_in si_me;
+       int syslog_socket, flags, rcvbuf;
+       socklen_t optlen = sizeof(rcvbuf);
 
        if ((syslog_socket=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP))==-1)
         {
@@ -51,6 +63,17 @@ int a_syslog_socket_setup
          a_cleanup_and_exit();
         }
 
+       if(G_config_info.syslog_rcvbuf > 0)
+        {
+         rcvbuf = G_config_info.syslog_rcvbuf;
+         if(setsockopt(syslog_socket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == -1)
+          fprintf(stderr,"WARNING: a_syslog_socket_setup: cannot set syslog socket receive buffer to %d bytes (%d)!\n",
+                  G_config_info.syslog_rcvbuf,errno);
+        }
+
+       if(getsockopt(syslog_socket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen) == 0)
+        a_debug_info2(DEBUGLVL5,"a_syslog_socket_setup: syslog socket receive buffer is %d bytes.",rcvbuf);
+
        memset((char *) &si_me, 0, sizeof(si_me));
        si_me.sin_family = AF_INET;
        si_me.sin_port = htons(G_config_info.syslog_port);
@@ -62,71 +85,194 @@ int a_syslog_socket_setup
          a_cleanup_and_exit();
         }
        
+       flags = fcntl(syslog_socket, F_GETFL, 0);
        fcntl(syslog_socket, F_SETFL, flags | O_NONBLOCK);
 
+       if((G_syslog_batch = a_syslog_batch_alloc(G_config_info.syslog_batch_size)) == NULL)
+        {
+         fprintf(stderr,"FATAL: a_syslog_socket_setup: cannot allocate syslog receive buffers!");
+         a_cleanup_and_exit();
+        }
+
        a_debug_info2(DEBUGLVL5,"a_syslog_socket_setup: syslog socket ready. return.");
 
        return syslog_socket;
 
 }
 
-int a_check_syslog_stream
-(int sock, char *buf, char *from)
+
+syslog_batch_t *a_syslog_batch_alloc
+(int capacity)
 /*
-* receive new data from UDP socket. 
-* if there is more that one buf of data on the socket, then receive more, and reassemble.
-* return something only if device config event is found in the received data.
-* guard bounds of the receive buffer - receive only 8KB of data in one call 
-* (8KB limit per syslog message).
+*
+* allocate receive batch for up to capacity datagrams. 
+* every datagram gets its own buffer, so payloads from different senders are never mixed.
+*
 */
 {
-      struct sockaddr_in si_other;
-      char wrkbuf[1024];
-      int i,slen=sizeof(si_other),recv_flags=0;
-      struct hostent *hostnam;
-      char *regexp_test;
-      int readed=1024,finished=0,received_data_len=0;
+      syslog_batch_t *batch;
+      struct iovec *iov;
+      int i;
+
+      if( (batch = malloc(sizeof(syslog_batch_t))) == NULL )
+       return NULL;
+
+      batch->capacity = capacity;
+      batch->count = 0;
+      batch->dgrams = malloc(capacity * sizeof(syslog_datagram_t));
+      batch->iovec = malloc(capacity * sizeof(struct iovec));
+
+#ifdef HAVE_RECVMMSG
+      batch->msgvec = malloc(capacity * sizeof(struct mmsghdr));
+#else
+      batch->msgvec = NULL;
+#endif
+
+      if( (batch->dgrams == NULL) || (batch->iovec == NULL)
+#ifdef HAVE_RECVMMSG
+          || (batch->msgvec == NULL)
+#endif
+        )
+       {
+        a_debug_info2(DEBUGLVL3,"a_syslog_batch_alloc: malloc failed!");
+        free(batch->dgrams);
+        free(batch->iovec);
+        free(batch->msgvec);
+        free(batch);
+        return NULL;
+       }
 
-      if(G_stop_all_processing)
-       return 1;   /* program is in the state of cleanup&exit - just return. */
+      iov = (struct iovec *)batch->iovec;
 
-      bzero(buf,BUFLEN);
-      bzero(from,IPSTRLEN);
- 
-      while(!finished) {
+      for(i = 0; i < capacity; i++)
+       {
+        iov[i].iov_base = batch->dgrams[i].payload;
+        iov[i].iov_len = MAX_SYSLOG_DGRAM_LEN;
 
-        if ( (readed == 1024) && (buf[(strlen(buf)-1)] != 0xa) && (received_data_len < BUFLEN) ) {
+#ifdef HAVE_RECVMMSG
+        struct mmsghdr *msg = &((struct mmsghdr *)batch->msgvec)[i];
 
-         bzero(wrkbuf,1024);
-         readed = recvfrom(sock,wrkbuf,SOCK_RECVLEN,recv_flags,(struct sockaddr *)&si_other,&slen);
+        memset(msg, 0, sizeof(struct mmsghdr));
+        msg->msg_hdr.msg_iov = &iov[i];
+        msg->msg_hdr.msg_iovlen = 1;
+        msg->msg_hdr.msg_name = &batch->dgrams[i].from;
+#endif
+       }
+
+      return batch;
+}
 
-         if(readed>0)                    
-          strncat(buf,wrkbuf,readed+1);    /* reassemble syslog stream if longer than 1024 bytes */
-          received_data_len += readed;    
 
+int a_syslog_batch_receive
+(int sock, syslog_batch_t *batch, int wait)
+/*
+*
+* receive as many waiting datagrams as fit into the batch (one recvmmsg() call where available).
+* if wait is set - block until at least one datagram arrives.
+* return number of datagrams received.
+*
+*/
+{
+      int i, received = 0;
+
+      batch->count = 0;
+
+#ifdef HAVE_RECVMMSG
+
+      struct mmsghdr *msgs = (struct mmsghdr *)batch->msgvec;
+
+      for(i = 0; i < batch->capacity; i++)
+       msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);  /* reset - value/result field */
+
+      do
+       received = recvmmsg(sock, msgs, batch->capacity, (wait ? MSG_WAITFORONE : MSG_DONTWAIT), NULL);
+      while( (received == -1) && (errno == EINTR) );
+
+      if(received <= 0)
+       return 0;
+
+      for(i = 0; i < received; i++)
+       batch->dgrams[i].len = msgs[i].msg_len;
+
+#else
+
+      socklen_t slen;
+      ssize_t readed;
+
+      while(received < batch->capacity)
+       {
+        slen = sizeof(struct sockaddr_in);
+        readed = recvfrom(sock, batch->dgrams[received].payload, MAX_SYSLOG_DGRAM_LEN,
+                          ((wait && (received == 0)) ? 0 : MSG_DONTWAIT),
+                          (struct sockaddr *)&batch->dgrams[received].from, &slen);
+        if(readed < 0)
+         {
+          if(errno == EINTR) continue;
+          break;    /* EAGAIN - socket drained */
          }
+        batch->dgrams[received].len = readed;
+        received++;
+       }
 
-        else finished = 1;                 /* nothing more to receive */
+#endif
 
-        usleep(100);
+      for(i = 0; i < received; i++)
+       batch->dgrams[i].payload[batch->dgrams[i].len] = 0x0;
 
-       } 
+      batch->count = received;
+
+      return received;
+}
 
-       if(received_data_len>0)
-        {
-         a_debug_info2(DEBUGLVL5,"a_check_syslog_stream: readed %d bytes from network",received_data_len);
-         regexp_test = a_config_regexp_match(buf); /* pre-filtering of syslog messages */
-
-         if(regexp_test != NULL)
-           {
-            hostnam = gethostbyaddr(&si_other.sin_addr,4,AF_INET);
-            strcat(from,hostnam->h_name); 
-            a_debug_info2(DEBUGLVL5,"a_check_syslog_stream: got something !");
-            return received_data_len;
-           } 
-        }
 
-    return 0; 
+int a_syslog_batch_process
+(syslog_batch_t *batch)
+/*
+* check every received datagram on its own and credit it to its own sender;
+* datagrams carrying a device config event are passed to the syslog parser.
+* return number of datagrams with a config event found.
+*/
+{
+      syslog_datagram_t *dgram;
+      char from[NI_MAXHOST];
+      int i, matched = 0;
+
+      for(i = 0; i < batch->count; i++)
+       {
+        dgram = &batch->dgrams[i];
+
+        if(a_config_regexp_match(dgram->payload) == NULL)   /* pre-filtering of syslog messages */
+         continue;
+
+        a_device_name_by_addr(&dgram->from, from, sizeof(from));
+        a_debug_info2(DEBUGLVL5,"a_syslog_batch_process: got something from %s!",from);
+
+        a_parse_syslog_buffer(dgram->payload, from);
+        matched++;
+       }
+
+      return matched;
+}
+
+
+int a_check_syslog_stream
+(int sock)
+/*
+* receive a batch of datagrams from the UDP socket (main loop version) and parse it.
+* return number of datagrams with a config event found.
+*/
+{
+      int received;
+
+      if(G_stop_all_processing)
+       return 1;   /* program is in the state of cleanup&exit - just return. */
+
+      if( (received = a_syslog_batch_receive(sock, G_syslog_batch, NO)) == 0 )
+       return 0;
+
+      a_debug_info2(DEBUGLVL5,"a_check_syslog_stream: received %d datagrams from network",received);
+
+      return a_syslog_batch_process(G_syslog_batch);
 }
 
 
@@ -136,36 +282,26 @@ a_parse_syslog_buffer
 * parse pre-checked syslog buffer (data got from UDP or syslog file). 
 * here, we are sure that we have matched ConfigRegexp in the received buffer.
 * find config lines, and pass them to the next level of parsing
+* (called both from the main loop and from syslog receiver threads - must stay reentrant)
 */
 {
    
     char localcopy[BUFLEN];
     char *strtok_pointer;
+    char *strtok_state;
     char *regexp_test;
-    char *username_token;
 
     a_debug_info2(DEBUGLVL5,"a_parse_syslog_buffer: got the following data:\n%s,\n",syslog_message);
     
-    strncpy(localcopy,syslog_message,BUFLEN);
-
-    strtok_pointer = (char *)strtok(localcopy,"\n");
-    regexp_test = (char *)a_config_regexp_match(strtok_pointer);
+    strncpy(localcopy,syslog_message,BUFLEN-1);
+    localcopy[BUFLEN-1] = 0x0;
 
-     if( (strtok_pointer != NULL) && (regexp_test != NULL) )
-      {
-       username_token = regexp_test;
-       a_parse_config_event(strtok_pointer,src_ip,username_token); 
-      }
-
-    while(strtok_pointer != NULL)
+    for(strtok_pointer = strtok_r(localcopy,"\n",&strtok_state); strtok_pointer != NULL;
+        strtok_pointer = strtok_r(NULL,"\n",&strtok_state))
      {
-      strtok_pointer = (char *)strtok(NULL,"\n");
-      regexp_test = (char *)a_config_regexp_match(strtok_pointer);
-      if( (strtok_pointer != NULL) && (regexp_test != NULL) ) 
-       {
-        username_token = regexp_test;
-        a_parse_config_event(strtok_pointer,src_ip,username_token);
-       }     
+      regexp_test = a_config_regexp_match(strtok_pointer);
+      if(regexp_test != NULL) 
+        a_parse_config_event(strtok_pointer,src_ip,regexp_test);   /* regexp_test is username token */
      }    
 
 }
@@ -175,27 +311,33 @@ a_parse_config_event
 (char *config_event_data, char *src_ip, char *username_preceding_token)
 /*
 * fill in config_event_info_t structure with data from a syslog line,
-* and execute config archiving thread with this struct as an argument.
+* and submit it for archiving.
 *
 */
 {
 
     char *strtok_pointer;
+    char *strtok_state;
     char src_ip_from_taillog[IPSTRLEN];
     int field_counter = 1;
     config_event_info_t *conf_event_info;
 
-    conf_event_info = malloc(sizeof(config_event_info_t));
+    if( (conf_event_info = malloc(sizeof(config_event_info_t))) == NULL )
+     {
+      a_debug_info2(DEBUGLVL3,"a_parse_config_event: malloc failed!");
+      return 0;
+     }
 
     conf_event_info->configured_by[0] = 0x0;
     conf_event_info->configured_on[0] = 0x0;
     conf_event_info->configured_from[0] = 0x0;
+    src_ip_from_taillog[0] = 0x0;
 
     a_debug_info2(DEBUGLVL5,"a_parse_config_event: allocated new data structure at 0x%p",conf_event_info);
 
     a_debug_info2(DEBUGLVL5,"a_parse_config_event: starting parsing syslog message...");
 
-    strtok_pointer=(char *)strtok(config_event_data," "); 
+    strtok_pointer = strtok_r(config_event_data," ",&strtok_state); 
 
     while(strtok_pointer != NULL)
      {
@@ -203,77 +345,262 @@ a_parse_config_event
       if((strcmp(strtok_pointer,username_preceding_token) != 0) &&   
          (strtok_pointer != NULL))                          
 
-      strtok_pointer = (char *)strtok(NULL," ");                  /* get next token from string */
+      strtok_pointer = strtok_r(NULL," ",&strtok_state);          /* get next token from string */
       if(strtok_pointer != NULL)
        {
 
         if(strcmp(strtok_pointer,username_preceding_token) == 0) 
           {
-           strtok_pointer = (char *)strtok(NULL," ");                /* next token should be username */
-           if(strlen(strtok_pointer) > 0)                            /* use it, if it's nonzero length */
-             strncpy(conf_event_info->configured_by,strtok_pointer,255);
+           strtok_pointer = strtok_r(NULL," ",&strtok_state);        /* next token should be username */
+           if( (strtok_pointer != NULL) && (strlen(strtok_pointer) > 0) )  /* use it, if it's nonzero length */
+            {
+             strncpy(conf_event_info->configured_by,strtok_pointer,sizeof(conf_event_info->configured_by)-1);
+             conf_event_info->configured_by[sizeof(conf_event_info->configured_by)-1] = 0x0;
+            }
           }
 
         }
 
       field_counter++;
 
-      if((field_counter == G_config_info.hostname_field_in_syslog)&&(src_ip == NULL))  /* this is a line from tailing syslog file */
-       { 						                 /* get source address/name from predefined field  */
-        strcpy(src_ip_from_taillog,strtok_pointer); 
+      if((field_counter == G_config_info.hostname_field_in_syslog)&&(src_ip == NULL)&&(strtok_pointer != NULL))
+       { 		 /* this is a line from tailing syslog file - get source address/name from predefined field */
+        strncpy(src_ip_from_taillog,strtok_pointer,IPSTRLEN-1); 
+        src_ip_from_taillog[IPSTRLEN-1] = 0x0;
        }                 
 
      }
 
     if(src_ip != NULL) 
-     strcpy(conf_event_info->device_id,src_ip);    
+     strncpy(conf_event_info->device_id,src_ip,sizeof(conf_event_info->device_id)-1);
     else
-     strcpy(conf_event_info->device_id,src_ip_from_taillog);
+     strncpy(conf_event_info->device_id,src_ip_from_taillog,sizeof(conf_event_info->device_id)-1);
+
+    conf_event_info->device_id[sizeof(conf_event_info->device_id)-1] = 0x0;
 
     if(strlen(conf_event_info->configured_by) == 0)
      {
       a_logmsg("%s: cannot parse config event message! not archived!",conf_event_info->device_id);
       a_debug_info2(DEBUGLVL5,"a_parse_config_event: error: cannot get username from config event message!",conf_event_info->device_id);
+      free(conf_event_info);
       return 0;
      }
 
     a_remove_quotes(conf_event_info->configured_by);  /* FWSM and JUNOS use quotation around the username */
 
-    /* prepare to start archiver thread */
+    a_debug_info2(DEBUGLVL5,"a_parse_config_event: finished parsing.");
 
-    while(G_active_archiver_threads >= NUM_ARCH_THREADS)
+    if(G_syslog_event_queue != NULL)     /* receiver threads are running - hand the event over to the main loop */
      {
-      a_debug_info2(DEBUGLVL5,"a_parse_config_event: waiting for a thread count to decrease...");
-      usleep(300);
+      if(!a_evqueue_push(G_syslog_event_queue, conf_event_info))
+       {
+        a_logmsg("%s: WARNING: config event queue is full! event (configured by %s) dropped!",
+                 conf_event_info->device_id,conf_event_info->configured_by);
+        free(conf_event_info);
+        return 0;
+       }
+      return 1;
      }
 
-    /* start archiver thread for a single device and exit from function */
+    return a_dispatch_config_event(conf_event_info);
 
-    a_debug_info2(DEBUGLVL5,"a_parse_config_event: finished parsing. starting archiver thread...");
-    a_logmsg("%s: starting syslog-triggered archiver thread (configured by %s).",
-             conf_event_info->device_id,conf_event_info->configured_by);
-    
-    pthread_t triggered_thread;
-    pthread_attr_t thread_attr;    
-    size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
+}
 
-    pthread_attr_init(&thread_attr);
-    pthread_attr_setdetachstate(&thread_attr,PTHREAD_CREATE_DETACHED);
-    pthread_attr_setstacksize(&thread_attr, stacksize);
 
-    if(pthread_create(&triggered_thread, &thread_attr, a_archive_single, (void *)conf_event_info))
+int a_dispatch_config_event
+(config_event_info_t *conf_event_info)
+/*
+* queue archiving job for a parsed config event. 
+* conf_event_info is freed by the archiver worker (or here, if the queue is full).
+*/
+{
+
+    char device_id[255];
+    int queued;
+
+    strcpy(device_id,conf_event_info->device_id);   /* event may be gone once it is queued */
+
+    a_logmsg("%s: queueing syslog-triggered archiving (configured by %s).",
+             device_id,conf_event_info->configured_by);
+
+    if( (queued = a_archiver_submit(conf_event_info, NO, G_config_info.archive_quiet_period)) == 0 )
      {
-      a_logmsg("%s: FATAL: cannot create archiver thread for %s!",
-               conf_event_info->device_id);
-      a_debug_info2(DEBUGLVL5,"a_parse_config_event: FATAL: cannot create archiver thread for %s!",
-                    conf_event_info->device_id);
+      a_logmsg("%s: WARNING: archiver queue is full (%d jobs)! event dropped!",
+               device_id,a_archiver_queue_depth());
       free(conf_event_info);
       return 0;
      }
 
+    if(queued == 2)
+     a_debug_info2(DEBUGLVL5,"a_dispatch_config_event: %s: event merged into already queued job.",device_id);
+    else
+     a_debug_info2(DEBUGLVL5,"a_dispatch_config_event: job queued, archiver queue depth now %d",
+                   a_archiver_queue_depth());
+
     return 1;    
 
 }
 
-/* end of syslog.c  */
 
+void a_syslog_events_consume
+(void)
+/*
+* archiving side of the syslog event queue: take all config events queued by 
+* receiver threads and start archiving for them. called from the main loop.
+*/
+{
+    config_event_info_t *conf_event_info;
+
+    if(G_syslog_event_queue == NULL)
+     return;
+
+    a_evqueue_clear_notify(G_syslog_event_queue);
+
+    while( (conf_event_info = a_evqueue_pop(G_syslog_event_queue)) != NULL )
+     {
+      if(G_stop_all_processing)
+       {
+        free(conf_event_info);
+        continue;
+       }
+      a_dispatch_config_event(conf_event_info);
+     }
+}
+
+
+int a_syslog_receivers_setup
+(void)
+/*
+* open SyslogReceiverThreads UDP sockets bound to the same syslog port (SO_REUSEPORT - kernel 
+* spreads incoming datagrams between them), and create the event queue. 
+* called before daemonizing, so errors still reach the terminal. threads are started later.
+* without SO_REUSEPORT all receiver threads share one socket.
+*/
+{
+    struct sockaddr_in si_me;
+    int i, sock, one = 1, rcvbuf, nsockets;
+
+    nsockets = G_config_info.syslog_receiver_threads;
+
+#ifndef SO_REUSEPORT
+    nsockets = 1;
+    fprintf(stderr,"WARNING: SO_REUSEPORT is not supported here - %d syslog receiver threads will share one socket.\n",
+            G_config_info.syslog_receiver_threads);
+#endif
+
+    if( (G_syslog_receiver_sockets = malloc(G_config_info.syslog_receiver_threads * sizeof(int))) == NULL )
+     {
+      fprintf(stderr,"FATAL: a_syslog_receivers_setup: malloc failed!\n");
+      a_cleanup_and_exit();
+     }
+
+    for(i = 0; i < nsockets; i++)
+     {
+      if((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+       {
+        fprintf(stderr,"FATAL: a_syslog_receivers_setup: cannot create UDP socket (%d)!\n",errno);
+        a_cleanup_and_exit();
+       }
+
+#ifdef SO_REUSEPORT
+      if(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1)
+       {
+        fprintf(stderr,"FATAL: a_syslog_receivers_setup: cannot set SO_REUSEPORT (%d)!\n",errno);
+        a_cleanup_and_exit();
+       }
+#endif
+
+      if(G_config_info.syslog_rcvbuf > 0)
+       {
+        rcvbuf = G_config_info.syslog_rcvbuf;
+        if(setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == -1)
+         fprintf(stderr,"WARNING: a_syslog_receivers_setup: cannot set syslog socket receive buffer to %d bytes (%d)!\n",
+                 G_config_info.syslog_rcvbuf,errno);
+       }
+
+      memset((char *) &si_me, 0, sizeof(si_me));
+      si_me.sin_family = AF_INET;
+      si_me.sin_port = htons(G_config_info.syslog_port);
+      si_me.sin_addr.s_addr = htonl(INADDR_ANY);
+
+      if(bind(sock,(struct sockaddr *)&si_me, sizeof(si_me)) == -1)
+       {
+        fprintf(stderr,"FATAL: a_syslog_receivers_setup: cannot bind to UDP socket on port %d (%d)!\n",
+                G_config_info.syslog_port,errno);
+        a_cleanup_and_exit();
+       }
+
+      G_syslog_receiver_sockets[i] = sock;
+     }
+
+    for(; i < G_config_info.syslog_receiver_threads; i++)
+     G_syslog_receiver_sockets[i] = G_syslog_receiver_sockets[0];
+
+    if( (G_syslog_event_queue = a_evqueue_create(SYSLOG_EVENT_QUEUE_LEN)) == NULL )
+     {
+      fprintf(stderr,"FATAL: a_syslog_receivers_setup: cannot create syslog event queue!\n");
+      a_cleanup_and_exit();
+     }
+
+    a_debug_info2(DEBUGLVL5,"a_syslog_receivers_setup: %d syslog receiver sockets ready.",nsockets);
+
+    return nsockets;
+}
+
+
+void *a_syslog_receiver
+(void *arg)
+/*
+* syslog receiver thread: block on own socket, receive datagram batches, 
+* and push parsed config events to the event queue. never waits for archiving.
+*/
+{
+    int sock = *((int *)arg);
+    syslog_batch_t *batch;
+
+    if( (batch = a_syslog_batch_alloc(G_config_info.syslog_batch_size)) == NULL )
+     {
+      a_logmsg("FATAL: syslog receiver thread cannot allocate receive buffers!");
+      pthread_exit(NULL);
+     }
+
+    a_debug_info2(DEBUGLVL5,"a_syslog_receiver: thread listening on socket %d.",sock);
+
+    while(!G_stop_all_processing)
+     {
+      if(a_syslog_batch_receive(sock, batch, YES) > 0)
+       if(a_syslog_batch_process(batch) > 0)
+        a_evqueue_notify(G_syslog_event_queue);
+     }
+
+    pthread_exit(NULL);
+}
+
+
+int a_syslog_receivers_start
+(void)
+/*
+* start syslog receiver threads (after daemonizing - threads don't survive fork())
+*/
+{
+    pthread_t receiver_thread;
+    pthread_attr_t thread_attr;
+    size_t stacksize = ARCHIVIST_THREAD_STACK_SIZE;
+    int i, started = 0;
+
+    pthread_attr_init(&thread_attr);
+    pthread_attr_setdetachstate(&thread_attr,PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&thread_attr, stacksize);
+
+    for(i = 0; i < G_config_info.syslog_receiver_threads; i++)
+     {
+      if(pthread_create(&receiver_thread, &thread_attr, a_syslog_receiver, (void *)&G_syslog_receiver_sockets[i]))
+       a_logmsg("ERROR: cannot create syslog receiver thread %d!",i);
+      else
+       started++;
+     }
+
+    return started;
+}
+
+/* end of syslog.c  */
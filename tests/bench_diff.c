@@ -0,0 +1,179 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    bench_diff.c - a_config_diff on 1MB configs
+*
+*    generates a config of about BENCH_CONFIG_SIZE bytes (interface blocks with
+*    lots of repeated lines, like real configs), and times a_config_diff with the
+*    unified diff text against: the same config, a copy with edits scattered over
+*    the whole config (changed, added and removed lines), and a completely
+*    different config. exits non-zero if a result looks wrong.
+*
+*    usage: bench_diff [config size in bytes]
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_CONFIG_SIZE (1024 * 1024)
+#define BENCH_ROUNDS 20
+#define BENCH_EDIT_EVERY 500      /* one edit per that many lines */
+
+
+size_t a_bench_config
+(char *config, size_t size, const char *prefix, int edits)
+/*
+*
+* fill config with about size bytes of interface blocks. with edits, every
+* BENCH_EDIT_EVERY-th line is changed, dropped or followed by a new line.
+* returns config length.
+*
+*/
+{
+   size_t len = 0;
+   int line = 0, port = 0;
+   char block[512];
+   char *p, *eol;
+
+   while(len < size)
+    {
+     snprintf(block, sizeof(block),
+              "interface %sGigabitEthernet%d/%d\n description uplink %d\n switchport mode trunk\n"
+              " switchport trunk allowed vlan 10,20,30\n mtu 9000\n no shutdown\n!\n",
+              prefix, port / 48, port % 48, port);
+     port++;
+
+     for(p = block; *p; p = eol + 1, line++)
+      {
+       eol = strchr(p, '\n');
+
+       if(edits && (line % BENCH_EDIT_EVERY == BENCH_EDIT_EVERY - 1))
+        switch((line / BENCH_EDIT_EVERY) % 3)
+         {
+          case 0:                                          /* changed */
+           len += snprintf(config + len, size * 2 - len, " description changed %d\n", line);
+           continue;
+          case 1:                                          /* removed */
+           continue;
+          case 2:                                          /* added after this one */
+           memcpy(config + len, p, eol + 1 - p);
+           len += eol + 1 - p;
+           len += snprintf(config + len, size * 2 - len, " ip address 10.0.%d.%d/31\n", line / 256, line % 256);
+           continue;
+         }
+
+       memcpy(config + len, p, eol + 1 - p);
+       len += eol + 1 - p;
+      }
+    }
+
+   config[len] = 0x0;
+   return len;
+}
+
+
+double a_bench_diff
+(const char *name, char *old_config, size_t old_len, char *new_config, size_t new_len, int *added, int *removed)
+/*
+*
+* run a_config_diff BENCH_ROUNDS times, print and return milliseconds per diff
+*
+*/
+{
+   config_diff_t diff;
+   double start, ms;
+   size_t text_len = 0;
+   int round;
+
+   start = a_test_now();
+
+   for(round = 0; round < BENCH_ROUNDS; round++)
+    {
+     CHECK(a_config_diff(old_config, old_len, new_config, new_len, "old", "new", &diff) != -1);
+     *added = diff.added;
+     *removed = diff.removed;
+     text_len = diff.text_len;
+     a_config_diff_free(&diff);
+    }
+
+   ms = (a_test_now() - start) * 1e3 / BENCH_ROUNDS;
+
+   printf("%-22s %8.2f ms/diff  (+%d -%d lines, %zu bytes of diff text)\n",name,ms,*added,*removed,text_len);
+
+   return ms;
+}
+
+
+int main
+(int argc, char **argv)
+{
+   char *old_config, *new_config, *other_config;
+   size_t size = BENCH_CONFIG_SIZE, old_len, new_len, other_len;
+   int added, removed, old_lines = 0;
+   char *p;
+
+   if(argc > 1)
+    size = atol(argv[1]);
+
+   if(size == 0)
+    {
+     fprintf(stderr,"usage: %s [config size in bytes]\n",argv[0]);
+     return 2;
+    }
+
+   old_config = malloc(size * 2 + 1024);
+   new_config = malloc(size * 2 + 1024);
+   other_config = malloc(size * 2 + 1024);
+
+   if((old_config == NULL) || (new_config == NULL) || (other_config == NULL))
+    return 1;
+
+   old_len = a_bench_config(old_config, size, "", NO);
+   new_len = a_bench_config(new_config, size, "", YES);
+   other_len = a_bench_config(other_config, size, "Ten", NO);
+
+   for(p = old_config; (p = strchr(p, '\n')) != NULL; p++)
+    old_lines++;
+
+   printf("config: %zu bytes, %d lines\n",old_len,old_lines);
+
+   a_bench_diff("same config", old_config, old_len, old_config, old_len, &added, &removed);
+   CHECK((added == 0) && (removed == 0));
+
+   a_bench_diff("scattered edits", old_config, old_len, new_config, new_len, &added, &removed);
+   CHECK((added > 0) && (removed > 0) && (added + removed < old_lines / BENCH_EDIT_EVERY * 3));
+
+   a_bench_diff("different config", old_config, old_len, other_config, other_len, &added, &removed);
+   CHECK(removed > 0);
+
+   free(old_config);
+   free(new_config);
+   free(other_config);
+
+   return TEST_RESULT();
+}
+
+
+/* end of bench_diff.c  */
@@ -0,0 +1,169 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    bench_router_db.c - router.db lookups at 100k entries
+*
+*    loads a generated router.db with BENCH_ENTRIES devices, and times
+*    a_router_db_search and a_set_archived through the hostname index, and the
+*    same lookups with the index switched off (list walk). hostnames are looked
+*    up in mixed case. exits non-zero if any lookup finds a wrong entry.
+*
+*    usage: bench_router_db [entries]
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_ENTRIES 100000
+#define BENCH_LOOKUPS 1000000     /* through the index */
+#define BENCH_WALK_LOOKUPS 500    /* list walk - every lookup scans half of the list on average */
+
+
+int a_bench_router_db_file
+(char *filename, int entries)
+/*
+*
+* write router.db with entries devices: group<n % 100>:router<n>:cisco:set01:telnet
+*
+*/
+{
+   FILE *router_db;
+   int i;
+
+   if( (router_db = fopen(filename, "w")) == NULL )
+    return 0;
+
+   fprintf(router_db,"# generated by bench_router_db\n");
+
+   for(i = 0; i < entries; i++)
+    fprintf(router_db,"group%d:router%07d:cisco:set01:telnet\n",i % 100,i);
+
+   fclose(router_db);
+   return 1;
+}
+
+
+double a_bench_lookups
+(int entries, int lookups, int set_archived)
+/*
+*
+* look up (or flag as archived) pseudo-random devices, hostnames in upper case.
+* returns nanoseconds per lookup.
+*
+*/
+{
+   router_db_entry_t *entry;
+   char hostname[64];
+   unsigned int seed = 12345;
+   double start;
+   int i, n;
+
+   start = a_test_now();
+
+   for(i = 0; i < lookups; i++)
+    {
+     seed = seed * 1103515245 + 12345;
+     n = (seed >> 8) % entries;
+     snprintf(hostname,sizeof(hostname),"ROUTER%07d",n);
+
+     if(set_archived)
+      {
+       CHECK(a_set_archived(G_router_db, hostname, 1) == 1);
+       CHECK(a_set_archived(G_router_db, hostname, 0) == 1);
+      }
+     else
+      {
+       entry = a_router_db_search(G_router_db, hostname);
+       CHECK((entry != NULL) && (atoi(entry->hostname + strlen("router")) == n));
+      }
+    }
+
+   return (a_test_now() - start) * 1e9 / lookups;
+}
+
+
+int main
+(int argc, char **argv)
+{
+   char filename[MAXPATH];
+   hash_table_t *index;
+   double indexed, walked;
+   int entries = BENCH_ENTRIES;
+
+   if(argc > 1)
+    entries = atoi(argv[1]);
+
+   if(entries <= 0)
+    {
+     fprintf(stderr,"usage: %s [entries]\n",argv[0]);
+     return 2;
+    }
+
+   snprintf(filename,MAXPATH,"bench_router_db.%d.tmp",getpid());
+
+   if(!a_bench_router_db_file(filename, entries))
+    {
+     fprintf(stderr,"cannot write %s!\n",filename);
+     return 1;
+    }
+
+   G_router_db = a_load_router_db(filename);
+   remove(filename);
+
+   CHECK(G_router_db_entries == entries);
+   CHECK(G_router_db_index != NULL);
+
+   CHECK(a_router_db_search(G_router_db, "no-such-router") == NULL);
+   CHECK(a_router_db_search(G_router_db, "  Router0000000 ") != NULL);
+   CHECK(a_set_archived(G_router_db, "no-such-router", 1) == 0);
+
+   printf("router.db: %d entries\n",entries);
+
+   indexed = a_bench_lookups(entries, BENCH_LOOKUPS, NO);
+   printf("a_router_db_search, index:     %10.1f ns/lookup (%d lookups)\n",indexed,BENCH_LOOKUPS);
+
+   indexed = a_bench_lookups(entries, BENCH_LOOKUPS, YES);
+   printf("a_set_archived x2, index:      %10.1f ns/lookup (%d lookups)\n",indexed,BENCH_LOOKUPS);
+
+   /* same lookups with the index switched off - the old list walk */
+
+   index = G_router_db_index;
+   G_router_db_index = NULL;
+
+   walked = a_bench_lookups(entries, BENCH_WALK_LOOKUPS, NO);
+   printf("a_router_db_search, list walk: %10.1f ns/lookup (%d lookups)\n",walked,BENCH_WALK_LOOKUPS);
+
+   walked = a_bench_lookups(entries, BENCH_WALK_LOOKUPS, YES);
+   printf("a_set_archived x2, list walk:  %10.1f ns/lookup (%d lookups)\n",walked,BENCH_WALK_LOOKUPS);
+
+   G_router_db_index = index;
+   a_router_db_free(G_router_db);
+
+   return TEST_RESULT();
+}
+
+
+/* end of bench_router_db.c  */
@@ -0,0 +1,398 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    fake_device.c - scripted telnet device for collector tests
+*
+*    listens on a loopback port and plays an IOS-like dialogue with every client
+*    (thread per connection): telnet option negotiation, banner, login, enable,
+*    pager commands, config command with --More-- paging, exit. what the device
+*    does is set in fake_device_t - see fake_device.h.
+*
+*/
+
+#include "fake_device.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <arpa/telnet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define FAKE_LINE_LEN 256
+
+typedef struct { fake_device_t *device;
+                 int fd;
+               } fake_connection_t;
+
+
+int a_fake_send
+(int fd, const char *data, size_t len)
+{
+   ssize_t sent;
+
+   while(len > 0)
+    {
+     if( (sent = send(fd, data, len, MSG_NOSIGNAL)) <= 0 )
+      return 0;
+     data += sent;
+     len -= sent;
+    }
+
+   return 1;
+}
+
+
+int a_fake_send_str
+(int fd, const char *data)
+{
+   return a_fake_send(fd, data, strlen(data));
+}
+
+
+int a_fake_read_char
+(int fd)
+/*
+*
+* next data byte from the client - telnet commands and NULs skipped. -1 on EOF.
+*
+*/
+{
+   unsigned char c;
+
+   for(;;)
+    {
+     if(recv(fd, &c, 1, 0) != 1)
+      return -1;
+
+     if(c == IAC)
+      {
+       if(recv(fd, &c, 1, 0) != 1)
+        return -1;
+
+       if(c == IAC)
+        return c;
+
+       if((c == WILL) || (c == WONT) || (c == DO) || (c == DONT))
+        {
+         if(recv(fd, &c, 1, 0) != 1)
+          return -1;
+        }
+       else if(c == SB)
+        {
+         do
+          if(recv(fd, &c, 1, 0) != 1)
+           return -1;
+         while(c != SE);
+        }
+       continue;
+      }
+
+     if(c != 0x0)
+      return c;
+    }
+}
+
+
+int a_fake_read_line
+(int fd, char *line)
+/*
+*
+* read one line (CR dropped) into line[FAKE_LINE_LEN]. returns 0 on EOF.
+*
+*/
+{
+   int c, len = 0;
+
+   while( (c = a_fake_read_char(fd)) != -1 )
+    {
+     if(c == '\n')
+      {
+       line[len] = 0x0;
+       return 1;
+      }
+
+     if((c != '\r') && (len < FAKE_LINE_LEN - 1))
+      line[len++] = c;
+    }
+
+   return 0;
+}
+
+
+char *a_fake_device_config
+(fake_device_t *device)
+/*
+*
+* config the device sends for its config command (malloc'ed)
+*
+*/
+{
+   char *config, *p;
+   int i;
+
+   if( (config = malloc(256 + device->config_lines * 96)) == NULL )
+    return NULL;
+
+   p = config + sprintf(config,"Building configuration...\r\n\r\nCurrent configuration : 4242 bytes\r\n!\r\n"
+                               "version 12.4\r\nhostname %s\r\n!\r\n",device->hostname);
+
+   for(i = 0; i < device->config_lines; i++)
+    p += sprintf(p,"interface GigabitEthernet0/%d\r\n description port %d # uplink\r\n no shutdown\r\n!\r\n",i,i);
+
+   strcpy(p,"end\r\n\r\n");
+
+   return config;
+}
+
+
+int a_fake_send_config
+(fake_device_t *device, int fd)
+/*
+*
+* send the config in small chunks, with --More-- pages if the pager is on.
+* returns 0 if the client went away (or the device hangs).
+*
+*/
+{
+   char *config, *p, *eol;
+   int lines = 0, sent = 0, ok = 1;
+   char erase[32];
+
+   if( (config = a_fake_device_config(device)) == NULL )
+    return 0;
+
+   for(p = config; ok && *p; p = eol + 1)
+    {
+     eol = strchr(p, '\n');
+
+     if((device->pager != FAKE_PAGER_NONE) && (lines > 0) && (lines % device->page_lines == 0))
+      {
+       ok = a_fake_send_str(fd, " --More-- ") && (a_fake_read_char(fd) == ' ');
+
+       if(device->pager == FAKE_PAGER_BS)
+        strcpy(erase, "\b\b\b\b\b\b\b\b\b\b          \b\b\b\b\b\b\b\b\b\b");
+       else
+        strcpy(erase, "\r          \r");
+
+       ok = ok && a_fake_send_str(fd, erase);
+      }
+
+     if(device->hang_after && (sent >= device->hang_after))
+      {
+       /* stop talking - wait for the client to give up */
+       while(a_fake_read_char(fd) != -1);
+       ok = 0;
+       break;
+      }
+
+     ok = ok && a_fake_send(fd, p, eol + 1 - p);
+     sent += eol + 1 - p;
+     lines++;
+    }
+
+   free(config);
+   return ok;
+}
+
+
+void *a_fake_connection
+(void *arg)
+/*
+*
+* one client: the whole dialogue
+*
+*/
+{
+   fake_connection_t *connection = (fake_connection_t *)arg;
+   fake_device_t *device = connection->device;
+   int fd = connection->fd, enabled, tries;
+   unsigned char negotiation[] = { IAC, WILL, TELOPT_ECHO, IAC, WILL, TELOPT_SGA, IAC, DO, TELOPT_TTYPE };
+   char line[FAKE_LINE_LEN], password[FAKE_LINE_LEN], prompt[FAKE_LINE_LEN];
+
+   free(connection);
+
+   a_fake_send(fd, (char *)negotiation, sizeof(negotiation));
+
+   if(device->banner != NULL)
+    {
+     a_fake_send_str(fd, device->banner);
+     usleep(100000);          /* let the banner come alone */
+    }
+
+   if(device->login != NULL)
+    for(tries = 0; ; tries++)
+     {
+      if(tries == 3)
+       goto connection_done;
+
+      if(!a_fake_send_str(fd, "\r\nUser Access Verification\r\n\r\nUsername: ") || !a_fake_read_line(fd, line))
+       goto connection_done;
+      a_fake_send_str(fd, line);
+      if(!a_fake_send_str(fd, "\r\nPassword: ") || !a_fake_read_line(fd, password))
+       goto connection_done;
+
+      if(!strcmp(line, device->login) && !strcmp(password, device->password))
+       break;
+
+      a_fake_send_str(fd, "\r\n% Login invalid\r\n");
+     }
+
+   if(device->shell_prompt != NULL)
+    for(;;)
+     {
+      a_fake_send_str(fd, "\r\n");
+      a_fake_send_str(fd, device->shell_prompt);
+      if(!a_fake_read_line(fd, line))
+       goto connection_done;
+      a_fake_send_str(fd, line);
+      if(!strcmp(line, "cli"))
+       break;
+     }
+
+   /* juniper-like devices (shell first) have a '>' prompt and no enable */
+
+   enabled = (device->enable_password == NULL);
+   snprintf(prompt, sizeof(prompt), "%s%s", device->hostname, (enabled && !device->shell_prompt) ? "#" : ">");
+
+   a_fake_send_str(fd, "\r\n");
+   a_fake_send_str(fd, prompt);
+
+   while(a_fake_read_line(fd, line))
+    {
+     a_fake_send_str(fd, line);    /* echo */
+     a_fake_send_str(fd, "\r\n");
+
+     if(!strcmp(line, "exit"))
+      break;
+     else if(!strcmp(line, "enable") && !enabled)
+      {
+       a_fake_send_str(fd, "Password: ");
+       if(!a_fake_read_line(fd, password))
+        break;
+       a_fake_send_str(fd, "\r\n");
+
+       if(!strcmp(password, device->enable_password))
+        {
+         enabled = 1;
+         snprintf(prompt, sizeof(prompt), "%s#", device->hostname);
+        }
+       else
+        a_fake_send_str(fd, "% Access denied\r\n\r\n");
+      }
+     else if((!strcmp(line, "terminal length 0") || !strcmp(line, "set cli screen-length 0")) &&
+             (device->pager == FAKE_PAGER_NONE))
+      ;
+     else if(!strcmp(line, device->config_command))
+      {
+       if(!a_fake_send_config(device, fd))
+        break;
+      }
+     else if(line[0] != 0x0)
+      a_fake_send_str(fd, "                ^\r\n% Invalid input detected at '^' marker.\r\n\r\n");
+
+     a_fake_send_str(fd, prompt);
+    }
+
+ connection_done:
+   close(fd);
+   return NULL;
+}
+
+
+void *a_fake_device_listener
+(void *arg)
+{
+   fake_device_t *device = (fake_device_t *)arg;
+   fake_connection_t *connection;
+   pthread_t thread;
+   int fd;
+
+   while( (fd = accept(device->listen_fd, NULL, NULL)) != -1 )
+    {
+     if( (connection = malloc(sizeof(fake_connection_t))) == NULL )
+      {
+       close(fd);
+       continue;
+      }
+
+     connection->device = device;
+     connection->fd = fd;
+
+     if(pthread_create(&thread, NULL, a_fake_connection, connection))
+      {
+       free(connection);
+       close(fd);
+       continue;
+      }
+
+     pthread_detach(thread);
+    }
+
+   return NULL;
+}
+
+
+int a_fake_device_start
+(fake_device_t *device)
+/*
+*
+* listen on a free loopback port (device->port) and serve clients in the background.
+* returns 1 on success, 0 on error.
+*
+*/
+{
+   struct sockaddr_in addr;
+   socklen_t addr_len = sizeof(addr);
+   pthread_t thread;
+
+   if( (device->listen_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 )
+    return 0;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port = 0;
+
+   if((bind(device->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) ||
+      (listen(device->listen_fd, 256) == -1) ||
+      (getsockname(device->listen_fd, (struct sockaddr *)&addr, &addr_len) == -1))
+    {
+     close(device->listen_fd);
+     return 0;
+    }
+
+   device->port = ntohs(addr.sin_port);
+
+   if(pthread_create(&thread, NULL, a_fake_device_listener, device))
+    return 0;
+
+   pthread_detach(thread);
+   return 1;
+}
+
+
+/* end of fake_device.c  */
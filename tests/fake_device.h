@@ -0,0 +1,51 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    fake_device.h - scripted telnet device for collector tests
+*
+*/
+
+#ifndef ARCHIVIST_FAKE_DEVICE_H
+#define ARCHIVIST_FAKE_DEVICE_H
+
+#define FAKE_PAGER_NONE 0       /* "terminal length 0" works */
+#define FAKE_PAGER_BS 1         /* ignores it, pages with " --More-- ", erased with backspaces */
+#define FAKE_PAGER_CR 2         /* same, erased with CR, spaces, CR */
+
+typedef struct { const char *banner;          /* sent before the login prompt (NULL - none) */
+                 const char *login;           /* NULL - no login asked, device starts at its prompt */
+                 const char *password;
+                 const char *enable_password; /* NULL - login lands in the enabled (#) prompt */
+                 const char *hostname;        /* prompt is <hostname>> or <hostname># */
+                 const char *shell_prompt;    /* login lands in this shell first (juniper) - "cli" leaves it */
+                 const char *config_command;
+                 int config_lines;            /* interface blocks in the config */
+                 int pager;                   /* FAKE_PAGER_* */
+                 int page_lines;
+                 int hang_after;              /* stop responding after that many config bytes (0 - never) */
+                 int port;                    /* set by a_fake_device_start */
+                 int listen_fd;
+               } fake_device_t;
+
+int a_fake_device_start(fake_device_t *device);
+char *a_fake_device_config(fake_device_t *device);
+
+#endif
+
+/* end of fake_device.h  */
@@ -0,0 +1,258 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    random_regexp.c - random ConfigRegexp patterns and syslog lines for tests
+*
+*    patterns use the POSIX extended subset the ConfigRegexp matchers handle
+*    (literals, '.', bracket expressions, groups, alternation, anchors and all
+*    quantifiers) over a small alphabet, so that random lines hit them often.
+*    results of the prefilter and the DFA are compared with plain regexec.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "random_regexp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static char *a_random_append
+(char *p, const char *end, const char *s)
+{
+   while(*s && (p < end))
+    *p++ = *s++;
+   *p = 0x0;
+   return p;
+}
+
+
+static char *a_random_alt(char *p, const char *end, const char *alphabet, int depth);
+
+
+static char *a_random_atom
+(char *p, const char *end, const char *alphabet, int depth)
+/*
+*
+* literal, '.', bracket expression or group
+*
+*/
+{
+   char buf[8];
+   int n = strlen(alphabet), r = random() % 100;
+
+   if(r < 60)
+    {
+     buf[0] = alphabet[random() % n];
+     buf[1] = 0x0;
+     return a_random_append(p, end, buf);
+    }
+
+   if(r < 68)
+    return a_random_append(p, end, ".");
+
+   if(r < 80)
+    {
+     switch(random() % 3)
+      {
+       case 0:
+        snprintf(buf, sizeof(buf), "[%c%c]", alphabet[random() % n], alphabet[random() % n]);
+        break;
+       case 1:
+        snprintf(buf, sizeof(buf), "[^%c]", alphabet[random() % n]);
+        break;
+       default:
+        snprintf(buf, sizeof(buf), "[%c-%c]", alphabet[0], alphabet[n - 1]);
+      }
+     return a_random_append(p, end, buf);
+    }
+
+   if(depth > 0)
+    {
+     p = a_random_append(p, end, "(");
+     p = a_random_alt(p, end, alphabet, depth - 1);
+     return a_random_append(p, end, ")");
+    }
+
+   buf[0] = alphabet[random() % n];
+   buf[1] = 0x0;
+   return a_random_append(p, end, buf);
+}
+
+
+static char *a_random_cat
+(char *p, const char *end, const char *alphabet, int depth)
+/*
+*
+* 1-4 atoms, each with an optional quantifier. groups with anchors are not
+* repeated - the DFA leaves those to regexec (see a_regexp_parse_repeat).
+*
+*/
+{
+   const char *quantifiers[] = { "*", "+", "?", "{2}", "{1,}", "{0,2}", "{1,3}" };
+   int atoms = 1 + random() % 4;
+   char *atom;
+
+   while(atoms--)
+    {
+     atom = p;
+     p = a_random_atom(p, end, alphabet, depth);
+     if((random() % 10 < 3) && !strpbrk(atom, "^$"))
+      p = a_random_append(p, end, quantifiers[random() % 7]);
+    }
+
+   return p;
+}
+
+
+static char *a_random_alt
+(char *p, const char *end, const char *alphabet, int depth)
+{
+   int branches = (random() % 4 == 0) ? 2 + random() % 2 : 1;
+
+   while(branches--)
+    {
+     if(random() % 10 == 0)
+      p = a_random_append(p, end, "^");
+     p = a_random_cat(p, end, alphabet, depth);
+     if(random() % 10 == 0)
+      p = a_random_append(p, end, "$");
+     if(branches)
+      p = a_random_append(p, end, "|");
+    }
+
+   return p;
+}
+
+
+void a_random_regexp
+(char *regexp, const char *alphabet, int depth)
+/*
+*
+* random pattern over alphabet into regexp[RANDOM_REGEXP_LEN]. depth - group nesting.
+*
+*/
+{
+   regexp[0] = 0x0;
+   a_random_alt(regexp, regexp + RANDOM_REGEXP_LEN - 1, alphabet, depth);
+}
+
+
+void a_random_line
+(char *line, const char *alphabet, int max_len)
+/*
+*
+* random line of 0..max_len characters of alphabet (and an occasional stranger)
+*
+*/
+{
+   int len = random() % (max_len + 1), n = strlen(alphabet), i;
+
+   if(len >= RANDOM_LINE_LEN)
+    len = RANDOM_LINE_LEN - 1;
+
+   for(i = 0; i < len; i++)
+    line[i] = (random() % 20 == 0) ? 'x' : alphabet[random() % n];
+
+   line[len] = 0x0;
+}
+
+
+void a_random_line_edit
+(char *line, const char *sample, const char *alphabet)
+/*
+*
+* copy of sample with a few random characters changed, dropped or inserted
+*
+*/
+{
+   int len, edits, pos, n = strlen(alphabet);
+
+   strncpy(line, sample, RANDOM_LINE_LEN - 1);
+   line[RANDOM_LINE_LEN - 1] = 0x0;
+
+   for(edits = random() % 4; edits > 0; edits--)
+    {
+     if( (len = strlen(line)) == 0 )
+      break;
+     pos = random() % len;
+
+     switch(random() % 3)
+      {
+       case 0:
+        line[pos] = alphabet[random() % n];
+        break;
+       case 1:
+        memmove(line + pos, line + pos + 1, len - pos);
+        break;
+       default:
+        if(len < RANDOM_LINE_LEN - 1)
+         {
+          memmove(line + pos + 1, line + pos, len - pos + 1);
+          line[pos] = alphabet[random() % n];
+         }
+      }
+    }
+}
+
+
+config_regexp_t *a_random_regexp_list
+(char regexps[][RANDOM_REGEXP_LEN], int count)
+/*
+*
+* ConfigRegexp list from patterns (username token "by"), regexps[0] at the head.
+* patterns regcomp rejects are left out. returns list head.
+*
+*/
+{
+   config_regexp_t *list = NULL;
+   char entry[RANDOM_REGEXP_LEN + 8];
+   int i;
+
+   for(i = count - 1; i >= 0; i--)
+    {
+     snprintf(entry, sizeof(entry), "%s by", regexps[i]);
+     list = a_config_regexp_add(list, entry);
+    }
+
+   return list;
+}
+
+
+config_regexp_t *a_regexec_match
+(config_regexp_t *config_regexp_list, const char *line)
+/*
+*
+* first entry of the list matching line according to regexec, NULL if none
+*
+*/
+{
+   config_regexp_t *workptr;
+
+   for(workptr = config_regexp_list; workptr != NULL; workptr = workptr->prev)
+    if(regexec(&workptr->compiled_regexp, line, 0, NULL, 0) == 0)
+     return workptr;
+
+   return NULL;
+}
+
+
+/* end of random_regexp.c  */
@@ -0,0 +1,40 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    random_regexp.h - random ConfigRegexp patterns and syslog lines for tests
+*
+*/
+
+#ifndef ARCHIVIST_RANDOM_REGEXP_H
+#define ARCHIVIST_RANDOM_REGEXP_H
+
+/* needs archivist_config.h included before (config_regexp_t) */
+
+#define RANDOM_REGEXP_LEN 256
+#define RANDOM_LINE_LEN 128
+
+void a_random_regexp(char *regexp, const char *alphabet, int depth);
+void a_random_line(char *line, const char *alphabet, int max_len);
+void a_random_line_edit(char *line, const char *sample, const char *alphabet);
+config_regexp_t *a_random_regexp_list(char regexps[][RANDOM_REGEXP_LEN], int count);
+config_regexp_t *a_regexec_match(config_regexp_t *config_regexp_list, const char *line);
+
+#endif
+
+/* end of random_regexp.h  */
@@ -0,0 +1,63 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test.h - helpers shared by test and benchmark programs (make check)
+*
+*    a test program checks as much as it can, reports every failed check on
+*    stderr and exits with non-zero status if any of them failed.
+*
+*/
+
+#ifndef ARCHIVIST_TEST_H
+#define ARCHIVIST_TEST_H
+
+#include <stdio.h>
+#include <time.h>
+
+int G_test_failures = 0;
+
+#define CHECK(cond) \
+ do { \
+  if(!(cond)) \
+   { \
+    fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,__LINE__,#cond); \
+    G_test_failures++; \
+   } \
+ } while(0)
+
+#define TEST_RESULT() (G_test_failures ? 1 : 0)
+
+
+static double a_test_now
+(void)
+/*
+*
+* monotonic time in seconds - for benchmarks
+*
+*/
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
+
+/* end of test.h  */
@@ -0,0 +1,362 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_archpool.c - archiver worker pool (archpool.c)
+*
+*    the pool archives devices with a stub which only records its runs, so it
+*    can be watched: a burst of events ends with a single run after the
+*    quiet period (or after DEVICE_JOB_MAX_DELAY quiet periods at most), users
+*    from all events end up on configured_by, events coming while the device
+*    is running give exactly one more run, and locked devices are retried.
+*    bulk archiving waits for its own devices only.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_RUNS 64
+
+typedef struct { char device_id[255];
+                 char configured_by[255];
+                 double started;
+                 double finished;
+               } test_run_t;
+
+test_run_t G_test_runs[MAX_RUNS];
+int G_test_run_count = 0;
+int G_test_run_ms = 0;             /* how long a run takes */
+int G_test_locked_runs = 0;        /* runs left which find the device locked */
+pthread_mutex_t G_test_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+int a_test_archive_device
+(config_event_info_t *config_event_info)
+/*
+*
+* a_archive_device stub: record the run, take G_test_run_ms, report the device locked while
+* G_test_locked_runs lasts
+*
+*/
+{
+   test_run_t *run = NULL;
+   int run_ms, locked;
+
+   pthread_mutex_lock(&G_test_mutex);
+
+   if(G_test_run_count < MAX_RUNS)
+    {
+     run = &G_test_runs[G_test_run_count++];
+     strcpy(run->device_id, config_event_info->device_id);
+     strcpy(run->configured_by, config_event_info->configured_by);
+     run->started = a_test_now();
+     run->finished = 0;
+    }
+
+   run_ms = G_test_run_ms;
+   if( (locked = (G_test_locked_runs > 0)) )
+    G_test_locked_runs--;
+
+   pthread_mutex_unlock(&G_test_mutex);
+
+   usleep(run_ms * 1000);
+
+   pthread_mutex_lock(&G_test_mutex);
+   if(run != NULL)
+    run->finished = a_test_now();
+   pthread_mutex_unlock(&G_test_mutex);
+
+   return locked ? -1 : 1;
+}
+
+
+int a_test_event
+(char *device_id, char *configured_by, int wait, int quiet_period)
+/*
+*
+* submit config event like syslog (or bulk archiving, wait set) does.
+* returns a_archiver_submit result.
+*
+*/
+{
+   config_event_info_t *event;
+   int result;
+
+   if( (event = calloc(1, sizeof(config_event_info_t))) == NULL )
+    return 0;
+
+   strcpy(event->device_id, device_id);
+   strcpy(event->configured_by, configured_by);
+
+   if( (result = a_archiver_submit(event, wait, quiet_period)) == 0 )
+    free(event);
+
+   return result;
+}
+
+
+int a_test_runs
+(char *device_id, test_run_t *runs, int max_runs)
+/*
+*
+* copy finished runs of device_id into runs. returns number of its runs (finished or not).
+*
+*/
+{
+   int i, count = 0;
+
+   pthread_mutex_lock(&G_test_mutex);
+
+   for(i = 0; i < G_test_run_count; i++)
+    if(!strcmp(G_test_runs[i].device_id, device_id))
+     {
+      if((count < max_runs) && (G_test_runs[i].finished > 0))
+       runs[count] = G_test_runs[i];
+      count++;
+     }
+
+   pthread_mutex_unlock(&G_test_mutex);
+
+   return count;
+}
+
+
+void a_test_settle
+(void)
+/*
+*
+* wait until nothing is queued or delayed and the last run has finished
+*
+*/
+{
+   int i, running;
+
+   for(i = 0; i < 1500; i++)
+    {
+     pthread_mutex_lock(&G_test_mutex);
+     running = (G_test_run_count > 0) && (G_test_runs[G_test_run_count - 1].finished == 0);
+     pthread_mutex_unlock(&G_test_mutex);
+
+     if(!running && (a_archiver_queue_depth() == 0))
+      break;
+
+     usleep(10000);
+    }
+
+   usleep(200000);        /* the worker puts a rerun back only after the stub returns */
+}
+
+
+void a_test_burst
+(void)
+/*
+*
+* burst of events - one run with all users, not earlier than quiet_period
+* after the last event (due times are whole seconds - up to a second later)
+*
+*/
+{
+   char *users[] = { "alice", "bob", "alice", "carol", "bob" };
+   test_run_t runs[2];
+   double last = 0;
+   int i;
+
+   G_test_run_ms = 0;
+
+   for(i = 0; i < 5; i++)
+    {
+     CHECK(a_test_event("burst", users[i], NO, 2) == ((i == 0) ? 1 : 2));
+     last = a_test_now();
+     CHECK(a_test_runs("burst", runs, 2) == 0);
+     usleep(300000);
+    }
+
+   CHECK(a_archiver_queue_depth() == 1);
+
+   sleep(3);
+   a_test_settle();
+
+   CHECK(a_test_runs("burst", runs, 2) == 1);
+   CHECK(!strcmp(runs[0].configured_by, "alice, bob, carol"));
+   CHECK(runs[0].started - last > 1.99);
+   CHECK(runs[0].started - last < 3.5);
+}
+
+
+void a_test_max_delay
+(void)
+/*
+*
+* events never stop - the device is archived anyway, DEVICE_JOB_MAX_DELAY
+* quiet periods after the first event
+*
+*/
+{
+   test_run_t runs[4];
+   double first, elapsed;
+
+   G_test_run_ms = 0;
+
+   first = a_test_now();
+
+   while((a_test_runs("busy", runs, 4) == 0) && (a_test_now() - first < 3 * DEVICE_JOB_MAX_DELAY))
+    {
+     a_test_event("busy", "alice", NO, 1);
+     usleep(300000);
+    }
+
+   a_test_settle();
+
+   CHECK(a_test_runs("busy", runs, 4) >= 1);
+   elapsed = runs[0].started - first;
+   CHECK((elapsed > DEVICE_JOB_MAX_DELAY - 0.01) && (elapsed < DEVICE_JOB_MAX_DELAY + 1.5));
+}
+
+
+void a_test_rerun
+(void)
+/*
+*
+* events coming while the device is running - exactly one more run, with the
+* users of these events only, started after the first run is over
+*
+*/
+{
+   test_run_t runs[3];
+   int i;
+
+   G_test_run_ms = 1000;
+
+   CHECK(a_test_event("rerun", "alice", NO, 0) == 1);
+
+   for(i = 0; (i < 200) && (a_test_runs("rerun", runs, 3) == 0); i++)
+    usleep(10000);
+
+   CHECK(a_test_event("rerun", "bob", NO, 0) == 2);
+   CHECK(a_test_event("rerun", "carol", NO, 0) == 2);
+   CHECK(a_test_event("rerun", "bob", NO, 0) == 2);
+
+   usleep(1500000);
+   a_test_settle();
+
+   CHECK(a_test_runs("rerun", runs, 3) == 2);
+   CHECK(!strcmp(runs[0].configured_by, "alice"));
+   CHECK(!strcmp(runs[1].configured_by, "bob, carol"));
+   CHECK(runs[1].started >= runs[0].finished);
+}
+
+
+void a_test_locked
+(void)
+/*
+*
+* device locked by someone else - the pool tries again (about once a second)
+* and keeps the events, together with those coming in meanwhile
+*
+*/
+{
+   test_run_t runs[4];
+
+   G_test_run_ms = 0;
+   G_test_locked_runs = 2;
+
+   CHECK(a_test_event("locked", "alice", NO, 0) == 1);
+   usleep(200000);
+   CHECK(a_test_event("locked", "bob", NO, 0) == 2);
+
+   sleep(3);
+   a_test_settle();
+
+   CHECK(a_test_runs("locked", runs, 4) == 3);
+   CHECK(!strcmp(runs[0].configured_by, "alice"));
+   CHECK(!strcmp(runs[2].configured_by, "alice, bob"));
+   CHECK(G_test_locked_runs == 0);
+}
+
+
+void a_test_bulk
+(void)
+/*
+*
+* a_archiver_pool_wait_bulk returns when the devices of the bulk run are done -
+* also one merged into a job in its quiet period (archived at once then) and
+* one running already (archived once more) - not waiting for other devices
+*
+*/
+{
+   test_run_t runs[3];
+   double start;
+   int i;
+
+   G_test_run_ms = 500;
+
+   CHECK(a_test_event("syslog", "alice", NO, 30) == 1);
+   CHECK(a_test_event("both", "alice", NO, 30) == 1);
+   CHECK(a_test_event("running", "alice", NO, 0) == 1);
+
+   for(i = 0; (i < 200) && (a_test_runs("running", runs, 3) == 0); i++)
+    usleep(10000);
+
+   start = a_test_now();
+
+   CHECK(a_test_event("bulk1", "scheduled_archiving", YES, 0) == 1);
+   CHECK(a_test_event("bulk2", "scheduled_archiving", YES, 0) == 1);
+   CHECK(a_test_event("both", "scheduled_archiving", YES, 0) == 2);
+   CHECK(a_test_event("running", "scheduled_archiving", YES, 0) == 2);
+
+   a_archiver_pool_wait_bulk();
+
+   CHECK(a_test_now() - start < 5);
+   CHECK(G_archiver_pool->bulk_jobs == 0);
+
+   CHECK((a_test_runs("bulk1", runs, 3) == 1) && (a_test_runs("bulk2", runs, 3) == 1));
+   CHECK(a_test_runs("both", runs, 3) == 1);
+   CHECK(!strcmp(runs[0].configured_by, "alice, scheduled_archiving"));
+   CHECK(a_test_runs("running", runs, 3) == 2);
+   CHECK(!strcmp(runs[1].configured_by, "scheduled_archiving"));
+   CHECK(a_test_runs("syslog", runs, 3) == 0);
+   CHECK(a_archiver_queue_depth() == 1);
+}
+
+
+int main
+(int argc, char **argv)
+{
+   G_logfile_handle = stderr;
+
+   CHECK(a_archiver_pool_start(4, 16) == 4);
+   G_archiver_pool->archive = a_test_archive_device;
+
+   a_test_burst();
+   a_test_max_delay();
+   a_test_rerun();
+   a_test_locked();
+   a_test_bulk();
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_archpool.c  */
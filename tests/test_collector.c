@@ -0,0 +1,174 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_collector.c - native collector end to end, telnet to a fake device
+*
+*    every case starts a scripted device (fake_device.c) on a loopback port and
+*    downloads its config with a_get_using_native: login and enable, prompt
+*    detection behind a banner of '#' lines, --More-- paging erased with
+*    backspaces or CR, a juniper-like shell, failed login and enable, a device
+*    which stops responding (CollectorTimeout), and many sessions at once.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+#include "fake_device.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CONCURRENT_SESSIONS 64
+
+auth_set_t G_test_auth_sets[2] = { { "set01", "admin", "secret", "enpass", NULL },
+                                   { "set02", "admin", "wrong", "enpass", NULL } };
+
+
+int a_test_collect
+(const char *name, fake_device_t *device, char *device_type, char *auth_set, int expected)
+/*
+*
+* download config of the fake device. with expected == 1 the config must be the
+* one the device sent. returns 1 if the result was as expected.
+*
+*/
+{
+   config_buffer_t config;
+   char set_name[16];
+   char *device_config;
+   int result, ok;
+
+   G_config_info.telnet_port = device->port;
+
+   a_config_buffer_init(&config);
+   strcpy(set_name, auth_set);             /* a_auth_set_search lowercases it in place */
+
+   result = a_get_using_native("127.0.0.1", device_type, set_name, "telnet", &config);
+
+   ok = (result == expected);
+
+   if(ok && (expected == 1))
+    {
+     device_config = a_fake_device_config(device);
+     ok = (config.len == strlen(device_config)) && !memcmp(config.data, device_config, config.len);
+
+     if(!ok)
+      fprintf(stderr,"case %s: config differs - got %zu bytes:\n%s\n",name,config.len,
+              config.data ? config.data : "");
+     free(device_config);
+    }
+   else if(!ok)
+    fprintf(stderr,"case %s: a_get_using_native returned %d, expected %d\n",name,result,expected);
+
+   if(!ok)
+    G_test_failures++;
+
+   a_config_buffer_free(&config);
+
+   return ok;
+}
+
+
+void *a_test_concurrent_session
+(void *arg)
+{
+   a_test_collect("concurrent", (fake_device_t *)arg, "cisco", "set01", 1);
+   return NULL;
+}
+
+
+int main
+(int argc, char **argv)
+{
+   fake_device_t cisco = { "##########\r\n# banner #\r\n##########\r\n", "admin", "secret", "enpass", "router",
+                           NULL, "write term", 200, FAKE_PAGER_NONE, 0, 0 };
+   fake_device_t paged = { NULL, "admin", "secret", "enpass", "switch", NULL, "write term", 60, FAKE_PAGER_BS, 23, 0 };
+   fake_device_t paged_cr = { NULL, NULL, NULL, NULL, "nexus", NULL, "show running-config", 60, FAKE_PAGER_CR, 17, 0 };
+   fake_device_t juniper = { NULL, "admin", "secret", NULL, "admin@mx1", "admin@mx1:~ % ", "show configuration",
+                             20, FAKE_PAGER_NONE, 0, 0 };
+   fake_device_t hanging = { NULL, "admin", "secret", "enpass", "router", NULL, "write term", 200, FAKE_PAGER_NONE, 0, 3000 };
+   pthread_t threads[CONCURRENT_SESSIONS];
+   char set01[] = "set01";
+   double start;
+   int i;
+
+   G_logfile_handle = stderr;
+   G_auth_set_list = &G_test_auth_sets[1];
+   G_test_auth_sets[1].prev = &G_test_auth_sets[0];
+
+   G_config_info.collector_timeout = 2;
+   G_config_info.helper_timeout = 30;
+   strcpy(G_config_info.script_dir, "/nonexistent");   /* no post-processing scripts */
+
+   if(!a_fake_device_start(&cisco) || !a_fake_device_start(&paged) || !a_fake_device_start(&paged_cr) ||
+      !a_fake_device_start(&juniper) || !a_fake_device_start(&hanging))
+    {
+     fprintf(stderr,"cannot start fake devices!\n");
+     return 1;
+    }
+
+   /* no collector threads yet - caller falls back to expect */
+
+   CHECK(a_get_using_native("127.0.0.1", "cisco", set01, "telnet", NULL) == 0);
+
+   CHECK(a_collector_start(2) == 2);
+
+   /* platforms and methods without a native dialogue */
+
+   CHECK(a_get_using_native("127.0.0.1", "cat5", set01, "telnet", NULL) == 0);
+   CHECK(a_get_using_native("127.0.0.1", "cisco", set01, "ssh1", NULL) == 0);
+
+   a_test_collect("login and enable", &cisco, "cisco", "set01", 1);
+   a_test_collect("--More-- erased with backspaces", &paged, "cisco", "set01", 1);
+   a_test_collect("--More-- erased with CR, no login", &paged_cr, "nxos", "set01", 1);
+   a_test_collect("juniper shell", &juniper, "juniper", "set01", 1);
+
+   a_test_collect("wrong password", &cisco, "cisco", "set02", -1);
+
+   G_test_auth_sets[0].password2 = "wrong";
+   a_test_collect("wrong enable password", &cisco, "cisco", "set01", -1);
+   G_test_auth_sets[0].password2 = "enpass";
+
+   /* device stops in the middle of the config - session ends after CollectorTimeout */
+
+   start = a_test_now();
+   a_test_collect("timeout", &hanging, "cisco", "set01", -1);
+   CHECK(a_test_now() - start >= G_config_info.collector_timeout - 1);
+   CHECK(a_test_now() - start < G_config_info.collector_timeout + 3);
+
+   /* nothing listening */
+
+   G_config_info.telnet_port = 1;
+   CHECK(a_get_using_native("127.0.0.1", "cisco", set01, "telnet", NULL) == -1);
+
+   /* many sessions on two collector threads */
+
+   for(i = 0; i < CONCURRENT_SESSIONS; i++)
+    CHECK(pthread_create(&threads[i], NULL, a_test_concurrent_session, &paged) == 0);
+
+   for(i = 0; i < CONCURRENT_SESSIONS; i++)
+    pthread_join(threads[i], NULL);
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_collector.c  */
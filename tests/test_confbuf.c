@@ -0,0 +1,233 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_confbuf.c - in-memory config buffers (confbuf.c)
+*
+*    appends of random sizes compared with a plain copy, save/load round trips
+*    (empty, binary, bigger than the initial buffer), load from a FIFO whose size
+*    says nothing about its content, and the error cases.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define APPEND_TOTAL (1024 * 1024)
+#define FIFO_TOTAL (300 * 1000)       /* whole 1000 byte chunks */
+
+char G_test_dir[] = "/tmp/test_confbuf.XXXXXX";
+char G_test_fifo[MAXPATH];
+
+
+void a_test_append
+(void)
+{
+   config_buffer_t config;
+   char *expected, chunk[4096];
+   size_t len = 0, n;
+   int i;
+
+   a_config_buffer_init(&config);
+   CHECK((config.data == NULL) && (config.len == 0) && (config.size == 0));
+
+   CHECK(a_config_buffer_append(&config, "", 0) == 1);
+   CHECK((config.data != NULL) && (config.len == 0) && (config.data[0] == 0x0));
+   CHECK(config.size == CONFIG_BUFFER_INITIAL);
+
+   CHECK( (expected = malloc(APPEND_TOTAL + sizeof(chunk))) != NULL );
+
+   srandom(4242);
+
+   while(len < APPEND_TOTAL)
+    {
+     n = random() % sizeof(chunk);
+     for(i = 0; i < n; i++)
+      chunk[i] = random() % 256;
+
+     memcpy(expected + len, chunk, n);
+     len += n;
+
+     CHECK(a_config_buffer_append(&config, chunk, n) == 1);
+     CHECK(config.size > config.len);
+    }
+
+   CHECK(config.len == len);
+   CHECK(!memcmp(config.data, expected, len));
+   CHECK(config.data[len] == 0x0);
+
+   a_config_buffer_free(&config);
+   CHECK((config.data == NULL) && (config.len == 0) && (config.size == 0));
+
+   free(expected);
+}
+
+
+void a_test_save_load
+(const char *name, size_t len)
+/*
+*
+* save len bytes (with NULs), load them back - the file must be gone after load
+*
+*/
+{
+   config_buffer_t config, loaded;
+   char filename[MAXPATH];
+   struct stat file_stat;
+   size_t i;
+   int ok;
+
+   snprintf(filename, sizeof(filename), "%s/%s", G_test_dir, name);
+
+   a_config_buffer_init(&config);
+   a_config_buffer_init(&loaded);
+
+   for(i = 0; i < len; i++)
+    CHECK(a_config_buffer_append(&config, (i % 77) ? "x" : "\0", 1) == 1);
+
+   CHECK(a_config_buffer_save(&config, filename) == 1);
+   CHECK((stat(filename, &file_stat) == 0) && (file_stat.st_size == len));
+
+   CHECK(a_config_buffer_append(&loaded, "old content", 11) == 1);   /* replaced by load */
+   CHECK(a_config_buffer_load(&loaded, filename) == 1);
+
+   ok = (loaded.len == len) && (loaded.data[len] == 0x0) && ((len == 0) || !memcmp(loaded.data, config.data, len));
+   if(!ok)
+    {
+     fprintf(stderr,"save/load %s: %zu bytes saved, %zu loaded\n",name,len,loaded.len);
+     G_test_failures++;
+    }
+
+   CHECK(access(filename, F_OK) == -1);
+
+   a_config_buffer_free(&config);
+   a_config_buffer_free(&loaded);
+}
+
+
+void *a_test_fifo_writer
+(void *arg)
+{
+   char chunk[1000];
+   size_t written;
+   int fd;
+
+   memset(chunk, 'f', sizeof(chunk));
+
+   if( (fd = open(G_test_fifo, O_WRONLY)) == -1 )
+    return NULL;
+
+   for(written = 0; written < FIFO_TOTAL; written += sizeof(chunk))
+    if(write(fd, chunk, sizeof(chunk)) != sizeof(chunk))
+     break;
+
+   close(fd);
+   return NULL;
+}
+
+
+void a_test_fifo
+(void)
+/*
+*
+* helper output read from a pipe - st_size is 0, content is not
+*
+*/
+{
+   config_buffer_t config;
+   pthread_t writer;
+   size_t i;
+   int same = 1;
+
+   snprintf(G_test_fifo, sizeof(G_test_fifo), "%s/fifo", G_test_dir);
+   CHECK(mkfifo(G_test_fifo, 0600) == 0);
+
+   CHECK(pthread_create(&writer, NULL, a_test_fifo_writer, NULL) == 0);
+
+   a_config_buffer_init(&config);
+   CHECK(a_config_buffer_load(&config, G_test_fifo) == 1);
+
+   pthread_join(writer, NULL);
+
+   CHECK(config.len == FIFO_TOTAL);
+   for(i = 0; i < config.len; i++)
+    same = same && (config.data[i] == 'f');
+   CHECK(same);
+   CHECK((config.len < config.size) && (config.data[config.len] == 0x0));
+
+   a_config_buffer_free(&config);
+}
+
+
+void a_test_errors
+(void)
+{
+   config_buffer_t config;
+   char filename[MAXPATH];
+
+   a_config_buffer_init(&config);
+   CHECK(a_config_buffer_append(&config, "keep", 4) == 1);
+
+   snprintf(filename, sizeof(filename), "%s/missing", G_test_dir);
+   CHECK(a_config_buffer_load(&config, filename) == 0);
+   CHECK((config.len == 4) && !strcmp(config.data, "keep"));
+
+   CHECK(a_config_buffer_load(&config, G_test_dir) == 0);        /* directory - read fails */
+
+   snprintf(filename, sizeof(filename), "%s/missing/file", G_test_dir);
+   CHECK(a_config_buffer_save(&config, filename) == 0);
+
+   a_config_buffer_free(&config);
+}
+
+
+int main
+(int argc, char **argv)
+{
+   if(mkdtemp(G_test_dir) == NULL)
+    {
+     fprintf(stderr,"cannot create %s!\n",G_test_dir);
+     return 1;
+    }
+
+   a_test_append();
+
+   a_test_save_load("empty", 0);
+   a_test_save_load("small", 100);
+   a_test_save_load("initial", CONFIG_BUFFER_INITIAL);
+   a_test_save_load("big", 5 * CONFIG_BUFFER_INITIAL + 1);
+
+   a_test_fifo();
+   a_test_errors();
+
+   unlink(G_test_fifo);
+   rmdir(G_test_dir);
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_confbuf.c  */
@@ -0,0 +1,346 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_dfa.c - union DFA for ConfigRegexp entries (dfa.c) against regexec
+*
+*    a_config_dfa_match must report the same ConfigRegexp entry the regexec loop
+*    in a_config_regexp_match finds first. checked on hand written patterns,
+*    random single patterns and random pattern sets with random lines, from many
+*    threads on one DFA, and with a pattern set that fills the state cache (lines
+*    then go to regexec). unsupported syntax must leave the DFA unbuilt.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+#include "random_regexp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RANDOM_SINGLE_ROUNDS 5000
+#define RANDOM_SET_ROUNDS 1000
+#define RANDOM_LINES 100
+#define THREADS 8
+#define THREAD_LINES 20000
+
+char G_test_patterns[][RANDOM_REGEXP_LEN] = {
+ "SYS-5-CONFIG_I", "startup-config[[:space:]]was", "UI_DBASE_LOGOUT_EVENT", "^<[0-9]+>.*CONFIG_I",
+ "a{2,3}b", "^$", "^a?$", "(^|x)ab", "ab$|^ba", "[]a]+c", "[^[:alpha:]]{2}", "\\w+@\\W", "\\s\\S",
+ "a\\.b", "[a-c-]x", "(ab|a)(c|bcd)(d*)", "((a*)*|b)c", "x(a|b|)y", "[[:digit:][:upper:]]z", "." };
+
+char G_test_subjects[][RANDOM_LINE_LEN] = {
+ "", "a", "ab", "aab", "aaab", "aaaab", "ba", "xab", "cab", "ab ", "]]c", "a]c", "-x", "dx", "12",
+ "a1", "foo@ bar", "foo@bar", "a b", " ", "a.b", "axb", "abcd", "abcdd", "acd", "c", "bc", "xy", "xay",
+ "xaby", "Zz", "9z", "z", "<189>12: %SYS-5-CONFIG_I: Configured from console by admin",
+ "<189>: %SYS-5-CONFIG_I", "startup-config\twas changed", "startup-configwas", "UI_DBASE_LOGOUT_EVEN" };
+
+config_dfa_t *G_test_dfa;
+config_regexp_t *G_test_list;
+char (*G_test_lines)[RANDOM_LINE_LEN];
+config_regexp_t **G_test_expected;
+
+
+int a_test_same
+(config_dfa_t *dfa, config_regexp_t *list, const char *line)
+/*
+*
+* 1 if the DFA result for line agrees with regexec (or the DFA gave up, -2)
+*
+*/
+{
+   config_regexp_t *expected;
+   int r;
+
+   expected = a_regexec_match(list, line);
+   r = a_config_dfa_match(dfa, line);
+
+   if(r == -2)
+    return 1;
+
+   if(r == -1)
+    return expected == NULL;
+
+   return (r >= 0) && (r < dfa->npatterns) && (dfa->patterns[r] == expected);
+}
+
+
+config_dfa_t *a_test_build
+(const char *regexp, config_regexp_t **list)
+{
+   char regexps[1][RANDOM_REGEXP_LEN];
+
+   snprintf(regexps[0], RANDOM_REGEXP_LEN, "%s", regexp);
+   *list = a_random_regexp_list(regexps, 1);
+
+   return a_config_dfa_build(*list);
+}
+
+
+void a_test_unsupported
+(void)
+/*
+*
+* syntax the DFA cannot match exactly - not built, regexec does the job
+*
+*/
+{
+   config_regexp_t *list;
+
+   CHECK(a_config_dfa_build(NULL) == NULL);
+
+   CHECK(a_test_build("(a)\\1", &list) == NULL);
+   CHECK(a_test_build("\\bfoo", &list) == NULL);
+   CHECK(a_test_build("^*a", &list) == NULL);
+   CHECK(a_test_build("(^b)+c", &list) == NULL);
+   CHECK(a_test_build("(a|b$){2}", &list) == NULL);
+   CHECK(a_test_build("a{300}", &list) == NULL);
+   CHECK(a_test_build("[[:foo:]]", &list) == NULL);
+
+   CHECK(a_test_build("a{255}", &list) != NULL);
+}
+
+
+void a_test_fixed_patterns
+(void)
+/*
+*
+* every hand written pattern against every subject, alone and all together
+*
+*/
+{
+   config_regexp_t *list;
+   config_dfa_t *dfa;
+   int npatterns = sizeof(G_test_patterns) / RANDOM_REGEXP_LEN;
+   int nsubjects = sizeof(G_test_subjects) / RANDOM_LINE_LEN;
+   int i, j;
+
+   for(i = 0; i < npatterns; i++)
+    {
+     if( (dfa = a_test_build(G_test_patterns[i], &list)) == NULL )
+      {
+       fprintf(stderr,"DFA not built for '%s'\n",G_test_patterns[i]);
+       G_test_failures++;
+       continue;
+      }
+
+     for(j = 0; j < nsubjects; j++)
+      if(!a_test_same(dfa, list, G_test_subjects[j]))
+       {
+        fprintf(stderr,"'%s' on '%s': DFA %d, regexec %s\n",G_test_patterns[i],G_test_subjects[j],
+                a_config_dfa_match(dfa, G_test_subjects[j]),a_regexec_match(list, G_test_subjects[j]) ? "match" : "no match");
+        G_test_failures++;
+       }
+    }
+
+   list = a_random_regexp_list(G_test_patterns, npatterns);
+   CHECK( (dfa = a_config_dfa_build(list)) != NULL );
+   if(dfa == NULL)
+    return;
+   CHECK(dfa->npatterns == npatterns);
+
+   for(j = 0; j < nsubjects; j++)
+    CHECK(a_test_same(dfa, list, G_test_subjects[j]));
+}
+
+
+void a_test_random_patterns
+(void)
+/*
+*
+* random single patterns, then random sets of 2-6 patterns
+*
+*/
+{
+   char regexps[6][RANDOM_REGEXP_LEN], line[RANDOM_LINE_LEN];
+   config_regexp_t *list;
+   config_dfa_t *dfa;
+   int round, i, count, unbuilt = 0, wrong = 0, matched = 0, lines = 0;
+
+   for(round = 0; round < RANDOM_SINGLE_ROUNDS + RANDOM_SET_ROUNDS; round++)
+    {
+     count = (round < RANDOM_SINGLE_ROUNDS) ? 1 : 2 + random() % 5;
+
+     for(i = 0; i < count; i++)
+      a_random_regexp(regexps[i], "abc", 2);
+
+     if( (list = a_random_regexp_list(regexps, count)) == NULL )
+      continue;
+
+     if( (dfa = a_config_dfa_build(list)) == NULL )
+      {
+       if(unbuilt++ < 5)
+        fprintf(stderr,"DFA not built for '%s'\n",regexps[0]);
+       continue;
+      }
+
+     for(i = 0; i < RANDOM_LINES; i++, lines++)
+      {
+       a_random_line(line, "abc", 16);
+
+       if(a_regexec_match(list, line) != NULL)
+        matched++;
+
+       if(!a_test_same(dfa, list, line))
+        {
+         if(wrong++ < 5)
+          fprintf(stderr,"'%s'%s on '%s': DFA %d, regexec %s\n",regexps[0],count > 1 ? " (+more)" : "",
+                  line,a_config_dfa_match(dfa, line),a_regexec_match(list, line) ? "match" : "no match");
+        }
+      }
+    }
+
+   printf("random patterns: %d lines, %d matched\n",lines,matched);
+
+   CHECK(unbuilt == 0);
+   CHECK(wrong == 0);
+   CHECK((matched > lines / 10) && (matched < lines - lines / 10));
+}
+
+
+void *a_test_thread
+(void *arg)
+{
+   long wrong = 0;
+   int i, r;
+
+   for(i = 0; i < THREAD_LINES; i++)
+    {
+     r = a_config_dfa_match(G_test_dfa, G_test_lines[i]);
+
+     if(r == -2)
+      continue;
+
+     if((r == -1) ? (G_test_expected[i] != NULL) : (G_test_dfa->patterns[r] != G_test_expected[i]))
+      wrong++;
+    }
+
+   return (void *)wrong;
+}
+
+
+void a_test_threads
+(void)
+/*
+*
+* fresh DFA, all states built while THREADS threads match at the same time
+*
+*/
+{
+   char regexps[5][RANDOM_REGEXP_LEN] = { "a.{6}b", "(ab|cd){3}d$", "c[^a]{4}c", "^d+c", "b{3,5}a" };
+   pthread_t threads[THREADS];
+   void *wrong;
+   long total_wrong = 0;
+   int i;
+
+   G_test_list = a_random_regexp_list(regexps, 5);
+   G_test_lines = malloc(THREAD_LINES * RANDOM_LINE_LEN);
+   G_test_expected = malloc(THREAD_LINES * sizeof(config_regexp_t *));
+
+   CHECK((G_test_lines != NULL) && (G_test_expected != NULL));
+   CHECK( (G_test_dfa = a_config_dfa_build(G_test_list)) != NULL );
+   if(G_test_dfa == NULL)
+    return;
+
+   for(i = 0; i < THREAD_LINES; i++)
+    {
+     a_random_line(G_test_lines[i], "abcd", 40);
+     G_test_expected[i] = a_regexec_match(G_test_list, G_test_lines[i]);
+    }
+
+   for(i = 0; i < THREADS; i++)
+    CHECK(pthread_create(&threads[i], NULL, a_test_thread, NULL) == 0);
+
+   for(i = 0; i < THREADS; i++)
+    {
+     pthread_join(threads[i], &wrong);
+     total_wrong += (long)wrong;
+    }
+
+   printf("%d threads: %d DFA states built\n",THREADS,G_test_dfa->nstates);
+
+   CHECK(total_wrong == 0);
+   CHECK(G_test_dfa->nstates > 100);
+}
+
+
+void a_test_state_cache_full
+(void)
+/*
+*
+* (a|b)*a(a|b){12} needs 2^13 DFA states - more than MAX_DFA_STATES. the DFA
+* gives up on some lines (-2), a_config_regexp_match still has to be right.
+*
+*/
+{
+   char regexps[2][RANDOM_REGEXP_LEN] = { "(a|b)*a(a|b){12}", "^b+$" };
+   char line[RANDOM_LINE_LEN];
+   config_regexp_t *expected;
+   char *token;
+   int i, r, gave_up = 0, wrong = 0;
+
+   G_config_regexp_list = a_random_regexp_list(regexps, 2);
+   G_config_prefilter = NULL;
+   CHECK( (G_config_dfa = a_config_dfa_build(G_config_regexp_list)) != NULL );
+   if(G_config_dfa == NULL)
+    return;
+
+   for(i = 0; i < 20000; i++)
+    {
+     a_random_line(line, "ab", 40);
+
+     expected = a_regexec_match(G_config_regexp_list, line);
+
+     if( (r = a_config_dfa_match(G_config_dfa, line)) == -2 )
+      gave_up++;
+     else if((r == -1) ? (expected != NULL) : (G_config_dfa->patterns[r] != expected))
+      wrong++;
+
+     token = a_config_regexp_match(line);
+     if(token != (expected ? expected->username_field_token : NULL))
+      wrong++;
+    }
+
+   CHECK(G_config_dfa->nstates == MAX_DFA_STATES);
+   CHECK(gave_up > 0);
+   CHECK(wrong == 0);
+
+   G_config_dfa = NULL;
+   G_config_regexp_list = NULL;
+}
+
+
+int main
+(int argc, char **argv)
+{
+   srandom(4242);
+
+   a_test_unsupported();
+   a_test_fixed_patterns();
+   a_test_random_patterns();
+   a_test_threads();
+   a_test_state_cache_full();
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_dfa.c  */
@@ -0,0 +1,354 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_diff.c - a_config_diff: decision, line counts and unified diff text
+*
+*    fixed cases are compared with the exact diff text. random configs with random
+*    edits are checked by applying the diff to the old config (must give the new one)
+*    and by comparing the edit count with the longest common subsequence.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RANDOM_ROUNDS 500
+#define RANDOM_MAX_LINES 60
+
+
+void a_test_diff_case
+(const char *name, const char *old_config, const char *new_config, int result, int added, int removed,
+ const char *text)
+/*
+*
+* diff old_config -> new_config and check everything a_config_diff returns
+*
+*/
+{
+   config_diff_t diff;
+   int r;
+
+   r = a_config_diff(old_config, strlen(old_config), new_config, strlen(new_config), "old", "new", &diff);
+
+   if((r != result) || (diff.added != added) || (diff.removed != removed) ||
+      ((text == NULL) != (diff.text == NULL)) || ((text != NULL) && strcmp(text, diff.text)) ||
+      ((diff.text != NULL) && (diff.text_len != strlen(diff.text))))
+    {
+     fprintf(stderr,"case %s: got %d, +%d -%d:\n%s\n",name,r,diff.added,diff.removed,
+             diff.text ? diff.text : "(no text)");
+     G_test_failures++;
+    }
+
+   a_config_diff_free(&diff);
+}
+
+
+void a_test_fixed_cases
+(void)
+{
+   config_diff_t diff;
+
+   a_test_diff_case("same", "a\nb\n", "a\nb\n", 0, 0, 0, NULL);
+
+   a_test_diff_case("both empty", "", "", 0, 0, 0, NULL);
+
+   a_test_diff_case("from empty", "", "a\nb\n", 1, 2, 0,
+                    "--- old\n+++ new\n@@ -0,0 +1,2 @@\n+a\n+b\n");
+
+   a_test_diff_case("to empty", "a\nb\n", "", 1, 0, 2,
+                    "--- old\n+++ new\n@@ -1,2 +0,0 @@\n-a\n-b\n");
+
+   a_test_diff_case("add only", "1\n2\n3\n4\n5\n6\n7\n8\n", "1\n2\n3\n4\nx\ny\n5\n6\n7\n8\n", 1, 2, 0,
+                    "--- old\n+++ new\n@@ -2,6 +2,8 @@\n 2\n 3\n 4\n+x\n+y\n 5\n 6\n 7\n");
+
+   a_test_diff_case("remove only", "1\n2\n3\n4\nx\ny\n5\n6\n7\n8\n", "1\n2\n3\n4\n5\n6\n7\n8\n", 1, 0, 2,
+                    "--- old\n+++ new\n@@ -2,8 +2,6 @@\n 2\n 3\n 4\n-x\n-y\n 5\n 6\n 7\n");
+
+   a_test_diff_case("change at start", "a\n1\n2\n3\n4\n", "b\n1\n2\n3\n4\n", 1, 1, 1,
+                    "--- old\n+++ new\n@@ -1,4 +1,4 @@\n-a\n+b\n 1\n 2\n 3\n");
+
+   a_test_diff_case("change at end", "1\n2\n3\n4\na\n", "1\n2\n3\n4\nb\n", 1, 1, 1,
+                    "--- old\n+++ new\n@@ -2,4 +2,4 @@\n 2\n 3\n 4\n-a\n+b\n");
+
+   /* last line without newline */
+
+   a_test_diff_case("newline removed", "a\nb\n", "a\nb", 1, 1, 1,
+                    "--- old\n+++ new\n@@ -1,2 +1,2 @@\n a\n-b\n+b\n\\ No newline at end of file\n");
+
+   a_test_diff_case("newline added", "a\nb", "a\nb\n", 1, 1, 1,
+                    "--- old\n+++ new\n@@ -1,2 +1,2 @@\n a\n-b\n\\ No newline at end of file\n+b\n");
+
+   a_test_diff_case("no newline, line added", "a", "a\nb", 1, 2, 1,
+                    "--- old\n+++ new\n@@ -1,1 +1,2 @@\n-a\n\\ No newline at end of file\n+a\n"
+                    "+b\n\\ No newline at end of file\n");
+
+   /* changes 2 * DIFF_CONTEXT_LINES lines apart share one hunk, one more line splits them */
+
+   a_test_diff_case("hunks merged", "a\n1\n2\n3\n4\n5\n6\nb\n", "A\n1\n2\n3\n4\n5\n6\nB\n", 1, 2, 2,
+                    "--- old\n+++ new\n@@ -1,8 +1,8 @@\n-a\n+A\n 1\n 2\n 3\n 4\n 5\n 6\n-b\n+B\n");
+
+   a_test_diff_case("hunks split", "a\n1\n2\n3\n4\n5\n6\n7\nb\n", "A\n1\n2\n3\n4\n5\n6\n7\nB\n", 1, 2, 2,
+                    "--- old\n+++ new\n@@ -1,4 +1,4 @@\n-a\n+A\n 1\n 2\n 3\n@@ -6,4 +6,4 @@\n 5\n 6\n 7\n-b\n+B\n");
+
+   /* moved block - lines existing in both configs, found by the middle snake */
+
+   a_test_diff_case("moved line", "a\nb\nc\nd\n", "b\nc\nd\na\n", 1, 1, 1,
+                    "--- old\n+++ new\n@@ -1,4 +1,4 @@\n-a\n b\n c\n d\n+a\n");
+
+   /* repeated lines */
+
+   a_test_diff_case("repeated lines", "!\n!\n!\n", "!\n!\n", 1, 0, 1,
+                    "--- old\n+++ new\n@@ -1,3 +1,2 @@\n !\n !\n-!\n");
+
+   /* without labels only the counts are returned */
+
+   CHECK(a_config_diff("a\n", 2, "b\n", 2, NULL, NULL, &diff) == 1);
+   CHECK((diff.text == NULL) && (diff.added == 1) && (diff.removed == 1));
+   a_config_diff_free(&diff);
+}
+
+
+int a_test_apply
+(const char *old_config, const char *diff_text, char *result, size_t result_size)
+/*
+*
+* apply unified diff to old_config. returns length of the result, -1 if the diff
+* doesn't fit old_config.
+*
+*/
+{
+   const char *old = old_config, *p = diff_text, *eol;
+   size_t len = 0, line_len, old_len;
+   int old_line = 1, hunk_old, hunk_old_count, no_newline;
+
+   /* skip --- and +++ */
+
+   p = strchr(p, '\n') + 1;
+   p = strchr(p, '\n') + 1;
+
+   while(*p)
+    {
+     hunk_old_count = 1;
+
+     if(sscanf(p, "@@ -%d,%d", &hunk_old, &hunk_old_count) < 1)
+      return -1;
+
+     if(hunk_old_count == 0)         /* nothing removed - lines go after line hunk_old */
+      hunk_old++;
+
+     /* copy unchanged lines up to the hunk */
+
+     for(; old_line < hunk_old; old_line++)
+      {
+       if( (eol = strchr(old, '\n')) == NULL )
+        return -1;
+       line_len = eol + 1 - old;
+       if(len + line_len >= result_size)
+        return -1;
+       memcpy(result + len, old, line_len);
+       len += line_len;
+       old = eol + 1;
+      }
+
+     for(p = strchr(p, '\n') + 1; *p && (*p != '@'); p = eol + 1)
+      {
+       eol = strchr(p, '\n');
+       line_len = eol - p;                  /* without prefix, with newline */
+       no_newline = (eol[1] == '\\');      /* next line says there is no newline */
+
+       if(*p == '\\')
+        continue;
+
+       if((*p == ' ') || (*p == '-'))        /* must be there in the old config */
+        {
+         old_len = strchr(old, '\n') ? (size_t)(strchr(old, '\n') + 1 - old) : strlen(old);
+
+         if((old_len != line_len - no_newline) || memcmp(old, p + 1, old_len))
+          return -1;
+
+         old += old_len;
+         old_line++;
+        }
+
+       if((*p == ' ') || (*p == '+'))
+        {
+         if(len + line_len >= result_size)
+          return -1;
+         memcpy(result + len, p + 1, line_len - no_newline);
+         len += line_len - no_newline;
+        }
+      }
+    }
+
+   /* rest of the old config */
+
+   line_len = strlen(old);
+   if(len + line_len >= result_size)
+    return -1;
+   memcpy(result + len, old, line_len);
+   len += line_len;
+   result[len] = 0x0;
+
+   return len;
+}
+
+
+int a_test_lcs
+(char **old_lines, int old_count, char **new_lines, int new_count)
+/*
+*
+* length of the longest common subsequence of two line arrays (dynamic programming)
+*
+*/
+{
+   int *row, *prev, i, j, lcs;
+
+   row = calloc(new_count + 1, sizeof(int));
+   prev = calloc(new_count + 1, sizeof(int));
+
+   for(i = 1; i <= old_count; i++)
+    {
+     for(j = 1; j <= new_count; j++)
+      if(!strcmp(old_lines[i - 1], new_lines[j - 1]))
+       row[j] = prev[j - 1] + 1;
+      else
+       row[j] = (prev[j] > row[j - 1]) ? prev[j] : row[j - 1];
+
+     memcpy(prev, row, (new_count + 1) * sizeof(int));
+    }
+
+   lcs = prev[new_count];
+   free(row);
+   free(prev);
+
+   return lcs;
+}
+
+
+int a_test_random_config
+(char **lines, int max_lines, unsigned int *seed, char *config)
+/*
+*
+* random config from a small alphabet of lines (lots of repeated lines), last line
+* sometimes without newline. returns number of lines.
+*
+*/
+{
+   static char *alphabet[] = { "!\n", " no shutdown\n", "interface A\n", "interface B\n", " mtu 9000\n",
+                               "end\n", " description x\n", "hostname r1\n" };
+   int count, i;
+
+   *seed = *seed * 1103515245 + 12345;
+   count = (*seed >> 16) % max_lines;
+
+   config[0] = 0x0;
+
+   for(i = 0; i < count; i++)
+    {
+     *seed = *seed * 1103515245 + 12345;
+     lines[i] = alphabet[(*seed >> 16) % (sizeof(alphabet) / sizeof(char *))];
+     strcat(config, lines[i]);
+    }
+
+   *seed = *seed * 1103515245 + 12345;
+
+   if(count && ((*seed >> 16) % 4 == 0))
+    config[strlen(config) - 1] = 0x0;     /* last line without newline */
+
+   return count;
+}
+
+
+void a_test_random_cases
+(void)
+{
+   char *old_lines[RANDOM_MAX_LINES], *new_lines[RANDOM_MAX_LINES];
+   char old_config[RANDOM_MAX_LINES * 32], new_config[RANDOM_MAX_LINES * 32], applied[RANDOM_MAX_LINES * 64];
+   char old_last[32], new_last[32];
+   unsigned int seed = 4242;
+   config_diff_t diff;
+   int old_count, new_count, round, r, lcs;
+
+   for(round = 0; round < RANDOM_ROUNDS; round++)
+    {
+     old_count = a_test_random_config(old_lines, RANDOM_MAX_LINES, &seed, old_config);
+     new_count = a_test_random_config(new_lines, RANDOM_MAX_LINES, &seed, new_config);
+
+     r = a_config_diff(old_config, strlen(old_config), new_config, strlen(new_config), "old", "new", &diff);
+
+     if(r == 0)
+      {
+       CHECK(!strcmp(old_config, new_config));
+       continue;
+      }
+
+     CHECK(r == 1);
+
+     /* diff applied to the old config gives the new one */
+
+     if((a_test_apply(old_config, diff.text, applied, sizeof(applied)) == -1) || strcmp(applied, new_config))
+      {
+       fprintf(stderr,"round %d: diff doesn't turn old config into the new one:\n%s\n",round,diff.text);
+       G_test_failures++;
+      }
+
+     /* minimal edit script - compare lines as they are in the config (last one may lack newline) */
+
+     if(old_count && (old_config[strlen(old_config) - 1] != '\n'))
+      {
+       snprintf(old_last, sizeof(old_last), "%.*s", (int)strlen(old_lines[old_count - 1]) - 1, old_lines[old_count - 1]);
+       old_lines[old_count - 1] = old_last;
+      }
+
+     if(new_count && (new_config[strlen(new_config) - 1] != '\n'))
+      {
+       snprintf(new_last, sizeof(new_last), "%.*s", (int)strlen(new_lines[new_count - 1]) - 1, new_lines[new_count - 1]);
+       new_lines[new_count - 1] = new_last;
+      }
+
+     lcs = a_test_lcs(old_lines, old_count, new_lines, new_count);
+
+     if((diff.removed != old_count - lcs) || (diff.added != new_count - lcs))
+      {
+       fprintf(stderr,"round %d: +%d -%d, minimal is +%d -%d\n",round,diff.added,diff.removed,
+               new_count - lcs,old_count - lcs);
+       G_test_failures++;
+      }
+
+     a_config_diff_free(&diff);
+    }
+}
+
+
+int main
+(int argc, char **argv)
+{
+   a_test_fixed_cases();
+   a_test_random_cases();
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_diff.c  */
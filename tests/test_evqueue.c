@@ -0,0 +1,261 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_evqueue.c - lock-free config event queue (evqueue.c)
+*
+*    single thread: capacity rounding, full and empty queue, FIFO order across
+*    many wraps of the ring, eventfd wakeup. then producer and consumer threads
+*    hammer a small ring: every element must come out exactly once, and the
+*    elements of one producer in the order they were pushed.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <poll.h>
+
+#define PRODUCERS 4
+#define CONSUMERS 3
+#define ITEMS_PER_PRODUCER 200000
+#define THREADED_CAPACITY 64
+
+#define ITEM(producer, seq) ((void *)(((long)(producer) << 32) | ((seq) + 1)))
+#define ITEM_PRODUCER(item) ((int)((long)(item) >> 32))
+#define ITEM_SEQ(item) ((((long)(item)) & 0xffffffffL) - 1)
+
+evqueue_t *G_test_queue;
+unsigned char *G_test_seen[PRODUCERS];
+int G_test_producers_done = 0;
+
+
+void a_test_single_thread
+(void)
+{
+   evqueue_t *queue;
+   long i, round, pushed, next_pop = 0, next_push = 0;
+   int ok = 1;
+
+   CHECK( (queue = a_evqueue_create(5)) != NULL );
+   CHECK(queue->mask == 7);
+
+   CHECK(a_evqueue_pop(queue) == NULL);
+
+   for(i = 0; i < 8; i++)
+    CHECK(a_evqueue_push(queue, (void *)(i + 1)) == 1);
+
+   CHECK(a_evqueue_push(queue, (void *)100) == 0);      /* full */
+
+   for(i = 0; i < 8; i++)
+    CHECK(a_evqueue_pop(queue) == (void *)(i + 1));
+
+   CHECK(a_evqueue_pop(queue) == NULL);
+
+   /* uneven push/pop runs - ring wraps many times, order kept */
+
+   for(round = 0; round < 1000; round++)
+    {
+     for(pushed = 0; pushed < round % 9; pushed++)
+      if(a_evqueue_push(queue, (void *)(next_push + 1)))
+       next_push++;
+
+     for(i = 0; i < (round * 7) % 9; i++)
+      if(next_pop < next_push)
+       ok = ok && (a_evqueue_pop(queue) == (void *)(next_pop++ + 1));
+      else
+       ok = ok && (a_evqueue_pop(queue) == NULL);
+    }
+
+   CHECK(ok);
+   CHECK(next_push > 1000);
+
+   free(queue->cells);
+   free(queue);
+}
+
+
+void a_test_notify
+(void)
+/*
+*
+* notify makes notify_fd readable, clear_notify resets it
+*
+*/
+{
+   evqueue_t *queue;
+   struct pollfd pfd;
+
+   CHECK( (queue = a_evqueue_create(16)) != NULL );
+
+   if(queue->notify_fd == -1)
+    {
+     fprintf(stderr,"no eventfd - notify not tested\n");
+     return;
+    }
+
+   pfd.fd = queue->notify_fd;
+   pfd.events = POLLIN;
+
+   CHECK(poll(&pfd, 1, 0) == 0);
+
+   a_evqueue_notify(queue);
+   a_evqueue_notify(queue);
+   CHECK((poll(&pfd, 1, 0) == 1) && (pfd.revents & POLLIN));
+
+   a_evqueue_clear_notify(queue);
+   CHECK(poll(&pfd, 1, 0) == 0);
+
+   a_evqueue_clear_notify(queue);                 /* nothing signalled - must not block */
+
+   close(queue->notify_fd);
+   free(queue->cells);
+   free(queue);
+}
+
+
+void *a_test_producer
+(void *arg)
+{
+   long producer = (long)arg, seq;
+
+   for(seq = 0; seq < ITEMS_PER_PRODUCER; seq++)
+    while(!a_evqueue_push(G_test_queue, ITEM(producer, seq)))
+     sched_yield();                               /* full - consumers are behind */
+
+   return NULL;
+}
+
+
+void *a_test_consumer
+(void *arg)
+/*
+*
+* pop until producers are done and the queue is empty. returns the number of
+* elements seen out of producer order (or twice).
+*
+*/
+{
+   long last[PRODUCERS], errors = 0, seq;
+   int producer, done;
+   void *item;
+
+   for(producer = 0; producer < PRODUCERS; producer++)
+    last[producer] = -1;
+
+   for(;;)
+    {
+     done = __atomic_load_n(&G_test_producers_done, __ATOMIC_ACQUIRE);
+
+     if( (item = a_evqueue_pop(G_test_queue)) == NULL )
+      {
+       if(done)
+        break;
+       sched_yield();
+       continue;
+      }
+
+     producer = ITEM_PRODUCER(item);
+     seq = ITEM_SEQ(item);
+
+     if((producer < 0) || (producer >= PRODUCERS) || (seq < 0) || (seq >= ITEMS_PER_PRODUCER))
+      {
+       errors++;
+       continue;
+      }
+
+     if(seq <= last[producer])
+      errors++;
+     last[producer] = seq;
+
+     if(__atomic_fetch_add(&G_test_seen[producer][seq], 1, __ATOMIC_RELAXED) != 0)
+      errors++;
+    }
+
+   return (void *)errors;
+}
+
+
+void a_test_threads
+(void)
+{
+   pthread_t producers[PRODUCERS], consumers[CONSUMERS];
+   void *errors;
+   long total_errors = 0, missing = 0, i;
+   int p;
+   double start;
+
+   CHECK( (G_test_queue = a_evqueue_create(THREADED_CAPACITY)) != NULL );
+
+   for(p = 0; p < PRODUCERS; p++)
+    CHECK( (G_test_seen[p] = calloc(ITEMS_PER_PRODUCER, 1)) != NULL );
+
+   start = a_test_now();
+
+   for(p = 0; p < CONSUMERS; p++)
+    CHECK(pthread_create(&consumers[p], NULL, a_test_consumer, NULL) == 0);
+
+   for(p = 0; p < PRODUCERS; p++)
+    CHECK(pthread_create(&producers[p], NULL, a_test_producer, (void *)(long)p) == 0);
+
+   for(p = 0; p < PRODUCERS; p++)
+    pthread_join(producers[p], NULL);
+
+   __atomic_store_n(&G_test_producers_done, 1, __ATOMIC_RELEASE);
+
+   for(p = 0; p < CONSUMERS; p++)
+    {
+     pthread_join(consumers[p], &errors);
+     total_errors += (long)errors;
+    }
+
+   for(p = 0; p < PRODUCERS; p++)
+    for(i = 0; i < ITEMS_PER_PRODUCER; i++)
+     if(G_test_seen[p][i] != 1)
+      missing++;
+
+   printf("%d producers, %d consumers: %d elements in %.2f s\n",PRODUCERS,CONSUMERS,
+          PRODUCERS * ITEMS_PER_PRODUCER,a_test_now() - start);
+
+   CHECK(total_errors == 0);
+   CHECK(missing == 0);
+   CHECK(a_evqueue_pop(G_test_queue) == NULL);
+
+   for(p = 0; p < PRODUCERS; p++)
+    free(G_test_seen[p]);
+}
+
+
+int main
+(int argc, char **argv)
+{
+   a_test_single_thread();
+   a_test_notify();
+   a_test_threads();
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_evqueue.c  */
@@ -0,0 +1,222 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_hash.c - string keyed hash table (hash.c)
+*
+*    put/get/replace/remove, case-insensitive tables, growth, and random
+*    operations checked against a plain array of keys.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GROWTH_KEYS 20000
+#define RANDOM_KEYS 512
+#define RANDOM_OPS 200000
+
+int G_test_freed = 0;
+
+
+void a_test_free_data
+(void *data)
+{
+   G_test_freed++;
+}
+
+
+void a_test_basic
+(void)
+{
+   hash_table_t *table;
+   int a = 1, b = 2, c = 3;
+
+   CHECK(a_hash_get(NULL, "x") == NULL);
+
+   CHECK( (table = a_hash_create(0, NO)) != NULL );
+   CHECK(table->size == HASH_MIN_SIZE);
+
+   CHECK(a_hash_get(table, "router1") == NULL);
+   CHECK(a_hash_get(table, NULL) == NULL);
+
+   CHECK(a_hash_put(table, "router1", &a) == 1);
+   CHECK(a_hash_put(table, "router2", &b) == 1);
+   CHECK(a_hash_put(table, "", &c) == 1);
+   CHECK(table->count == 3);
+
+   CHECK(a_hash_get(table, "router1") == &a);
+   CHECK(a_hash_get(table, "router2") == &b);
+   CHECK(a_hash_get(table, "") == &c);
+   CHECK(a_hash_get(table, "ROUTER1") == NULL);
+   CHECK(a_hash_get(table, "router") == NULL);
+
+   /* same key replaces the data, count stays */
+
+   CHECK(a_hash_put(table, "router1", &c) == 1);
+   CHECK(a_hash_get(table, "router1") == &c);
+   CHECK(table->count == 3);
+
+   CHECK(a_hash_remove(table, "router1") == &c);
+   CHECK(a_hash_get(table, "router1") == NULL);
+   CHECK(a_hash_remove(table, "router1") == NULL);
+   CHECK(a_hash_get(table, "router2") == &b);
+   CHECK(table->count == 2);
+
+   G_test_freed = 0;
+   a_hash_free(table, a_test_free_data);
+   CHECK(G_test_freed == 2);
+
+   a_hash_free(NULL, NULL);
+}
+
+
+void a_test_nocase
+(void)
+{
+   hash_table_t *table;
+   int a = 1, b = 2;
+
+   CHECK( (table = a_hash_create(16, YES)) != NULL );
+
+   CHECK(a_hash_put(table, "Core-Router.Example.COM", &a) == 1);
+   CHECK(a_hash_get(table, "core-router.example.com") == &a);
+   CHECK(a_hash_get(table, "CORE-ROUTER.EXAMPLE.COM") == &a);
+
+   CHECK(a_hash_put(table, "CORE-router.example.com", &b) == 1);
+   CHECK(table->count == 1);
+   CHECK(a_hash_get(table, "Core-Router.Example.COM") == &b);
+
+   CHECK(a_hash_remove(table, "core-ROUTER.example.com") == &b);
+   CHECK(table->count == 0);
+
+   a_hash_free(table, NULL);
+}
+
+
+void a_test_growth
+(void)
+/*
+*
+* many more keys than buckets - table grows, every key still found
+*
+*/
+{
+   hash_table_t *table;
+   char key[32];
+   long i;
+   int found = 0;
+
+   CHECK( (table = a_hash_create(HASH_MIN_SIZE, NO)) != NULL );
+
+   for(i = 0; i < GROWTH_KEYS; i++)
+    {
+     snprintf(key, sizeof(key), "10.%ld.%ld.%ld", i >> 16, (i >> 8) & 0xff, i & 0xff);
+     CHECK(a_hash_put(table, key, (void *)(i + 1)) == 1);
+    }
+
+   CHECK(table->count == GROWTH_KEYS);
+   CHECK(table->size >= GROWTH_KEYS);
+
+   for(i = 0; i < GROWTH_KEYS; i++)
+    {
+     snprintf(key, sizeof(key), "10.%ld.%ld.%ld", i >> 16, (i >> 8) & 0xff, i & 0xff);
+     if(a_hash_get(table, key) == (void *)(i + 1))
+      found++;
+    }
+
+   CHECK(found == GROWTH_KEYS);
+
+   G_test_freed = 0;
+   a_hash_free(table, a_test_free_data);
+   CHECK(G_test_freed == GROWTH_KEYS);
+}
+
+
+void a_test_random
+(void)
+/*
+*
+* random put/remove/get on a small key space, compared with an array
+*
+*/
+{
+   hash_table_t *table;
+   void *expected[RANDOM_KEYS];
+   char key[32];
+   int i, k, count = 0, wrong = 0;
+   void *data;
+
+   srandom(4242);
+   memset(expected, 0, sizeof(expected));
+
+   CHECK( (table = a_hash_create(0, NO)) != NULL );
+
+   for(i = 0; i < RANDOM_OPS; i++)
+    {
+     k = random() % RANDOM_KEYS;
+     snprintf(key, sizeof(key), "device-%d", k);
+
+     switch(random() % 3)
+      {
+       case 0:
+        data = (void *)(long)(i + 1);
+        CHECK(a_hash_put(table, key, data) == 1);
+        if(expected[k] == NULL)
+         count++;
+        expected[k] = data;
+        break;
+       case 1:
+        if(a_hash_remove(table, key) != expected[k])
+         wrong++;
+        if(expected[k] != NULL)
+         count--;
+        expected[k] = NULL;
+        break;
+       case 2:
+        if(a_hash_get(table, key) != expected[k])
+         wrong++;
+        break;
+      }
+    }
+
+   CHECK(wrong == 0);
+   CHECK(table->count == count);
+
+   a_hash_free(table, NULL);
+}
+
+
+int main
+(int argc, char **argv)
+{
+   a_test_basic();
+   a_test_nocase();
+   a_test_growth();
+   a_test_random();
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_hash.c  */
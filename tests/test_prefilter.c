@@ -0,0 +1,229 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_prefilter.c - ConfigRegexp literal prefilter (prefilter.c) against regexec
+*
+*    the prefilter may only drop lines no ConfigRegexp matches: for every line
+*    regexec matches, a_literal_prefilter_scan has to say 1. checked on the
+*    ConfigRegexp entries from archivist.conf.dist with edited syslog lines, and
+*    on random patterns with random lines. it must also drop most other lines.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+#include "random_regexp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SYSLOG_EDITS 100000
+#define RANDOM_ROUNDS 2000
+#define RANDOM_LINES 200
+
+char G_test_config_regexps[][RANDOM_REGEXP_LEN] = { "SYS-5-CONFIG_I",
+                                                    "startup-config[[:space:]]was",
+                                                    "UI_DBASE_LOGOUT_EVENT",
+                                                    "VSHD-5-VSHD_SYSLOG_CONFIG_I" };
+
+const char *G_test_syslog_lines[] = {
+ "<189>42: *Mar  1 00:12:31.123: %SYS-5-CONFIG_I: Configured from console by admin on vty0 (10.0.0.1)",
+ "<189>43: *Mar  1 00:12:40.001: %SYS-5-RESTART: System restarted --",
+ "<190>12: Mar  1 00:13:01: %LINK-3-UPDOWN: Interface GigabitEthernet0/1, changed state to up",
+ "<189>Mar  1 00:14:00: %SYS-5-CONFIG: startup-config was changed by admin",
+ "<30>Mar  1 00:15:00 mx1 mgd[1234]: UI_DBASE_LOGOUT_EVENT: User 'admin' exiting configuration mode",
+ "<30>Mar  1 00:15:00 mx1 mgd[1234]: UI_COMMIT: User 'admin' requested 'commit' operation",
+ "<189>2024 Mar  1 00:16:00 nexus %VSHD-5-VSHD_SYSLOG_CONFIG_I: Configured from vty by admin on 10.0.0.1",
+ "" };
+
+
+int a_test_build
+(const char *regexp)
+/*
+*
+* 1 if the prefilter gets built for the single pattern
+*
+*/
+{
+   char regexps[1][RANDOM_REGEXP_LEN];
+
+   snprintf(regexps[0], RANDOM_REGEXP_LEN, "%s", regexp);
+   return a_literal_prefilter_build(a_random_regexp_list(regexps, 1)) != NULL;
+}
+
+
+void a_test_fixed_cases
+(void)
+{
+   literal_prefilter_t *prefilter;
+   char regexps[2][RANDOM_REGEXP_LEN] = { "SYS-5-CONFIG_I", "SYS-6-.*by" };
+
+   CHECK(a_literal_prefilter_build(NULL) == NULL);
+
+   /* patterns without a required literal - every line has to go to regexec */
+
+   CHECK(!a_test_build("CONFIG|RESTART"));
+   CHECK(!a_test_build(".*"));
+   CHECK(!a_test_build("[[:alpha:]]+"));
+   CHECK(!a_test_build("(CONFIG)?"));
+
+   CHECK(a_test_build("^<[0-9]+>.*CONFIG_I"));
+   CHECK(a_test_build("(a|b)CONFIG(c|d)"));
+
+   /* all literals start with 'S' - scanned with strchr */
+
+   CHECK( (prefilter = a_literal_prefilter_build(a_random_regexp_list(regexps, 2))) != NULL );
+   CHECK(prefilter->single_first_byte == 'S');
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[0]) == 1);
+   CHECK(a_literal_prefilter_scan(prefilter, "SSSSYS-6-X") == 1);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[1]) == 0);
+   CHECK(a_literal_prefilter_scan(prefilter, "SYS-5-CONFIG") == 0);
+   CHECK(a_literal_prefilter_scan(prefilter, "") == 0);
+
+   /* archivist.conf.dist set */
+
+   CHECK( (prefilter = a_literal_prefilter_build(a_random_regexp_list(G_test_config_regexps, 4))) != NULL );
+   CHECK(prefilter->single_first_byte == -1);
+   CHECK(prefilter->nliterals == 4);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[0]) == 1);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[1]) == 0);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[2]) == 0);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[3]) == 1);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[4]) == 1);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[5]) == 0);
+   CHECK(a_literal_prefilter_scan(prefilter, G_test_syslog_lines[6]) == 1);
+}
+
+
+void a_test_syslog_edits
+(void)
+/*
+*
+* archivist.conf.dist patterns, sample lines with random edits
+*
+*/
+{
+   config_regexp_t *list;
+   literal_prefilter_t *prefilter;
+   char line[RANDOM_LINE_LEN];
+   int i, nsamples, matched = 0, dropped = 0, missed = 0;
+
+   list = a_random_regexp_list(G_test_config_regexps, 4);
+   CHECK( (prefilter = a_literal_prefilter_build(list)) != NULL );
+   if(prefilter == NULL)
+    return;
+
+   for(nsamples = 0; G_test_syslog_lines[nsamples][0]; nsamples++);
+
+   for(i = 0; i < SYSLOG_EDITS; i++)
+    {
+     a_random_line_edit(line, G_test_syslog_lines[random() % nsamples], "SYS-5_CONFIGt a\t\n");
+
+     if(a_regexec_match(list, line) != NULL)
+      {
+       matched++;
+       if(!a_literal_prefilter_scan(prefilter, line))
+        {
+         if(missed++ < 5)
+          fprintf(stderr,"prefilter dropped matching line: %s\n",line);
+        }
+      }
+     else if(!a_literal_prefilter_scan(prefilter, line))
+      dropped++;
+    }
+
+   printf("syslog lines: %d matched, %d of %d others dropped by the prefilter\n",matched,dropped,
+          SYSLOG_EDITS - matched);
+
+   CHECK(missed == 0);
+   CHECK(matched > SYSLOG_EDITS / 10);
+   CHECK(dropped > (SYSLOG_EDITS - matched) / 2);
+}
+
+
+void a_test_random_patterns
+(void)
+/*
+*
+* random patterns over a small alphabet, random lines
+*
+*/
+{
+   char regexps[4][RANDOM_REGEXP_LEN], line[RANDOM_LINE_LEN];
+   config_regexp_t *list;
+   literal_prefilter_t *prefilter;
+   int round, i, count, built = 0, matched = 0, dropped = 0, missed = 0;
+
+   for(round = 0; round < RANDOM_ROUNDS; round++)
+    {
+     count = 1 + random() % 4;
+     for(i = 0; i < count; i++)
+      a_random_regexp(regexps[i], "abcd", 2);
+
+     list = a_random_regexp_list(regexps, count);
+
+     if( (prefilter = a_literal_prefilter_build(list)) == NULL )
+      continue;
+     built++;
+
+     for(i = 0; i < RANDOM_LINES; i++)
+      {
+       a_random_line(line, "abcd", 24);
+
+       if(a_regexec_match(list, line) != NULL)
+        {
+         matched++;
+         if(!a_literal_prefilter_scan(prefilter, line))
+          {
+           if(missed++ < 5)
+            fprintf(stderr,"prefilter dropped matching line '%s' (patterns: %s %s %s %s)\n",line,
+                    regexps[0],count > 1 ? regexps[1] : "",count > 2 ? regexps[2] : "",
+                    count > 3 ? regexps[3] : "");
+          }
+        }
+       else if(!a_literal_prefilter_scan(prefilter, line))
+        dropped++;
+      }
+    }
+
+   printf("random patterns: %d of %d prefilters built, %d lines matched, %d dropped\n",built,RANDOM_ROUNDS,
+          matched,dropped);
+
+   CHECK(missed == 0);
+   CHECK(built > RANDOM_ROUNDS / 10);
+   CHECK((matched > 0) && (dropped > 0));
+}
+
+
+int main
+(int argc, char **argv)
+{
+   srandom(4242);
+
+   a_test_fixed_cases();
+   a_test_syslog_edits();
+   a_test_random_patterns();
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_prefilter.c  */
@@ -0,0 +1,181 @@
+/*
+*
+*    This file is part of Archivist - network device config archiver.
+*
+*    Archivist is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    Archivist is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with Archivist.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    Author: Wojtek Mitus (woytekm@gmail.com)
+*
+*    test_spawn.c - running helper programs (spawn.c)
+*
+*    exit codes, argv passed without a shell, stdout and stderr captured (only
+*    the tail if there is more), helpers killed by a signal or by the timeout -
+*    with their whole process group - and helpers which cannot be started.
+*
+*/
+
+#include "../config.h"
+#include "defs.h"
+#include "archivist_config.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+
+
+int a_test_spawn
+(int timeout, char *output, size_t output_len, char *arg0, char *arg1, char *arg2, char *arg3)
+{
+   char *argv[] = { arg0, arg1, arg2, arg3, NULL };
+
+   return a_spawn(argv, timeout, output, output_len);
+}
+
+
+int a_test_process_gone
+(pid_t pid)
+/*
+*
+* 1 if the process is dead - reaped, or a zombie nobody reaped yet
+*
+*/
+{
+   char filename[64], stat[256], *state;
+   FILE *stat_file;
+
+   if((kill(pid, 0) == -1) && (errno == ESRCH))
+    return 1;
+
+   snprintf(filename, sizeof(filename), "/proc/%d/stat", (int)pid);
+
+   if( (stat_file = fopen(filename, "r")) == NULL )
+    return 0;
+
+   state = NULL;
+   if(fgets(stat, sizeof(stat), stat_file) != NULL)
+    state = strrchr(stat, ')');
+   fclose(stat_file);
+
+   return (state != NULL) && (state[1] == ' ') && (state[2] == 'Z');
+}
+
+
+void a_test_exit_and_output
+(void)
+{
+   char output[SPAWN_OUTPUT_LEN], tail[16];
+
+   CHECK(a_test_spawn(0, NULL, 0, "true", NULL, NULL, NULL) == 0);
+   CHECK(a_test_spawn(0, output, sizeof(output), "sh", "-c", "exit 3", NULL) == 3);
+   CHECK(output[0] == 0x0);
+
+   /* argv goes to the helper as it is - no shell expansion */
+
+   CHECK(a_test_spawn(0, output, sizeof(output), "printf", "%s|%s", "a b", "$(x);*") == 0);
+   CHECK(!strcmp(output, "a b|$(x);*"));
+
+   CHECK(a_test_spawn(0, output, sizeof(output), "sh", "-c", "echo out; echo err >&2; exit 1", NULL) == 1);
+   CHECK(!strcmp(output, "out\nerr\n"));
+
+   /* more output than room - last bytes kept */
+
+   CHECK(a_test_spawn(0, tail, sizeof(tail), "sh", "-c", "i=0; while [ $i -lt 5000 ]; do i=$((i+1)); echo $i; done",
+                      NULL) == 0);
+   CHECK(!strcmp(tail, "4998\n4999\n5000\n"));
+
+   /* stdin is /dev/null */
+
+   CHECK(a_test_spawn(5, output, sizeof(output), "sh", "-c", "cat; echo done", NULL) == 0);
+   CHECK(!strcmp(output, "done\n"));
+}
+
+
+void a_test_signals
+(void)
+/*
+*
+* helpers get default signal handling even if the caller blocks or ignores signals
+*
+*/
+{
+   sigset_t block, old;
+
+   sigemptyset(&block);
+   sigaddset(&block, SIGTERM);
+   pthread_sigmask(SIG_BLOCK, &block, &old);
+   signal(SIGPIPE, SIG_IGN);
+
+   CHECK(a_test_spawn(0, NULL, 0, "sh", "-c", "kill -TERM $$; sleep 5", NULL) == 128 + SIGTERM);
+   CHECK(a_test_spawn(0, NULL, 0, "sh", "-c", "kill -PIPE $$; sleep 5", NULL) == 128 + SIGPIPE);
+
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+   signal(SIGPIPE, SIG_DFL);
+}
+
+
+void a_test_timeout
+(void)
+/*
+*
+* helper and a process it started in the background - both killed after timeout
+*
+*/
+{
+   char output[SPAWN_OUTPUT_LEN];
+   double start, elapsed;
+   pid_t background;
+   int i;
+
+   start = a_test_now();
+   CHECK(a_test_spawn(1, output, sizeof(output), "sh", "-c", "sleep 30 & echo $!; wait", NULL) == SPAWN_TIMEOUT);
+   elapsed = a_test_now() - start;
+
+   CHECK((elapsed >= 0.95) && (elapsed < 3));
+
+   CHECK( (background = atoi(output)) > 0 );
+
+   for(i = 0; (i < 100) && (background > 0) && !a_test_process_gone(background); i++)
+    usleep(10000);
+
+   CHECK((background > 0) && a_test_process_gone(background));
+
+   /* helper done in time */
+
+   CHECK(a_test_spawn(10, output, sizeof(output), "sh", "-c", "sleep 0.2; echo ok", NULL) == 0);
+   CHECK(!strcmp(output, "ok\n"));
+}
+
+
+int main
+(int argc, char **argv)
+{
+   char output[SPAWN_OUTPUT_LEN];
+
+   G_logfile_handle = stderr;
+
+   a_test_exit_and_output();
+   a_test_signals();
+   a_test_timeout();
+
+   CHECK(a_test_spawn(0, output, sizeof(output), "/nonexistent/helper", NULL, NULL, NULL) == -1);
+   CHECK(a_test_spawn(0, output, sizeof(output), "no-such-helper-in-path", NULL, NULL, NULL) == -1);
+
+   return TEST_RESULT();
+}
+
+
+/* end of test_spawn.c  */